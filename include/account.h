@@ -14,6 +14,7 @@
 typedef struct mycertfp_ mycertfp_t;
 typedef struct myuser_name_ myuser_name_t;
 typedef struct chanacs_ chanacs_t;
+typedef struct chanacs_hostmatch_ chanacs_hostmatch_t;
 typedef struct kline_ kline_t;
 typedef struct xline_ xline_t;
 typedef struct qline_ qline_t;
@@ -24,6 +25,8 @@ typedef struct svsignore_ svsignore_t;
 struct kline_ {
   char *user;
   char *host;
+  match_pattern_t *userpat;	/* user and host, compiled */
+  match_pattern_t *hostpat;
   char *reason;
   char *setby;
 
@@ -31,6 +34,8 @@ struct kline_ {
   long duration;
   time_t settime;
   time_t expires;
+
+  mowgli_node_t node;	/* in klnlist */
 };
 
 /* xline list struct */
@@ -43,6 +48,9 @@ struct xline_ {
   long duration;
   time_t settime;
   time_t expires;
+
+  mowgli_node_t node;	/* in xlnlist */
+  pattern_set_entry_t *pattern;
 };
 
 /* qline list struct */
@@ -55,6 +63,8 @@ struct qline_ {
   long duration;
   time_t settime;
   time_t expires;
+  mowgli_node_t node;	/* in qlnlist */
+  pattern_set_entry_t *pattern;	/* nick masks only */
 };
 
 /* services ignore struct */
@@ -62,6 +72,7 @@ struct svsignore_ {
   svsignore_t *svsignore;
 
   char *mask;
+  match_pattern_t *pattern;	/* mask, compiled */
   time_t settime;
   char *setby;
   char *reason;
@@ -158,6 +169,18 @@ struct mychan_
 
   channel_t *chan;
   mowgli_list_t chanacs;
+
+  /* entries whose entity has its own chanacs validator (groups, exttargets) */
+  mowgli_list_t chanacs_dynamic;
+
+  /* index of the other entries, only kept for long access lists */
+  mowgli_patricia_t *chanacs_by_entity;	/* entity id -> chanacs */
+  mowgli_patricia_t *chanacs_by_host;	/* host mask -> chanacs */
+  unsigned int chanacs_dups;		/* entries shadowed by an indexed one */
+  chanacs_hostmatch_t *chanacs_hostmatch;	/* compiled host masks, see hostmatch.c */
+  unsigned int chanacs_gen;		/* changes whenever the list changes */
+  unsigned int chanacs_volatile;	/* entries matched by match_user() */
+
   time_t registered;
   time_t used;
 
@@ -199,11 +222,13 @@ struct chanacs_
 	myentity_t *entity;
 	mychan_t *mychan;
 	char     *host;
+	match_pattern_t *hostpat;	/* host, compiled */
 	unsigned int  level;
 	time_t    tmodified;
 
 	mowgli_node_t    cnode;
 	mowgli_node_t    unode;
+	mowgli_node_t    dnode;
 
 	char *setter;
 };
@@ -393,6 +418,8 @@ E void myuser_delete(myuser_t *mu);
 //inline myuser_t *myuser_find(const char *name);
 E void myuser_rename(myuser_t *mu, const char *name);
 E void myuser_set_email(myuser_t *mu, const char *newemail);
+E void myuser_journal(myuser_t *mu);
+E void mymemo_journal(myuser_t *mu, mymemo_t *memo, bool deleted);
 E myuser_t *myuser_find_ext(const char *name);
 E void myuser_notice(const char *from, myuser_t *target, const char *fmt, ...) PRINTFLIKE(3, 4);
 
@@ -438,6 +465,7 @@ E chanacs_t *chanacs_find_host_by_user(mychan_t *mychan, user_t *u, unsigned int
 E chanacs_t *chanacs_find_by_mask(mychan_t *mychan, const char *mask, unsigned int level);
 E bool chanacs_user_has_flag(mychan_t *mychan, user_t *u, unsigned int level);
 E unsigned int chanacs_user_flags(mychan_t *mychan, user_t *u);
+E void chanacs_cache_invalidate_all(void);
 //inline bool chanacs_source_has_flag(mychan_t *mychan, sourceinfo_t *si, unsigned int level);
 E unsigned int chanacs_source_flags(mychan_t *mychan, sourceinfo_t *si);
 
@@ -43,6 +43,7 @@ struct chanuser_
   channel_t *chan;
   user_t *user;
   unsigned int modes;
+  bool unconfirmed; /* kept from before the uplink was lost, not burst again yet */
   mowgli_node_t unode;
   mowgli_node_t cnode;
 };
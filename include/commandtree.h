@@ -23,6 +23,17 @@ struct commandentry_ {
 	} help;
 };
 
+/* per command timing, see command_exec() */
+#define COMMAND_STATS_BUCKETS	7	/* <10us, <100us, ... <1s, >=1s */
+
+typedef struct {
+	char *name;			/* service and command path */
+	unsigned int count;
+	unsigned long long total_us;
+	unsigned int max_us;
+	unsigned int histogram[COMMAND_STATS_BUCKETS];
+} command_stats_t;
+
 /* commandtree.c */
 E void command_add(command_t *cmd, mowgli_patricia_t *commandtree);
 E void command_delete(command_t *cmd, mowgli_patricia_t *commandtree);
@@ -31,6 +42,8 @@ E void command_exec(service_t *svs, sourceinfo_t *si, command_t *c, int parc, ch
 E void command_exec_split(service_t *svs, sourceinfo_t *si, const char *cmd, char *text, mowgli_patricia_t *commandtree);
 E void command_help(sourceinfo_t *si, mowgli_patricia_t *commandtree);
 E void command_help_short(sourceinfo_t *si, mowgli_patricia_t *commandtree, const char *maincmds);
+E void command_stats_foreach(void (*cb)(command_stats_t *st, void *privdata), void *privdata);
+E void command_stats_reset(void);
 E bool (*command_authorize)(service_t *svs, sourceinfo_t *si, command_t *c, const char *userlevel);
 
 /* help.c */
@@ -32,13 +32,25 @@ union sockaddr_any_
 
 typedef struct connection_ connection_t;
 
+/* received data, kept in one piece so that lines can be handled in place */
+typedef struct {
+	char *buf;
+	size_t size;
+	size_t start;	/* first byte not yet taken */
+	size_t end;	/* one past the last byte received */
+} recvq_t;
+
 struct connection_
 {
 	char name[HOSTLEN];
 	char hbuf[BUFSIZE + 1];
 
-	mowgli_list_t recvq;
+	recvq_t recvq;
 	mowgli_list_t sendq;
+	size_t sendq_len;	/* bytes on sendq */
+	size_t sendq_peak;	/* most bytes ever on sendq */
+	uint64_t sendq_total;	/* bytes ever queued */
+	unsigned int sendq_writes;	/* write calls made flushing it */
 
 	int fd;
 	int pollslot;
@@ -100,6 +112,7 @@ extern connection_t *connection_accept_tcp(connection_t *,
 extern void connection_setselect_read(connection_t *, void(*)(connection_t *));
 extern void connection_setselect_write(connection_t *, void(*)(connection_t *));
 extern void connection_close(connection_t *);
+extern int connection_release(connection_t *);
 extern void connection_close_soon(connection_t *);
 extern void connection_close_soon_children(connection_t *);
 extern void connection_close_all(void);
@@ -90,4 +90,20 @@ E void db_process(database_handle_t *db, const char *type);
 E void db_init(void);
 E database_module_t *db_mod;
 
+/* timing of the most recent database save, for STATS T */
+typedef struct {
+	unsigned int saves;
+	unsigned int failures;
+	unsigned int coalesced;
+	unsigned int last_duration;	/* ms from start of save until it is on disk */
+	unsigned int last_stall;	/* ms the event loop was blocked by the save */
+	unsigned int max_stall;
+} database_save_stats_t;
+
+E database_save_stats_t db_save_stats;
+
+/* change journal between full saves; opened by the backend once loading is done */
+E database_handle_t *db_journal;
+E bool db_journal_start_row(const char *type);
+
 #endif
@@ -13,11 +13,15 @@ E void sendq_add_eof(connection_t *cptr);
 E void sendq_flush(connection_t *cptr);
 E bool sendq_nonempty(connection_t *cptr);
 E void sendq_set_limit(connection_t *cptr, size_t len);
+E unsigned int sendq_pool_length(void);
+E unsigned int sendq_pool_allocs;
 
 E int recvq_length(connection_t *cptr);
 E void recvq_put(connection_t *cptr);
 E int recvq_get(connection_t *cptr, char *buf, size_t len);
 E int recvq_getline(connection_t *cptr, char *buf, size_t len);
+E char *recvq_nextline(connection_t *cptr, size_t maxlen, size_t *len);
+E void recvq_restore(connection_t *cptr, const char *buf, size_t len);
 
 E void sendqrecvq_free(connection_t *cptr);
 
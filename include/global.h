@@ -22,6 +22,7 @@ struct me
   char *actual;                 /* the reported name of the uplink    */
   char *vhost;                  /* IP we bind outgoing stuff to       */
   unsigned int recontime;           /* time between reconnection attempts */
+  unsigned int reconciletime;       /* how long to keep network state without uplink */
   unsigned int restarttime;         /* time before restarting             */
   char *netname;                /* IRC network name                   */
   char *hidehostsuffix;         /* host suffix for P10 +x etc         */
@@ -100,9 +101,13 @@ struct ConfOption
   unsigned int default_clone_allowed;  /* default clone kill */
   unsigned int default_clone_warn;  /* default clone warn */
   bool clone_increase;  /* If the clone limit will increase based on # of identified clones */
+  char *clone_ipv4_prefixes;	/* prefix lengths IPv4 clients are counted by */
+  char *clone_ipv6_prefixes;	/* prefix lengths IPv6 clients are counted by */
 
   unsigned int uplink_sendq_limit;
 
+  unsigned int command_slow_threshold;	/* log commands slower than this, in ms */
+
   char *language;		/* default language */
 
   mowgli_list_t exempts;		/* List of masks never to automatically kline */
@@ -162,6 +167,8 @@ E int runflags;
 #define RF_STARTING     0x00000004      /* starting up */
 #define RF_RESTART      0x00000008      /* restart     */
 #define RF_REHASHING    0x00000010      /* rehashing   */
+#define RF_HANDOFF      0x00000020      /* restart hands the network over, see handoff.c */
+#define RF_RESTORING    0x00000040      /* taking the network over; no hooks are called */
 
 /* node.c */
 E void init_nodes(void);
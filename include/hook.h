@@ -9,12 +9,33 @@
 #define HOOK_H
 
 typedef struct hook_ hook_t;
+typedef struct hook_handler_ hook_handler_t;
 
+/* hooks are never freed, so a hook_t can be kept as a handle */
 struct hook_ {
 	char *name;
-	mowgli_list_t hooks;
+	mowgli_list_t hooks;		/* hook_handler_t */
+
+	unsigned int running;		/* calls in progress */
+	bool dead;			/* handlers were deleted while running */
+
+	unsigned int calls;
+	unsigned long long total_us;
+	unsigned int max_us;
 };
 
+struct hook_handler_ {
+	void (*func)(void *data);	/* NULL once deleted */
+	char *module;			/* module that added it, NULL for the core */
+	mowgli_node_t node;
+
+	unsigned int calls;
+	unsigned long long total_us;
+	unsigned int max_us;
+};
+
+E unsigned long long hook_time_us;	/* in hooks not run from other hooks */
+
 E hook_t *hook_add_event(const char *);
 E void hook_del_event(const char *);
 E void hook_del_hook(const char *, void (*)(void *));
@@ -22,6 +43,11 @@ E void hook_add_hook(const char *, void (*)(void *));
 E void hook_add_hook_first(const char *, void (*)(void *));
 E void hook_call_event(const char *, void *);
 
+E void hook_add_handler(hook_t *, void (*)(void *), bool);
+E void hook_del_handler(hook_t *, void (*)(void *));
+E void hook_call_handle(hook_t *, void *);
+E void hook_stats_foreach(void (*)(hook_t *, void *), void *);
+
 #endif
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
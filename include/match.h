@@ -11,6 +11,7 @@
 #define _MATCH_H
 
 /* cidr.c */
+E int cidr_parse_ip(const char *ip, unsigned char *addr);
 E int match_ips(const char *mask, const char *address);
 E int match_cidr(const char *mask, const char *address);
 
@@ -53,6 +54,25 @@ E void noopcanon(char *);
 E int match(const char *, const char *);
 E char *collapse(char *);
 
+/* matchpattern.c */
+typedef struct match_pattern_ match_pattern_t;
+
+typedef enum {
+	MATCH_PATTERN_ANY,		/* only '*' */
+	MATCH_PATTERN_LITERAL,
+	MATCH_PATTERN_PREFIX,		/* head* */
+	MATCH_PATTERN_SUFFIX,		/* *tail */
+	MATCH_PATTERN_SUBSTRING,	/* *middle* */
+	MATCH_PATTERN_SEGMENTS,		/* several literals between '*' */
+	MATCH_PATTERN_GLOB		/* other wildcards; uses match() */
+} match_pattern_kind_t;
+
+E match_pattern_t *match_pattern_create(const char *mask);
+E void match_pattern_destroy(match_pattern_t *mp);
+E const char *match_pattern_mask(const match_pattern_t *mp);
+E match_pattern_kind_t match_pattern_kind(const match_pattern_t *mp);
+E int match_pattern(match_pattern_t *mp, const char *name);
+
 /* regex_create() flags */
 #define AREGEX_ICASE	1 /* case insensitive */
 #define AREGEX_PCRE	2 /* use libpcre engine */
@@ -64,6 +84,18 @@ E char *regex_extract(char *pattern, char **pend, int *pflags);
 E bool regex_match(atheme_regex_t *preg, char *string);
 E bool regex_destroy(atheme_regex_t *preg);
 
+/* patternset.c */
+typedef struct pattern_set_ pattern_set_t;
+typedef struct pattern_set_entry_ pattern_set_entry_t;
+
+E pattern_set_t *pattern_set_create(void);
+E void pattern_set_destroy(pattern_set_t *ps);
+E pattern_set_entry_t *pattern_set_add(pattern_set_t *ps, const char *pattern, void *data);
+E pattern_set_entry_t *pattern_set_add_regex(pattern_set_t *ps, const char *pattern, int flags, atheme_regex_t *re, void *data);
+E void pattern_set_delete(pattern_set_t *ps, pattern_set_entry_t *e);
+E void *pattern_set_match(pattern_set_t *ps, const char *subject, bool (*accept)(void *data));
+E unsigned int pattern_set_match_all(pattern_set_t *ps, const char *subject, void (*cb)(void *data, void *privdata), void *privdata);
+
 #endif
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
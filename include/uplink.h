@@ -40,6 +40,7 @@ E uplink_t *uplink_add(const char *name, const char *host, const char *send_pass
 E void uplink_delete(uplink_t *u);
 E uplink_t *uplink_find(const char *name);
 E void uplink_connect(void);
+E void uplink_adopt(uplink_t *u, int fd);
 
 /* packet.c */
 /* bursting timer */
@@ -48,7 +49,10 @@ E struct timeval burstime;
 #endif
 
 E void (*parse)(char *line);
+E void core_line_set(const char *line);
+E const char *core_line(void);
 E void irc_handle_connect(connection_t *cptr);
+E void irc_handle_adopt(connection_t *cptr);
 
 /* send.c */
 E int sts(const char *fmt, ...) PRINTFLIKE(1, 2);
@@ -38,6 +38,8 @@ struct user_
 	mowgli_node_t snode; /* for server_t.userlist */
 
 	char *certfp; /* client certificate fingerprint */
+
+	struct chanacs_cache_ *chanacs_cache; /* see chanacs_user_flags() */
 };
 
 #define FLOOD_MSGS_FACTOR 256
@@ -54,6 +56,9 @@ struct user_
 #define UF_ENFORCER    0x00001000 /* this is an enforcer client */
 #define UF_WASENFORCED 0x00002000 /* this user was FNCed once already */
 #define UF_DEAF        0x00004000 /* user does not receive channel msgs */
+#define UF_NETSPLIT    0x00008000 /* user is being removed with its server, see user_delete_bulk() */
+#define UF_UNCONFIRMED 0x00010000 /* kept from before the uplink was lost, not burst again yet */
+#define UF_RECONCILED  0x00020000 /* was kept and burst again; it is not new */
 
 #define CLIENT_NAME(user)	((user)->uid != NULL ? (user)->uid : (user)->nick)
 
@@ -62,6 +67,12 @@ typedef struct {
 	const char *oldnick;	/* Previous nick for nick changes. u->nick is the new nick. */
 } hook_user_nick_t;
 
+typedef struct {
+	user_t **users;		/* users about to be deleted; they have UF_NETSPLIT set */
+	size_t count;
+	const char *comment;
+} hook_user_delete_bulk_t;
+
 /* function.c */
 E bool is_ircop(user_t *user);
 E bool is_admin(user_t *user);
@@ -76,6 +87,7 @@ E void init_users(void);
 
 E user_t *user_add(const char *nick, const char *user, const char *host, const char *vhost, const char *ip, const char *uid, const char *gecos, server_t *server, time_t ts);
 E void user_delete(user_t *u, const char *comment);
+E void user_delete_bulk(user_t **users, size_t count, const char *comment);
 E user_t *user_find(const char *nick);
 E user_t *user_find_named(const char *nick);
 E void user_changeuid(user_t *u, const char *uid);
@@ -88,6 +100,17 @@ E const char *user_get_umodestr(user_t *u);
 E void init_uid(void);
 E const char *uid_get(void);
 
+/* userscan.c */
+typedef struct userscan_ userscan_t;
+
+typedef void (*userscan_match_cb_t)(sourceinfo_t *si, const char *nick, const char *user, const char *host, const char *gecos, void *privdata);
+typedef void (*userscan_done_cb_t)(sourceinfo_t *si, unsigned int matches, bool cancelled, void *privdata);
+
+E bool userscan_start(sourceinfo_t *si, const char *name, atheme_regex_t *re, userscan_match_cb_t match, userscan_done_cb_t done, void *privdata);
+E bool userscan_find(sourceinfo_t *si, const char *name);
+E bool userscan_cancel(sourceinfo_t *si, const char *name);
+E void userscan_cancel_all(const char *name);
+
 #endif
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
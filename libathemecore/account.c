@@ -26,6 +26,7 @@
 #include "datastream.h"
 #include "privs.h"
 #include "authcookie.h"
+#include "internal.h"
 
 mowgli_patricia_t *nicklist;
 mowgli_patricia_t *oldnameslist;
@@ -39,6 +40,53 @@ mowgli_heap_t *myuser_name_heap;	/* HEAP_USER / 2 */
 mowgli_heap_t *mychan_heap;	/* HEAP_CHANNEL */
 mowgli_heap_t *chanacs_heap;	/* HEAP_CHANACS */
 
+static void chanacs_touch(mychan_t *mychan);
+
+/*
+ * Change journal rows. They carry the same fields as the rows of a full
+ * save, but are written as each change happens and replayed in order on
+ * top of the last full save, so they have to be safe to apply twice.
+ */
+static void journal_myuser(myuser_t *mu)
+{
+	/* JMU <uid> <name> <pass> <email> <registered> <flags> */
+	if (!db_journal_start_row("JMU"))
+		return;
+
+	db_write_word(db_journal, entity(mu)->id);
+	db_write_word(db_journal, entity(mu)->name);
+	db_write_word(db_journal, mu->pass);
+	db_write_word(db_journal, mu->email);
+	db_write_time(db_journal, mu->registered);
+	db_write_word(db_journal, gflags_tostr(mu_flags, mu->flags));
+	db_commit_row(db_journal);
+}
+
+static void journal_name(const char *type, const char *name, const char *arg)
+{
+	if (!db_journal_start_row(type))
+		return;
+
+	db_write_word(db_journal, name);
+	if (arg != NULL)
+		db_write_word(db_journal, arg);
+	db_commit_row(db_journal);
+}
+
+static void journal_chanacs(chanacs_t *ca)
+{
+	/* JCA <channel> <target> <flags> <modified> <setter> */
+	if (!db_journal_start_row("JCA"))
+		return;
+
+	db_write_word(db_journal, ca->mychan->name);
+	db_write_word(db_journal, ca->entity ? ca->entity->name : ca->host);
+	db_write_word(db_journal, bitmask_to_flags(ca->level));
+	db_write_time(db_journal, ca->tmodified);
+	db_write_word(db_journal, ca->setter ? ca->setter : "*");
+	db_commit_row(db_journal);
+}
+
 /*
  * init_accounts()
  *
@@ -163,6 +211,8 @@ myuser_t *myuser_add_id(const char *id, const char *name, const char *pass, cons
 
 	myuser_name_restore(entity(mu)->name, mu);
 
+	journal_myuser(mu);
+
 	cnt.myuser++;
 
 	return mu;
@@ -200,8 +250,13 @@ void myuser_delete(myuser_t *mu)
 
 	myuser_name_remember(entity(mu)->name, mu);
 
+	journal_name("JMUD", entity(mu)->name, NULL);
+
 	hook_call_myuser_delete(mu);
 
+	/* a new account may be allocated where this one was */
+	chanacs_cache_invalidate_all();
+
 	/* log them out */
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, mu->logins.head)
 	{
@@ -211,6 +266,7 @@ void myuser_delete(myuser_t *mu)
 			u->myuser = NULL;
 			mowgli_node_delete(n, &mu->logins);
 			mowgli_node_free(n);
+			hook_call_user_loginchange(u);
 		}
 	}
 
@@ -382,6 +438,8 @@ void myuser_rename(myuser_t *mu, const char *name)
 		}
 	}
 
+	journal_name("JMUR", nb, entity(mu)->name);
+
 	data.mu = mu;
 	data.oldname = nb;
 	hook_call_user_rename(&data);
@@ -409,6 +467,76 @@ void myuser_set_email(myuser_t *mu, const char *newemail)
 
 	strshare_unref(mu->email);
 	mu->email = strshare_get(newemail);
+
+	journal_name("JMUE", entity(mu)->name, mu->email);
+}
+
+/*
+ * myuser_journal(myuser_t *mu)
+ *
+ * Records the password and flags of an account in the change journal,
+ * after they were changed directly in the account.
+ *
+ * Inputs:
+ *      - account that was changed
+ *
+ * Outputs:
+ *      - nothing
+ *
+ * Side Effects:
+ *      - a JMUS row is written, unless the account is still being set up
+ *        by myuser_add(), which journals it whole
+ */
+void myuser_journal(myuser_t *mu)
+{
+	return_if_fail(mu != NULL);
+
+	if (db_journal == NULL || myuser_find(entity(mu)->name) != mu)
+		return;
+
+	/* JMUS <name> <pass> <flags> */
+	if (!db_journal_start_row("JMUS"))
+		return;
+
+	db_write_word(db_journal, entity(mu)->name);
+	db_write_word(db_journal, mu->pass);
+	db_write_word(db_journal, gflags_tostr(mu_flags, mu->flags));
+	db_commit_row(db_journal);
+}
+
+/*
+ * mymemo_journal(myuser_t *mu, mymemo_t *memo, bool deleted)
+ *
+ * Records a memo that was added to an account, had its status changed or
+ * was deleted in the change journal.
+ *
+ * Inputs:
+ *      - account the memo belongs to
+ *      - the memo; it must not be freed yet if it was deleted
+ *      - whether it was deleted
+ *
+ * Outputs:
+ *      - nothing
+ *
+ * Side Effects:
+ *      - a JME or JMED row is written
+ */
+void mymemo_journal(myuser_t *mu, mymemo_t *memo, bool deleted)
+{
+	return_if_fail(mu != NULL);
+	return_if_fail(memo != NULL);
+
+	/* JME <name> <sender> <sent> <status> <text>, JMED <name> <sender> <sent> <text> */
+	if (!db_journal_start_row(deleted ? "JMED" : "JME"))
+		return;
+
+	db_write_word(db_journal, entity(mu)->name);
+	db_write_word(db_journal, memo->sender);
+	db_write_time(db_journal, memo->sent);
+	if (!deleted)
+		db_write_uint(db_journal, memo->status);
+	db_write_str(db_journal, memo->text);
+	db_commit_row(db_journal);
 }
 
 /*
@@ -687,6 +815,8 @@ mynick_t *mynick_add(myuser_t *mu, const char *name)
 
 	myuser_name_restore(mn->nick, mu);
 
+	journal_name("JMN", entity(mu)->name, mn->nick);
+
 	cnt.mynick++;
 
 	return mn;
@@ -715,6 +845,8 @@ void mynick_delete(mynick_t *mn)
 
 	myuser_name_remember(mn->nick, mn->owner);
 
+	journal_name("JMND", mn->nick, NULL);
+
 	mowgli_patricia_delete(nicklist, mn->nick);
 	mowgli_node_delete(&mn->node, &mn->owner->nicks);
 
@@ -964,10 +1096,20 @@ static void mychan_delete(mychan_t *mc)
 	if (mc->chan != NULL)
 		mc->chan->mychan = NULL;
 
+	journal_name("JMCD", mc->name, NULL);
+
 	/* remove the chanacs shiz */
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, mc->chanacs.head)
 		object_unref(n->data);
 
+	if (mc->chanacs_by_entity != NULL)
+	{
+		mowgli_patricia_destroy(mc->chanacs_by_entity, NULL, NULL);
+		mowgli_patricia_destroy(mc->chanacs_by_host, NULL, NULL);
+	}
+
+	chanacs_hostmatch_free(mc);
+
 	metadata_delete_all(mc);
 
 	mowgli_patricia_delete(mclist, mc->name);
@@ -995,12 +1137,15 @@ mychan_t *mychan_add(char *name)
 	mc->name = strshare_get(name);
 	mc->registered = CURRTIME;
 	mc->chan = channel_find(name);
+	chanacs_touch(mc);
 
 	if (mc->chan != NULL)
 		mc->chan->mychan = mc;
 
 	mowgli_patricia_add(mclist, mc->name, mc);
 
+	journal_name("JMC", mc->name, NULL);
+
 	cnt.mychan++;
 
 	return mc;
@@ -1332,6 +1477,157 @@ const char *mychan_get_sts_mlock(mychan_t *mc)
  * C H A N A C S *
  *****************/
 
+/*
+ * Channels with at least this many access entries get an index, so that
+ * looking up an account or a literal host mask does not walk the list.
+ * Entries of entities with a validator are never indexed; they are kept
+ * on mychan->chanacs_dynamic, which every entity or user lookup scans.
+ * The entity index is keyed by entity ID, which does not change when an
+ * account is renamed.
+ */
+#define CHANACS_INDEX_MIN	32
+
+static inline bool chanacs_is_dynamic(chanacs_t *ca)
+{
+	return ca->entity != NULL && ca->entity->chanacs_validate != NULL;
+}
+
+/* can the index answer for this entity or host? */
+static inline bool chanacs_index_usable(mychan_t *mychan)
+{
+	return mychan->chanacs_by_entity != NULL && mychan->chanacs_dups == 0;
+}
+
+static mowgli_patricia_t *chanacs_index_of(chanacs_t *ca, const char **key)
+{
+	if (ca->entity != NULL)
+	{
+		*key = ca->entity->id;
+		return ca->mychan->chanacs_by_entity;
+	}
+
+	*key = ca->host;
+	return ca->mychan->chanacs_by_host;
+}
+
+/*
+ * Every change to a channel's access list gives the channel a new
+ * generation, drawn from one sequence so that a channel registered at
+ * the address of a dropped one never reuses its generation. Cached user
+ * flags (see chanacs_user_flags()) are only used while the generation
+ * they were computed at is current.
+ */
+static unsigned int chanacs_gen_seq;
+
+/* bumped by changes that can affect any channel, such as group membership */
+static unsigned int chanacs_global_gen;
+
+static void chanacs_touch(mychan_t *mychan)
+{
+	mychan->chanacs_gen = ++chanacs_gen_seq;
+}
+
+void chanacs_cache_invalidate_all(void)
+{
+	chanacs_global_gen++;
+}
+
+/* does matching this entry depend on more than the user's account and host? */
+static inline bool chanacs_is_volatile(chanacs_t *ca)
+{
+	return chanacs_is_dynamic(ca) && ca->entity->chanacs_validate->match_user != NULL;
+}
+
+static void chanacs_index_add(chanacs_t *ca)
+{
+	mowgli_patricia_t *idx;
+	const char *key;
+
+	if (chanacs_is_dynamic(ca) || ca->mychan->chanacs_by_entity == NULL)
+		return;
+
+	idx = chanacs_index_of(ca, &key);
+
+	/* duplicates only come from old databases; lookups go linear until they are gone */
+	if (mowgli_patricia_retrieve(idx, key) != NULL)
+	{
+		ca->mychan->chanacs_dups++;
+		return;
+	}
+
+	mowgli_patricia_add(idx, key, ca);
+}
+
+static void chanacs_index_delete(chanacs_t *ca)
+{
+	mowgli_patricia_t *idx;
+	mowgli_node_t *n;
+	const char *key;
+	chanacs_t *ca2;
+
+	if (chanacs_is_dynamic(ca) || ca->mychan->chanacs_by_entity == NULL)
+		return;
+
+	idx = chanacs_index_of(ca, &key);
+
+	if (mowgli_patricia_retrieve(idx, key) != ca)
+	{
+		ca->mychan->chanacs_dups--;
+		return;
+	}
+
+	mowgli_patricia_delete(idx, key);
+
+	if (ca->mychan->chanacs_dups == 0)
+		return;
+
+	/* let a duplicate take its place */
+	MOWGLI_ITER_FOREACH(n, ca->mychan->chanacs.head)
+	{
+		ca2 = n->data;
+
+		if (ca2 == ca || ca2->entity != ca->entity)
+			continue;
+		if (ca2->entity == NULL && strcasecmp(ca2->host, ca->host))
+			continue;
+
+		mowgli_patricia_add(idx, key, ca2);
+		ca->mychan->chanacs_dups--;
+		break;
+	}
+}
+
+/* puts a new entry on the channel's lists, building the index once the list is long */
+static void chanacs_link(chanacs_t *ca)
+{
+	mychan_t *mychan = ca->mychan;
+	mowgli_node_t *n;
+
+	mowgli_node_add(ca, &ca->cnode, &mychan->chanacs);
+	chanacs_touch(mychan);
+
+	if (chanacs_is_dynamic(ca))
+		mowgli_node_add(ca, &ca->dnode, &mychan->chanacs_dynamic);
+
+	if (chanacs_is_volatile(ca))
+		mychan->chanacs_volatile++;
+
+	if (mychan->chanacs_by_entity != NULL)
+	{
+		chanacs_index_add(ca);
+		return;
+	}
+
+	if (MOWGLI_LIST_LENGTH(&mychan->chanacs) < CHANACS_INDEX_MIN)
+		return;
+
+	mychan->chanacs_by_entity = mowgli_patricia_create(noopcanon);
+	mychan->chanacs_by_host = mowgli_patricia_create(strcasecanon);
+
+	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+		chanacs_index_add(n->data);
+}
+
 /* private destructor for chanacs_t */
 static void chanacs_delete(chanacs_t *ca)
 {
@@ -1342,7 +1638,21 @@ static void chanacs_delete(chanacs_t *ca)
 		slog(LG_DEBUG, "chanacs_delete(): %s -> %s [%s]", ca->mychan->name,
 			ca->entity != NULL ? entity(ca->entity)->name : ca->host,
 			ca->entity != NULL ? "entity" : "hostmask");
+
+	journal_name("JCAD", ca->mychan->name, ca->entity != NULL ? ca->entity->name : ca->host);
+
+	chanacs_index_delete(ca);
 	mowgli_node_delete(&ca->cnode, &ca->mychan->chanacs);
+	chanacs_touch(ca->mychan);
+
+	if (chanacs_is_volatile(ca))
+		ca->mychan->chanacs_volatile--;
+
+	if (ca->entity == NULL)
+		chanacs_hostmatch_delete(ca);
+
+	if (chanacs_is_dynamic(ca))
+		mowgli_node_delete(&ca->dnode, &ca->mychan->chanacs_dynamic);
 
 	if (ca->entity != NULL)
 	{
@@ -1359,6 +1669,8 @@ static void chanacs_delete(chanacs_t *ca)
 
 	if (ca->host != NULL)
 		free(ca->host);
+	if (ca->hostpat != NULL)
+		match_pattern_destroy(ca->hostpat);
 
 	mowgli_heap_free(chanacs_heap, ca);
 
@@ -1403,13 +1715,16 @@ chanacs_t *chanacs_add(mychan_t *mychan, myentity_t *mt, unsigned int level, tim
 	ca->mychan = mychan;
 	ca->entity = isdynamic(mt) ? object_ref(mt) : mt;
 	ca->host = NULL;
+	ca->hostpat = NULL;
 	ca->level = level & ca_all;
 	ca->tmodified = ts;
 	ca->setter = setter != NULL ? strshare_ref(setter->name) : NULL;
 
-	mowgli_node_add(ca, &ca->cnode, &mychan->chanacs);
+	chanacs_link(ca);
 	mowgli_node_add(ca, &ca->unode, &mt->chanacs);
 
+	journal_chanacs(ca);
+
 	cnt.chanacs++;
 
 	return ca;
@@ -1453,11 +1768,15 @@ chanacs_t *chanacs_add_host(mychan_t *mychan, const char *host, unsigned int lev
 	ca->mychan = mychan;
 	ca->entity = NULL;
 	ca->host = sstrdup(host);
+	ca->hostpat = match_pattern_create(host);
 	ca->level = level & ca_all;
 	ca->tmodified = ts;
 	ca->setter = setter != NULL ? strshare_ref(setter->name) : NULL;
 
-	mowgli_node_add(ca, &ca->cnode, &mychan->chanacs);
+	chanacs_link(ca);
+	chanacs_hostmatch_add(ca);
+
+	journal_chanacs(ca);
 
 	cnt.chanacs++;
 
@@ -1474,15 +1793,13 @@ chanacs_t *chanacs_find(mychan_t *mychan, myentity_t *mt, unsigned int level)
 	if ((ca = chanacs_find_literal(mychan, mt, level)) != NULL)
 		return ca;
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+	/* other plain entries only ever match their own entity */
+	MOWGLI_ITER_FOREACH(n, mychan->chanacs_dynamic.head)
 	{
 		entity_chanacs_validation_vtable_t *vt;
 
 		ca = (chanacs_t *)n->data;
 
-		if (ca->entity == NULL)
-			continue;
-
 		vt = myentity_get_chanacs_validator(ca->entity);
 		if (level != 0x0)
 		{
@@ -1504,14 +1821,32 @@ unsigned int chanacs_entity_flags(mychan_t *mychan, myentity_t *mt)
 
 	return_val_if_fail(mychan != NULL && mt != NULL, 0);
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+	/* entries of an entity with a validator are all on the dynamic list */
+	if (mt->chanacs_validate == NULL)
+	{
+		if (chanacs_index_usable(mychan))
+		{
+			if ((ca = mowgli_patricia_retrieve(mychan->chanacs_by_entity, mt->id)) != NULL)
+				result |= ca->level;
+		}
+		else
+		{
+			MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+			{
+				ca = (chanacs_t *)n->data;
+
+				if (ca->entity == mt)
+					result |= ca->level;
+			}
+		}
+	}
+
+	MOWGLI_ITER_FOREACH(n, mychan->chanacs_dynamic.head)
 	{
 		entity_chanacs_validation_vtable_t *vt;
 
 		ca = (chanacs_t *)n->data;
 
-		if (ca->entity == NULL)
-			continue;
 		if (ca->entity == mt)
 			result |= ca->level;
 		else
@@ -1534,7 +1869,17 @@ chanacs_t *chanacs_find_literal(mychan_t *mychan, myentity_t *mt, unsigned int l
 
 	return_val_if_fail(mychan != NULL && mt != NULL, NULL);
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+	if (mt->chanacs_validate == NULL && chanacs_index_usable(mychan))
+	{
+		ca = mowgli_patricia_retrieve(mychan->chanacs_by_entity, mt->id);
+
+		if (ca != NULL && (ca->level & level) == level)
+			return ca;
+
+		return NULL;
+	}
+
+	MOWGLI_ITER_FOREACH(n, mt->chanacs_validate != NULL ? mychan->chanacs_dynamic.head : mychan->chanacs.head)
 	{
 		ca = (chanacs_t *)n->data;
 
@@ -1563,10 +1908,10 @@ chanacs_t *chanacs_find_host(mychan_t *mychan, const char *host, unsigned int le
 
 		if (level != 0x0)
 		{
-			if ((ca->entity == NULL) && (!match(ca->host, host)) && ((ca->level & level) == level))
+			if ((ca->entity == NULL) && (!match_pattern(ca->hostpat, host)) && ((ca->level & level) == level))
 				return ca;
 		}
-		else if ((ca->entity == NULL) && (!match(ca->host, host)))
+		else if ((ca->entity == NULL) && (!match_pattern(ca->hostpat, host)))
 			return ca;
 	}
 
@@ -1585,7 +1930,7 @@ unsigned int chanacs_host_flags(mychan_t *mychan, const char *host)
 	{
 		ca = (chanacs_t *)n->data;
 
-		if (ca->entity == NULL && !match(ca->host, host))
+		if (ca->entity == NULL && !match_pattern(ca->hostpat, host))
 			result |= ca->level;
 	}
 
@@ -1600,6 +1945,16 @@ chanacs_t *chanacs_find_host_literal(mychan_t *mychan, const char *host, unsigne
 	if ((!mychan) || (!host))
 		return NULL;
 
+	if (chanacs_index_usable(mychan))
+	{
+		ca = mowgli_patricia_retrieve(mychan->chanacs_by_host, host);
+
+		if (ca != NULL && (ca->level & level) == level)
+			return ca;
+
+		return NULL;
+	}
+
 	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
 	{
 		ca = (chanacs_t *)n->data;
@@ -1616,6 +1971,21 @@ chanacs_t *chanacs_find_host_literal(mychan_t *mychan, const char *host, unsigne
 	return NULL;
 }
 
+/*
+ * Host masks of long access lists are matched through hostmatch.c, unless
+ * a protocol module matches them its own way.
+ */
+static bool chanacs_hostmatch_usable(mychan_t *mychan)
+{
+	if (next_matching_host_chanacs != generic_next_matching_host_chanacs)
+		return false;
+
+	if (mychan->chanacs_hostmatch == NULL && MOWGLI_LIST_LENGTH(&mychan->chanacs) >= CHANACS_INDEX_MIN)
+		chanacs_hostmatch_build(mychan);
+
+	return mychan->chanacs_hostmatch != NULL;
+}
+
 chanacs_t *chanacs_find_host_by_user(mychan_t *mychan, user_t *u, unsigned int level)
 {
 	mowgli_node_t *n;
@@ -1623,6 +1993,9 @@ chanacs_t *chanacs_find_host_by_user(mychan_t *mychan, user_t *u, unsigned int l
 
 	return_val_if_fail(mychan != NULL && u != NULL, 0);
 
+	if (chanacs_hostmatch_usable(mychan))
+		return chanacs_hostmatch(mychan, u, level, NULL);
+
 	for (n = next_matching_host_chanacs(mychan, u, mychan->chanacs.head); n != NULL; n = next_matching_host_chanacs(mychan, u, n->next))
 	{
 		ca = n->data;
@@ -1641,10 +2014,15 @@ static unsigned int chanacs_host_flags_by_user(mychan_t *mychan, user_t *u)
 
 	return_val_if_fail(mychan != NULL && u != NULL, 0);
 
-	for (n = next_matching_host_chanacs(mychan, u, mychan->chanacs.head); n != NULL; n = next_matching_host_chanacs(mychan, u, n->next))
+	if (chanacs_hostmatch_usable(mychan))
+		chanacs_hostmatch(mychan, u, 0, &result);
+	else
 	{
-		ca = n->data;
-		result |= ca->level;
+		for (n = next_matching_host_chanacs(mychan, u, mychan->chanacs.head); n != NULL; n = next_matching_host_chanacs(mychan, u, n->next))
+		{
+			ca = n->data;
+			result |= ca->level;
+		}
 	}
 
 	slog(LG_DEBUG, "chanacs_host_flags_by_user(%s, %s): return %s", mychan->name, u->nick, bitmask_to_flags(result));
@@ -1698,15 +2076,13 @@ static unsigned int chanacs_entity_flags_by_user(mychan_t *mychan, user_t *u)
 	return_val_if_fail(mychan != NULL, 0);
 	return_val_if_fail(u != NULL, 0);
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+	/* plain entries have no match_user */
+	MOWGLI_ITER_FOREACH(n, mychan->chanacs_dynamic.head)
 	{
 		chanacs_t *ca = n->data;
 		myentity_t *mt;
 		entity_chanacs_validation_vtable_t *vt;
 
-		if (ca->entity == NULL)
-			continue;
-
 		mt = ca->entity;
 		vt = myentity_get_chanacs_validator(mt);
 
@@ -1719,13 +2095,121 @@ static unsigned int chanacs_entity_flags_by_user(mychan_t *mychan, user_t *u)
 	return result;
 }
 
+/*
+ * Flags computed by chanacs_user_flags() are cached on the user, for a
+ * few channels at a time. Entries are dropped when the user's account,
+ * nick, username or hosts change, when the channel's access list changes
+ * or when chanacs_cache_invalidate_all() is called. The cache holds
+ * references to the user's strings, so comparing pointers is enough to
+ * tell whether they changed. Channels with entries that match users by
+ * other criteria (opers, channel members, ...) are not cached.
+ */
+#define CHANACS_CACHE_SIZE	4
+
+struct chanacs_cache_ {
+	myuser_t *myuser;
+	char *nick;
+	char *user;
+	char *vhost;
+	char *chost;
+	char *ip;
+	unsigned int global_gen;
+
+	struct {
+		mychan_t *mychan;
+		unsigned int gen;
+		unsigned int flags;
+	} entries[CHANACS_CACHE_SIZE];
+};
+
+static inline unsigned int chanacs_cache_slot(mychan_t *mychan)
+{
+	return ((uintptr_t)mychan / sizeof(void *)) % CHANACS_CACHE_SIZE;
+}
+
+static void chanacs_cache_release(struct chanacs_cache_ *cc)
+{
+	strshare_unref(cc->nick);
+	strshare_unref(cc->user);
+	strshare_unref(cc->vhost);
+	strshare_unref(cc->chost);
+	strshare_unref(cc->ip);
+}
+
+void chanacs_cache_free(user_t *u)
+{
+	if (u->chanacs_cache == NULL)
+		return;
+
+	chanacs_cache_release(u->chanacs_cache);
+	free(u->chanacs_cache);
+	u->chanacs_cache = NULL;
+}
+
+static bool chanacs_cache_lookup(mychan_t *mychan, user_t *u, unsigned int *flags)
+{
+	struct chanacs_cache_ *cc = u->chanacs_cache;
+	unsigned int i;
+
+	if (cc == NULL || cc->global_gen != chanacs_global_gen || cc->myuser != u->myuser ||
+			cc->nick != u->nick || cc->user != u->user || cc->vhost != u->vhost ||
+			cc->chost != u->chost || cc->ip != u->ip)
+		return false;
+
+	i = chanacs_cache_slot(mychan);
+	if (cc->entries[i].mychan != mychan || cc->entries[i].gen != mychan->chanacs_gen)
+		return false;
+
+	*flags = cc->entries[i].flags;
+	return true;
+}
+
+static void chanacs_cache_store(mychan_t *mychan, user_t *u, unsigned int flags)
+{
+	struct chanacs_cache_ *cc = u->chanacs_cache;
+	unsigned int i;
+
+	if (mychan->chanacs_volatile > 0)
+		return;
+
+	if (cc == NULL)
+		cc = u->chanacs_cache = scalloc(sizeof(struct chanacs_cache_), 1);
+
+	if (cc->global_gen != chanacs_global_gen || cc->myuser != u->myuser ||
+			cc->nick != u->nick || cc->user != u->user || cc->vhost != u->vhost ||
+			cc->chost != u->chost || cc->ip != u->ip)
+	{
+		chanacs_cache_release(cc);
+		memset(cc, 0, sizeof *cc);
+
+		cc->myuser = u->myuser;
+		cc->nick = strshare_ref(u->nick);
+		cc->user = strshare_ref(u->user);
+		cc->vhost = strshare_ref(u->vhost);
+		cc->chost = strshare_ref(u->chost);
+		cc->ip = strshare_ref(u->ip);
+		cc->global_gen = chanacs_global_gen;
+	}
+
+	i = chanacs_cache_slot(mychan);
+	cc->entries[i].mychan = mychan;
+	cc->entries[i].gen = mychan->chanacs_gen;
+	cc->entries[i].flags = flags;
+}
+
 unsigned int chanacs_user_flags(mychan_t *mychan, user_t *u)
 {
 	myentity_t *mt;
-	unsigned int result = 0;
+	unsigned int result = 0, cached;
+	bool hit;
 
 	return_val_if_fail(mychan != NULL && u != NULL, 0);
 
+	/* with debug logging on, hits are checked against the full computation */
+	hit = chanacs_cache_lookup(mychan, u, &cached);
+	if (hit && !log_debug_enabled())
+		return cached;
+
 	mt = entity(u->myuser);
 	if (mt != NULL)
 		result |= chanacs_entity_flags(mychan, mt);
@@ -1735,6 +2219,13 @@ unsigned int chanacs_user_flags(mychan_t *mychan, user_t *u)
 
 	slog(LG_DEBUG, "chanacs_user_flags(%s, %s): return %s", mychan->name, u->nick, bitmask_to_flags(result));
 
+	if (hit && cached != result)
+	{
+		slog(LG_ERROR, "chanacs_user_flags(%s, %s): stale cache entry %s", mychan->name, u->nick, bitmask_to_flags(cached));
+	}
+
+	chanacs_cache_store(mychan, u, result);
+
 	return result;
 }
 
@@ -1812,6 +2303,9 @@ bool chanacs_modify(chanacs_t *ca, unsigned int *addflags, unsigned int *removef
 		return false;
 	ca->level = (ca->level | *addflags) & ~*removeflags;
 	ca->tmodified = CURRTIME;
+	chanacs_touch(ca->mychan);
+
+	journal_chanacs(ca);
 
 	return true;
 }
@@ -1874,8 +2368,11 @@ bool chanacs_change(mychan_t *mychan, myentity_t *mt, const char *hostmask, unsi
 				return false;
 			ca->level = (ca->level | *addflags) & ~*removeflags;
 			ca->tmodified = CURRTIME;
+			chanacs_touch(mychan);
 			if (ca->level == 0)
 				object_unref(ca);
+			else
+				journal_chanacs(ca);
 		}
 	}
 	else /* hostmask != NULL */
@@ -1910,8 +2407,11 @@ bool chanacs_change(mychan_t *mychan, myentity_t *mt, const char *hostmask, unsi
 				return false;
 			ca->level = (ca->level | *addflags) & ~*removeflags;
 			ca->tmodified = CURRTIME;
+			chanacs_touch(mychan);
 			if (ca->level == 0)
 				object_unref(ca);
+			else
+				journal_chanacs(ca);
 		}
 	}
 	return true;
@@ -2119,6 +2619,70 @@ void db_check(void)
 	myentity_foreach_t(ENT_USER, check_myuser_cb, NULL);
 }
 
+/*
+ * metadata_journal(void *target, const char *name, const char *value)
+ *
+ * Records a metadata change in the change journal.
+ *
+ * Inputs:
+ *      - object the metadata belongs to
+ *      - metadata key
+ *      - new value, or NULL if the key was deleted
+ *
+ * Outputs:
+ *      - nothing
+ *
+ * Side Effects:
+ *      - a JMD or JMDD row is written if the object is one the backend
+ *        can find again by name; changes on other objects are left to
+ *        the next full save.
+ */
+void metadata_journal(void *target, const char *name, const char *value)
+{
+	destructor_t des = object(target)->destructor;
+	const char *type;
+	char buf[BUFSIZE];
+
+	if (db_journal == NULL)
+		return;
+
+	if (des == (destructor_t) myuser_delete)
+	{
+		type = "MDU";
+		mowgli_strlcpy(buf, entity((myuser_t *)target)->name, sizeof buf);
+	}
+	else if (des == (destructor_t) mychan_delete)
+	{
+		type = "MDC";
+		mowgli_strlcpy(buf, ((mychan_t *)target)->name, sizeof buf);
+	}
+	else if (des == (destructor_t) chanacs_delete)
+	{
+		chanacs_t *ca = target;
+
+		type = "MDA";
+		snprintf(buf, sizeof buf, "%s:%s", ca->mychan->name, ca->entity ? ca->entity->name : ca->host);
+	}
+	else if (des == (destructor_t) myuser_name_delete)
+	{
+		type = "MDN";
+		mowgli_strlcpy(buf, ((myuser_name_t *)target)->name, sizeof buf);
+	}
+	else
+		return;
+
+	/* JMD <type> <object> <key> <value>, JMDD <type> <object> <key> */
+	if (!db_journal_start_row(value != NULL ? "JMD" : "JMDD"))
+		return;
+
+	db_write_word(db_journal, type);
+	db_write_word(db_journal, buf);
+	db_write_word(db_journal, name);
+	if (value != NULL)
+		db_write_str(db_journal, value);
+	db_commit_row(db_journal);
+}
+
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
  * vim:ts=8
  * vim:sw=8
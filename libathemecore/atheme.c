@@ -442,11 +442,18 @@ int atheme_main(int argc, char *argv[])
 	mowgli_timer_add(base_eventloop, "rng_reseed", rng_reseed, NULL, 293);
 
 	me.connected = false;
-	uplink_connect();
+	if (!handoff_restore())
+		uplink_connect();
 
 	/* main loop */
 	io_loop();
 
+#ifdef HAVE_EXECVE
+	/* leave the network to the new process rather than quitting it */
+	if ((runflags & (RF_RESTART | RF_HANDOFF)) == (RF_RESTART | RF_HANDOFF))
+		handoff_save();
+#endif
+
 	/* we're shutting down */
 	hook_call_shutdown();
 
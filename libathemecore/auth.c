@@ -42,6 +42,8 @@ void set_password(myuser_t *mu, const char *newpassword)
 		mu->flags &= ~MU_CRYPTPASS;			/* just in case */
 		mowgli_strlcpy(mu->pass, newpassword, PASSLEN);
 	}
+
+	myuser_journal(mu);
 }
 
 bool verify_password(myuser_t *mu, const char *password)
@@ -67,6 +69,7 @@ bool verify_password(myuser_t *mu, const char *password)
 					      ci->id, ci_default->id, entity(mu)->name);
 
 				mowgli_strlcpy(mu->pass, ci_default->crypt(password, ci_default->salt()), PASSLEN);
+				myuser_journal(mu);
 			}
 
 			return true;
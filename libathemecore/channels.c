@@ -22,6 +22,7 @@
  */
 
 #include "atheme.h"
+#include "internal.h"
 
 mowgli_patricia_t *chanlist;
 
@@ -383,6 +384,16 @@ chanuser_t *chanuser_add(channel_t *chan, const char *nick)
 	tcu = chanuser_find(chan, u);
 	if (tcu != NULL)
 	{
+		if (tcu->unconfirmed)
+		{
+			/* kept from before the uplink was lost; the burst
+			 * has its current status */
+			slog(LG_DEBUG, "chanuser_add(): %s -> %s was kept, confirmed", chan->name, u->nick);
+			tcu->unconfirmed = false;
+			tcu->modes = flags;
+			return tcu;
+		}
+
 		slog(LG_DEBUG, "chanuser_add(): user is already present: %s -> %s", chan->name, u->nick);
 
 		/* could be an OPME or other desyncher... */
@@ -436,7 +447,6 @@ chanuser_t *chanuser_add(channel_t *chan, const char *nick)
 void chanuser_delete(channel_t *chan, user_t *user)
 {
 	chanuser_t *cu;
-	hook_channel_joinpart_t hdata;
 
 	return_if_fail(chan != NULL);
 	return_if_fail(user != NULL);
@@ -445,11 +455,43 @@ void chanuser_delete(channel_t *chan, user_t *user)
 	if (cu == NULL)
 		return;
 
+	chanuser_unlink(cu);
+
+	if (chan->nummembers == 0 && !(chan->modes & ircd->perm_mode))
+	{
+		/* empty channels die */
+		slog(LG_DEBUG, "chanuser_delete(): `%s' is empty, removing", chan->name);
+
+		channel_delete(chan);
+	}
+}
+
+/*
+ * chanuser_unlink(chanuser_t *cu)
+ *
+ * Removes a user from a channel like chanuser_delete(), but leaves the
+ * channel in place if that empties it; the caller deals with that.
+ *
+ * Inputs:
+ *     - channel user object to remove
+ *
+ * Outputs:
+ *     - none
+ *
+ * Side Effects:
+ *     - the channel user object is freed
+ */
+void chanuser_unlink(chanuser_t *cu)
+{
+	channel_t *chan = cu->chan;
+	user_t *user = cu->user;
+	hook_channel_joinpart_t hdata;
+
 	/* this is called BEFORE we remove the user */
 	hdata.cu = cu;
 	hook_call_channel_part(&hdata);
 
-	slog(LG_DEBUG, "chanuser_delete(): %s -> %s (%d)", cu->chan->name, cu->user->nick, cu->chan->nummembers - 1);
+	slog(LG_DEBUG, "chanuser_delete(): %s -> %s (%d)", chan->name, user->nick, chan->nummembers - 1);
 
 	mowgli_node_delete(&cu->cnode, &chan->members);
 	mowgli_node_delete(&cu->unode, &user->channels);
@@ -458,14 +500,6 @@ void chanuser_delete(channel_t *chan, user_t *user)
 
 	chan->nummembers--;
 	cnt.chanuser--;
-
-	if (chan->nummembers == 0 && !(chan->modes & ircd->perm_mode))
-	{
-		/* empty channels die */
-		slog(LG_DEBUG, "chanuser_delete(): `%s' is empty, removing", chan->name);
-
-		channel_delete(chan);
-	}
 }
 
 /*
@@ -243,6 +243,20 @@ inet_pton6(const char *src, u_char *dst)
 	return (1);
 }
 
+/*
+ * cidr_parse_ip()
+ *
+ * Input - address, buffer of at least 16 bytes
+ * Output - the number of bits in the address (32 or 128), 0 if it is not one
+ */
+int cidr_parse_ip(const char *ip, unsigned char *addr)
+{
+	if (strchr(ip, ':'))
+		return inet_pton6(ip, addr) ? 128 : 0;
+
+	return inet_pton4(ip, addr) ? 32 : 0;
+}
+
 /*
  * match_ips()
  *
@@ -25,6 +25,7 @@
 #include "privs.h"
 
 static int text_to_parv(char *text, int maxparc, char **parv);
+static bool string_in_list(const char *str, const char *name);
 
 void command_add(command_t *cmd, mowgli_patricia_t *commandtree)
 {
@@ -50,6 +51,141 @@ command_t *command_find(mowgli_patricia_t *commandtree, const char *command)
 	return mowgli_patricia_retrieve(commandtree, command);
 }
 
+/*
+ * Every command run is timed and accounted under its service and command
+ * path, e.g. "chanserv SET FOUNDER"; subcommands are also counted in the
+ * time of the command that runs them.
+ */
+static mowgli_patricia_t *command_stats;
+static char command_path[BUFSIZE];
+
+/* commands whose arguments are not logged when they are slow */
+static const char *command_secret[] = {
+	"IDENTIFY", "ID", "LOGIN", "REGISTER", "GROUP", "DROP", "VERIFY",
+	"PASSWORD", "SETPASS", "RESETPASS", "SENDPASS",
+	"GHOST", "REGAIN", "RELEASE", "RECOVER", NULL
+};
+
+static unsigned long long command_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void command_account(const char *path, unsigned long long us)
+{
+	command_stats_t *st;
+	unsigned long long limit;
+	int i;
+
+	if (command_stats == NULL)
+		command_stats = mowgli_patricia_create(strcasecanon);
+
+	if ((st = mowgli_patricia_retrieve(command_stats, path)) == NULL)
+	{
+		st = scalloc(sizeof(command_stats_t), 1);
+		st->name = sstrdup(path);
+		mowgli_patricia_add(command_stats, path, st);
+	}
+
+	st->count++;
+	st->total_us += us;
+	if (us > st->max_us)
+		st->max_us = us > UINT_MAX ? UINT_MAX : us;
+
+	for (i = 0, limit = 10; i < COMMAND_STATS_BUCKETS - 1 && us >= limit; i++, limit *= 10)
+		;
+	st->histogram[i]++;
+}
+
+static bool command_is_secret(const char *path, const char *arg)
+{
+	const char **p;
+
+	for (p = command_secret; *p != NULL; p++)
+		if (string_in_list(path, *p) || (arg != NULL && !strcasecmp(arg, *p)))
+			return true;
+
+	return false;
+}
+
+/* the arguments a command was given, before it gets to tokenize them */
+static void command_args(const char *path, int parc, char *parv[], char *buf, size_t buflen)
+{
+	char *first = NULL, *p;
+	int i;
+
+	*buf = '\0';
+
+	if (parc > 0 && parv[0] != NULL)
+	{
+		first = sstrdup(parv[0]);
+		if ((p = strchr(first, ' ')) != NULL)
+			*p = '\0';
+	}
+
+	if (command_is_secret(path, first))
+		mowgli_strlcpy(buf, "<hidden>", buflen);
+	else
+	{
+		for (i = 0; i < parc && parv[i] != NULL; i++)
+		{
+			if (i > 0)
+				mowgli_strlcat(buf, " ", buflen);
+			mowgli_strlcat(buf, parv[i], buflen);
+		}
+	}
+
+	free(first);
+}
+
+/*
+ * command_stats_foreach()
+ *
+ * Calls a function for the statistics of every command run so far.
+ *
+ * inputs:
+ *       a callback and data to pass to it
+ *
+ * outputs:
+ *       none
+ *
+ * side effects:
+ *       none
+ */
+void command_stats_foreach(void (*cb)(command_stats_t *st, void *privdata), void *privdata)
+{
+	mowgli_patricia_iteration_state_t state;
+	command_stats_t *st;
+
+	return_if_fail(cb != NULL);
+
+	if (command_stats == NULL)
+		return;
+
+	MOWGLI_PATRICIA_FOREACH(st, &state, command_stats)
+		cb(st, privdata);
+}
+
+static void command_stats_free(const char *key, void *data, void *privdata)
+{
+	command_stats_t *st = data;
+
+	free(st->name);
+	free(st);
+}
+
+void command_stats_reset(void)
+{
+	if (command_stats == NULL)
+		return;
+
+	mowgli_patricia_destroy(command_stats, command_stats_free, NULL);
+	command_stats = NULL;
+}
+
 static bool permissive_mode_fallback = false;
 static bool default_command_authorize(service_t *svs, sourceinfo_t *si, command_t *c, const char *userlevel)
 {
@@ -83,6 +219,39 @@ static inline bool command_verify(service_t *svs, sourceinfo_t *si, command_t *c
 	return false;
 }
 
+static void command_run(service_t *svs, sourceinfo_t *si, command_t *c, int parc, char *parv[])
+{
+	char source[BUFSIZE], args[BUFSIZE];
+	size_t pathlen = strlen(command_path);
+	unsigned long long start, us;
+
+	if (pathlen == 0)
+		snprintf(command_path, sizeof command_path, "%s %s", svs->internal_name, c->name);
+	else
+	{
+		mowgli_strlcat(command_path, " ", sizeof command_path);
+		mowgli_strlcat(command_path, c->name, sizeof command_path);
+	}
+
+	/* the command may tokenize its arguments or kill its source */
+	if (config_options.command_slow_threshold != 0)
+	{
+		mowgli_strlcpy(source, get_source_name(si), sizeof source);
+		command_args(command_path, parc, parv, args, sizeof args);
+	}
+
+	start = command_now();
+	c->cmd(si, parc, parv);
+	us = command_now() - start;
+
+	command_account(command_path, us);
+
+	if (config_options.command_slow_threshold != 0 && us >= config_options.command_slow_threshold * 1000ULL)
+		slog(LG_INFO, "command_exec(): %s took %llu ms for %s: %s", command_path, us / 1000, source, args);
+
+	command_path[pathlen] = '\0';
+}
+
 void command_exec(service_t *svs, sourceinfo_t *si, command_t *c, int parc, char *parv[])
 {
 	const char *cmdaccess;
@@ -106,7 +275,7 @@ void command_exec(service_t *svs, sourceinfo_t *si, command_t *c, int parc, char
 			language_set_active(si->force_language);
 
 		si->command = c;
-		c->cmd(si, parc, parv);
+		command_run(svs, si, c, parc, parv);
 		language_set_active(NULL);
 		return;
 	}
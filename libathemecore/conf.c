@@ -201,6 +201,7 @@ void init_newconf(void)
 	add_dupstr_conf_item("NUMERIC", &conf_si_table, CONF_NO_REHASH, &me.numeric, NULL);
 	add_dupstr_conf_item("VHOST", &conf_si_table, CONF_NO_REHASH, &me.vhost, NULL);
 	add_duration_conf_item("RECONTIME", &conf_si_table, 0, &me.recontime, "s", 10);
+	add_duration_conf_item("RECONCILETIME", &conf_si_table, 0, &me.reconciletime, "s", 0);
 	add_duration_conf_item("RESTARTTIME", &conf_si_table, 0, &me.restarttime, "s", 0);
 	add_dupstr_conf_item("NETNAME", &conf_si_table, 0, &me.netname, NULL);
 	add_dupstr_conf_item("HIDEHOSTSUFFIX", &conf_si_table, 0, &me.hidehostsuffix, NULL);
@@ -244,8 +245,11 @@ void init_newconf(void)
 	add_uint_conf_item("DEFAULT_CLONE_WARN", &conf_gi_table, 0, &config_options.default_clone_warn, 1, INT_MAX, 5);
 	add_uint_conf_item("DEFAULT_CLONE_ALLOWED", &conf_gi_table, 0, &config_options.default_clone_allowed, 1, INT_MAX, 5);
 	add_bool_conf_item("CLONE_IDENTIFIED_INCREASE_LIMIT", &conf_gi_table, 0, &config_options.clone_increase, false);
+	add_dupstr_conf_item("CLONE_IPV4_PREFIXES", &conf_gi_table, 0, &config_options.clone_ipv4_prefixes, "32");
+	add_dupstr_conf_item("CLONE_IPV6_PREFIXES", &conf_gi_table, 0, &config_options.clone_ipv6_prefixes, "64");
 
 	add_uint_conf_item("UPLINK_SENDQ_LIMIT", &conf_gi_table, 0, &config_options.uplink_sendq_limit, 10240, INT_MAX, 1048576);
+	add_uint_conf_item("COMMAND_SLOW_THRESHOLD", &conf_gi_table, 0, &config_options.command_slow_threshold, 0, INT_MAX, 0);
 	add_dupstr_conf_item("LANGUAGE", &conf_gi_table, 0, &config_options.language, "en");
 	add_conf_item("EXEMPTS", &conf_gi_table, c_gi_exempts);
 	add_conf_item("IMMUNE_LEVEL", &conf_gi_table, c_gi_immune_level);
@@ -786,6 +790,7 @@ static int c_logfile(mowgli_config_file_entry_t *ce)
 static void copy_me(struct me *src, struct me *dst)
 {
 	dst->recontime = src->recontime;
+	dst->reconciletime = src->reconciletime;
 	dst->restarttime = src->restarttime;
 	dst->netname = sstrdup(src->netname);
 	dst->hidehostsuffix = sstrdup(src->hidehostsuffix);
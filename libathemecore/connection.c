@@ -241,6 +241,48 @@ void connection_close(connection_t *cptr)
 	free(cptr);
 }
 
+/*
+ * connection_release()
+ *
+ * inputs:
+ *       the connection being given up.
+ *
+ * outputs:
+ *       its file descriptor, which is left open.
+ *
+ * side effects:
+ *       the connection is forgotten without its close handler being called;
+ *       anything still on its queues is lost.
+ */
+int connection_release(connection_t *cptr)
+{
+	mowgli_node_t *nptr;
+	int fd;
+
+	return_val_if_fail(cptr != NULL, -1);
+
+	nptr = mowgli_node_find(cptr, &connection_list);
+	if (!nptr)
+	{
+		slog(LG_ERROR, "connection_release(): connection %p is not registered!",
+			cptr);
+		return -1;
+	}
+
+	fd = cptr->fd;
+
+	mowgli_pollable_destroy(base_eventloop, cptr->pollable);
+
+	mowgli_node_delete(nptr, &connection_list);
+	mowgli_node_free(nptr);
+
+	sendqrecvq_free(cptr);
+
+	free(cptr);
+
+	return fd;
+}
+
 /* This one is only safe for use by connection_close_soon(),
  * it will cause infinite loops otherwise
  */
@@ -667,8 +709,8 @@ void connection_setselect_write(connection_t *cptr,
 void connection_stats(void (*stats_cb)(const char *, void *), void *privdata)
 {
 	mowgli_node_t *n;
-	char buf[160];
-	char buf2[20];
+	char buf[300];
+	char buf2[100];
 
 	MOWGLI_ITER_FOREACH(n, connection_list.head)
 	{
@@ -694,6 +736,13 @@ void connection_stats(void (*stats_cb)(const char *, void *), void *privdata)
 			else if (c->flags & CF_SEND_EOF)
 				mowgli_strlcat(buf, " send_eof", sizeof buf);
 		}
+		if (c->sendq_total != 0)
+		{
+			snprintf(buf2, sizeof buf2, " sendq %zu peak %zu queued %llu writes %u",
+					c->sendq_len, c->sendq_peak,
+					(unsigned long long)c->sendq_total, c->sendq_writes);
+			mowgli_strlcat(buf, buf2, sizeof buf);
+		}
 		stats_cb(buf, privdata);
 	}
 }
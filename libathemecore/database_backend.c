@@ -9,6 +9,32 @@
 
 database_module_t *db_mod = NULL;
 mowgli_patricia_t *db_types = NULL;
+database_save_stats_t db_save_stats;
+database_handle_t *db_journal = NULL;
+
+/*
+ * Handlers of recently seen row types. Loading a database looks up
+ * millions of rows, nearly all of a dozen types, so keep those out of
+ * the patricia. Emptied whenever a handler is (un)registered.
+ */
+#define DB_TYPE_CACHE_SIZE	64
+#define DB_TYPE_CACHE_KEYLEN	16
+
+static struct {
+	char type[DB_TYPE_CACHE_KEYLEN];
+	database_handler_f fun;
+} db_type_cache[DB_TYPE_CACHE_SIZE];
+
+static unsigned int
+db_type_hash(const char *type)
+{
+	unsigned int h = 0;
+
+	for (; *type != '\0'; type++)
+		h = h * 31 + (unsigned char) *type;
+
+	return h % DB_TYPE_CACHE_SIZE;
+}
 
 database_handle_t *
 db_open(const char *filename, database_transaction_t txn)
@@ -235,6 +261,7 @@ db_register_type_handler(const char *type, database_handler_f fun)
 	return_if_fail(fun != NULL);
 
 	mowgli_patricia_add(db_types, type, fun);
+	memset(db_type_cache, 0, sizeof db_type_cache);
 }
 
 void
@@ -244,23 +271,37 @@ db_unregister_type_handler(const char *type)
 	return_if_fail(type != NULL);
 
 	mowgli_patricia_delete(db_types, type);
+	memset(db_type_cache, 0, sizeof db_type_cache);
 }
 
 void
 db_process(database_handle_t *db, const char *type)
 {
 	database_handler_f fun;
+	unsigned int h;
 
 	return_if_fail(db_types != NULL);
 	return_if_fail(db != NULL);
 	return_if_fail(type != NULL);
 
+	h = db_type_hash(type);
+	if (db_type_cache[h].fun != NULL && !strcmp(db_type_cache[h].type, type))
+	{
+		db_type_cache[h].fun(db, type);
+		return;
+	}
+
 	fun = mowgli_patricia_retrieve(db_types, type);
 
 	if (!fun)
 	{
 		fun = mowgli_patricia_retrieve(db_types, "???");
 	}
+	else if (strlen(type) < DB_TYPE_CACHE_KEYLEN)
+	{
+		mowgli_strlcpy(db_type_cache[h].type, type, DB_TYPE_CACHE_KEYLEN);
+		db_type_cache[h].fun = fun;
+	}
 
 	fun(db, type);
 }
@@ -278,6 +319,22 @@ db_write_format(database_handle_t *db, const char *fmt, ...)
 	return db_write_word(db, buf);
 }
 
+/*
+ * Starts a row in the change journal, if the backend keeps one. The
+ * row is written with the normal db_write_*() functions on db_journal
+ * and finished with db_commit_row(db_journal). The backend replays
+ * journal rows over the last full save when loading, and only opens the
+ * journal afterwards, so nothing done by the loader is journaled again.
+ */
+bool
+db_journal_start_row(const char *type)
+{
+	if (db_journal == NULL)
+		return false;
+
+	return db_start_row(db_journal, type);
+}
+
 void
 db_init(void)
 {
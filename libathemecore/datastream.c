@@ -24,7 +24,22 @@
 #include "atheme.h"
 #include "datastream.h"
 
+#ifdef HAVE_WRITEV
+# include <sys/uio.h>
+#endif
+
 #define SENDQSIZE (4096 - 40)
+#define RECVQSIZE 16384
+
+/* chunks passed to one writev() */
+#if defined(IOV_MAX) && IOV_MAX < 64
+# define SENDQ_IOVECS IOV_MAX
+#else
+# define SENDQ_IOVECS 64
+#endif
+
+/* free chunks kept for reuse, about 256 KB */
+#define SENDQ_POOL_MAX 64
 
 #ifdef _WIN32
 # define EWOULDBLOCK	WSAEWOULDBLOCK
@@ -40,6 +55,45 @@ struct sendq {
 	char buf[SENDQSIZE];
 };
 
+static mowgli_list_t sendq_pool;
+unsigned int sendq_pool_allocs;	/* chunks that had to be allocated */
+
+static struct sendq *sendq_chunk_get(void)
+{
+	struct sendq *sq;
+	mowgli_node_t *n;
+
+	if ((n = sendq_pool.head) != NULL)
+	{
+		sq = n->data;
+		mowgli_node_delete(n, &sendq_pool);
+	}
+	else
+	{
+		sq = smalloc(sizeof(struct sendq));
+		sendq_pool_allocs++;
+	}
+
+	sq->firstused = sq->firstfree = 0;
+	return sq;
+}
+
+static void sendq_chunk_put(struct sendq *sq)
+{
+	if (MOWGLI_LIST_LENGTH(&sendq_pool) >= SENDQ_POOL_MAX)
+	{
+		free(sq);
+		return;
+	}
+
+	mowgli_node_add(sq, &sq->node, &sendq_pool);
+}
+
+unsigned int sendq_pool_length(void)
+{
+	return MOWGLI_LIST_LENGTH(&sendq_pool);
+}
+
 void sendq_add(connection_t * cptr, char *buf, size_t len)
 {
 	mowgli_node_t *n;
@@ -58,8 +112,7 @@ void sendq_add(connection_t * cptr, char *buf, size_t len)
 	if (len == 0)
 		return;
 
-	if (cptr->sendq_limit != 0 &&
-			MOWGLI_LIST_LENGTH(&cptr->sendq) * SENDQSIZE + len > cptr->sendq_limit)
+	if (cptr->sendq_limit != 0 && cptr->sendq_len + len > cptr->sendq_limit)
 	{
 		slog(LG_INFO, "sendq_add(): sendq limit exceeded on connection %s[%d]",
 				cptr->name, cptr->fd);
@@ -70,6 +123,11 @@ void sendq_add(connection_t * cptr, char *buf, size_t len)
 	if (!sendq_nonempty(cptr))
 		connection_setselect_write(cptr, sendq_flush);
 
+	cptr->sendq_len += len;
+	cptr->sendq_total += len;
+	if (cptr->sendq_len > cptr->sendq_peak)
+		cptr->sendq_peak = cptr->sendq_len;
+
 	n = cptr->sendq.tail;
 	if (n != NULL)
 	{
@@ -85,8 +143,7 @@ void sendq_add(connection_t * cptr, char *buf, size_t len)
 
 	while (len > 0)
 	{
-		sq = smalloc(sizeof(struct sendq));
-		sq->firstused = sq->firstfree = 0;
+		sq = sendq_chunk_get();
 		mowgli_node_add(sq, &sq->node, &cptr->sendq);
 		l = SENDQSIZE - sq->firstfree;
 		if (l > len)
@@ -114,24 +171,52 @@ void sendq_add_eof(connection_t * cptr)
 
 void sendq_flush(connection_t * cptr)
 {
-        mowgli_node_t *n, *tn;
-        struct sendq *sq;
-        int l;
+	mowgli_node_t *n, *tn;
+	struct sendq *sq;
+	ssize_t l;
+	size_t ll, want;
+	bool partial;
+#ifdef HAVE_WRITEV
+	struct iovec iov[SENDQ_IOVECS];
+	int iovcnt;
+#endif
 
 	return_if_fail(cptr != NULL);
 
-        MOWGLI_ITER_FOREACH_SAFE(n, tn, cptr->sendq.head)
-        {
-                sq = (struct sendq *)n->data;
+	while (cptr->sendq_len > 0)
+	{
+#ifdef HAVE_WRITEV
+		/* gather as many chunks as one call takes */
+		iovcnt = 0;
+		want = 0;
+		MOWGLI_ITER_FOREACH(n, cptr->sendq.head)
+		{
+			sq = n->data;
 
-                if (sq->firstused == sq->firstfree)
-                        break;
+			if (sq->firstused == sq->firstfree)
+				continue;
+			if (iovcnt == SENDQ_IOVECS)
+				break;
 
-                if ((l = send(cptr->fd, sq->buf + sq->firstused, sq->firstfree - sq->firstused, 0)) == -1)
-                {
-                        int err = ioerrno();
+			iov[iovcnt].iov_base = sq->buf + sq->firstused;
+			iov[iovcnt].iov_len = sq->firstfree - sq->firstused;
+			want += iov[iovcnt].iov_len;
+			iovcnt++;
+		}
+
+		l = writev(cptr->fd, iov, iovcnt);
+#else
+		sq = cptr->sendq.head->data;
+		want = sq->firstfree - sq->firstused;
+		l = send(cptr->fd, sq->buf + sq->firstused, want, 0);
+#endif
+		cptr->sendq_writes++;
+
+		if (l == -1)
+		{
+			int err = ioerrno();
 
-                        if (!mowgli_eventloop_ignore_errno(err))
+			if (!mowgli_eventloop_ignore_errno(err))
 			{
 				slog(LG_DEBUG, "sendq_flush(): write error %d (%s) on connection %s[%d]",
 						err, strerror(err),
@@ -139,24 +224,35 @@ void sendq_flush(connection_t * cptr)
 				cptr->flags |= CF_DEAD;
 			}
 
-                        return;
-                }
+			return;
+		}
+
+		cptr->sendq_len -= l;
 
-                sq->firstused += l;
-                if (sq->firstused == sq->firstfree)
-                {
-			if (MOWGLI_LIST_LENGTH(&cptr->sendq) > 1)
+		/* if not all went out, the socket buffer is full; wait until it drains */
+		partial = (size_t)l < want;
+
+		/* give back the chunks that went out completely */
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, cptr->sendq.head)
+		{
+			sq = n->data;
+
+			ll = sq->firstfree - sq->firstused;
+			if ((size_t)l < ll)
 			{
-                        	mowgli_node_delete(&sq->node, &cptr->sendq);
-                        	free(sq);
+				sq->firstused += l;
+				break;
 			}
-			else
-				/* keep one struct sendq */
-				sq->firstused = sq->firstfree = 0;
-                }
-                else
-                        return;
-        }
+
+			l -= ll;
+			mowgli_node_delete(&sq->node, &cptr->sendq);
+			sendq_chunk_put(sq);
+		}
+
+		if (partial)
+			return;
+	}
+
 	if (cptr->flags & CF_SEND_EOF)
 	{
 		/* shut down write end, kill entire connection
@@ -173,18 +269,11 @@ void sendq_flush(connection_t * cptr)
 
 bool sendq_nonempty(connection_t *cptr)
 {
-	mowgli_node_t *n;
-	struct sendq *sq;
-
 	if (cptr->flags & CF_SEND_DEAD)
 		return false;
 	if (cptr->flags & CF_SEND_EOF)
 		return true;
-	n = cptr->sendq.head;
-	if (n == NULL)
-		return false;
-	sq = n->data;
-	return sq->firstfree > sq->firstused;
+	return cptr->sendq_len > 0;
 }
 
 void sendq_set_limit(connection_t *cptr, size_t len)
@@ -194,22 +283,49 @@ void sendq_set_limit(connection_t *cptr, size_t len)
 
 int recvq_length(connection_t *cptr)
 {
-	int l = 0;
-	mowgli_node_t *n;
-	struct sendq *sq;
+	return cptr->recvq.end - cptr->recvq.start;
+}
 
-	MOWGLI_ITER_FOREACH(n, cptr->recvq.head)
+/* makes room for at least RECVQSIZE more bytes after the end of the data */
+static void recvq_reserve(recvq_t *rq)
+{
+	size_t used = rq->end - rq->start;
+
+	if (rq->size - rq->end >= RECVQSIZE)
+		return;
+
+	/* what is left is usually part of a line, so moving it is cheap */
+	if (rq->start > 0)
 	{
-		sq = n->data;
-		l += sq->firstfree - sq->firstused;
+		memmove(rq->buf, rq->buf + rq->start, used);
+		rq->start = 0;
+		rq->end = used;
 	}
-	return l;
+
+	if (rq->size - rq->end >= RECVQSIZE)
+		return;
+
+	rq->size = rq->size ? rq->size * 2 : RECVQSIZE;
+	rq->buf = srealloc(rq->buf, rq->size);
+}
+
+/* takes len bytes off the front of the recvq */
+static char *recvq_take(recvq_t *rq, size_t len)
+{
+	char *p = rq->buf + rq->start;
+
+	rq->start += len;
+
+	/* nothing in use; the bytes stay valid until the next recvq_put() */
+	if (rq->start == rq->end)
+		rq->start = rq->end = 0;
+
+	return p;
 }
 
 void recvq_put(connection_t *cptr)
 {
-	mowgli_node_t *n;
-	struct sendq *sq = NULL;
+	recvq_t *rq;
 	int l, ll;
 
 	return_if_fail(cptr != NULL);
@@ -228,24 +344,12 @@ void recvq_put(connection_t *cptr)
 		return;
 	}
 
-	n = cptr->recvq.tail;
-	if (n != NULL)
-	{
-		sq = n->data;
-		l = SENDQSIZE - sq->firstfree;
-		if (l == 0)
-			sq = NULL;
-	}
-	if (sq == NULL)
-	{
-		sq = smalloc(sizeof(struct sendq));
-		sq->firstused = sq->firstfree = 0;
-		mowgli_node_add(sq, &sq->node, &cptr->recvq);
-		l = SENDQSIZE;
-	}
+	rq = &cptr->recvq;
+	recvq_reserve(rq);
+
 	errno = 0;
 
-	l = recv(cptr->fd, sq->buf + sq->firstfree, l, 0);
+	l = recv(cptr->fd, rq->buf + rq->end, rq->size - rq->end, 0);
 	if (l == 0 || (l < 0 && !mowgli_eventloop_ignore_errno(ioerrno())))
 	{
 		if (l == 0)
@@ -256,7 +360,7 @@ void recvq_put(connection_t *cptr)
 		return;
 	}
 	else if (l > 0)
-		sq->firstfree += l;
+		rq->end += l;
 
 	if (cptr->recvq_handler)
 	{
@@ -271,101 +375,103 @@ void recvq_put(connection_t *cptr)
 	return;
 }
 
-int recvq_get(connection_t *cptr, char *buf, size_t len)
+/* puts back bytes that an earlier process received but did not handle */
+void recvq_restore(connection_t *cptr, const char *buf, size_t len)
 {
-	mowgli_node_t *n, *tn;
-	struct sendq *sq;
+	recvq_t *rq;
 	size_t l;
-	char *p = buf;
-
-	return_val_if_fail(cptr != NULL, 0);
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, cptr->recvq.head)
-	{
-		sq = (struct sendq *)n->data;
+	return_if_fail(cptr != NULL);
 
-		if (sq->firstused == sq->firstfree || len <= 0)
-			break;
+	rq = &cptr->recvq;
 
-		l = sq->firstfree - sq->firstused;
+	while (len > 0)
+	{
+		recvq_reserve(rq);
+		l = rq->size - rq->end;
 		if (l > len)
 			l = len;
-		memcpy(p, sq->buf + sq->firstused, l);
-
-		p += l;
+		memcpy(rq->buf + rq->end, buf, l);
+		rq->end += l;
+		buf += l;
 		len -= l;
-		sq->firstused += l;
-		if (sq->firstused == sq->firstfree)
-		{
-			if (MOWGLI_LIST_LENGTH(&cptr->recvq) > 1)
-			{
-				mowgli_node_delete(&sq->node, &cptr->recvq);
-				free(sq);
-			}
-			else
-				/* keep one struct sendq */
-				sq->firstused = sq->firstfree = 0;
-		}
-		else
-			return p - buf;
 	}
-	return p - buf;
 }
 
-int recvq_getline(connection_t *cptr, char *buf, size_t len)
+int recvq_get(connection_t *cptr, char *buf, size_t len)
 {
-	mowgli_node_t *n, *tn;
-	struct sendq *sq, *sq2 = NULL;
-	size_t l = 0;
-	char *p = buf;
-	char *newline = NULL;
+	size_t l;
 
 	return_val_if_fail(cptr != NULL, 0);
 
-	MOWGLI_ITER_FOREACH(n, cptr->recvq.head)
+	l = recvq_length(cptr);
+	if (l > len)
+		l = len;
+
+	memcpy(buf, recvq_take(&cptr->recvq, l), l);
+
+	return l;
+}
+
+/*
+ * recvq_nextline()
+ *
+ * Takes the next line off the recvq without copying it.
+ *
+ * inputs:
+ *       a connection, the longest line to return and where to store its
+ *       length
+ *
+ * outputs:
+ *       a pointer to the line, including its newline if it has one, or
+ *       NULL if no complete line was received yet; the line stays valid
+ *       until the next recvq_put() on the connection
+ *
+ * side effects:
+ *       if the line is longer than maxlen, its first maxlen bytes are
+ *       returned and CF_NONEWLINE is set until its end is taken
+ */
+char *recvq_nextline(connection_t *cptr, size_t maxlen, size_t *len)
+{
+	recvq_t *rq;
+	char *newline;
+	size_t l;
+
+	return_val_if_fail(cptr != NULL, NULL);
+
+	rq = &cptr->recvq;
+	l = rq->end - rq->start;
+	if (l > maxlen)
+		l = maxlen;
+
+	newline = memchr(rq->buf + rq->start, '\n', l);
+	if (newline != NULL)
 	{
-		sq2 = n->data;
-		l += sq2->firstfree - sq2->firstused;
-		newline = memchr(sq2->buf + sq2->firstused, '\n', sq2->firstfree - sq2->firstused);
-		if (newline != NULL || l >= len)
-			break;
+		cptr->flags &= ~CF_NONEWLINE;
+		l = newline - (rq->buf + rq->start) + 1;
 	}
-	if (newline == NULL && l < len)
-		return 0;
+	else if (l < maxlen || l == 0)
+		return NULL;
+	else
+		cptr->flags |= CF_NONEWLINE;
 
-	cptr->flags |= CF_NONEWLINE;
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, cptr->recvq.head)
-	{
-		sq = (struct sendq *)n->data;
+	*len = l;
+	return recvq_take(rq, l);
+}
 
-		if (sq->firstused == sq->firstfree || len <= 0)
-			break;
+int recvq_getline(connection_t *cptr, char *buf, size_t len)
+{
+	char *line;
+	size_t l;
 
-		l = sq->firstfree - sq->firstused;
-		if (l > len)
-			l = len;
-		if (sq == sq2 && l >= (size_t) (newline - sq->buf - sq->firstused + 1))
-			cptr->flags &= ~CF_NONEWLINE, l = newline - sq->buf - sq->firstused + 1;
-		memcpy(p, sq->buf + sq->firstused, l);
+	return_val_if_fail(cptr != NULL, 0);
 
-		p += l;
-		len -= l;
-		sq->firstused += l;
-		if (sq->firstused == sq->firstfree)
-		{
-			if (MOWGLI_LIST_LENGTH(&cptr->recvq) > 1)
-			{
-				mowgli_node_delete(&sq->node, &cptr->recvq);
-				free(sq);
-			}
-			else
-				/* keep one struct sendq */
-				sq->firstused = sq->firstfree = 0;
-		}
-		else
-			return p - buf;
-	}
-	return p - buf;
+	if ((line = recvq_nextline(cptr, len, &l)) == NULL)
+		return 0;
+
+	memcpy(buf, line, l);
+
+	return l;
 }
 
 void sendqrecvq_free(connection_t *cptr)
@@ -373,21 +479,18 @@ void sendqrecvq_free(connection_t *cptr)
 	mowgli_node_t *nptr, *nptr2;
 	struct sendq *sq;
 
-	MOWGLI_ITER_FOREACH_SAFE(nptr, nptr2, cptr->recvq.head)
-	{
-		sq = nptr->data;
-
-		mowgli_node_delete(&sq->node, &cptr->recvq);
-		free(sq);
-	}
+	free(cptr->recvq.buf);
+	memset(&cptr->recvq, 0, sizeof cptr->recvq);
 
 	MOWGLI_ITER_FOREACH_SAFE(nptr, nptr2, cptr->sendq.head)
 	{
 		sq = nptr->data;
 
 		mowgli_node_delete(&sq->node, &cptr->sendq);
-		free(sq);
+		sendq_chunk_put(sq);
 	}
+
+	cptr->sendq_len = 0;
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
@@ -0,0 +1,848 @@
+/*
+ * atheme-services: A collection of minimalist IRC services
+ * handoff.c: Restarting without leaving the network
+ *
+ * Copyright (c) 2026 Atheme Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * A handoff restart (OS RESTART HANDOFF) writes what is known about the
+ * network to an unlinked temporary file and leaves it and the socket to
+ * the uplink open across the exec. The new process loads its
+ * configuration and database as usual, but instead of linking it reads
+ * the file back and carries on with the existing link: the uplink sees
+ * no split and no burst.
+ *
+ * Protocol modules learn how to talk to the uplink during the handshake,
+ * so the lines received before the uplink introduced itself are kept and
+ * parsed again by the new process first; anything that would be sent
+ * while doing so is dropped. Hooks are not called while the network is
+ * taken over; handoff_restored is called once it is done.
+ *
+ * Services clients are matched by nick and keep their UIDs. Ones that
+ * are gone are quit and new ones are introduced.
+ */
+
+#include "atheme.h"
+#include "uplink.h"
+#include "datastream.h"
+#include "internal.h"
+
+#include <poll.h>
+
+#define HANDOFF_ENV		"ATHEME_HANDOFF"
+#define HANDOFF_VERSION		1
+#define HANDOFF_MAXRECORD	128
+
+/* the uplink's handshake, as received */
+static mowgli_list_t handshake;
+static bool handshake_overflow;
+
+/* a services client of the earlier process */
+typedef struct {
+	char *nick;
+	char *user;
+	char *host;
+	char *gecos;
+	char *uid;
+	time_t ts;
+	bool matched;
+	mowgli_node_t node;
+} handoff_client_t;
+
+typedef struct {
+	FILE *f;
+	server_t **servers;
+	unsigned int nservers, maxservers;
+	channel_t *chan;
+	mowgli_list_t clients;
+	char *lastuid;
+	char *recvq;
+	size_t recvqlen;
+	unsigned int users;
+} handoff_state_t;
+
+/*
+ * handoff_record()
+ *
+ * Keeps a line of the uplink's handshake.
+ *
+ * inputs:
+ *       a line received before the uplink introduced itself
+ *
+ * outputs:
+ *       none
+ *
+ * side effects:
+ *       the line is written out by a handoff restart
+ */
+void handoff_record(const char *line)
+{
+	if (MOWGLI_LIST_LENGTH(&handshake) >= HANDOFF_MAXRECORD)
+	{
+		handshake_overflow = true;
+		return;
+	}
+
+	mowgli_node_add(sstrdup(line), mowgli_node_create(), &handshake);
+}
+
+/* forgets the handshake of an earlier link */
+void handoff_forget(void)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, handshake.head)
+	{
+		free(n->data);
+		mowgli_node_delete(n, &handshake);
+		mowgli_node_free(n);
+	}
+
+	handshake_overflow = false;
+}
+
+/* sends what is queued for the uplink, waiting for it if need be */
+static bool handoff_flush(connection_t *cptr)
+{
+	struct pollfd pfd;
+	unsigned int tries;
+
+	for (tries = 0; sendq_nonempty(cptr); tries++)
+	{
+		if (tries == 20 || cptr->flags & CF_DEAD)
+			return false;
+
+		sendq_flush(cptr);
+
+		if (sendq_nonempty(cptr))
+		{
+			pfd.fd = cptr->fd;
+			pfd.events = POLLOUT;
+			poll(&pfd, 1, 500);
+		}
+	}
+
+	return !(cptr->flags & CF_DEAD);
+}
+
+static const char *handoff_opt(const char *s)
+{
+	return s != NULL ? s : "*";
+}
+
+static void handoff_write_user(FILE *f, user_t *u, unsigned int server)
+{
+	fprintf(f, "U %u %lu %u %s %s %s %s %s %s %s %s %s :%s\n",
+			server, (unsigned long)u->ts,
+			u->flags & ~(UF_NETSPLIT | UF_UNCONFIRMED | UF_RECONCILED),
+			u->nick, u->user, u->host, u->vhost, u->chost,
+			handoff_opt(u->ip), handoff_opt(u->uid),
+			u->myuser != NULL ? entity(u->myuser)->name : "*",
+			handoff_opt(u->certfp), u->gecos);
+}
+
+/* writes a server, the users on it and the servers behind it */
+static void handoff_write_server(FILE *f, server_t *s, unsigned int uplink, unsigned int *next)
+{
+	mowgli_node_t *n;
+	unsigned int idx = (*next)++;
+
+	if (s != me.me)
+		fprintf(f, "S %u %u %u %u %lu %s %s :%s\n",
+				idx, uplink, s->hops, s->flags & ~SF_UNCONFIRMED,
+				(unsigned long)s->connected_since,
+				handoff_opt(s->sid),
+				s->flags & SF_MASKED ? "*" : s->name, s->desc);
+
+	MOWGLI_ITER_FOREACH(n, s->userlist.head)
+		handoff_write_user(f, n->data, idx);
+
+	MOWGLI_ITER_FOREACH(n, s->children.head)
+		handoff_write_server(f, n->data, idx, next);
+}
+
+static void handoff_write_channel(FILE *f, channel_t *c)
+{
+	mowgli_node_t *n;
+	chanban_t *cb;
+	chanuser_t *cu;
+	size_t i;
+
+	fprintf(f, "C %lu %u %u %u %s %s\n",
+			(unsigned long)c->ts, c->modes, c->limit, c->flags,
+			c->name, handoff_opt(c->key));
+
+	for (i = 0; i < ignore_mode_list_size; i++)
+		if (c->extmodes[i] != NULL)
+			fprintf(f, "X %zu %s\n", i, c->extmodes[i]);
+
+	if (c->topic != NULL)
+		fprintf(f, "T %lu %s :%s\n", (unsigned long)c->topicts,
+				handoff_opt(c->topic_setter), c->topic);
+
+	MOWGLI_ITER_FOREACH(n, c->bans.head)
+	{
+		cb = n->data;
+		fprintf(f, "B %c %s\n", cb->type, cb->mask);
+	}
+
+	MOWGLI_ITER_FOREACH(n, c->members.head)
+	{
+		cu = n->data;
+		fprintf(f, "M %u %s\n", cu->modes, cu->user->nick);
+	}
+}
+
+/*
+ * handoff_save()
+ *
+ * Prepares a handoff restart.
+ *
+ * inputs:
+ *       none
+ *
+ * outputs:
+ *       true if the network can be handed over, false to restart as usual
+ *
+ * side effects:
+ *       the state is written to a temporary file; it and the uplink's
+ *       socket are left open for the new process, which finds them in
+ *       the environment; services are no longer linked
+ */
+bool handoff_save(void)
+{
+	mowgli_patricia_iteration_state_t state;
+	mowgli_node_t *n;
+	connection_t *cptr;
+	channel_t *c;
+	FILE *f;
+	const char *uid;
+	char env[32];
+	unsigned int next = 0;
+	int l, fd;
+
+	if (!me.connected || !me.recvsvr || me.bursting || curr_uplink == NULL ||
+			curr_uplink->conn == NULL || handshake_overflow ||
+			MOWGLI_LIST_LENGTH(&handshake) == 0)
+	{
+		slog(LG_INFO, "handoff_save(): not linked to a network, restarting as usual");
+		return false;
+	}
+
+	cptr = curr_uplink->conn;
+
+	if (!handoff_flush(cptr))
+	{
+		slog(LG_ERROR, "handoff_save(): cannot flush the sendq to the uplink, restarting as usual");
+		return false;
+	}
+
+	if ((f = tmpfile()) == NULL)
+	{
+		slog(LG_ERROR, "handoff_save(): cannot create a temporary file: %s", strerror(errno));
+		return false;
+	}
+
+	fprintf(f, "HANDOFF %d %s %s %s\n", HANDOFF_VERSION, me.name,
+			handoff_opt(me.numeric), curr_uplink->name);
+	fprintf(f, "IRCD :%s\n", ircd->ircdname);
+
+	/* where the UID generator is */
+	if (ircd->uses_uid && (uid = uid_get()) != NULL)
+		fprintf(f, "UID %s\n", uid);
+
+	MOWGLI_ITER_FOREACH(n, handshake.head)
+		fprintf(f, "L :%s\n", (const char *)n->data);
+
+	handoff_write_server(f, me.me, 0, &next);
+
+	MOWGLI_PATRICIA_FOREACH(c, &state, chanlist)
+		handoff_write_channel(f, c);
+
+	/* what was received after the last complete line */
+	l = recvq_length(cptr);
+	fprintf(f, "Q %d\n", l);
+	if (l > 0)
+		fwrite(cptr->recvq.buf + cptr->recvq.start, 1, l, f);
+
+	fprintf(f, "END\n");
+
+	if (fflush(f) != 0 || ferror(f))
+	{
+		slog(LG_ERROR, "handoff_save(): cannot write the state: %s", strerror(errno));
+		fclose(f);
+		return false;
+	}
+	rewind(f);
+
+	fd = connection_release(cptr);
+	curr_uplink->conn = NULL;
+	me.connected = false;
+
+	/* both have to survive the exec */
+	fcntl(fileno(f), F_SETFD, 0);
+	fcntl(fd, F_SETFD, 0);
+
+	snprintf(env, sizeof env, "%d:%d", fileno(f), fd);
+	setenv(HANDOFF_ENV, env, 1);
+
+	slog(LG_INFO, "handoff_save(): handing over %u servers, %u users and %u channels",
+			cnt.server, cnt.user, cnt.chan);
+
+	return true;
+}
+
+/* takes the next word of a line; one starting with ':' is the rest of it */
+static char *handoff_token(char **p)
+{
+	char *t = *p;
+
+	if (t == NULL || *t == '\0')
+		return NULL;
+
+	if (*t == ':')
+	{
+		*p = NULL;
+		return t + 1;
+	}
+
+	if ((*p = strchr(t, ' ')) != NULL)
+		*(*p)++ = '\0';
+
+	return t;
+}
+
+static const char *handoff_null(const char *s)
+{
+	return s == NULL || !strcmp(s, "*") ? NULL : s;
+}
+
+static bool handoff_read_server(handoff_state_t *hs, char *p)
+{
+	char *idx, *up, *hops, *flags, *since, *sid, *name, *desc;
+	server_t *s = NULL, *uplink;
+
+	idx = handoff_token(&p);
+	up = handoff_token(&p);
+	hops = handoff_token(&p);
+	flags = handoff_token(&p);
+	since = handoff_token(&p);
+	sid = handoff_token(&p);
+	name = handoff_token(&p);
+	desc = handoff_token(&p);
+
+	if (desc == NULL || strtoul(idx, NULL, 10) != hs->nservers ||
+			strtoul(up, NULL, 10) >= hs->nservers)
+		return false;
+
+	uplink = hs->servers[strtoul(up, NULL, 10)];
+
+	/* the uplink itself is back from the handshake */
+	if (ircd->uses_uid && handoff_null(sid) != NULL)
+		s = server_find(sid);
+	if (s == NULL && handoff_null(name) != NULL)
+		s = server_find(name);
+	if (s == NULL)
+		s = server_add(handoff_null(name), atoi(hops), uplink, handoff_null(sid), desc);
+	if (s == NULL)
+		return false;
+
+	s->flags = strtoul(flags, NULL, 10);
+	s->connected_since = strtoul(since, NULL, 10);
+
+	if (hs->nservers == hs->maxservers)
+	{
+		hs->maxservers *= 2;
+		hs->servers = srealloc(hs->servers, hs->maxservers * sizeof(server_t *));
+	}
+	hs->servers[hs->nservers++] = s;
+
+	return true;
+}
+
+static bool handoff_read_user(handoff_state_t *hs, char *p)
+{
+	char *server, *ts, *flags, *nick, *user, *host, *vhost, *chost, *ip, *uid, *account, *certfp, *gecos;
+	handoff_client_t *hc;
+	myuser_t *mu;
+	user_t *u;
+	server_t *s;
+
+	server = handoff_token(&p);
+	ts = handoff_token(&p);
+	flags = handoff_token(&p);
+	nick = handoff_token(&p);
+	user = handoff_token(&p);
+	host = handoff_token(&p);
+	vhost = handoff_token(&p);
+	chost = handoff_token(&p);
+	ip = handoff_token(&p);
+	uid = handoff_token(&p);
+	account = handoff_token(&p);
+	certfp = handoff_token(&p);
+	gecos = handoff_token(&p);
+
+	if (gecos == NULL || strtoul(server, NULL, 10) >= hs->nservers)
+		return false;
+
+	s = hs->servers[strtoul(server, NULL, 10)];
+
+	/* services clients are matched up once everything is there */
+	if (s == me.me)
+	{
+		hc = smalloc(sizeof(handoff_client_t));
+		hc->nick = sstrdup(nick);
+		hc->user = sstrdup(user);
+		hc->host = sstrdup(host);
+		hc->gecos = sstrdup(gecos);
+		hc->uid = handoff_null(uid) != NULL ? sstrdup(uid) : NULL;
+		hc->ts = strtoul(ts, NULL, 10);
+		hc->matched = false;
+		mowgli_node_add(hc, &hc->node, &hs->clients);
+		return true;
+	}
+
+	u = user_add(nick, user, host, vhost, handoff_null(ip), handoff_null(uid), gecos, s, strtoul(ts, NULL, 10));
+	if (u == NULL)
+		return false;
+
+	if (strcmp(u->chost, chost))
+	{
+		strshare_unref(u->chost);
+		u->chost = strshare_get(chost);
+	}
+	u->flags = strtoul(flags, NULL, 10);
+
+	if (handoff_null(certfp) != NULL)
+		u->certfp = sstrdup(certfp);
+
+	if (handoff_null(account) != NULL)
+	{
+		if ((mu = myuser_find(account)) != NULL)
+		{
+			u->myuser = mu;
+			mowgli_node_add(u, mowgli_node_create(), &mu->logins);
+		}
+		else
+			slog(LG_INFO, "handoff_restore(): %s was logged in to %s, which no longer exists", u->nick, account);
+	}
+
+	hs->users++;
+
+	return true;
+}
+
+static bool handoff_read_channel(handoff_state_t *hs, const char *type, char *p)
+{
+	char *a, *b, *c, *d, *name, *key;
+	chanuser_t *cu;
+	user_t *u;
+	size_t i;
+
+	if (!strcmp(type, "C"))
+	{
+		a = handoff_token(&p);
+		b = handoff_token(&p);
+		c = handoff_token(&p);
+		d = handoff_token(&p);
+		name = handoff_token(&p);
+		key = handoff_token(&p);
+		if (key == NULL)
+			return false;
+
+		if ((hs->chan = channel_add(name, strtoul(a, NULL, 10), me.me)) == NULL)
+			return false;
+
+		hs->chan->modes = strtoul(b, NULL, 10);
+		hs->chan->limit = strtoul(c, NULL, 10);
+		hs->chan->flags = strtoul(d, NULL, 10);
+		if (handoff_null(key) != NULL)
+		{
+			free(hs->chan->key);
+			hs->chan->key = sstrdup(key);
+		}
+		return true;
+	}
+
+	if (hs->chan == NULL)
+		return false;
+
+	a = handoff_token(&p);
+	b = handoff_token(&p);
+	if (b == NULL)
+		return false;
+
+	if (!strcmp(type, "X"))
+	{
+		if ((i = strtoul(a, NULL, 10)) >= ignore_mode_list_size)
+			return true;
+		free(hs->chan->extmodes[i]);
+		hs->chan->extmodes[i] = sstrdup(b);
+	}
+	else if (!strcmp(type, "T"))
+	{
+		if ((c = handoff_token(&p)) == NULL)
+			return false;
+		free(hs->chan->topic);
+		free(hs->chan->topic_setter);
+		hs->chan->topicts = strtoul(a, NULL, 10);
+		hs->chan->topic_setter = sstrdup(b);
+		hs->chan->topic = sstrdup(c);
+	}
+	else if (!strcmp(type, "B"))
+		chanban_add(hs->chan, b, *a);
+	else if (!strcmp(type, "M"))
+	{
+		/* services clients that are gone are not there */
+		if ((u = user_find_named(b)) == NULL)
+			return true;
+		if ((cu = chanuser_add(hs->chan, CLIENT_NAME(u))) == NULL)
+			return false;
+		cu->modes = strtoul(a, NULL, 10);
+	}
+	else
+		return false;
+
+	return true;
+}
+
+static handoff_client_t *handoff_find_client(handoff_state_t *hs, user_t *u)
+{
+	mowgli_node_t *n;
+	handoff_client_t *hc;
+
+	MOWGLI_ITER_FOREACH(n, hs->clients.head)
+	{
+		hc = n->data;
+		if (!hc->matched && !irccasecmp(hc->nick, u->nick) &&
+				!strcmp(hc->user, u->user) && !strcmp(hc->host, u->host) &&
+				!strcmp(hc->gecos, u->gecos))
+			return hc;
+	}
+
+	return NULL;
+}
+
+/* gives the services clients the UIDs they have on the network */
+static void handoff_services(handoff_state_t *hs)
+{
+	mowgli_list_t fresh = { NULL, NULL, 0 };
+	mowgli_node_t *n, *tn;
+	handoff_client_t *hc;
+	const char *uid;
+	user_t *u;
+
+	if (ircd->uses_uid)
+		MOWGLI_ITER_FOREACH(n, me.me->userlist.head)
+			user_changeuid(n->data, NULL);
+
+	MOWGLI_ITER_FOREACH(n, me.me->userlist.head)
+	{
+		u = n->data;
+
+		if ((hc = handoff_find_client(hs, u)) == NULL)
+		{
+			mowgli_node_add(u, mowgli_node_create(), &fresh);
+			continue;
+		}
+
+		hc->matched = true;
+		u->ts = hc->ts;
+		if (ircd->uses_uid)
+			user_changeuid(u, hc->uid);
+	}
+
+	/* quit the ones that are gone, like servtree_update() does */
+	MOWGLI_ITER_FOREACH(n, hs->clients.head)
+	{
+		hc = n->data;
+		if (hc->matched)
+			continue;
+
+		if ((u = user_find_named(hc->nick)) != NULL)
+		{
+			if (u->server != me.me)
+				continue;
+
+			/* a new client with the same nick */
+			if (ircd->uses_uid)
+				user_changeuid(u, hc->uid);
+			quit_sts(u, "Updating information");
+			if (ircd->uses_uid)
+				user_changeuid(u, NULL);
+		}
+		else if ((u = user_add(hc->nick, hc->user, hc->host, NULL, NULL, hc->uid, hc->gecos, me.me, hc->ts)) != NULL)
+		{
+			quit_sts(u, "Service unloaded");
+			user_delete(u, "Service unloaded");
+		}
+	}
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, fresh.head)
+	{
+		u = n->data;
+
+		if (ircd->uses_uid)
+		{
+			while ((uid = uid_get()) != NULL && mowgli_patricia_retrieve(uidlist, uid) != NULL)
+				;
+			user_changeuid(u, uid);
+		}
+		introduce_nick(u);
+
+		mowgli_node_delete(n, &fresh);
+		mowgli_node_free(n);
+	}
+}
+
+/* takes the UID generator to where it was */
+static void handoff_sync_uid(const char *last)
+{
+	const char *uid;
+	unsigned int i;
+
+	for (i = 0; i < 1 << 24; i++)
+		if ((uid = uid_get()) == NULL || !strcmp(uid, last))
+			return;
+}
+
+static void handoff_free(handoff_state_t *hs)
+{
+	mowgli_node_t *n, *tn;
+	handoff_client_t *hc;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, hs->clients.head)
+	{
+		hc = n->data;
+		mowgli_node_delete(&hc->node, &hs->clients);
+		free(hc->nick);
+		free(hc->user);
+		free(hc->host);
+		free(hc->gecos);
+		free(hc->uid);
+		free(hc);
+	}
+
+	free(hs->servers);
+	free(hs->lastuid);
+	free(hs->recvq);
+	fclose(hs->f);
+}
+
+/* forgets a network that could not be taken over completely */
+static void handoff_abandon(void)
+{
+	mowgli_patricia_iteration_state_t state;
+	mowgli_node_t *n, *tn;
+	server_t *s;
+	channel_t *c;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, me.me->children.head)
+	{
+		s = n->data;
+		server_delete(ircd->uses_uid && s->sid != NULL ? s->sid : s->name);
+	}
+
+	MOWGLI_PATRICIA_FOREACH(c, &state, chanlist)
+	{
+		channel_delete(c);
+	}
+
+	me.actual = NULL;
+	me.recvsvr = false;
+}
+
+/* reads the state back; false if it cannot be used */
+static bool handoff_read(handoff_state_t *hs)
+{
+	char line[BUFSIZE * 3];
+	char *p, *type, *arg;
+	size_t len;
+
+	while (fgets(line, sizeof line, hs->f) != NULL)
+	{
+		if ((len = strlen(line)) == 0 || line[len - 1] != '\n')
+			return false;
+		line[len - 1] = '\0';
+
+		p = line;
+		if ((type = handoff_token(&p)) == NULL)
+			return false;
+
+		if (!strcmp(type, "END"))
+			return me.recvsvr;
+		else if (!strcmp(type, "IRCD"))
+		{
+			if ((arg = handoff_token(&p)) == NULL || strcmp(arg, ircd->ircdname))
+			{
+				slog(LG_ERROR, "handoff_restore(): the protocol module has changed");
+				return false;
+			}
+		}
+		else if (!strcmp(type, "UID"))
+		{
+			if ((arg = handoff_token(&p)) == NULL)
+				return false;
+			free(hs->lastuid);
+			hs->lastuid = sstrdup(arg);
+		}
+		else if (!strcmp(type, "L"))
+		{
+			if ((arg = handoff_token(&p)) == NULL)
+				return false;
+			parse(arg);
+		}
+		else if (!strcmp(type, "S"))
+		{
+			if (!handoff_read_server(hs, p))
+				return false;
+		}
+		else if (!strcmp(type, "U"))
+		{
+			if (!handoff_read_user(hs, p))
+				return false;
+		}
+		else if (!strcmp(type, "Q"))
+		{
+			if ((arg = handoff_token(&p)) == NULL)
+				return false;
+			hs->recvqlen = strtoul(arg, NULL, 10);
+			hs->recvq = smalloc(hs->recvqlen + 1);
+			if (fread(hs->recvq, 1, hs->recvqlen, hs->f) != hs->recvqlen)
+				return false;
+		}
+		else if (!handoff_read_channel(hs, type, p))
+			return false;
+	}
+
+	return false;
+}
+
+/*
+ * handoff_restore()
+ *
+ * Takes over the network from the process that did a handoff restart,
+ * if this one was started by one.
+ *
+ * inputs:
+ *       none
+ *
+ * outputs:
+ *       true if services are linked, false if they have to link as usual
+ *
+ * side effects:
+ *       the network state of the earlier process is restored and its
+ *       link to the uplink is used
+ */
+bool handoff_restore(void)
+{
+	mowgli_patricia_iteration_state_t state;
+	handoff_state_t hs;
+	const char *env;
+	char line[BUFSIZE];
+	char *p, *name, *numeric, *uplinkname;
+	int statefd, fd;
+	uplink_t *u;
+	channel_t *c;
+	bool ok;
+
+	if ((env = getenv(HANDOFF_ENV)) == NULL)
+		return false;
+
+	if (sscanf(env, "%d:%d", &statefd, &fd) != 2)
+	{
+		unsetenv(HANDOFF_ENV);
+		return false;
+	}
+	unsetenv(HANDOFF_ENV);
+
+	memset(&hs, 0, sizeof hs);
+
+	if ((hs.f = fdopen(statefd, "r")) == NULL)
+	{
+		slog(LG_ERROR, "handoff_restore(): cannot read the state: %s", strerror(errno));
+		close(statefd);
+		close(fd);
+		return false;
+	}
+
+	/* the same server linked to the same uplink */
+	u = NULL;
+	if (fgets(line, sizeof line, hs.f) != NULL)
+	{
+		line[strcspn(line, "\n")] = '\0';
+		p = line;
+		if ((name = handoff_token(&p)) != NULL && !strcmp(name, "HANDOFF") &&
+				(name = handoff_token(&p)) != NULL && atoi(name) == HANDOFF_VERSION &&
+				(name = handoff_token(&p)) != NULL && !irccasecmp(name, me.name) &&
+				(numeric = handoff_token(&p)) != NULL &&
+				!strcmp(numeric, handoff_opt(me.numeric)) &&
+				(uplinkname = handoff_token(&p)) != NULL)
+			u = uplink_find(uplinkname);
+	}
+
+	if (u == NULL)
+	{
+		slog(LG_ERROR, "handoff_restore(): the state does not match the configuration, linking as usual");
+		fclose(hs.f);
+		close(fd);
+		return false;
+	}
+
+	slog(LG_INFO, "handoff_restore(): taking over the network from the previous process");
+
+	hs.maxservers = 16;
+	hs.servers = smalloc(hs.maxservers * sizeof(server_t *));
+	hs.servers[hs.nservers++] = me.me;
+
+	runflags |= RF_RESTORING;
+	curr_uplink = u;
+	me.connected = false;
+	me.recvsvr = false;
+
+	ok = handoff_read(&hs);
+
+	if (!ok)
+	{
+		slog(LG_ERROR, "handoff_restore(): the state is incomplete, linking as usual");
+		handoff_abandon();
+		handoff_free(&hs);
+		close(fd);
+		runflags &= ~RF_RESTORING;
+		return false;
+	}
+
+	if (hs.lastuid != NULL)
+		handoff_sync_uid(hs.lastuid);
+
+	uplink_adopt(u, fd);
+	me.bursting = false;
+
+	handoff_services(&hs);
+
+	/* channels only services were in before they went */
+	MOWGLI_PATRICIA_FOREACH(c, &state, chanlist)
+	{
+		if (c->nummembers == 0 && !(c->modes & ircd->perm_mode))
+			channel_delete(c);
+	}
+
+	if (hs.recvqlen > 0)
+		recvq_restore(curr_uplink->conn, hs.recvq, hs.recvqlen);
+
+	slog(LG_INFO, "handoff_restore(): took over %u servers, %u users and %u channels",
+			hs.nservers, hs.users, cnt.chan);
+
+	handoff_free(&hs);
+	runflags &= ~RF_RESTORING;
+
+	hook_call_handoff_restored();
+
+	return true;
+}
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
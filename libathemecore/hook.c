@@ -26,8 +26,14 @@
 
 mowgli_patricia_t *hooks;
 mowgli_heap_t *hook_heap;
+unsigned long long hook_time_us;
+static unsigned int hook_depth;
 static hook_t *find_hook(const char *name);
 
+/* the handles of the hooks in hooktypes.in */
+#define HOOK_DEFINE(name) hook_t *hook_handle_##name;
+HOOK_HANDLES(HOOK_DEFINE)
+
 void hooks_init()
 {
 	hooks = mowgli_patricia_create(strcasecanon);
@@ -38,6 +44,17 @@ void hooks_init()
 		slog(LG_INFO, "hooks_init(): block allocator failed.");
 		exit(EXIT_SUCCESS);
 	}
+
+#define HOOK_RESOLVE(name) hook_handle_##name = hook_add_event(#name);
+	HOOK_HANDLES(HOOK_RESOLVE)
+}
+
+static unsigned long long hook_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
 }
 
 hook_t *hook_add_event(const char *name)
@@ -48,6 +65,7 @@ hook_t *hook_add_event(const char *name)
 		return nh;
 
 	nh = mowgli_heap_alloc(hook_heap);
+	memset(nh, 0, sizeof(hook_t));
 	nh->name = sstrdup(name);
 
 	mowgli_patricia_add(hooks, name, nh);
@@ -55,23 +73,51 @@ hook_t *hook_add_event(const char *name)
 	return nh;
 }
 
-void hook_del_event(const char *name)
+static void hook_free_handler(hook_t *h, hook_handler_t *hh)
 {
-	hook_t *h;
+	mowgli_node_delete(&hh->node, &h->hooks);
+	free(hh->module);
+	free(hh);
+}
+
+/* drops the handlers deleted while the hook was running */
+static void hook_sweep(hook_t *h)
+{
+	mowgli_node_t *n, *tn;
+	hook_handler_t *hh;
 
-	if ((h = find_hook(name)) != NULL)
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, h->hooks.head)
 	{
-		mowgli_node_t *n, *tn;
+		hh = n->data;
 
-		MOWGLI_ITER_FOREACH_SAFE(n, tn, h->hooks.head)
-		{
-			mowgli_node_delete(n, &h->hooks);
-			mowgli_node_free(n);
-		}
+		if (hh->func == NULL)
+			hook_free_handler(h, hh);
+	}
+
+	h->dead = false;
+}
+
+/*
+ * hook_del_event()
+ *
+ * Deletes all handlers of a hook. The hook itself is kept, as its
+ * handle may still be used.
+ */
+void hook_del_event(const char *name)
+{
+	hook_t *h;
+	mowgli_node_t *n;
 
-		mowgli_heap_free(hook_heap, h);
+	if ((h = find_hook(name)) == NULL)
 		return;
-	}
+
+	MOWGLI_ITER_FOREACH(n, h->hooks.head)
+		((hook_handler_t *)n->data)->func = NULL;
+
+	if (h->running)
+		h->dead = true;
+	else
+		hook_sweep(h);
 }
 
 static hook_t *find_hook(const char *name)
@@ -79,62 +125,175 @@ static hook_t *find_hook(const char *name)
 	return mowgli_patricia_retrieve(hooks, name);
 }
 
-void hook_del_hook(const char *event, void (*handler)(void *data))
+void hook_del_handler(hook_t *h, void (*handler)(void *data))
 {
-	mowgli_node_t *n, *n2;
-	hook_t *h;
+	mowgli_node_t *n, *tn;
+	hook_handler_t *hh;
 
-	if (!(h = find_hook(event)))
-		return;
+	return_if_fail(h != NULL);
 
-	MOWGLI_ITER_FOREACH_SAFE(n, n2, h->hooks.head)
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, h->hooks.head)
 	{
-		if (handler == (void (*)(void *)) n->data)
+		hh = n->data;
+
+		if (hh->func != handler)
+			continue;
+
+		/* the running call may be about to use this handler */
+		if (h->running)
 		{
-			mowgli_node_delete(n, &h->hooks);
-			mowgli_node_free(n);
+			hh->func = NULL;
+			h->dead = true;
 		}
+		else
+			hook_free_handler(h, hh);
 	}
 }
 
-void hook_add_hook(const char *event, void (*handler)(void *data))
+void hook_del_hook(const char *event, void (*handler)(void *data))
 {
 	hook_t *h;
-	mowgli_node_t *n;
 
 	if (!(h = find_hook(event)))
-		h = hook_add_event(event);
+		return;
+
+	hook_del_handler(h, handler);
+}
+
+/*
+ * hook_add_handler()
+ *
+ * Adds a handler to a hook, at the front or at the end.
+ *
+ * inputs:
+ *       a hook, the handler and whether it goes first
+ *
+ * outputs:
+ *       none
+ *
+ * side effects:
+ *       the handler is attributed to the module being loaded, if any
+ */
+void hook_add_handler(hook_t *h, void (*handler)(void *data), bool first)
+{
+	hook_handler_t *hh;
+
+	return_if_fail(h != NULL);
+	return_if_fail(handler != NULL);
+
+	hh = scalloc(sizeof(hook_handler_t), 1);
+	hh->func = handler;
+	hh->module = modtarget != NULL ? sstrdup(modtarget->name) : NULL;
+
+	if (first)
+		mowgli_node_add_head(hh, &hh->node, &h->hooks);
+	else
+		mowgli_node_add(hh, &hh->node, &h->hooks);
+}
 
-	n = mowgli_node_create();
-	mowgli_node_add((void *) handler, n, &h->hooks);
+void hook_add_hook(const char *event, void (*handler)(void *data))
+{
+	hook_add_handler(hook_add_event(event), handler, false);
 }
 
 void hook_add_hook_first(const char *event, void (*handler)(void *data))
 {
-	hook_t *h;
+	hook_add_handler(hook_add_event(event), handler, true);
+}
+
+/*
+ * hook_call_handle()
+ *
+ * Runs the handlers of a hook, timing each of them.
+ *
+ * inputs:
+ *       a hook and the data to pass to its handlers
+ *
+ * outputs:
+ *       none
+ *
+ * side effects:
+ *       whatever the handlers do
+ */
+void hook_call_handle(hook_t *h, void *dptr)
+{
 	mowgli_node_t *n;
+	hook_handler_t *hh;
+	unsigned long long start, t, us;
 
-	if (!(h = find_hook(event)))
-		h = hook_add_event(event);
+	/* the network is being taken over as it was; nothing happens */
+	if (runflags & RF_RESTORING)
+		return;
+
+	if (h == NULL || h->hooks.head == NULL)
+		return;
+
+	h->running++;
+	hook_depth++;
+	start = t = hook_now();
 
-	n = mowgli_node_create();
-	mowgli_node_add_head((void *) handler, n, &h->hooks);
+	/* handlers deleted meanwhile stay in the list until the end */
+	MOWGLI_ITER_FOREACH(n, h->hooks.head)
+	{
+		hh = n->data;
+
+		if (hh->func == NULL)
+			continue;
+
+		hh->func(dptr);
+
+		us = hook_now() - t;
+		t += us;
+
+		hh->calls++;
+		hh->total_us += us;
+		if (us > hh->max_us)
+			hh->max_us = us > UINT_MAX ? UINT_MAX : us;
+	}
+
+	us = t - start;
+	h->calls++;
+	h->total_us += us;
+	if (us > h->max_us)
+		h->max_us = us > UINT_MAX ? UINT_MAX : us;
+
+	/* hooks run from hooks are already in their caller's time */
+	if (--hook_depth == 0)
+		hook_time_us += us;
+
+	if (--h->running == 0 && h->dead)
+		hook_sweep(h);
 }
 
 void hook_call_event(const char *event, void *dptr)
 {
+	hook_call_handle(find_hook(event), dptr);
+}
+
+/*
+ * hook_stats_foreach()
+ *
+ * Calls a function for every hook, e.g. to report the time spent in
+ * its handlers.
+ *
+ * inputs:
+ *       a callback and data to pass to it
+ *
+ * outputs:
+ *       none
+ *
+ * side effects:
+ *       none
+ */
+void hook_stats_foreach(void (*cb)(hook_t *h, void *privdata), void *privdata)
+{
+	mowgli_patricia_iteration_state_t state;
 	hook_t *h;
-	mowgli_node_t *n, *tn;
-	void (*func)(void *data);
 
-	if (!(h = find_hook(event)))
-		return;
+	return_if_fail(cb != NULL);
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, h->hooks.head)
-	{
-		func = (void (*)(void *)) n->data;
-		func(dptr);
-	}
+	MOWGLI_PATRICIA_FOREACH(h, &state, hooks)
+		cb(h, privdata);
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
@@ -0,0 +1,450 @@
+/*
+ * atheme-services: A collection of minimalist IRC services
+ * hostmatch.c: Compiled host mask matching for channel access lists
+ *
+ * Copyright (c) 2026 Atheme Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Matching a user against the host entries of a big access list runs
+ * match() on every entry for each of the user's hosts. Nearly all those
+ * entries are *!*@host, *!*@*.domain, *!*@prefix.* or *!*@ip/len, which
+ * can be looked up instead: the first in a table of literal hosts, the
+ * next two in tables of suffixes and prefixes probed once for each
+ * length in use, and CIDR masks in a table of networks probed once for
+ * each prefix length in use. Anything else is still matched one by one.
+ */
+
+#include "atheme.h"
+#include "internal.h"
+
+typedef enum {
+	HM_LITERAL,
+	HM_SUFFIX,
+	HM_PREFIX,
+	HM_CIDR,
+	HM_OTHER
+} hostmatch_class_t;
+
+struct chanacs_hostmatch_ {
+	mowgli_patricia_t *literal;	/* host -> chanacs */
+	mowgli_patricia_t *suffix;	/* tail of host -> chanacs */
+	mowgli_patricia_t *prefix;	/* head of host -> chanacs */
+	mowgli_patricia_t *cidr;	/* network/len -> chanacs */
+
+	/* how many keys of each length are in the tables above */
+	unsigned int suffix_lens[HOSTLEN + 1];
+	unsigned int prefix_lens[HOSTLEN + 1];
+	unsigned int cidr4_lens[33];
+	unsigned int cidr6_lens[129];
+
+	/* entries that need match() */
+	mowgli_list_t other;
+
+	/* whether the ircd matches CIDR masks; fixed once this is built */
+	bool cidr_bans;
+};
+
+/* the characters match() treats specially */
+#define HM_WILDCARDS	"*?&#%\\"
+
+/* the network part of an ip/len mask as a table key, or false if it is not one */
+static bool hostmatch_cidr_key(const char *ip, int len, char *key, size_t keylen)
+{
+	unsigned char addr[16];
+	char buf[INET6_ADDRSTRLEN];
+	int family, bits, i;
+
+	family = strchr(ip, ':') != NULL ? AF_INET6 : AF_INET;
+	bits = family == AF_INET6 ? 128 : 32;
+
+	if (len <= 0 || len > bits || inet_pton(family, ip, addr) != 1)
+		return false;
+
+	for (i = len; i < bits; i++)
+		addr[i / 8] &= ~(0x80 >> (i % 8));
+
+	if (inet_ntop(family, addr, buf, sizeof buf) == NULL)
+		return false;
+
+	snprintf(key, keylen, "%s/%d", buf, len);
+	return true;
+}
+
+/* sorts a host mask into one of the tables, giving the key to file it under */
+static hostmatch_class_t hostmatch_classify(chanacs_hostmatch_t *hm, const char *mask, char *key, size_t keylen, int *len)
+{
+	const char *host, *slash;
+	char ip[HOSTLEN + 1];
+	size_t n;
+
+	if (strncmp(mask, "*!*@", 4))
+		return HM_OTHER;
+
+	host = mask + 4;
+	n = strlen(host);
+
+	if (n == 0 || n > HOSTLEN || strpbrk(host, "!@") != NULL)
+		return HM_OTHER;
+
+	if (strpbrk(host, HM_WILDCARDS) == NULL)
+	{
+		if (hm->cidr_bans && (slash = strrchr(host, '/')) != NULL)
+		{
+			mowgli_strlcpy(ip, host, (size_t)(slash - host) + 1 < sizeof ip ? (size_t)(slash - host) + 1 : sizeof ip);
+			*len = atoi(slash + 1);
+
+			if (hostmatch_cidr_key(ip, *len, key, keylen))
+				return HM_CIDR;
+
+			return HM_OTHER;
+		}
+
+		mowgli_strlcpy(key, host, keylen);
+		return HM_LITERAL;
+	}
+
+	/* *tail and head*, with no other wildcards */
+	if (n > 1 && host[0] == '*' && strpbrk(host + 1, HM_WILDCARDS) == NULL)
+	{
+		mowgli_strlcpy(key, host + 1, keylen);
+		*len = n - 1;
+		return HM_SUFFIX;
+	}
+
+	if (n > 1 && host[n - 1] == '*' && strcspn(host, HM_WILDCARDS) == n - 1)
+	{
+		mowgli_strlcpy(key, host, keylen);
+		key[n - 1] = '\0';
+		*len = n - 1;
+		return HM_PREFIX;
+	}
+
+	return HM_OTHER;
+}
+
+static mowgli_patricia_t *hostmatch_table(chanacs_hostmatch_t *hm, hostmatch_class_t class, int len, unsigned int **count)
+{
+	switch (class)
+	{
+	case HM_LITERAL:
+		*count = NULL;
+		return hm->literal;
+	case HM_SUFFIX:
+		*count = &hm->suffix_lens[len];
+		return hm->suffix;
+	case HM_PREFIX:
+		*count = &hm->prefix_lens[len];
+		return hm->prefix;
+	case HM_CIDR:
+		/* counted per address family by the caller */
+		*count = NULL;
+		return hm->cidr;
+	default:
+		*count = NULL;
+		return NULL;
+	}
+}
+
+/*
+ * chanacs_hostmatch_add()
+ *
+ * Adds a host access entry to its channel's compiled matcher, if the
+ * channel has one.
+ *
+ * inputs:
+ *       a chanacs with a host mask
+ *
+ * outputs:
+ *       none
+ *
+ * side effects:
+ *       the entry will be found by chanacs_hostmatch()
+ */
+void chanacs_hostmatch_add(chanacs_t *ca)
+{
+	chanacs_hostmatch_t *hm;
+	hostmatch_class_t class;
+	mowgli_patricia_t *table;
+	unsigned int *count;
+	char key[BUFSIZE];
+	int len = 0;
+
+	return_if_fail(ca != NULL && ca->host != NULL);
+
+	if ((hm = ca->mychan->chanacs_hostmatch) == NULL)
+		return;
+
+	class = hostmatch_classify(hm, ca->host, key, sizeof key, &len);
+	table = hostmatch_table(hm, class, len, &count);
+
+	/* a second entry with the same key can only be a duplicate from an old database */
+	if (table == NULL || mowgli_patricia_retrieve(table, key) != NULL)
+	{
+		mowgli_node_add(ca, mowgli_node_create(), &hm->other);
+		return;
+	}
+
+	mowgli_patricia_add(table, key, ca);
+
+	if (class == HM_CIDR)
+		(strchr(key, ':') != NULL ? hm->cidr6_lens : hm->cidr4_lens)[len]++;
+	else if (count != NULL)
+		(*count)++;
+}
+
+/*
+ * chanacs_hostmatch_delete()
+ *
+ * Removes a host access entry from its channel's compiled matcher.
+ *
+ * inputs:
+ *       a chanacs with a host mask
+ *
+ * outputs:
+ *       none
+ *
+ * side effects:
+ *       none
+ */
+void chanacs_hostmatch_delete(chanacs_t *ca)
+{
+	chanacs_hostmatch_t *hm;
+	hostmatch_class_t class;
+	mowgli_patricia_t *table;
+	mowgli_node_t *n;
+	unsigned int *count;
+	char key[BUFSIZE];
+	int len = 0;
+
+	return_if_fail(ca != NULL && ca->host != NULL);
+
+	if ((hm = ca->mychan->chanacs_hostmatch) == NULL)
+		return;
+
+	class = hostmatch_classify(hm, ca->host, key, sizeof key, &len);
+	table = hostmatch_table(hm, class, len, &count);
+
+	if (table != NULL && mowgli_patricia_retrieve(table, key) == ca)
+	{
+		mowgli_patricia_delete(table, key);
+
+		if (class == HM_CIDR)
+			(strchr(key, ':') != NULL ? hm->cidr6_lens : hm->cidr4_lens)[len]--;
+		else if (count != NULL)
+			(*count)--;
+
+		return;
+	}
+
+	if ((n = mowgli_node_find(ca, &hm->other)) != NULL)
+	{
+		mowgli_node_delete(n, &hm->other);
+		mowgli_node_free(n);
+	}
+}
+
+/*
+ * chanacs_hostmatch_build()
+ *
+ * Compiles the host entries of a channel's access list.
+ *
+ * inputs:
+ *       a channel registration
+ *
+ * outputs:
+ *       none
+ *
+ * side effects:
+ *       chanacs_hostmatch_add() and chanacs_hostmatch_delete() keep the
+ *       result up to date until chanacs_hostmatch_free()
+ */
+void chanacs_hostmatch_build(mychan_t *mc)
+{
+	chanacs_hostmatch_t *hm;
+	mowgli_node_t *n;
+	chanacs_t *ca;
+
+	return_if_fail(mc != NULL);
+
+	if (mc->chanacs_hostmatch != NULL)
+		return;
+
+	hm = scalloc(sizeof(chanacs_hostmatch_t), 1);
+	hm->literal = mowgli_patricia_create(irccasecanon);
+	hm->suffix = mowgli_patricia_create(irccasecanon);
+	hm->prefix = mowgli_patricia_create(irccasecanon);
+	hm->cidr = mowgli_patricia_create(noopcanon);
+	hm->cidr_bans = ircd != NULL && ircd->flags & IRCD_CIDR_BANS;
+
+	mc->chanacs_hostmatch = hm;
+
+	MOWGLI_ITER_FOREACH(n, mc->chanacs.head)
+	{
+		ca = n->data;
+
+		if (ca->entity == NULL)
+			chanacs_hostmatch_add(ca);
+	}
+}
+
+void chanacs_hostmatch_free(mychan_t *mc)
+{
+	chanacs_hostmatch_t *hm;
+	mowgli_node_t *n, *tn;
+
+	return_if_fail(mc != NULL);
+
+	if ((hm = mc->chanacs_hostmatch) == NULL)
+		return;
+
+	mowgli_patricia_destroy(hm->literal, NULL, NULL);
+	mowgli_patricia_destroy(hm->suffix, NULL, NULL);
+	mowgli_patricia_destroy(hm->prefix, NULL, NULL);
+	mowgli_patricia_destroy(hm->cidr, NULL, NULL);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, hm->other.head)
+	{
+		mowgli_node_delete(n, &hm->other);
+		mowgli_node_free(n);
+	}
+
+	free(hm);
+	mc->chanacs_hostmatch = NULL;
+}
+
+/* state for one lookup: flags seen so far and the first entry with the wanted level */
+typedef struct {
+	unsigned int level;
+	unsigned int flags;
+	chanacs_t *found;
+} hostmatch_result_t;
+
+static inline void hostmatch_hit(hostmatch_result_t *res, chanacs_t *ca)
+{
+	if (ca == NULL)
+		return;
+
+	res->flags |= ca->level;
+
+	if (res->found == NULL && (ca->level & res->level) == res->level)
+		res->found = ca;
+}
+
+static void hostmatch_host(chanacs_hostmatch_t *hm, const char *host, hostmatch_result_t *res)
+{
+	char buf[HOSTLEN + 1];
+	size_t hlen, n;
+
+	hlen = strlen(host);
+
+	hostmatch_hit(res, mowgli_patricia_retrieve(hm->literal, host));
+
+	for (n = 1; n <= hlen && n <= HOSTLEN; n++)
+	{
+		if (hm->suffix_lens[n] > 0)
+			hostmatch_hit(res, mowgli_patricia_retrieve(hm->suffix, host + hlen - n));
+
+		if (hm->prefix_lens[n] > 0)
+		{
+			memcpy(buf, host, n);
+			buf[n] = '\0';
+			hostmatch_hit(res, mowgli_patricia_retrieve(hm->prefix, buf));
+		}
+	}
+}
+
+static void hostmatch_ip(chanacs_hostmatch_t *hm, const char *ip, hostmatch_result_t *res)
+{
+	unsigned int *lens;
+	char key[BUFSIZE];
+	int len, bits;
+
+	if (strchr(ip, ':') != NULL)
+	{
+		lens = hm->cidr6_lens;
+		bits = 128;
+	}
+	else
+	{
+		lens = hm->cidr4_lens;
+		bits = 32;
+	}
+
+	for (len = 1; len <= bits; len++)
+		if (lens[len] > 0 && hostmatch_cidr_key(ip, len, key, sizeof key))
+			hostmatch_hit(res, mowgli_patricia_retrieve(hm->cidr, key));
+}
+
+/*
+ * chanacs_hostmatch()
+ *
+ * Finds the host entries of a channel's access list that match a user,
+ * the same way generic_next_matching_host_chanacs() does.
+ *
+ * inputs:
+ *       a channel registration with a compiled matcher, a user, a level
+ *       and optionally where to store the flags of all matching entries
+ *
+ * outputs:
+ *       a matching entry having all flags in level, or NULL; which one is
+ *       returned if several do is unspecified
+ *
+ * side effects:
+ *       none
+ */
+chanacs_t *chanacs_hostmatch(mychan_t *mc, user_t *u, unsigned int level, unsigned int *flags)
+{
+	chanacs_hostmatch_t *hm;
+	hostmatch_result_t res;
+	mowgli_node_t *n;
+	chanacs_t *ca;
+	char hostbuf[NICKLEN+USERLEN+HOSTLEN];
+	char hostbuf2[NICKLEN+USERLEN+HOSTLEN];
+	char ipbuf[NICKLEN+USERLEN+HOSTLEN];
+
+	return_val_if_fail(mc != NULL && u != NULL, NULL);
+	return_val_if_fail((hm = mc->chanacs_hostmatch) != NULL, NULL);
+
+	res.level = level;
+	res.flags = 0;
+	res.found = NULL;
+
+	hostmatch_host(hm, u->vhost, &res);
+	if (strcmp(u->chost, u->vhost))
+		hostmatch_host(hm, u->chost, &res);
+
+	if (u->ip != NULL && *u->ip != '\0')
+	{
+		if (strcmp(u->ip, u->vhost) && strcmp(u->ip, u->chost))
+			hostmatch_host(hm, u->ip, &res);
+
+		if (hm->cidr_bans)
+			hostmatch_ip(hm, u->ip, &res);
+	}
+
+	if (hm->other.head != NULL)
+	{
+		snprintf(hostbuf, sizeof hostbuf, "%s!%s@%s", u->nick, u->user, u->vhost);
+		snprintf(hostbuf2, sizeof hostbuf2, "%s!%s@%s", u->nick, u->user, u->chost);
+		snprintf(ipbuf, sizeof ipbuf, "%s!%s@%s", u->nick, u->user, u->ip != NULL ? u->ip : "");
+
+		MOWGLI_ITER_FOREACH(n, hm->other.head)
+		{
+			ca = n->data;
+
+			if (!match_pattern(ca->hostpat, hostbuf) || !match_pattern(ca->hostpat, hostbuf2) || !match_pattern(ca->hostpat, ipbuf) || (hm->cidr_bans && !match_cidr(ca->host, ipbuf)))
+				hostmatch_hit(&res, ca);
+		}
+	}
+
+	if (flags != NULL)
+		*flags = res.flags;
+
+	return res.found;
+}
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
@@ -19,6 +19,32 @@ E void init_signal_handlers(void);
 
 E void language_init(void);
 
+/* account.c */
+E void metadata_journal(void *target, const char *name, const char *value);
+E void chanacs_cache_free(user_t *u);
+
+/* channels.c */
+E void chanuser_unlink(chanuser_t *cu);
+
+/* handoff.c */
+E void handoff_record(const char *line);
+E void handoff_forget(void);
+E bool handoff_save(void);
+E bool handoff_restore(void);
+
+/* hostmatch.c */
+E void chanacs_hostmatch_build(mychan_t *mc);
+E void chanacs_hostmatch_free(mychan_t *mc);
+E void chanacs_hostmatch_add(chanacs_t *ca);
+E void chanacs_hostmatch_delete(chanacs_t *ca);
+E chanacs_t *chanacs_hostmatch(mychan_t *mc, user_t *u, unsigned int level, unsigned int *flags);
+
+/* matchpattern.c */
+E void match_pattern_mapping_changed(void);
+
+/* module.c */
+E module_t *modtarget;
+
 #endif
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
@@ -22,6 +22,7 @@
  */
 
 #include "atheme.h"
+#include "internal.h"
 
 #include <regex.h>
 #ifdef HAVE_PCRE
@@ -118,9 +119,70 @@ int ToUpper(int c)
 	return (ToUpperTab[(unsigned char)(c)]);
 }
 
+/*
+ * Upper casing for irccasecanon() and irccasecmp(), as a table for the
+ * current mapping. Both mappings in use only move one range of ASCII
+ * bytes down by 0x20 ('a'-'z' for ascii, 'a'-'~' for rfc1459); when the
+ * table is just that, eight bytes at a time are folded with a few word
+ * operations instead of a lookup per byte.
+ */
+static unsigned char ascii_upper[256];
+static const unsigned char *casemap_upper = ToUpperTab;
+static bool casemap_words = true;
+static uint64_t casemap_lo = 0x8080808080808080ULL - 0x6161616161616161ULL;	/* 0x80 - 'a' */
+static uint64_t casemap_hi = 0x7f7f7f7f7f7f7f7fULL - 0x7e7e7e7e7e7e7e7eULL;	/* 0x7f - '~' */
+
+#define CASEMAP_ONES	0x0101010101010101ULL
+#define CASEMAP_HIGH	0x8080808080808080ULL
+
+static void casemap_update(void)
+{
+	int c, lo = 256, hi = -1;
+
+	if (match_mapping == MATCH_ASCII)
+	{
+		for (c = 0; c < 256; c++)
+			ascii_upper[c] = toupper(c);
+		casemap_upper = ascii_upper;
+	}
+	else
+		casemap_upper = ToUpperTab;
+
+	for (c = 0; c < 256; c++)
+	{
+		if (casemap_upper[c] != c)
+		{
+			if (c < lo)
+				lo = c;
+			hi = c;
+		}
+	}
+
+	casemap_words = hi >= 0 && hi < 0x80;
+	for (c = 0; c < 256 && casemap_words; c++)
+		if (casemap_upper[c] != (c >= lo && c <= hi ? c - 0x20 : c) || (c >= lo && c <= hi && !(c & 0x20)))
+			casemap_words = false;
+
+	if (casemap_words)
+	{
+		casemap_lo = (0x80 - lo) * CASEMAP_ONES;
+		casemap_hi = (0x7f - hi) * CASEMAP_ONES;
+	}
+}
+
+/* upper cases eight ASCII bytes; the additions cannot carry into the next byte */
+static inline uint64_t casemap_word(uint64_t w)
+{
+	uint64_t in = ((w + casemap_lo) & ~(w + casemap_hi)) & CASEMAP_HIGH;
+
+	return w ^ (in >> 2);
+}
+
 void set_match_mapping(int type)
 {
 	match_mapping = type;
+	casemap_update();
+	match_pattern_mapping_changed();
 }
 
 #define MAX_ITERATIONS  512
@@ -257,6 +319,8 @@ int irccasecmp(const char *s1, const char *s2)
 {
 	const unsigned char *str1 = (const unsigned char *)s1;
 	const unsigned char *str2 = (const unsigned char *)s2;
+	uint64_t w1, w2;
+	size_t len, len2;
 	int res;
 
 	if (!s1 || !s2)
@@ -265,7 +329,23 @@ int irccasecmp(const char *s1, const char *s2)
 	if (match_mapping == MATCH_ASCII)
 		return strcasecmp(s1, s2);
 
-	while ((res = ToUpper(*str1) - ToUpper(*str2)) == 0)
+	/* skip the equal part of long strings a word at a time */
+	if (casemap_words && (len = strlen(s1)) >= 16)
+	{
+		if ((len2 = strlen(s2)) < len)
+			len = len2;
+
+		for (; len >= 8; len -= 8, str1 += 8, str2 += 8)
+		{
+			memcpy(&w1, str1, 8);
+			memcpy(&w2, str2, 8);
+
+			if ((w1 | w2) & CASEMAP_HIGH || casemap_word(w1) != casemap_word(w2))
+				break;
+		}
+	}
+
+	while ((res = casemap_upper[*str1] - casemap_upper[*str2]) == 0)
 	{
 		if (*str1 == '\0')
 			return 0;
@@ -284,7 +364,7 @@ int ircncasecmp(const char *str1, const char *str2, size_t n)
 	if (match_mapping == MATCH_ASCII)
 		return strncasecmp(str1, str2, n);
 
-	while ((res = ToUpper(*s1) - ToUpper(*s2)) == 0)
+	while ((res = casemap_upper[*s1] - casemap_upper[*s2]) == 0)
 	{
 		s1++;
 		s2++;
@@ -297,12 +377,26 @@ int ircncasecmp(const char *str1, const char *str2, size_t n)
 
 void irccasecanon(char *str)
 {
-	while (*str)
+	unsigned char *p = (unsigned char *)str;
+	uint64_t w;
+	size_t len;
+
+	if (casemap_words && (len = strlen(str)) >= 8)
 	{
-		*str = ToUpper(*str);
-		str++;
+		for (; len >= 8; len -= 8, p += 8)
+		{
+			memcpy(&w, p, 8);
+
+			if (w & CASEMAP_HIGH)
+				break;
+
+			w = casemap_word(w);
+			memcpy(p, &w, 8);
+		}
 	}
-	return;
+
+	for (; *p != '\0'; p++)
+		*p = casemap_upper[*p];
 }
 
 void strcasecanon(char *str)
@@ -0,0 +1,331 @@
+/*
+ * atheme-services: A collection of minimalist IRC services
+ * matchpattern.c: Glob patterns compiled for repeated matching
+ *
+ * Copyright (c) 2026 Atheme Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * A mask whose only wildcard is '*' is a list of literal segments: the
+ * first anchored at the start of the string unless the mask starts with
+ * '*', the last anchored at the end unless it ends with '*', and the rest
+ * found leftmost in order. That is what match() does with such masks,
+ * without going back over the string. The segments are folded to lower
+ * case once; each is searched for with memchr() on one of its characters
+ * that only one byte folds to, so the libc's vectorized scan does most of
+ * the work. Masks using '?', '&', '#', '%' or '\' are left to match().
+ *
+ * Unlike match(), the segment matcher does not give up after
+ * MAX_ITERATIONS steps, so it also matches long strings match() would
+ * refuse.
+ */
+
+#include "atheme.h"
+
+typedef struct {
+	const char *text;	/* folded */
+	size_t len;
+	size_t anchor;		/* position of the character to memchr() for */
+	int anchor_byte;	/* or -1 if every character has case variants */
+} match_segment_t;
+
+struct match_pattern_ {
+	match_pattern_kind_t kind;
+	int mapping;		/* match_mapping the segments were folded for */
+	bool lead, trail;	/* mask starts, ends with '*' */
+	size_t minlen;
+
+	unsigned int nseg;
+	match_segment_t *seg;
+	char *folded;
+	char *mask;
+};
+
+/* what ToLower() does for the current match_mapping, as a table; built on
+ * first use and again by set_match_mapping() */
+static unsigned char match_fold[256];
+static unsigned char match_fold_count[256];	/* bytes folding to each value */
+static bool match_fold_ready = false;
+
+static void match_fold_build(void)
+{
+	int c;
+
+	memset(match_fold_count, 0, sizeof match_fold_count);
+
+	for (c = 0; c < 256; c++)
+	{
+		match_fold[c] = ToLower(c);
+		match_fold_count[match_fold[c]]++;
+	}
+
+	match_fold_ready = true;
+}
+
+/* a pattern refolds itself once it sees the mapping changed, but the table
+ * is shared by all of them and must always be for the current mapping */
+void match_pattern_mapping_changed(void)
+{
+	match_fold_build();
+}
+
+/* folds the segments and picks what to search for in each */
+static void match_pattern_fold(match_pattern_t *mp)
+{
+	const char *m = mp->mask;
+	char *f = mp->folded;
+	match_segment_t *s;
+	unsigned int i;
+	size_t j;
+	unsigned char c;
+
+	if (!match_fold_ready)
+		match_fold_build();
+
+	for (i = 0; i < mp->nseg; i++)
+	{
+		s = &mp->seg[i];
+
+		while (*m == '*')
+			m++;
+
+		s->text = f;
+		s->anchor_byte = -1;
+		s->anchor = 0;
+
+		for (j = 0; j < s->len; j++)
+		{
+			c = (unsigned char)m[j];
+			f[j] = match_fold[c];
+
+			/* a byte nothing else folds to, preferably not punctuation */
+			if (match_fold_count[match_fold[c]] == 1 &&
+					(s->anchor_byte == -1 || (strchr(".-_", s->anchor_byte) != NULL && strchr(".-_", c) == NULL)))
+			{
+				s->anchor = j;
+				s->anchor_byte = c;
+			}
+		}
+
+		f[s->len] = '\0';
+		f += s->len + 1;
+		m += s->len;
+	}
+
+	mp->mapping = match_mapping;
+}
+
+/*
+ * match_pattern_create()
+ *
+ * Compiles a mask for match_pattern().
+ *
+ * inputs:
+ *       a mask as for match()
+ *
+ * outputs:
+ *       the compiled pattern, to be freed with match_pattern_destroy()
+ *
+ * side effects:
+ *       none
+ */
+match_pattern_t *match_pattern_create(const char *mask)
+{
+	match_pattern_t *mp;
+	const char *p;
+	unsigned int nseg = 0, i;
+	size_t len;
+	char *buf;
+
+	return_val_if_fail(mask != NULL, NULL);
+
+	len = strlen(mask);
+
+	for (p = mask; *p != '\0'; p++)
+		if (*p != '*' && (p == mask || p[-1] == '*'))
+			nseg++;
+	if (len == 0)
+		nseg = 1;
+
+	mp = smalloc(sizeof(match_pattern_t) + nseg * sizeof(match_segment_t) + 2 * (len + 1));
+	mp->seg = (match_segment_t *)(mp + 1);
+	buf = (char *)(mp->seg + nseg);
+	mp->mask = buf;
+	mp->folded = buf + len + 1;
+	memcpy(mp->mask, mask, len + 1);
+
+	mp->nseg = nseg;
+	mp->lead = *mask == '*';
+	mp->trail = len > 0 && mask[len - 1] == '*';
+	mp->minlen = 0;
+
+	for (i = 0, p = mask; i < nseg; i++)
+	{
+		while (*p == '*')
+			p++;
+		mp->seg[i].len = strcspn(p, "*");
+		mp->minlen += mp->seg[i].len;
+		p += mp->seg[i].len;
+	}
+
+	if (strpbrk(mask, "?&#%\\") != NULL)
+		mp->kind = MATCH_PATTERN_GLOB;
+	else if (nseg == 0)
+		mp->kind = MATCH_PATTERN_ANY;
+	else if (nseg > 1)
+		mp->kind = MATCH_PATTERN_SEGMENTS;
+	else if (mp->lead)
+		mp->kind = mp->trail ? MATCH_PATTERN_SUBSTRING : MATCH_PATTERN_SUFFIX;
+	else
+		mp->kind = mp->trail ? MATCH_PATTERN_PREFIX : MATCH_PATTERN_LITERAL;
+
+	if (mp->kind != MATCH_PATTERN_GLOB)
+		match_pattern_fold(mp);
+
+	return mp;
+}
+
+void match_pattern_destroy(match_pattern_t *mp)
+{
+	free(mp);
+}
+
+const char *match_pattern_mask(const match_pattern_t *mp)
+{
+	return mp->mask;
+}
+
+match_pattern_kind_t match_pattern_kind(const match_pattern_t *mp)
+{
+	return mp->kind;
+}
+
+/* whether a segment is at name, which has at least s->len characters */
+static inline bool match_segment_at(const match_segment_t *s, const unsigned char *name)
+{
+	size_t i;
+
+	for (i = 0; i < s->len; i++)
+		if (match_fold[name[i]] != (unsigned char)s->text[i])
+			return false;
+
+	return true;
+}
+
+/* finds the first occurrence of a segment in name[0..len) */
+static const unsigned char *match_segment_find(const match_segment_t *s, const unsigned char *name, size_t len)
+{
+	const unsigned char *p, *last;
+
+	if (len < s->len)
+		return NULL;
+
+	last = name + len - s->len;
+
+	if (s->anchor_byte != -1)
+	{
+		p = name + s->anchor;
+
+		while ((p = memchr(p, s->anchor_byte, last + s->anchor - p + 1)) != NULL)
+		{
+			if (match_segment_at(s, p - s->anchor))
+				return p - s->anchor;
+			p++;
+		}
+
+		return NULL;
+	}
+
+	for (p = name; p <= last; p++)
+		if (match_fold[*p] == (unsigned char)s->text[0] && match_segment_at(s, p))
+			return p;
+
+	return NULL;
+}
+
+/*
+ * match_pattern()
+ *
+ * Matches a string against a compiled mask.
+ *
+ * inputs:
+ *       a compiled mask and a string
+ *
+ * outputs:
+ *       0 if it matches, 1 if not, like match()
+ *
+ * side effects:
+ *       the mask is folded again if the case mapping changed
+ */
+int match_pattern(match_pattern_t *mp, const char *name)
+{
+	const unsigned char *n = (const unsigned char *)name, *end, *p;
+	const match_segment_t *first, *last;
+	unsigned int i;
+	size_t len;
+
+	if (mp == NULL || name == NULL)
+		return 1;
+
+	if (mp->kind == MATCH_PATTERN_ANY)
+		return 0;
+
+	if (mp->kind == MATCH_PATTERN_GLOB)
+		return match(mp->mask, name);
+
+	if (mp->mapping != match_mapping)
+		match_pattern_fold(mp);
+
+	len = strlen(name);
+	if (len < mp->minlen)
+		return 1;
+
+	first = &mp->seg[0];
+	last = &mp->seg[mp->nseg - 1];
+	end = n + len;
+
+	switch (mp->kind)
+	{
+	case MATCH_PATTERN_LITERAL:
+		return len == first->len && match_segment_at(first, n) ? 0 : 1;
+	case MATCH_PATTERN_PREFIX:
+		return match_segment_at(first, n) ? 0 : 1;
+	case MATCH_PATTERN_SUFFIX:
+		return match_segment_at(first, end - first->len) ? 0 : 1;
+	case MATCH_PATTERN_SUBSTRING:
+		return match_segment_find(first, n, len) != NULL ? 0 : 1;
+	default:
+		break;
+	}
+
+	/* anchored ends first; minlen keeps them from overlapping */
+	i = 0;
+	if (!mp->lead)
+	{
+		if (!match_segment_at(first, n))
+			return 1;
+		n += first->len;
+		i++;
+	}
+
+	if (!mp->trail)
+	{
+		if (!match_segment_at(last, end - last->len))
+			return 1;
+		end -= last->len;
+	}
+
+	for (; i < mp->nseg - (mp->trail ? 0 : 1); i++)
+	{
+		if ((p = match_segment_find(&mp->seg[i], n, end - n)) == NULL)
+			return 1;
+		n = p + mp->seg[i].len;
+	}
+
+	return 0;
+}
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
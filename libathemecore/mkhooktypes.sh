@@ -28,23 +28,34 @@ fi
 echo "/* Generated by $0 from $1, do not edit! */"
 echo "/* Type checking for hook functions */"
 echo
+handles=
 while read hook type; do
 	case $hook:$type in
 	[#]*|:)
 		continue
 		;;
 	*:void)
-		echo "#define hook_call_$hook() hook_call_event(\"$hook\", NULL)"
+		echo "E hook_t *hook_handle_$hook;"
+		echo "#define hook_call_$hook() hook_call_handle(hook_handle_$hook, NULL)"
 		# Still require a dummy void * function parameter here.
-		echo "#define hook_add_$hook(f) hook_add_hook(\"$hook\", f)"
-		echo "#define hook_add_first_$hook(f) hook_add_hook_first(\"$hook\", f)"
-		echo "#define hook_del_$hook(f) hook_del_hook(\"$hook\", f)"
+		echo "#define hook_add_$hook(f) hook_add_handler(hook_handle_$hook, f, false)"
+		echo "#define hook_add_first_$hook(f) hook_add_handler(hook_handle_$hook, f, true)"
+		echo "#define hook_del_$hook(f) hook_del_handler(hook_handle_$hook, f)"
 		;;
 	*)
-		echo "#define hook_call_$hook(x) hook_call_event(\"$hook\", ENSURE_TYPE(x, $type))"
-		echo "#define hook_add_$hook(f) hook_add_hook(\"$hook\", (void (*)(void *))ENSURE_TYPE(f, void (*)($type)))"
-		echo "#define hook_add_first_$hook(f) hook_add_hook_first(\"$hook\", (void (*)(void *))ENSURE_TYPE(f, void (*)($type)))"
-		echo "#define hook_del_$hook(f) hook_del_hook(\"$hook\", (void (*)(void *))ENSURE_TYPE(f, void (*)($type)))"
+		echo "E hook_t *hook_handle_$hook;"
+		echo "#define hook_call_$hook(x) hook_call_handle(hook_handle_$hook, ENSURE_TYPE(x, $type))"
+		echo "#define hook_add_$hook(f) hook_add_handler(hook_handle_$hook, (void (*)(void *))ENSURE_TYPE(f, void (*)($type)), false)"
+		echo "#define hook_add_first_$hook(f) hook_add_handler(hook_handle_$hook, (void (*)(void *))ENSURE_TYPE(f, void (*)($type)), true)"
+		echo "#define hook_del_$hook(f) hook_del_handler(hook_handle_$hook, (void (*)(void *))ENSURE_TYPE(f, void (*)($type)))"
 		;;
 	esac
+	handles="$handles $hook"
 done < "$1"
+echo
+echo "/* The handles are resolved by hooks_init(). */"
+echo "#define HOOK_HANDLES(X) \\"
+for hook in $handles; do
+	echo "	X($hook) \\"
+done
+echo "	/* end */"
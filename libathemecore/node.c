@@ -33,6 +33,8 @@ mowgli_heap_t *kline_heap;	/* 16 */
 mowgli_heap_t *xline_heap;	/* 16 */
 mowgli_heap_t *qline_heap;	/* 16 */
 
+static void init_line_indexes(void);
+
 /*************
  * L I S T S *
  *************/
@@ -49,6 +51,8 @@ void init_nodes(void)
 		exit(EXIT_FAILURE);
 	}
 
+	init_line_indexes();
+
 	init_uplinks();
 	init_servers();
 	init_metadata();
@@ -119,19 +123,389 @@ void remove_illegals()
  * K L I N E *
  *************/
 
+/*
+ * AKILLs are indexed by their host mask, so that checking a connecting
+ * user does not run match() against every one of them. Literal hosts are
+ * looked up directly, *tail and head* masks by probing each length in
+ * use, and ip/len masks by probing each prefix length in use; whatever
+ * is found is still checked with the original match so the index only
+ * has to be complete, not exact. Other masks are kept on a list and
+ * matched one by one.
+ */
+typedef enum {
+	KLINE_LITERAL,
+	KLINE_SUFFIX,
+	KLINE_PREFIX,
+	KLINE_OTHER
+} kline_class_t;
+
+static mowgli_patricia_t *kline_by_host;	/* host -> list of klines */
+static mowgli_patricia_t *kline_by_suffix;	/* tail of *tail -> list of klines */
+static mowgli_patricia_t *kline_by_prefix;	/* head of head* -> list of klines */
+static mowgli_patricia_t *kline_by_net;		/* network/len -> list of klines */
+static mowgli_patricia_t *kline_by_num;		/* number -> kline */
+static mowgli_list_t kline_other;
+static unsigned int kline_num_dups;		/* klines shadowed in kline_by_num */
+
+/* how many klines are indexed under keys of each length */
+static unsigned int kline_suffix_lens[HOSTLEN + 1];
+static unsigned int kline_prefix_lens[HOSTLEN + 1];
+static unsigned int kline_net_lens[129];	/* IPv4 prefix lengths are stored as 96 + len */
+
+#define KLINE_WILDCARDS	"*?&#%\\"
+
+/* X-lines and nick Q-lines are matched through pattern sets */
+static pattern_set_t *xline_patterns;
+static pattern_set_t *qline_patterns;
+static mowgli_patricia_t *qline_by_mask;	/* mask -> list of qlines */
+
+static void init_line_indexes(void)
+{
+	kline_by_host = mowgli_patricia_create(irccasecanon);
+	kline_by_suffix = mowgli_patricia_create(irccasecanon);
+	kline_by_prefix = mowgli_patricia_create(irccasecanon);
+	kline_by_net = mowgli_patricia_create(noopcanon);
+	kline_by_num = mowgli_patricia_create(noopcanon);
+
+	xline_patterns = pattern_set_create();
+	qline_patterns = pattern_set_create();
+	qline_by_mask = mowgli_patricia_create(irccasecanon);
+}
+
+/* the network part of an address as a table key */
+static void kline_net_key(const unsigned char *addr, int bits, int len, char *key, size_t keylen)
+{
+	unsigned char net[16];
+	char *p = key;
+	int i;
+
+	memcpy(net, addr, bits / 8);
+	for (i = len; i < bits; i++)
+		net[i / 8] &= ~(0x80 >> (i % 8));
+
+	for (i = 0; i < (len + 7) / 8 && (size_t)(p - key) + 3 < keylen; i++)
+		p += sprintf(p, "%02x", net[i]);
+
+	snprintf(p, keylen - (p - key), "/%d", bits == 32 ? 96 + len : len);
+}
+
+/* the network key of an ip/len mask, if it is one match_ips() would take */
+static bool kline_net_of(const char *host, char *key, size_t keylen, int *len)
+{
+	unsigned char addr[16];
+	char ip[HOSTLEN + 1];
+	const char *slash;
+	int bits;
+
+	if ((slash = strrchr(host, '/')) == NULL || (size_t)(slash - host) >= sizeof ip)
+		return false;
+
+	memcpy(ip, host, slash - host);
+	ip[slash - host] = '\0';
+	*len = atoi(slash + 1);
+
+	if ((bits = cidr_parse_ip(ip, addr)) == 0 || *len <= 0 || *len > bits)
+		return false;
+
+	kline_net_key(addr, bits, *len, key, keylen);
+
+	if (bits == 32)
+		*len += 96;
+
+	return true;
+}
+
+static kline_class_t kline_classify(const char *host, char *key, size_t keylen, int *len)
+{
+	size_t n = strlen(host);
+
+	if (strpbrk(host, KLINE_WILDCARDS) == NULL)
+	{
+		mowgli_strlcpy(key, host, keylen);
+		return KLINE_LITERAL;
+	}
+
+	if (n > 1 && n <= HOSTLEN + 1 && host[0] == '*' && strpbrk(host + 1, KLINE_WILDCARDS) == NULL)
+	{
+		mowgli_strlcpy(key, host + 1, keylen);
+		*len = n - 1;
+		return KLINE_SUFFIX;
+	}
+
+	if (n > 1 && n <= HOSTLEN + 1 && host[n - 1] == '*' && strcspn(host, KLINE_WILDCARDS) == n - 1)
+	{
+		mowgli_strlcpy(key, host, keylen);
+		key[n - 1] = '\0';
+		*len = n - 1;
+		return KLINE_PREFIX;
+	}
+
+	return KLINE_OTHER;
+}
+
+/* keys that several entries can share map to lists of them */
+static void index_bucket_add(mowgli_patricia_t *table, const char *key, void *data)
+{
+	mowgli_list_t *l;
+
+	if ((l = mowgli_patricia_retrieve(table, key)) == NULL)
+	{
+		l = mowgli_list_create();
+		mowgli_patricia_add(table, key, l);
+	}
+
+	mowgli_node_add(data, mowgli_node_create(), l);
+}
+
+static void index_bucket_delete(mowgli_patricia_t *table, const char *key, void *data)
+{
+	mowgli_list_t *l;
+	mowgli_node_t *n;
+
+	if ((l = mowgli_patricia_retrieve(table, key)) == NULL)
+		return;
+
+	if ((n = mowgli_node_find(data, l)) != NULL)
+	{
+		mowgli_node_delete(n, l);
+		mowgli_node_free(n);
+	}
+
+	if (MOWGLI_LIST_LENGTH(l) == 0)
+	{
+		mowgli_patricia_delete(table, key);
+		mowgli_list_free(l);
+	}
+}
+
+static void kline_index_add(kline_t *k)
+{
+	char key[BUFSIZE];
+	int len = 0;
+
+	snprintf(key, sizeof key, "%lu", k->number);
+	if (mowgli_patricia_retrieve(kline_by_num, key) == NULL)
+		mowgli_patricia_add(kline_by_num, key, k);
+	else
+		kline_num_dups++;
+
+	switch (kline_classify(k->host, key, sizeof key, &len))
+	{
+	case KLINE_LITERAL:
+		index_bucket_add(kline_by_host, key, k);
+		if (kline_net_of(k->host, key, sizeof key, &len))
+		{
+			index_bucket_add(kline_by_net, key, k);
+			kline_net_lens[len]++;
+		}
+		break;
+	case KLINE_SUFFIX:
+		index_bucket_add(kline_by_suffix, key, k);
+		kline_suffix_lens[len]++;
+		break;
+	case KLINE_PREFIX:
+		index_bucket_add(kline_by_prefix, key, k);
+		kline_prefix_lens[len]++;
+		break;
+	default:
+		mowgli_node_add(k, mowgli_node_create(), &kline_other);
+	}
+}
+
+static void kline_index_delete(kline_t *k)
+{
+	mowgli_node_t *n;
+	char key[BUFSIZE];
+	int len = 0;
+
+	snprintf(key, sizeof key, "%lu", k->number);
+	if (mowgli_patricia_retrieve(kline_by_num, key) != k)
+		kline_num_dups--;
+	else
+	{
+		mowgli_patricia_delete(kline_by_num, key);
+
+		/* let another kline with the same number, from an old database, take its place */
+		MOWGLI_ITER_FOREACH(n, kline_num_dups > 0 ? klnlist.head : NULL)
+		{
+			if (n->data != k && ((kline_t *)n->data)->number == k->number)
+			{
+				mowgli_patricia_add(kline_by_num, key, n->data);
+				kline_num_dups--;
+				break;
+			}
+		}
+	}
+
+	switch (kline_classify(k->host, key, sizeof key, &len))
+	{
+	case KLINE_LITERAL:
+		index_bucket_delete(kline_by_host, key, k);
+		if (kline_net_of(k->host, key, sizeof key, &len))
+		{
+			index_bucket_delete(kline_by_net, key, k);
+			kline_net_lens[len]--;
+		}
+		break;
+	case KLINE_SUFFIX:
+		index_bucket_delete(kline_by_suffix, key, k);
+		kline_suffix_lens[len]--;
+		break;
+	case KLINE_PREFIX:
+		index_bucket_delete(kline_by_prefix, key, k);
+		kline_prefix_lens[len]--;
+		break;
+	default:
+		if ((n = mowgli_node_find(k, &kline_other)) != NULL)
+		{
+			mowgli_node_delete(n, &kline_other);
+			mowgli_node_free(n);
+		}
+	}
+}
+
+/* the original test: does kline k match this user@host or user@ip? */
+static bool kline_matches(kline_t *k, const char *user, const char *host, const char *ip)
+{
+	if (match_pattern(k->userpat, user))
+		return false;
+
+	if (!match_pattern(k->hostpat, host))
+		return true;
+
+	return ip != NULL && (!match_pattern(k->hostpat, ip) || !match_ips(k->host, ip));
+}
+
+typedef struct {
+	const char *user;
+	const char *host;
+	const char *ip;
+	bool active;	/* skip expired klines */
+} kline_query_t;
+
+static kline_t *kline_bucket_find(mowgli_patricia_t *table, const char *key, kline_query_t *q)
+{
+	mowgli_list_t *l;
+	mowgli_node_t *n;
+	kline_t *k;
+
+	if ((l = mowgli_patricia_retrieve(table, key)) == NULL)
+		return NULL;
+
+	MOWGLI_ITER_FOREACH(n, l->head)
+	{
+		k = n->data;
+
+		if (q->active && k->duration != 0 && k->expires <= CURRTIME)
+			continue;
+		if (kline_matches(k, q->user, q->host, q->ip))
+			return k;
+	}
+
+	return NULL;
+}
+
+/* looks up the klines with literal, *tail or head* masks matching host */
+static kline_t *kline_find_host(const char *host, kline_query_t *q)
+{
+	char buf[HOSTLEN + 1];
+	size_t hlen, n;
+	kline_t *k;
+
+	if ((k = kline_bucket_find(kline_by_host, host, q)) != NULL)
+		return k;
+
+	hlen = strlen(host);
+
+	for (n = 1; n <= hlen && n <= HOSTLEN; n++)
+	{
+		if (kline_suffix_lens[n] > 0 && (k = kline_bucket_find(kline_by_suffix, host + hlen - n, q)) != NULL)
+			return k;
+
+		if (kline_prefix_lens[n] > 0)
+		{
+			memcpy(buf, host, n);
+			buf[n] = '\0';
+
+			if ((k = kline_bucket_find(kline_by_prefix, buf, q)) != NULL)
+				return k;
+		}
+	}
+
+	return NULL;
+}
+
+/* looks up the klines with ip/len masks matching ip */
+static kline_t *kline_find_ip(const char *ip, kline_query_t *q)
+{
+	unsigned char addr[16];
+	char key[BUFSIZE];
+	int bits, len, first;
+	kline_t *k;
+
+	if ((bits = cidr_parse_ip(ip, addr)) == 0)
+		return NULL;
+
+	first = bits == 32 ? 96 : 0;
+
+	for (len = 1; len <= bits; len++)
+	{
+		if (kline_net_lens[first + len] == 0)
+			continue;
+
+		kline_net_key(addr, bits, len, key, sizeof key);
+
+		if ((k = kline_bucket_find(kline_by_net, key, q)) != NULL)
+			return k;
+	}
+
+	return NULL;
+}
+
+static kline_t *kline_find_query(kline_query_t *q)
+{
+	mowgli_node_t *n;
+	kline_t *k;
+
+	if ((k = kline_find_host(q->host, q)) != NULL)
+		return k;
+
+	if (q->ip != NULL)
+	{
+		if (strcmp(q->ip, q->host) && (k = kline_find_host(q->ip, q)) != NULL)
+			return k;
+
+		if ((k = kline_find_ip(q->ip, q)) != NULL)
+			return k;
+	}
+
+	MOWGLI_ITER_FOREACH(n, kline_other.head)
+	{
+		k = n->data;
+
+		if (q->active && k->duration != 0 && k->expires <= CURRTIME)
+			continue;
+		if (kline_matches(k, q->user, q->host, q->ip))
+			return k;
+	}
+
+	return NULL;
+}
+
 kline_t *kline_add_with_id(const char *user, const char *host, const char *reason, long duration, const char *setby, unsigned long id)
 {
 	kline_t *k;
-	mowgli_node_t *n = mowgli_node_create();
 
 	slog(LG_DEBUG, "kline_add(): %s@%s -> %s (%ld)", user, host, reason, duration);
 
 	k = mowgli_heap_alloc(kline_heap);
 
-	mowgli_node_add(k, n, &klnlist);
+	mowgli_node_add(k, &k->node, &klnlist);
 
 	k->user = sstrdup(user);
 	k->host = sstrdup(host);
+	k->userpat = match_pattern_create(user);
+	k->hostpat = match_pattern_create(host);
 	k->reason = sstrdup(reason);
 	k->setby = sstrdup(setby);
 	k->duration = duration;
@@ -139,6 +513,8 @@ kline_t *kline_add_with_id(const char *user, const char *host, const char *reaso
 	k->expires = CURRTIME + duration;
 	k->number = id;
 
+	kline_index_add(k);
+
 	cnt.kline++;
 
 
@@ -158,8 +534,6 @@ kline_t *kline_add(const char *user, const char *host, const char *reason, long
 
 void kline_delete(kline_t *k)
 {
-	mowgli_node_t *n;
-
 	return_if_fail(k != NULL);
 
 	slog(LG_DEBUG, "kline_delete(): %s@%s -> %s", k->user, k->host, k->reason);
@@ -168,12 +542,13 @@ void kline_delete(kline_t *k)
 	if (me.connected && (k->duration == 0 || k->expires > CURRTIME))
 		unkline_sts("*", k->user, k->host);
 
-	n = mowgli_node_find(k, &klnlist);
-	mowgli_node_delete(n, &klnlist);
-	mowgli_node_free(n);
+	mowgli_node_delete(&k->node, &klnlist);
+	kline_index_delete(k);
 
 	free(k->user);
 	free(k->host);
+	match_pattern_destroy(k->userpat);
+	match_pattern_destroy(k->hostpat);
 	free(k->reason);
 	free(k->setby);
 
@@ -184,52 +559,25 @@ void kline_delete(kline_t *k)
 
 kline_t *kline_find(const char *user, const char *host)
 {
-	kline_t *k;
-	mowgli_node_t *n;
-
-	MOWGLI_ITER_FOREACH(n, klnlist.head)
-	{
-		k = (kline_t *)n->data;
+	kline_query_t q = { user, host, NULL, false };
 
-		if ((!match(k->user, user)) && (!match(k->host, host)))
-			return k;
-	}
-
-	return NULL;
+	return kline_find_query(&q);
 }
 
 kline_t *kline_find_num(unsigned long number)
 {
-	kline_t *k;
-	mowgli_node_t *n;
-
-	MOWGLI_ITER_FOREACH(n, klnlist.head)
-	{
-		k = (kline_t *)n->data;
+	char key[BUFSIZE];
 
-		if (k->number == number)
-			return k;
-	}
+	snprintf(key, sizeof key, "%lu", number);
 
-	return NULL;
+	return mowgli_patricia_retrieve(kline_by_num, key);
 }
 
 kline_t *kline_find_user(user_t *u)
 {
-	kline_t *k;
-	mowgli_node_t *n;
-
-	MOWGLI_ITER_FOREACH(n, klnlist.head)
-	{
-		k = (kline_t *)n->data;
+	kline_query_t q = { u->user, u->host, u->ip, true };
 
-		if (k->duration != 0 && k->expires <= CURRTIME)
-			continue;
-		if (!match(k->user, u->user) && (!match(k->host, u->host) || !match(k->host, u->ip) || !match_ips(k->host, u->ip)))
-			return k;
-	}
-
-	return NULL;
+	return kline_find_query(&q);
 }
 
 void kline_expire(void *arg)
@@ -268,14 +616,13 @@ void kline_expire(void *arg)
 xline_t *xline_add(const char *realname, const char *reason, long duration, const char *setby)
 {
 	xline_t *x;
-	mowgli_node_t *n = mowgli_node_create();
 	static unsigned int xcnt = 0;
 
 	slog(LG_DEBUG, "xline_add(): %s -> %s (%ld)", realname, reason, duration);
 
 	x = mowgli_heap_alloc(xline_heap);
 
-	mowgli_node_add(x, n, &xlnlist);
+	mowgli_node_add(x, &x->node, &xlnlist);
 
 	x->realname = sstrdup(realname);
 	x->reason = sstrdup(reason);
@@ -284,6 +631,7 @@ xline_t *xline_add(const char *realname, const char *reason, long duration, cons
 	x->settime = CURRTIME;
 	x->expires = CURRTIME + duration;
 	x->number = ++xcnt;
+	x->pattern = pattern_set_add(xline_patterns, x->realname, x);
 
 	cnt.xline++;
 
@@ -296,7 +644,6 @@ xline_t *xline_add(const char *realname, const char *reason, long duration, cons
 void xline_delete(const char *realname)
 {
 	xline_t *x = xline_find(realname);
-	mowgli_node_t *n;
 
 	if (!x)
 	{
@@ -310,9 +657,8 @@ void xline_delete(const char *realname)
 	if (me.connected && (x->duration == 0 || x->expires > CURRTIME))
 		unxline_sts("*", x->realname);
 
-	n = mowgli_node_find(x, &xlnlist);
-	mowgli_node_delete(n, &xlnlist);
-	mowgli_node_free(n);
+	mowgli_node_delete(&x->node, &xlnlist);
+	pattern_set_delete(xline_patterns, x->pattern);
 
 	free(x->realname);
 	free(x->reason);
@@ -325,18 +671,7 @@ void xline_delete(const char *realname)
 
 xline_t *xline_find(const char *realname)
 {
-	xline_t *x;
-	mowgli_node_t *n;
-
-	MOWGLI_ITER_FOREACH(n, xlnlist.head)
-	{
-		x = (xline_t *)n->data;
-
-		if (!match(x->realname, realname))
-			return x;
-	}
-
-	return NULL;
+	return pattern_set_match(xline_patterns, realname, NULL);
 }
 
 xline_t *xline_find_num(unsigned int number)
@@ -355,23 +690,16 @@ xline_t *xline_find_num(unsigned int number)
 	return NULL;
 }
 
-xline_t *xline_find_user(user_t *u)
+static bool xline_active(void *data)
 {
-	xline_t *x;
-	mowgli_node_t *n;
-
-	MOWGLI_ITER_FOREACH(n, xlnlist.head)
-	{
-		x = (xline_t *)n->data;
-
-		if (x->duration != 0 && x->expires <= CURRTIME)
-			continue;
+	xline_t *x = data;
 
-		if (!match(x->realname, u->gecos))
-			return x;
-	}
+	return x->duration == 0 || x->expires > CURRTIME;
+}
 
-	return NULL;
+xline_t *xline_find_user(user_t *u)
+{
+	return pattern_set_match(xline_patterns, u->gecos, xline_active);
 }
 
 void xline_expire(void *arg)
@@ -406,13 +734,12 @@ void xline_expire(void *arg)
 qline_t *qline_add(const char *mask, const char *reason, long duration, const char *setby)
 {
 	qline_t *q;
-	mowgli_node_t *n = mowgli_node_create();
 	static unsigned int qcnt = 0;
 
 	slog(LG_DEBUG, "qline_add(): %s -> %s (%ld)", mask, reason, duration);
 
 	q = mowgli_heap_alloc(qline_heap);
-	mowgli_node_add(q, n, &qlnlist);
+	mowgli_node_add(q, &q->node, &qlnlist);
 
 	q->mask = sstrdup(mask);
 	q->reason = sstrdup(reason);
@@ -422,6 +749,13 @@ qline_t *qline_add(const char *mask, const char *reason, long duration, const ch
 	q->expires = CURRTIME + duration;
 	q->number = ++qcnt;
 
+	index_bucket_add(qline_by_mask, q->mask, q);
+
+	if (q->mask[0] == '#' || q->mask[0] == '&')
+		q->pattern = NULL;
+	else
+		q->pattern = pattern_set_add(qline_patterns, q->mask, q);
+
 	cnt.qline++;
 
 	if (me.connected)
@@ -433,7 +767,6 @@ qline_t *qline_add(const char *mask, const char *reason, long duration, const ch
 void qline_delete(const char *mask)
 {
 	qline_t *q = qline_find(mask);
-	mowgli_node_t *n;
 
 	if (!q)
 	{
@@ -447,9 +780,11 @@ void qline_delete(const char *mask)
 	if (me.connected && (q->duration == 0 || q->expires > CURRTIME))
 		unqline_sts("*", q->mask);
 
-	n = mowgli_node_find(q, &qlnlist);
-	mowgli_node_delete(n, &qlnlist);
-	mowgli_node_free(n);
+	mowgli_node_delete(&q->node, &qlnlist);
+	index_bucket_delete(qline_by_mask, q->mask, q);
+
+	if (q->pattern != NULL)
+		pattern_set_delete(qline_patterns, q->pattern);
 
 	free(q->mask);
 	free(q->reason);
@@ -462,18 +797,12 @@ void qline_delete(const char *mask)
 
 qline_t *qline_find(const char *mask)
 {
-	qline_t *q;
-	mowgli_node_t *n;
-
-	MOWGLI_ITER_FOREACH(n, qlnlist.head)
-	{
-		q = (qline_t *)n->data;
+	mowgli_list_t *l;
 
-		if (!irccasecmp(q->mask, mask))
-			return q;
-	}
+	if ((l = mowgli_patricia_retrieve(qline_by_mask, mask)) == NULL || l->head == NULL)
+		return NULL;
 
-	return NULL;
+	return l->head->data;
 }
 
 qline_t *qline_find_num(unsigned int number)
@@ -492,39 +821,30 @@ qline_t *qline_find_num(unsigned int number)
 	return NULL;
 }
 
-qline_t *qline_find_user(user_t *u)
+static bool qline_active(void *data)
 {
-	qline_t *q;
-	mowgli_node_t *n;
-
-	MOWGLI_ITER_FOREACH(n, qlnlist.head)
-	{
-		q = (qline_t *)n->data;
+	qline_t *q = data;
 
-		if (q->duration != 0 && q->expires <= CURRTIME)
-			continue;
-		if (q->mask[0] == '#' || q->mask[0] == '&')
-			continue;
-		if (!match(q->mask, u->nick))
-			return q;
-	}
+	return q->duration == 0 || q->expires > CURRTIME;
+}
 
-	return NULL;
+qline_t *qline_find_user(user_t *u)
+{
+	return pattern_set_match(qline_patterns, u->nick, qline_active);
 }
 
 qline_t *qline_find_channel(channel_t *c)
 {
-	qline_t *q;
+	mowgli_list_t *l;
 	mowgli_node_t *n;
 
-	MOWGLI_ITER_FOREACH(n, qlnlist.head)
-	{
-		q = (qline_t *)n->data;
+	if ((l = mowgli_patricia_retrieve(qline_by_mask, c->name)) == NULL)
+		return NULL;
 
-		if (q->duration != 0 && q->expires <= CURRTIME)
-			continue;
-		if (!irccasecmp(q->mask, c->name))
-			return q;
+	MOWGLI_ITER_FOREACH(n, l->head)
+	{
+		if (qline_active(n->data))
+			return n->data;
 	}
 
 	return NULL;
@@ -22,6 +22,7 @@
  */
 
 #include "atheme.h"
+#include "internal.h"
 
 #ifdef OBJECT_DEBUG
 mowgli_list_t object_list = { NULL, NULL, 0 };
@@ -216,6 +217,28 @@ void object_dispose(void *object)
 		mowgli_patricia_destroy(metadata, NULL, NULL);
 }
 
+/* remove an entry without journaling it */
+static void metadata_destroy(void *target, const char *name)
+{
+	object_t *obj;
+	metadata_t *md = metadata_find(target, name);
+
+	if (!md)
+		return;
+
+	obj = object(target);
+
+	if (obj->metadata == NULL)
+		obj->metadata = mowgli_patricia_create(strcasecanon);
+
+	mowgli_patricia_delete(obj->metadata, name);
+
+	strshare_unref(md->name);
+	free(md->value);
+
+	mowgli_heap_free(metadata_heap, md);
+}
+
 metadata_t *metadata_add(void *target, const char *name, const char *value)
 {
 	object_t *obj;
@@ -230,7 +253,7 @@ metadata_t *metadata_add(void *target, const char *name, const char *value)
 		obj->metadata = mowgli_patricia_create(strcasecanon);
 
 	if (metadata_find(target, name))
-		metadata_delete(target, name);
+		metadata_destroy(target, name);
 
 	md = mowgli_heap_alloc(metadata_heap);
 
@@ -239,28 +262,18 @@ metadata_t *metadata_add(void *target, const char *name, const char *value)
 
 	mowgli_patricia_add(obj->metadata, md->name, md);
 
+	metadata_journal(target, name, value);
+
 	return md;
 }
 
 void metadata_delete(void *target, const char *name)
 {
-	object_t *obj;
-	metadata_t *md = metadata_find(target, name);
-
-	if (!md)
+	if (!metadata_find(target, name))
 		return;
 
-	obj = object(target);
-
-	if (obj->metadata == NULL)
-		obj->metadata = mowgli_patricia_create(strcasecanon);
-
-	mowgli_patricia_delete(obj->metadata, name);
-
-	strshare_unref(md->name);
-	free(md->value);
-
-	mowgli_heap_free(metadata_heap, md);
+	metadata_destroy(target, name);
+	metadata_journal(target, name, NULL);
 }
 
 metadata_t *metadata_find(void *target, const char *name)
@@ -289,9 +302,10 @@ void metadata_delete_all(void *target)
 	if (obj->metadata == NULL)
 		obj->metadata = mowgli_patricia_create(strcasecanon);
 
+	/* the owner is going away; its own journal row covers this */
 	MOWGLI_PATRICIA_FOREACH(md, &state, obj->metadata)
 	{
-		metadata_delete(obj, md->name);
+		metadata_destroy(obj, md->name);
 	}
 }
 
@@ -24,6 +24,7 @@
 #include "atheme.h"
 #include "uplink.h"
 #include "datastream.h"
+#include "internal.h"
 
 /* bursting timer */
 #if HAVE_GETTIMEOFDAY
@@ -32,27 +33,72 @@ struct timeval burstime;
 
 mowgli_eventloop_timer_t *ping_uplink_timer = NULL;
 
+/* the line being parsed, so we know what we crashed on */
+static const char *core_line_buf;
+static size_t core_line_len;
+
+/* called by the protocol parser with each line before tokenizing it, and
+ * with NULL once it is done with it */
+void core_line_set(const char *line)
+{
+	core_line_buf = line;
+	core_line_len = line != NULL ? strlen(line) : 0;
+}
+
+/* puts the line being parsed back together for logging; tokenizing it
+ * replaced separators with NULs, including the colon of a trailing
+ * parameter */
+const char *core_line(void)
+{
+	static char buf[BUFSIZE];
+	size_t i, len;
+
+	if (core_line_buf == NULL)
+		return "";
+
+	len = core_line_len < sizeof buf ? core_line_len : sizeof buf - 1;
+	for (i = 0; i < len; i++)
+		buf[i] = core_line_buf[i] != '\0' ? core_line_buf[i] : ' ';
+	buf[len] = '\0';
+
+	return buf;
+}
+
 static void irc_recvq_handler(connection_t *cptr)
 {
 	bool wasnonl;
 	char parsebuf[BUFSIZE + 1];
-	int count;
-
-	wasnonl = cptr->flags & CF_NONEWLINE ? true : false;
-	count = recvq_getline(cptr, parsebuf, sizeof parsebuf - 1);
-	if (count <= 0)
-		return;
-	cnt.bin += count;
-	/* ignore the excessive part of a too long line */
-	if (wasnonl)
-		return;
-	me.uplinkpong = CURRTIME;
-	if (parsebuf[count - 1] == '\n')
-		count--;
-	if (count > 0 && parsebuf[count - 1] == '\r')
-		count--;
-	parsebuf[count] = '\0';
-	parse(parsebuf);
+	char *line;
+	size_t count;
+
+	/* handle every complete line there is, in place in the recvq */
+	while (!(cptr->flags & CF_DEAD))
+	{
+		wasnonl = cptr->flags & CF_NONEWLINE ? true : false;
+		line = recvq_nextline(cptr, BUFSIZE, &count);
+		if (line == NULL)
+			return;
+		cnt.bin += count;
+		/* ignore the excessive part of a too long line */
+		if (wasnonl)
+			continue;
+		me.uplinkpong = CURRTIME;
+		if (line[count - 1] == '\n')
+			count--;
+		else
+		{
+			/* the first part of a too long line; the byte after it is not ours */
+			memcpy(parsebuf, line, count);
+			line = parsebuf;
+		}
+		if (count > 0 && line[count - 1] == '\r')
+			count--;
+		line[count] = '\0';
+		/* the link's handshake is replayed after a handoff restart */
+		if (!me.recvsvr)
+			handoff_record(line);
+		parse(line);
+	}
 }
 
 static void ping_uplink(void *arg)
@@ -85,18 +131,32 @@ static void ping_uplink(void *arg)
 	}
 }
 
+static void irc_setup_connection(connection_t *cptr)
+{
+	cptr->flags = CF_UPLINK;
+	cptr->recvq_handler = irc_recvq_handler;
+	connection_setselect_read(cptr, recvq_put);
+	me.connected = true;
+
+	/* ping our uplink every 5 minutes */
+	if (ping_uplink_timer != NULL)
+		mowgli_timer_destroy(base_eventloop, ping_uplink_timer);
+
+	ping_uplink_timer = mowgli_timer_add(base_eventloop, "ping_uplink", ping_uplink, NULL, 300);
+
+	me.uplinkpong = time(NULL);
+}
+
 void irc_handle_connect(connection_t *cptr)
 {
 	/* add our server */
 	{
-		cptr->flags = CF_UPLINK;
-		cptr->recvq_handler = irc_recvq_handler;
-		connection_setselect_read(cptr, recvq_put);
 		slog(LG_INFO, "irc_handle_connect(): connection to uplink established");
-		me.connected = true;
 		/* no SERVER message received */
 		me.recvsvr = false;
+		handoff_forget();
 
+		irc_setup_connection(cptr);
 
 		server_login();
 
@@ -107,15 +167,15 @@ void irc_handle_connect(connection_t *cptr)
 
 		/* done bursting by this time... */
 		ping_sts();
+	}
+}
 
-		/* ping our uplink every 5 minutes */
-		if (ping_uplink_timer != NULL)
-			mowgli_timer_destroy(base_eventloop, ping_uplink_timer);
-
-		ping_uplink_timer = mowgli_timer_add(base_eventloop, "ping_uplink", ping_uplink, NULL, 300);
+/* takes over a link that an earlier process set up, see handoff.c */
+void irc_handle_adopt(connection_t *cptr)
+{
+	slog(LG_INFO, "irc_handle_adopt(): taking over the connection to the uplink");
 
-		me.uplinkpong = time(NULL);
-	}
+	irc_setup_connection(cptr);
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
@@ -0,0 +1,708 @@
+/*
+ * atheme-services: A collection of minimalist IRC services
+ * patternset.c: Matching a string against many glob patterns at once
+ *
+ * Copyright (c) 2026 Atheme Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Every pattern has a longest run of literal characters, which any string
+ * it matches must contain. Those runs are compiled into an Aho-Corasick
+ * automaton, so one pass over the string finds the patterns that can
+ * possibly match it; only those are then tried with match(), or with
+ * regex_match() for regexes. Patterns without a literal character are
+ * always tried. The automaton is built on the first lookup after the set
+ * changes.
+ */
+
+#include "atheme.h"
+
+struct pattern_set_entry_ {
+	char *pattern;
+	atheme_regex_t *re;	/* the compiled pattern, if it is a regex */
+	int reflags;
+	void *data;
+	unsigned int seq;	/* order of addition */
+	unsigned int stamp;	/* lookup that last tried this pattern */
+	mowgli_node_t node;
+};
+
+/* automaton; index 0 of edges and outputs means none, state 0 is the root */
+typedef struct {
+	unsigned int edge;	/* first edge */
+	unsigned int fail;
+	unsigned int dict;	/* nearest state on the fail chain with outputs */
+	unsigned int output;	/* first output */
+} pattern_state_t;
+
+typedef struct {
+	unsigned char c;
+	unsigned int next;
+	unsigned int sibling;
+} pattern_edge_t;
+
+typedef struct {
+	pattern_set_entry_t *entry;
+	unsigned int next;
+} pattern_output_t;
+
+struct pattern_set_ {
+	mowgli_list_t entries;
+	unsigned int seq;
+	unsigned int stamp;
+
+	bool dirty;
+	mowgli_list_t always;	/* patterns without literals */
+
+	pattern_state_t *states;
+	unsigned int nstates, maxstates;
+	pattern_edge_t *edges;
+	unsigned int nedges, maxedges;
+	pattern_output_t *outputs;
+	unsigned int noutputs, maxoutputs;
+
+	pattern_set_entry_t **candidates;	/* for pattern_set_match_all() */
+	unsigned int ncandidates, maxcandidates;
+};
+
+pattern_set_t *pattern_set_create(void)
+{
+	pattern_set_t *ps;
+
+	ps = scalloc(sizeof(pattern_set_t), 1);
+	ps->dirty = true;
+
+	return ps;
+}
+
+static void pattern_set_clear(pattern_set_t *ps)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, ps->always.head)
+	{
+		mowgli_node_delete(n, &ps->always);
+		mowgli_node_free(n);
+	}
+
+	free(ps->states);
+	free(ps->edges);
+	free(ps->outputs);
+
+	ps->states = NULL;
+	ps->edges = NULL;
+	ps->outputs = NULL;
+	ps->nstates = ps->maxstates = 0;
+	ps->nedges = ps->maxedges = 0;
+	ps->noutputs = ps->maxoutputs = 0;
+}
+
+void pattern_set_destroy(pattern_set_t *ps)
+{
+	mowgli_node_t *n, *tn;
+	pattern_set_entry_t *e;
+
+	return_if_fail(ps != NULL);
+
+	pattern_set_clear(ps);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, ps->entries.head)
+	{
+		e = n->data;
+
+		mowgli_node_delete(&e->node, &ps->entries);
+		free(e->pattern);
+		free(e);
+	}
+
+	free(ps->candidates);
+	free(ps);
+}
+
+/*
+ * pattern_set_add()
+ *
+ * Adds a pattern to a set.
+ *
+ * inputs:
+ *       a pattern set, a pattern for match() and the data to return
+ *       when it matches
+ *
+ * outputs:
+ *       a handle for pattern_set_delete()
+ *
+ * side effects:
+ *       the set is recompiled on the next lookup
+ */
+pattern_set_entry_t *pattern_set_add(pattern_set_t *ps, const char *pattern, void *data)
+{
+	pattern_set_entry_t *e;
+
+	return_val_if_fail(ps != NULL && pattern != NULL, NULL);
+
+	e = smalloc(sizeof(pattern_set_entry_t));
+	e->pattern = sstrdup(pattern);
+	e->re = NULL;
+	e->reflags = 0;
+	e->data = data;
+	e->seq = ps->seq++;
+	e->stamp = 0;
+
+	mowgli_node_add(e, &e->node, &ps->entries);
+	ps->dirty = true;
+
+	return e;
+}
+
+/*
+ * pattern_set_add_regex()
+ *
+ * Adds a regex to a set.
+ *
+ * inputs:
+ *       a pattern set, a regex and the flags as given to regex_create(),
+ *       the compiled regex and the data to return when it matches; the
+ *       compiled regex must stay around until the entry is deleted
+ *
+ * outputs:
+ *       a handle for pattern_set_delete()
+ *
+ * side effects:
+ *       the set is recompiled on the next lookup
+ */
+pattern_set_entry_t *pattern_set_add_regex(pattern_set_t *ps, const char *pattern, int flags, atheme_regex_t *re, void *data)
+{
+	pattern_set_entry_t *e;
+
+	return_val_if_fail(re != NULL, NULL);
+
+	if ((e = pattern_set_add(ps, pattern, data)) == NULL)
+		return NULL;
+
+	e->re = re;
+	e->reflags = flags;
+
+	return e;
+}
+
+void pattern_set_delete(pattern_set_t *ps, pattern_set_entry_t *e)
+{
+	return_if_fail(ps != NULL && e != NULL);
+
+	mowgli_node_delete(&e->node, &ps->entries);
+	free(e->pattern);
+	free(e);
+
+	ps->dirty = true;
+}
+
+/* finds the longest run of characters match() compares literally */
+static size_t pattern_literal(const char *pattern, char *buf, size_t buflen)
+{
+	const char *p;
+	char run[BUFSIZE];
+	size_t len = 0, best = 0;
+
+	for (p = pattern; *p != '\0'; p++)
+	{
+		if (*p == '\\' && p[1] != '\0' && strchr("*?&#%", p[1]) != NULL)
+			p++;
+		else if (strchr("*?&#%", *p) != NULL)
+		{
+			len = 0;
+			continue;
+		}
+
+		if (len + 1 >= sizeof run)
+			break;
+
+		run[len++] = ToLower(*p);
+
+		if (len > best && len < buflen)
+		{
+			best = len;
+			memcpy(buf, run, len);
+		}
+	}
+
+	buf[best] = '\0';
+	return best;
+}
+
+/*
+ * Skips a bracket expression; p points at its [. A ] right after the [ or
+ * [^ is part of the set, as is one in [:class:], [.coll.] or [=equiv=].
+ * Returns what follows the closing ], or NULL if there is none.
+ */
+static const unsigned char *regex_skip_bracket(const unsigned char *p, bool pcre)
+{
+	const unsigned char *end;
+
+	p++;
+	if (*p == '^')
+		p++;
+	if (*p == ']')
+		p++;
+
+	while (*p != '\0' && *p != ']')
+	{
+		if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '='))
+		{
+			end = (const unsigned char *)strstr((const char *)p + 2, p[1] == ':' ? ":]" : p[1] == '.' ? ".]" : "=]");
+
+			if (end == NULL)
+				return NULL;
+			p = end + 2;
+			continue;
+		}
+		if (pcre && *p == '\\' && p[1] != '\0')
+			p++;
+		p++;
+	}
+
+	return *p == ']' ? p + 1 : NULL;
+}
+
+/*
+ * The same for a regex, erring on the side of a shorter run: anything that
+ * is not plainly a literal character, or that a quantifier may drop, ends
+ * the run, and alternation at the top level means there is none at all.
+ * Only ASCII is used, as the case folding of the scan only covers that.
+ */
+static size_t regex_literal(const char *pattern, bool pcre, char *buf, size_t buflen)
+{
+	const unsigned char *p = (const unsigned char *)pattern;
+	char run[BUFSIZE];
+	size_t len = 0, best = 0;
+	bool last_literal = false;	/* whether the last atom is at the end of run */
+	int depth;
+
+#define RUN_END() do { \
+		if (len > best && len < buflen) \
+		{ \
+			best = len; \
+			memcpy(buf, run, len); \
+		} \
+		len = 0; \
+		last_literal = false; \
+	} while (0)
+
+	/* extended mode, comments and quoting change what is literal */
+	if (pcre && (strstr(pattern, "(?") != NULL || strstr(pattern, "\\Q") != NULL))
+		return buf[0] = '\0', 0;
+
+	while (*p != '\0')
+	{
+		switch (*p)
+		{
+		case '\\':
+			if (p[1] == '\0')
+				goto out;
+
+			/* \d, \x41, \1, \p{..} and so on */
+			if (isalnum(p[1]) || p[1] >= 0x80)
+			{
+				RUN_END();
+				for (p += 2; isalnum(*p); p++)
+					;
+				if (*p == '{' && (p = (const unsigned char *)strchr((const char *)p, '}')) != NULL)
+					p++;
+				if (p == NULL)
+					goto out;
+				continue;
+			}
+
+			if (len + 1 >= sizeof run)
+				goto out;
+			run[len++] = ToLower(p[1]);
+			last_literal = true;
+			p += 2;
+			continue;
+
+		case '[':
+			RUN_END();
+			if ((p = regex_skip_bracket(p, pcre)) == NULL)
+				goto out;
+			continue;
+
+		case '(':
+			RUN_END();
+			for (depth = 0; *p != '\0'; p++)
+			{
+				/* a ) in a bracket expression does not close anything */
+				if (*p == '[')
+				{
+					if ((p = regex_skip_bracket(p, pcre)) == NULL)
+						goto out;
+					p--;
+				}
+				else if (*p == '\\' && p[1] != '\0')
+					p++;
+				else if (*p == '(')
+					depth++;
+				else if (*p == ')' && --depth == 0)
+					break;
+			}
+			if (*p == '\0')
+				goto out;
+			p++;
+			continue;
+
+		case '|':
+			buf[0] = '\0';
+			return 0;
+
+		case '*':
+		case '?':
+		case '{':
+			/* the atom before may not be there at all */
+			if (last_literal)
+				len--;
+			RUN_END();
+			if (*p == '{' && (p = (const unsigned char *)strchr((const char *)p, '}')) == NULL)
+				goto out;
+			p++;
+			continue;
+
+		case '+':
+			/* POSIX reads b+? as (b+)?, which may drop the b */
+			if (last_literal && (p[1] == '?' || p[1] == '*' || p[1] == '{'))
+				len--;
+			RUN_END();
+			p++;
+			continue;
+
+		case '.':
+		case '^':
+		case '$':
+		case ')':
+			RUN_END();
+			p++;
+			continue;
+
+		default:
+			if (*p >= 0x80)
+			{
+				RUN_END();
+				p++;
+				continue;
+			}
+
+			if (len + 1 >= sizeof run)
+				goto out;
+			run[len++] = ToLower(*p);
+			last_literal = true;
+			p++;
+			continue;
+		}
+	}
+
+out:
+	RUN_END();
+
+#undef RUN_END
+
+	buf[best] = '\0';
+	return best;
+}
+
+static unsigned int pattern_new_state(pattern_set_t *ps)
+{
+	if (ps->nstates == ps->maxstates)
+	{
+		ps->maxstates = ps->maxstates ? ps->maxstates * 2 : 64;
+		ps->states = srealloc(ps->states, ps->maxstates * sizeof(pattern_state_t));
+	}
+
+	memset(&ps->states[ps->nstates], 0, sizeof(pattern_state_t));
+	return ps->nstates++;
+}
+
+static unsigned int pattern_goto(pattern_set_t *ps, unsigned int s, unsigned char c)
+{
+	unsigned int e;
+
+	for (e = ps->states[s].edge; e != 0; e = ps->edges[e].sibling)
+		if (ps->edges[e].c == c)
+			return ps->edges[e].next;
+
+	return 0;
+}
+
+static void pattern_insert(pattern_set_t *ps, const char *literal, pattern_set_entry_t *entry)
+{
+	unsigned int s = 0, t, e;
+	const unsigned char *p;
+
+	for (p = (const unsigned char *)literal; *p != '\0'; p++)
+	{
+		if ((t = pattern_goto(ps, s, *p)) == 0)
+		{
+			t = pattern_new_state(ps);
+
+			if (ps->nedges == ps->maxedges)
+			{
+				ps->maxedges = ps->maxedges ? ps->maxedges * 2 : 64;
+				ps->edges = srealloc(ps->edges, ps->maxedges * sizeof(pattern_edge_t));
+			}
+
+			e = ps->nedges++;
+			ps->edges[e].c = *p;
+			ps->edges[e].next = t;
+			ps->edges[e].sibling = ps->states[s].edge;
+			ps->states[s].edge = e;
+		}
+
+		s = t;
+	}
+
+	if (ps->noutputs == ps->maxoutputs)
+	{
+		ps->maxoutputs = ps->maxoutputs ? ps->maxoutputs * 2 : 64;
+		ps->outputs = srealloc(ps->outputs, ps->maxoutputs * sizeof(pattern_output_t));
+	}
+
+	e = ps->noutputs++;
+	ps->outputs[e].entry = entry;
+	ps->outputs[e].next = ps->states[s].output;
+	ps->states[s].output = e;
+}
+
+static void pattern_set_compile(pattern_set_t *ps)
+{
+	mowgli_node_t *n;
+	pattern_set_entry_t *entry;
+	char literal[BUFSIZE];
+	unsigned int *queue, head = 0, tail = 0, s, t, f, e;
+
+	pattern_set_clear(ps);
+
+	pattern_new_state(ps);
+	ps->nedges = ps->noutputs = 1;	/* 0 is the end of the chain */
+	ps->maxedges = ps->maxoutputs = 64;
+	ps->edges = smalloc(ps->maxedges * sizeof(pattern_edge_t));
+	ps->outputs = smalloc(ps->maxoutputs * sizeof(pattern_output_t));
+
+	MOWGLI_ITER_FOREACH(n, ps->entries.head)
+	{
+		entry = n->data;
+
+		if ((entry->re != NULL ? regex_literal(entry->pattern, entry->reflags & AREGEX_PCRE, literal, sizeof literal) :
+				pattern_literal(entry->pattern, literal, sizeof literal)) == 0)
+			mowgli_node_add(entry, mowgli_node_create(), &ps->always);
+		else
+			pattern_insert(ps, literal, entry);
+	}
+
+	/* breadth first, so that fail links point to states already done */
+	queue = smalloc(ps->nstates * sizeof(unsigned int));
+
+	for (e = ps->states[0].edge; e != 0; e = ps->edges[e].sibling)
+		queue[tail++] = ps->edges[e].next;
+
+	while (head < tail)
+	{
+		s = queue[head++];
+
+		for (e = ps->states[s].edge; e != 0; e = ps->edges[e].sibling)
+		{
+			t = ps->edges[e].next;
+			queue[tail++] = t;
+
+			for (f = ps->states[s].fail; f != 0 && pattern_goto(ps, f, ps->edges[e].c) == 0; f = ps->states[f].fail)
+				;
+
+			f = pattern_goto(ps, f, ps->edges[e].c);
+			ps->states[t].fail = f != t ? f : 0;
+			ps->states[t].dict = ps->states[ps->states[t].fail].output != 0 ? ps->states[t].fail : ps->states[ps->states[t].fail].dict;
+		}
+	}
+
+	free(queue);
+
+	ps->dirty = false;
+}
+
+static bool pattern_matches(pattern_set_entry_t *e, const char *subject)
+{
+	if (e->re != NULL)
+		return regex_match(e->re, (char *)subject);
+
+	return !match(e->pattern, subject);
+}
+
+static void pattern_try(pattern_set_t *ps, pattern_set_entry_t *e, const char *subject, bool (*accept)(void *data), pattern_set_entry_t **best)
+{
+	if (e->stamp == ps->stamp)
+		return;
+
+	e->stamp = ps->stamp;
+
+	if (*best != NULL && (*best)->seq < e->seq)
+		return;
+
+	if (pattern_matches(e, subject) && (accept == NULL || accept(e->data)))
+		*best = e;
+}
+
+/* compiles the set if needed and starts a lookup; false if it is empty */
+static bool pattern_set_begin(pattern_set_t *ps)
+{
+	mowgli_node_t *n;
+
+	if (MOWGLI_LIST_LENGTH(&ps->entries) == 0)
+		return false;
+
+	if (ps->dirty)
+		pattern_set_compile(ps);
+
+	if (++ps->stamp == 0)
+	{
+		/* stamps wrapped; forget the old ones */
+		MOWGLI_ITER_FOREACH(n, ps->entries.head)
+			((pattern_set_entry_t *)n->data)->stamp = 0;
+		ps->stamp = 1;
+	}
+
+	return true;
+}
+
+/* feeds the automaton one character of the string */
+static inline unsigned int pattern_step(pattern_set_t *ps, unsigned int s, unsigned char c)
+{
+	c = ToLower(c);
+
+	while (s != 0 && pattern_goto(ps, s, c) == 0)
+		s = ps->states[s].fail;
+
+	return pattern_goto(ps, s, c);
+}
+
+/*
+ * pattern_set_match()
+ *
+ * Finds the pattern of a set that was added first among those matching a
+ * string, like trying them all with match() in order would.
+ *
+ * inputs:
+ *       a pattern set, a string and optionally a function that can reject
+ *       the data of a matching pattern
+ *
+ * outputs:
+ *       the data of the matching pattern, or NULL
+ *
+ * side effects:
+ *       the set is compiled if it changed
+ */
+void *pattern_set_match(pattern_set_t *ps, const char *subject, bool (*accept)(void *data))
+{
+	pattern_set_entry_t *best = NULL;
+	const unsigned char *p;
+	mowgli_node_t *n;
+	unsigned int s = 0, t, o;
+
+	return_val_if_fail(ps != NULL && subject != NULL, NULL);
+
+	if (!pattern_set_begin(ps))
+		return NULL;
+
+	for (p = (const unsigned char *)subject; *p != '\0'; p++)
+	{
+		s = pattern_step(ps, s, *p);
+
+		for (t = ps->states[s].output != 0 ? s : ps->states[s].dict; t != 0; t = ps->states[t].dict)
+			for (o = ps->states[t].output; o != 0; o = ps->outputs[o].next)
+				pattern_try(ps, ps->outputs[o].entry, subject, accept, &best);
+	}
+
+	MOWGLI_ITER_FOREACH(n, ps->always.head)
+		pattern_try(ps, n->data, subject, accept, &best);
+
+	return best != NULL ? best->data : NULL;
+}
+
+static void pattern_candidate(pattern_set_t *ps, pattern_set_entry_t *e)
+{
+	if (e->stamp == ps->stamp)
+		return;
+
+	e->stamp = ps->stamp;
+
+	if (ps->ncandidates == ps->maxcandidates)
+	{
+		ps->maxcandidates = ps->maxcandidates ? ps->maxcandidates * 2 : 16;
+		ps->candidates = srealloc(ps->candidates, ps->maxcandidates * sizeof(pattern_set_entry_t *));
+	}
+
+	ps->candidates[ps->ncandidates++] = e;
+}
+
+static int pattern_seq_cmp(const void *a, const void *b)
+{
+	const pattern_set_entry_t *ea = *(pattern_set_entry_t * const *)a;
+	const pattern_set_entry_t *eb = *(pattern_set_entry_t * const *)b;
+
+	return ea->seq < eb->seq ? -1 : ea->seq > eb->seq;
+}
+
+/*
+ * pattern_set_match_all()
+ *
+ * Finds every pattern of a set that matches a string.
+ *
+ * inputs:
+ *       a pattern set, a string, and a function to call with the data of
+ *       each matching pattern and privdata, in the order they were added
+ *
+ * outputs:
+ *       the number of matching patterns
+ *
+ * side effects:
+ *       the set is compiled if it changed. This is not reentrant: the
+ *       callback must neither change the set nor match against it again,
+ *       also not indirectly, e.g. through a hook that something it sends
+ *       runs synchronously
+ */
+unsigned int pattern_set_match_all(pattern_set_t *ps, const char *subject, void (*cb)(void *data, void *privdata), void *privdata)
+{
+	const unsigned char *p;
+	mowgli_node_t *n;
+	unsigned int s = 0, t, o, i, count = 0;
+
+	return_val_if_fail(ps != NULL && subject != NULL && cb != NULL, 0);
+
+	if (!pattern_set_begin(ps))
+		return 0;
+
+	ps->ncandidates = 0;
+
+	for (p = (const unsigned char *)subject; *p != '\0'; p++)
+	{
+		s = pattern_step(ps, s, *p);
+
+		for (t = ps->states[s].output != 0 ? s : ps->states[s].dict; t != 0; t = ps->states[t].dict)
+			for (o = ps->states[t].output; o != 0; o = ps->outputs[o].next)
+				pattern_candidate(ps, ps->outputs[o].entry);
+	}
+
+	MOWGLI_ITER_FOREACH(n, ps->always.head)
+		pattern_candidate(ps, n->data);
+
+	qsort(ps->candidates, ps->ncandidates, sizeof(pattern_set_entry_t *), pattern_seq_cmp);
+
+	for (i = 0; i < ps->ncandidates; i++)
+	{
+		if (!pattern_matches(ps->candidates[i], subject))
+			continue;
+
+		cb(ps->candidates[i]->data, privdata);
+		count++;
+	}
+
+	return count;
+}
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
@@ -25,6 +25,7 @@
 #include "uplink.h"
 #include "pmodule.h"
 #include "privs.h"
+#include "datastream.h"
 
 void handle_info(user_t *u)
 {
@@ -79,6 +80,13 @@ static void connection_stats_cb(const char *line, void *privdata)
 	numeric_sts(me.me, 249, ((user_t *)privdata), "F :%s", line);
 }
 
+static void command_stats_cb(command_stats_t *st, void *privdata)
+{
+	numeric_sts(me.me, 249, ((user_t *)privdata), "M :%-28s %7u %9.1fms avg %7.2fms max %7.2fms",
+			st->name, st->count, st->total_us / 1000.0,
+			st->total_us / 1000.0 / st->count, st->max_us / 1000.0);
+}
+
 void handle_stats(user_t *u, char req)
 {
 	kline_t *k;
@@ -191,6 +199,14 @@ void handle_stats(user_t *u, char req)
 
 		  break;
 
+	  case 'M':
+	  case 'm':
+		  if (!has_priv_user(u, PRIV_SERVER_AUSPEX))
+			  break;
+
+		  command_stats_foreach(command_stats_cb, u);
+		  break;
+
 	  case 'o':
 	  case 'O':
 		  if (!has_priv_user(u, PRIV_VIEWPRIVS))
@@ -242,6 +258,11 @@ void handle_stats(user_t *u, char req)
 		  numeric_sts(me.me, 249, u, "T :objects    %7zu", MOWGLI_LIST_LENGTH(&object_list));
 #endif
 
+		  numeric_sts(me.me, 249, u, "T :db saves   %7u (%u failed, %u coalesced)", db_save_stats.saves, db_save_stats.failures, db_save_stats.coalesced);
+		  numeric_sts(me.me, 249, u, "T :db save    %7ums (stalled %ums, max %ums)", db_save_stats.last_duration, db_save_stats.last_stall, db_save_stats.max_stall);
+
+		  numeric_sts(me.me, 249, u, "T :hooks      %7llums", hook_time_us / 1000);
+		  numeric_sts(me.me, 249, u, "T :sendq pool %7u (%u chunks allocated)", sendq_pool_length(), sendq_pool_allocs);
 		  numeric_sts(me.me, 249, u, "T :bytes sent %7.2f%s", bytes(cnt.bout), sbytes(cnt.bout));
 		  numeric_sts(me.me, 249, u, "T :bytes recv %7.2f%s", bytes(cnt.bin), sbytes(cnt.bin));
 		  break;
@@ -784,9 +805,10 @@ server_t *handle_server(sourceinfo_t *si, const char *name, const char *sid,
 		/* A server introducing another server */
 		s = server_add(name, hops, si->s, sid, desc);
 	}
-	else if (cnt.server == 1)
+	else if (!me.recvsvr)
 	{
-		/* Our uplink introducing itself */
+		/* Our uplink introducing itself; servers kept across a
+		 * reconnect (see reconciletime) may already be there */
 		if (irccasecmp(name, curr_uplink->name))
 			slog(LG_ERROR, "handle_server(): uplink %s actually has name %s, continuing anyway", curr_uplink->name, name);
 		s = server_add(name, hops, me.me, sid, desc);
@@ -31,6 +31,8 @@ mowgli_heap_t *serv_heap;
 mowgli_heap_t *tld_heap;
 
 static void server_delete_serv(server_t *s);
+static void server_announce_delete(server_t *s);
+static void server_delete_tree(server_t *s);
 
 /*
  * init_servers()
@@ -62,6 +64,65 @@ void init_servers(void)
 	sidlist = mowgli_patricia_create(noopcanon);
 }
 
+/*
+ * Takes back a server kept from before the uplink was lost, if the burst
+ * introduces it again as it was; one that changed is deleted instead.
+ */
+static server_t *server_reconfirm(const char *name, unsigned int hops, server_t *uplink, const char *id, const char *desc)
+{
+	server_t *s = NULL;
+	mowgli_node_t *n;
+
+	if (id != NULL)
+		s = mowgli_patricia_retrieve(sidlist, id);
+	if (s == NULL && name != NULL)
+		s = mowgli_patricia_retrieve(servlist, name);
+
+	if (s == NULL || !(s->flags & SF_UNCONFIRMED))
+		return NULL;
+
+	if ((name != NULL ? irccasecmp(s->name, name) : !(s->flags & SF_MASKED)) ||
+			(id != NULL ? s->sid == NULL || strcmp(s->sid, id) : s->sid != NULL))
+	{
+		server_delete_serv(s);
+		return NULL;
+	}
+
+	s->flags &= ~SF_UNCONFIRMED;
+	s->hops = hops;
+
+	if (!strncmp(desc, "(H)", 3))
+	{
+		s->flags |= SF_HIDE;
+		desc += 3;
+		if (*desc == ' ')
+			desc++;
+	}
+	else
+		s->flags &= ~SF_HIDE;
+
+	free(s->desc);
+	s->desc = sstrdup(desc);
+
+	if (s->uplink != uplink)
+	{
+		if (s->uplink != NULL)
+		{
+			n = mowgli_node_find(s, &s->uplink->children);
+			mowgli_node_delete(n, &s->uplink->children);
+			mowgli_node_free(n);
+		}
+
+		s->uplink = uplink;
+		if (uplink != NULL)
+			mowgli_node_add(s, mowgli_node_create(), &uplink->children);
+	}
+
+	slog(LG_DEBUG, "server_add(): %s was kept, confirmed", s->name);
+
+	return s;
+}
+
 /*
  * server_add(const char *name, unsigned int hops, const char *uplink,
  *            const char *id, const char *desc)
@@ -103,6 +164,9 @@ server_t *server_add(const char *name, unsigned int hops, server_t *uplink, cons
 	else
 		slog(LG_DEBUG, "server_add(): %s, root", name);
 
+	if ((s = server_reconfirm(name, hops, uplink, id, desc)) != NULL)
+		return s;
+
 	s = mowgli_heap_alloc(serv_heap);
 
 	if (id != NULL)
@@ -179,11 +243,40 @@ void server_delete(const char *name)
 	server_delete_serv(s);
 }
 
-static void server_delete_serv(server_t *s)
+/* collects the users on a server and the servers behind it */
+static void server_collect_users(server_t *s, user_t ***users, size_t *count, size_t *size)
 {
-	server_t *child;
+	mowgli_node_t *n;
 	user_t *u;
-	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH(n, s->userlist.head)
+	{
+		u = (user_t *)n->data;
+		/* This user split, allow bursted logins for the account.
+		 * XXX should we do this here?
+		 * -- jilles */
+		if (u->myuser != NULL && u->myuser->flags & MU_NOBURSTLOGIN)
+		{
+			u->myuser->flags &= ~MU_NOBURSTLOGIN;
+			myuser_journal(u->myuser);
+		}
+
+		if (*count == *size)
+		{
+			*size = *size ? *size * 2 : 64;
+			*users = srealloc(*users, *size * sizeof(user_t *));
+		}
+		(*users)[(*count)++] = u;
+	}
+
+	MOWGLI_ITER_FOREACH(n, s->children.head)
+		server_collect_users(n->data, users, count, size);
+}
+
+static void server_delete_serv(server_t *s)
+{
+	user_t **users = NULL;
+	size_t count = 0, size = 0;
 
 	if (s == me.me)
 	{
@@ -195,6 +288,20 @@ static void server_delete_serv(server_t *s)
 		return;
 	}
 
+	server_announce_delete(s);
+
+	/* first get rid of all users behind it in one go */
+	server_collect_users(s, &users, &count, &size);
+	user_delete_bulk(users, count, "*.net *.split");
+	free(users);
+
+	server_delete_tree(s);
+}
+
+static void server_announce_delete(server_t *s)
+{
+	mowgli_node_t *n;
+
 	if (s->sid)
 		slog(me.connected ? LG_NETWORK : LG_DEBUG, "server_delete(): %s (%s), uplink %s (%d users)",
 				s->name, s->sid,
@@ -207,22 +314,19 @@ static void server_delete_serv(server_t *s)
 
 	hook_call_server_delete((&(hook_server_delete_t){ .s = s }));
 
-	/* first go through it's users and kill all of them */
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, s->userlist.head)
-	{
-		u = (user_t *)n->data;
-		/* This user split, allow bursted logins for the account.
-		 * XXX should we do this here?
-		 * -- jilles */
-		if (u->myuser != NULL)
-			u->myuser->flags &= ~MU_NOBURSTLOGIN;
-		user_delete(u, "*.net *.split");
-	}
+	MOWGLI_ITER_FOREACH(n, s->children.head)
+		server_announce_delete(n->data);
+}
+
+static void server_delete_tree(server_t *s)
+{
+	server_t *child;
+	mowgli_node_t *n, *tn;
 
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, s->children.head)
 	{
 		child = n->data;
-		server_delete_serv(child);
+		server_delete_tree(child);
 	}
 
 	/* now remove the server */
@@ -369,6 +369,10 @@ void handle_nickchange(user_t *u)
 	return_if_fail(u != NULL);
 	return_if_fail(!is_internal_client(u));
 
+	/* kept across an uplink reconnect; it was checked when it came */
+	if (u->flags & UF_RECONCILED)
+		return;
+
 	svs = service_find("global");
 
 	if (runflags & RF_LIVE && log_debug_enabled())
@@ -457,6 +461,7 @@ void handle_burstlogin(user_t *u, char *login, time_t ts)
 	u->flags &= ~UF_SOPER_PASS;
 	n = mowgli_node_create();
 	mowgli_node_add(u, n, &mu->logins);
+	hook_call_user_loginchange(u);
 	slog(LG_DEBUG, "handle_burstlogin(): automatically identified %s as %s", u->nick, login);
 }
 
@@ -492,6 +497,7 @@ void handle_setlogin(sourceinfo_t *si, user_t *u, char *login, time_t ts)
 			mowgli_node_free(n);
 		}
 		u->myuser = NULL;
+		hook_call_user_loginchange(u);
 	}
 	if (mu == NULL)
 	{
@@ -527,6 +533,7 @@ void handle_setlogin(sourceinfo_t *si, user_t *u, char *login, time_t ts)
 	u->flags &= ~UF_SOPER_PASS;
 	n = mowgli_node_create();
 	mowgli_node_add(u, n, &mu->logins);
+	hook_call_user_loginchange(u);
 	slog(LG_DEBUG, "handle_setlogin(): %s set %s logged in as %s",
 			get_oper_name(si), u->nick, login);
 }
@@ -554,6 +561,7 @@ void handle_clearlogin(sourceinfo_t *si, user_t *u)
 		mowgli_node_free(n);
 	}
 	u->myuser = NULL;
+	hook_call_user_loginchange(u);
 }
 
 void handle_certfp(sourceinfo_t *si, user_t *u, const char *certfp)
@@ -614,6 +622,7 @@ void myuser_login(service_t *svs, user_t *u, myuser_t *mu, bool sendaccount)
 	u->myuser = mu;
 	mowgli_node_add(u, mowgli_node_create(), &mu->logins);
 	u->flags &= ~UF_SOPER_PASS;
+	hook_call_user_loginchange(u);
 
 	/* keep track of login address for users */
 	mowgli_strlcpy(lau, u->user, BUFSIZE);
@@ -822,6 +831,42 @@ sourceinfo_t *sourceinfo_create(void)
 	return out;
 }
 
+/*
+ * Protocol parsers need a sourceinfo for every line they handle, and it is
+ * almost never referenced after the handler returns; one is kept around so
+ * that it does not have to be allocated again for the next line.
+ */
+static sourceinfo_t *sourceinfo_spare = NULL;
+
+sourceinfo_t *sourceinfo_acquire(void)
+{
+	sourceinfo_t *si;
+
+	if (sourceinfo_spare == NULL)
+		return sourceinfo_create();
+
+	si = sourceinfo_spare;
+	sourceinfo_spare = NULL;
+
+	return si;
+}
+
+void sourceinfo_release(sourceinfo_t *si)
+{
+	return_if_fail(si != NULL);
+
+	/* somebody kept a reference, or it is carrying something along */
+	if (sourceinfo_spare != NULL || object(si)->refcount != 1 ||
+			object(si)->metadata != NULL || object(si)->privatedata != NULL)
+	{
+		object_unref(si);
+		return;
+	}
+
+	memset((char *)si + sizeof(object_t), 0, sizeof(sourceinfo_t) - sizeof(object_t));
+	sourceinfo_spare = si;
+}
+
 void command_fail(sourceinfo_t *si, faultcode_t code, const char *fmt, ...)
 {
 	va_list args;
@@ -53,6 +53,7 @@ svsignore_t *svsignore_add(const char *mask, const char *reason)
         mowgli_node_add(svsignore, n, &svs_ignore_list);
         
         svsignore->mask = sstrdup(mask);
+        svsignore->pattern = match_pattern_create(mask);
         svsignore->settime = CURRTIME;
         svsignore->reason = sstrdup(reason);
         cnt.svsignore++;
@@ -95,7 +96,7 @@ svsignore_t *svsignore_find(user_t *source)
         {
                 svsignore = (svsignore_t *)n->data;
         
-                if (!match(svsignore->mask, host))
+                if (!match_pattern(svsignore->pattern, host))
                         return svsignore;
         }
 
@@ -124,6 +125,7 @@ void svsignore_delete(svsignore_t *svsignore)
 	mowgli_node_delete(n, &svs_ignore_list);
 
 	free(svsignore->mask);
+	match_pattern_destroy(svsignore->pattern);
 	free(svsignore->reason);
 	free(svsignore);
 }
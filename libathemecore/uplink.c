@@ -24,6 +24,7 @@
 #include "atheme.h"
 #include "datastream.h"
 #include "uplink.h"
+#include "internal.h"
 
 void (*parse) (char *line) = NULL;
 
@@ -163,6 +164,221 @@ void uplink_connect(void)
 		mowgli_timer_add_once(base_eventloop, "reconn", reconn, NULL, me.recontime);
 }
 
+/* takes over a connection to an uplink that an earlier process made */
+void uplink_adopt(uplink_t *u, int fd)
+{
+	curr_uplink = u;
+
+	curr_uplink->conn = connection_add(u->name, fd, CF_UPLINK, NULL, NULL);
+	curr_uplink->conn->close_handler = uplink_close;
+	sendq_set_limit(curr_uplink->conn, config_options.uplink_sendq_limit);
+
+	irc_handle_adopt(curr_uplink->conn);
+}
+
+/* forgets the network, except for our own server and services */
+static void uplink_clear_state(void)
+{
+	channel_t *c;
+	server_t *s;
+	mowgli_node_t *n, *tn;
+	mowgli_patricia_iteration_state_t state;
+
+	slog(LG_DEBUG, "uplink_close(): ----------------------- clearing -----------------------");
+
+	/* we have to kill everything.
+	 * we do not clear users here because when you delete a server,
+	 * it deletes its users
+	 */
+	if (me.actual != NULL)
+		server_delete(me.actual);
+	me.actual = NULL;
+	/* and anything kept from an earlier link */
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, me.me->children.head)
+	{
+		s = n->data;
+		server_delete(s->name);
+	}
+	/* remove all the channels left */
+	MOWGLI_PATRICIA_FOREACH(c, &state, chanlist)
+	{
+		channel_delete(c);
+	}
+	/* this leaves me.me and all users on it (i.e. services) */
+
+	slog(LG_DEBUG, "uplink_close(): ------------------------- done -------------------------");
+}
+
+static mowgli_eventloop_timer_t *reconcile_timer = NULL;
+
+static void reconcile_expire(void *arg)
+{
+	reconcile_timer = NULL;
+
+	/* if we are linked again, the end of the burst sorts it out */
+	if (me.connected)
+		return;
+
+	slog(LG_INFO, "reconcile_expire(): uplink did not come back in time, forgetting the network");
+	uplink_clear_state();
+}
+
+static void reconcile_mark_servers(server_t *s)
+{
+	mowgli_node_t *n;
+
+	s->flags |= SF_UNCONFIRMED;
+	s->flags &= ~(SF_EOB | SF_EOB2);
+
+	MOWGLI_ITER_FOREACH(n, s->children.head)
+		reconcile_mark_servers(n->data);
+}
+
+/* masked servers only have a SID to be found by */
+static void reconcile_collect_servers(server_t *s, mowgli_list_t *gone)
+{
+	mowgli_node_t *n;
+
+	if (s->flags & SF_UNCONFIRMED)
+	{
+		mowgli_node_add(sstrdup(ircd->uses_uid && s->sid != NULL ? s->sid : s->name), mowgli_node_create(), gone);
+		return;
+	}
+
+	MOWGLI_ITER_FOREACH(n, s->children.head)
+		reconcile_collect_servers(n->data, gone);
+}
+
+/*
+ * Keeps what is known about the network while the uplink is away. Every
+ * server, user and channel membership is marked unconfirmed; the burst
+ * after the next link confirms what is still there (see server_add(),
+ * user_add() and chanuser_add()) and reconcile_burst_done() drops the
+ * rest. Services leave their channels, as the ircd forgot them there.
+ */
+static void uplink_keep_state(void)
+{
+	mowgli_patricia_iteration_state_t state;
+	mowgli_node_t *n, *tn;
+	user_t *u;
+	channel_t *c;
+	chanuser_t *cu;
+
+	slog(LG_INFO, "uplink_close(): keeping network state for up to %u seconds", me.reconciletime);
+
+	MOWGLI_ITER_FOREACH(n, me.me->children.head)
+		reconcile_mark_servers(n->data);
+
+	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
+	{
+		if (u->server != me.me)
+			u->flags |= UF_UNCONFIRMED;
+	}
+
+	MOWGLI_PATRICIA_FOREACH(c, &state, chanlist)
+	{
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, c->members.head)
+		{
+			cu = n->data;
+			if (!is_internal_client(cu->user))
+				cu->unconfirmed = true;
+			else
+				chanuser_unlink(cu);
+		}
+
+		if (c->nummembers == 0)
+			channel_delete(c);
+	}
+
+	/* the uplink's name belongs to its server_t */
+	me.actual = NULL;
+
+	if (reconcile_timer == NULL)
+		reconcile_timer = mowgli_timer_add_once(base_eventloop, "reconcile_expire", reconcile_expire, NULL, me.reconciletime);
+}
+
+/* drops what the burst did not confirm */
+static void reconcile_burst_done(void *unused)
+{
+	mowgli_patricia_iteration_state_t state;
+	mowgli_node_t *n, *tn;
+	mowgli_list_t gone = { NULL, NULL, 0 };
+	user_t **users = NULL;
+	size_t count = 0, size = 0;
+	unsigned int kept = 0, parted = 0;
+	user_t *u;
+	channel_t *c;
+	chanuser_t *cu;
+
+	if (reconcile_timer != NULL)
+	{
+		mowgli_timer_destroy(base_eventloop, reconcile_timer);
+		reconcile_timer = NULL;
+	}
+
+	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
+	{
+		if (u->flags & UF_RECONCILED)
+			kept++;
+		u->flags &= ~UF_RECONCILED;
+
+		if (!(u->flags & UF_UNCONFIRMED))
+			continue;
+
+		if (u->myuser != NULL && u->myuser->flags & MU_NOBURSTLOGIN)
+		{
+			u->myuser->flags &= ~MU_NOBURSTLOGIN;
+			myuser_journal(u->myuser);
+		}
+
+		if (count == size)
+		{
+			size = size ? size * 2 : 64;
+			users = srealloc(users, size * sizeof(user_t *));
+		}
+		users[count++] = u;
+	}
+
+	user_delete_bulk(users, count, "*.net *.split");
+	free(users);
+
+	/* users that are still there but left channels meanwhile */
+	MOWGLI_PATRICIA_FOREACH(c, &state, chanlist)
+	{
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, c->members.head)
+		{
+			cu = n->data;
+			if (!cu->unconfirmed)
+				continue;
+
+			parted++;
+			if (c->nummembers == 1)
+			{
+				/* the channel goes with its last member */
+				chanuser_delete(c, cu->user);
+				break;
+			}
+			chanuser_delete(c, cu->user);
+		}
+	}
+
+	MOWGLI_ITER_FOREACH(n, me.me->children.head)
+		reconcile_collect_servers(n->data, &gone);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, gone.head)
+	{
+		server_delete(n->data);
+
+		free(n->data);
+		mowgli_node_delete(n, &gone);
+		mowgli_node_free(n);
+	}
+
+	if (kept != 0 || count != 0)
+		slog(LG_INFO, "reconcile_burst_done(): kept %u users, dropped %zu users and %u memberships",
+				kept, count, parted);
+}
+
 /*
  * uplink_close()
  * 
@@ -177,11 +393,11 @@ void uplink_connect(void)
  *       reconnection is scheduled
  *       uplink marked dead
  *       uplink deleted if it had been removed from configuration
+ *       network state kept or cleared, see reconciletime
  */
 static void uplink_close(connection_t *cptr)
 {
-	channel_t *c;
-	mowgli_patricia_iteration_state_t state;
+	static bool reconcile_hooked = false;
 
 	mowgli_timer_add_once(base_eventloop, "reconn", reconn, NULL, me.recontime);
 
@@ -200,23 +416,20 @@ static void uplink_close(connection_t *cptr)
 	}
 	curr_uplink->conn = NULL;
 
-	slog(LG_DEBUG, "uplink_close(): ----------------------- clearing -----------------------");
+	if (me.reconciletime == 0)
+	{
+		uplink_clear_state();
+		return;
+	}
 
-	/* we have to kill everything.
-	 * we do not clear users here because when you delete a server,
-	 * it deletes its users
-	 */
-	if (me.actual != NULL)
-		server_delete(me.actual);
-	me.actual = NULL;
-	/* remove all the channels left */
-	MOWGLI_PATRICIA_FOREACH(c, &state, chanlist)
+	if (!reconcile_hooked)
 	{
-		channel_delete(c);
+		hook_add_event("burst_done");
+		hook_add_first_burst_done(reconcile_burst_done);
+		reconcile_hooked = true;
 	}
-	/* this leaves me.me and all users on it (i.e. services) */
 
-	slog(LG_DEBUG, "uplink_close(): ------------------------- done -------------------------");
+	uplink_keep_state();
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs ts=8 sw=8 noexpandtab
@@ -22,6 +22,7 @@
  */
 
 #include "atheme.h"
+#include "internal.h"
 
 mowgli_heap_t *user_heap;
 
@@ -56,6 +57,56 @@ void init_users(void)
 	uidlist = mowgli_patricia_create(noopcanon);
 }
 
+static void user_replace_string(char **ref, const char *value)
+{
+	if (*ref != NULL && !strcmp(*ref, value))
+		return;
+
+	strshare_unref(*ref);
+	*ref = strshare_get(value);
+}
+
+/*
+ * Takes back a user kept from before the uplink was lost, if the burst
+ * introduces it again as the same client; a stale one is deleted instead.
+ */
+static user_t *user_reconfirm(user_t *u2, const char *user, const char *host,
+	const char *vhost, const char *ip, const char *uid, const char *gecos,
+	server_t *server, time_t ts)
+{
+	user_t *u;
+
+	/* a kept user may hold the UID under another nick */
+	if (uid != NULL && (u = mowgli_patricia_retrieve(uidlist, uid)) != NULL &&
+			u != u2 && u->flags & UF_UNCONFIRMED)
+		user_delete(u, "*.net *.split");
+
+	if (u2 == NULL || !(u2->flags & UF_UNCONFIRMED))
+		return NULL;
+
+	if (u2->server != server || u2->ts != ts ||
+			(uid != NULL ? u2->uid == NULL || strcmp(u2->uid, uid) : u2->uid != NULL) ||
+			strcmp(u2->user, user) || strcmp(u2->host, host))
+	{
+		user_delete(u2, "*.net *.split");
+		return NULL;
+	}
+
+	u2->flags &= ~UF_UNCONFIRMED;
+	u2->flags |= UF_RECONCILED;
+
+	user_replace_string(&u2->vhost, vhost ? vhost : host);
+	user_replace_string(&u2->chost, vhost ? vhost : host);
+	user_replace_string(&u2->gecos, gecos);
+
+	if (ip && strcmp(ip, "0") && strcmp(ip, "0.0.0.0") && strcmp(ip, "255.255.255.255"))
+		user_replace_string(&u2->ip, ip);
+
+	slog(LG_DEBUG, "user_add(): %s was kept, confirmed", u2->nick);
+
+	return u2;
+}
+
 /*
  * user_add(const char *nick, const char *user, const char *host, const char *vhost, const char *ip,
  *          const char *uid, const char *gecos, server_t *server, time_t ts);
@@ -91,6 +142,14 @@ user_t *user_add(const char *nick, const char *user, const char *host,
 	slog(LG_DEBUG, "user_add(): %s (%s@%s) -> %s", nick, user, host, server->name);
 
 	u2 = user_find_named(nick);
+	if (server != me.me)
+	{
+		if ((u = user_reconfirm(u2, user, host, vhost, ip, uid, gecos, server, ts)) != NULL)
+			return u;
+		/* a stale user may have been deleted */
+		if (u2 != NULL)
+			u2 = user_find_named(nick);
+	}
 	if (u2 != NULL)
 	{
 		if (server == me.me)
@@ -186,25 +245,13 @@ user_t *user_add(const char *nick, const char *user, const char *host,
 	return hdata.u;
 }
 
-/*
- * user_delete(user_t *u, const char *comment)
- *
- * Destroys a user object and deletes the object from the users DTree.
- *
- * Inputs:
- *     - user object to delete
- *     - quit comment
- *
- * Outputs:
- *     - nothing
- *
- * Side Effects:
- *     - on success, a user is deleted from the users DTree.
- */
-void user_delete(user_t *u, const char *comment)
+/* if emptied is not NULL, channels the user leaves empty are not deleted
+ * but their names are added to it */
+static void user_delete_real(user_t *u, const char *comment, mowgli_list_t *emptied)
 {
 	mowgli_node_t *n, *tn;
 	chanuser_t *cu;
+	channel_t *c;
 	mynick_t *mn;
 	char oldnick[NICKLEN];
 	bool doenforcer = false;
@@ -239,7 +286,16 @@ void user_delete(user_t *u, const char *comment)
 	{
 		cu = (chanuser_t *)n->data;
 
-		chanuser_delete(cu->chan, u);
+		if (emptied == NULL)
+		{
+			chanuser_delete(cu->chan, u);
+			continue;
+		}
+
+		c = cu->chan;
+		chanuser_unlink(cu);
+		if (c->nummembers == 0)
+			mowgli_node_add(sstrdup(c->name), mowgli_node_create(), emptied);
 	}
 
 	mowgli_patricia_delete(userlist, u->nick);
@@ -267,6 +323,8 @@ void user_delete(user_t *u, const char *comment)
 		u->myuser = NULL;
 	}
 
+	chanacs_cache_free(u);
+
 	strshare_unref(u->uid);
 	strshare_unref(u->nick);
 	strshare_unref(u->user);
@@ -284,6 +342,84 @@ void user_delete(user_t *u, const char *comment)
 		introduce_enforcer(oldnick);
 }
 
+/*
+ * user_delete(user_t *u, const char *comment)
+ *
+ * Destroys a user object and deletes the object from the users DTree.
+ *
+ * Inputs:
+ *     - user object to delete
+ *     - quit comment
+ *
+ * Outputs:
+ *     - nothing
+ *
+ * Side Effects:
+ *     - on success, a user is deleted from the users DTree.
+ */
+void user_delete(user_t *u, const char *comment)
+{
+	return_if_fail(u != NULL);
+
+	user_delete_real(u, comment, NULL);
+}
+
+/*
+ * user_delete_bulk(user_t **users, size_t count, const char *comment)
+ *
+ * Destroys many user objects at once, e.g. all users behind a split
+ * server. The user_delete_bulk hook is called once for all of them,
+ * before user_delete is called for each; modules hooking both can skip
+ * users with UF_NETSPLIT set in the latter. Channels are only checked
+ * for being empty after all users have left them.
+ *
+ * Inputs:
+ *     - array of user objects to delete
+ *     - number of user objects
+ *     - quit comment
+ *
+ * Outputs:
+ *     - nothing
+ *
+ * Side Effects:
+ *     - the users are deleted, and channels they left empty
+ */
+void user_delete_bulk(user_t **users, size_t count, const char *comment)
+{
+	mowgli_list_t emptied = { NULL, NULL, 0 };
+	mowgli_node_t *n, *tn;
+	channel_t *c;
+	size_t i;
+
+	if (count == 0)
+		return;
+
+	return_if_fail(users != NULL);
+
+	for (i = 0; i < count; i++)
+		users[i]->flags |= UF_NETSPLIT;
+
+	hook_call_user_delete_bulk((&(hook_user_delete_bulk_t){ .users = users, .count = count, .comment = comment }));
+
+	for (i = 0; i < count; i++)
+		user_delete_real(users[i], comment, &emptied);
+
+	/* hooks may have put somebody back in, or destroyed the channel */
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, emptied.head)
+	{
+		c = channel_find(n->data);
+		if (c != NULL && c->nummembers == 0 && !(c->modes & ircd->perm_mode))
+		{
+			slog(LG_DEBUG, "user_delete_bulk(): `%s' is empty, removing", c->name);
+			channel_delete(c);
+		}
+
+		free(n->data);
+		mowgli_node_delete(n, &emptied);
+		mowgli_node_free(n);
+	}
+}
+
 /*
  * user_find(const char *nick)
  *
@@ -0,0 +1,360 @@
+/*
+ * atheme-services: A collection of minimalist IRC services
+ * userscan.c: Matching a regex against every user without stalling
+ *
+ * Copyright (c) 2026 Atheme Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * A scan takes a snapshot of the nick, user, host and gecos of every user
+ * and works through it in slices of a few milliseconds, one slice per pass
+ * of the event loop, so that services keep answering while a regex is run
+ * against a large network. What a slice finds is handed to the command
+ * that started the scan right away; klines and the like are issued from
+ * there as before. The oper who started a scan gets a progress notice now
+ * and then and can cancel it; it is cancelled when they quit.
+ */
+
+#include "atheme.h"
+
+#define USERSCAN_SLICE_US		10000	/* time a slice may take */
+#define USERSCAN_PROGRESS_INTERVAL	10	/* seconds between progress notices */
+
+struct userscan_ {
+	char *name;		/* command, e.g. "RMATCH" */
+	user_t *owner;		/* oper who started it, NULL if synchronous */
+	service_t *service;
+	atheme_regex_t *re;
+
+	char *strings;		/* "nick\0user\0host\0gecos\0" per user */
+	unsigned int *offsets;
+	unsigned int count, pos, matches;
+
+	userscan_match_cb_t match;
+	userscan_done_cb_t done;
+	void *privdata;
+
+	time_t last_progress;
+	mowgli_eventloop_timer_t *timer;
+	mowgli_node_t node;
+};
+
+static mowgli_list_t userscans;
+
+static void userscan_run(void *arg);
+
+static unsigned long long userscan_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/* a sourceinfo for talking to the owner outside of the command */
+static sourceinfo_t *userscan_sourceinfo(userscan_t *us)
+{
+	sourceinfo_t *si;
+
+	si = sourceinfo_create();
+	si->su = us->owner;
+	si->smu = us->owner->myuser;
+	si->service = us->service;
+
+	return si;
+}
+
+static void userscan_destroy(userscan_t *us)
+{
+	if (us->timer != NULL)
+		mowgli_timer_destroy(base_eventloop, us->timer);
+
+	if (us->owner != NULL)
+		mowgli_node_delete(&us->node, &userscans);
+
+	regex_destroy(us->re);
+	free(us->strings);
+	free(us->offsets);
+	free(us->name);
+	free(us);
+}
+
+static void userscan_finish(userscan_t *us, sourceinfo_t *si, bool cancelled)
+{
+	us->done(si, us->matches, cancelled, us->privdata);
+	userscan_destroy(us);
+}
+
+/*
+ * runs one slice of a scan; if si is NULL, the owner is notified with a
+ * sourceinfo made up for it. returns whether the scan is finished, in which
+ * case it has been destroyed.
+ */
+static bool userscan_slice(userscan_t *us, sourceinfo_t *si)
+{
+	char usermask[BUFSIZE];
+	const char *nick, *user, *host, *gecos;
+	unsigned long long deadline;
+	bool own_si = false, finished;
+
+	if (si == NULL)
+	{
+		si = userscan_sourceinfo(us);
+		own_si = true;
+	}
+
+	deadline = userscan_now() + USERSCAN_SLICE_US;
+
+	while (us->pos < us->count)
+	{
+		nick = us->strings + us->offsets[us->pos++];
+		user = nick + strlen(nick) + 1;
+		host = user + strlen(user) + 1;
+		gecos = host + strlen(host) + 1;
+
+		snprintf(usermask, sizeof usermask, "%s!%s@%s %s", nick, user, host, gecos);
+
+		if (regex_match(us->re, usermask))
+		{
+			us->matches++;
+			us->match(si, nick, user, host, gecos, us->privdata);
+		}
+
+		/* a synchronous scan has nobody to hand the rest to */
+		if (us->owner != NULL && (us->pos & 255) == 0 && userscan_now() >= deadline)
+			break;
+	}
+
+	finished = us->pos == us->count;
+
+	if (finished)
+		userscan_finish(us, si, false);
+	else if (CURRTIME - us->last_progress >= USERSCAN_PROGRESS_INTERVAL)
+	{
+		command_success_nodata(si, _("%s: \2%u\2 of \2%u\2 users scanned, \2%u\2 matches so far (%s CANCEL to stop)"),
+				us->name, us->pos, us->count, us->matches, us->name);
+		us->last_progress = CURRTIME;
+	}
+
+	if (own_si)
+		object_unref(si);
+
+	return finished;
+}
+
+static void userscan_run(void *arg)
+{
+	userscan_t *us = arg;
+
+	us->timer = NULL;
+
+	if (!userscan_slice(us, NULL))
+		us->timer = mowgli_timer_add_once(base_eventloop, "userscan", userscan_run, us, 0);
+}
+
+static void userscan_user_delete(user_t *u)
+{
+	mowgli_node_t *n, *tn;
+	userscan_t *us;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, userscans.head)
+	{
+		us = n->data;
+
+		if (us->owner != u)
+			continue;
+
+		slog(LG_INFO, "userscan: %s by %s cancelled as they quit (%u of %u users scanned, %u matches)",
+				us->name, u->nick, us->pos, us->count, us->matches);
+		userscan_finish(us, NULL, true);
+	}
+}
+
+/* copies what the regex is matched against, so that users may come and go */
+static void userscan_snapshot(userscan_t *us)
+{
+	mowgli_patricia_iteration_state_t state;
+	user_t *u;
+	size_t size = 0, off = 0, len;
+
+	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
+		size += strlen(u->nick) + strlen(u->user) + strlen(u->host) + strlen(u->gecos) + 4;
+
+	us->count = mowgli_patricia_size(userlist);
+	us->offsets = smalloc(sizeof(unsigned int) * (us->count + 1));
+	us->strings = smalloc(size + 1);
+
+	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
+	{
+		us->offsets[us->pos++] = off;
+
+#define USERSCAN_COPY(s) \
+		len = strlen(s) + 1; \
+		memcpy(us->strings + off, (s), len); \
+		off += len;
+
+		USERSCAN_COPY(u->nick);
+		USERSCAN_COPY(u->user);
+		USERSCAN_COPY(u->host);
+		USERSCAN_COPY(u->gecos);
+
+#undef USERSCAN_COPY
+	}
+
+	us->count = us->pos;
+	us->pos = 0;
+}
+
+/*
+ * userscan_start()
+ *
+ * Matches a regex against "nick!user@host gecos" of every user.
+ *
+ * inputs:
+ *       the sourceinfo of the command, the name of the command, a compiled
+ *       regex which the scan takes over, a function called for each
+ *       matching user, a function called once the scan is over, and
+ *       privdata for both
+ *
+ * outputs:
+ *       false if the source already has a scan of that name running, in
+ *       which case nothing is called and the regex is not taken over
+ *
+ * side effects:
+ *       the first slice is run at once, and the callbacks are given si;
+ *       if the source is on IRC, the rest run from the event loop and the
+ *       callbacks are given a sourceinfo of the same user and service. If
+ *       the scan is cancelled because the user quit, done is called with
+ *       a NULL sourceinfo.
+ */
+bool userscan_start(sourceinfo_t *si, const char *name, atheme_regex_t *re,
+		userscan_match_cb_t match, userscan_done_cb_t done, void *privdata)
+{
+	static bool hooked = false;
+	userscan_t *us;
+
+	return_val_if_fail(si != NULL && name != NULL && re != NULL, false);
+	return_val_if_fail(match != NULL && done != NULL, false);
+
+	if (userscan_find(si, name))
+		return false;
+
+	if (!hooked)
+	{
+		hook_add_event("user_delete");
+		hook_add_user_delete(userscan_user_delete);
+		hooked = true;
+	}
+
+	us = scalloc(sizeof(userscan_t), 1);
+	us->name = sstrdup(name);
+	us->owner = si->su;
+	us->service = si->service;
+	us->re = re;
+	us->match = match;
+	us->done = done;
+	us->privdata = privdata;
+	us->last_progress = CURRTIME;
+
+	userscan_snapshot(us);
+
+	if (us->owner != NULL)
+		mowgli_node_add(us, &us->node, &userscans);
+
+	if (!userscan_slice(us, si))
+		us->timer = mowgli_timer_add_once(base_eventloop, "userscan", userscan_run, us, 0);
+
+	return true;
+}
+
+static userscan_t *userscan_find_real(sourceinfo_t *si, const char *name)
+{
+	mowgli_node_t *n;
+	userscan_t *us;
+
+	if (si->su == NULL)
+		return NULL;
+
+	MOWGLI_ITER_FOREACH(n, userscans.head)
+	{
+		us = n->data;
+
+		if (us->owner == si->su && !strcasecmp(us->name, name))
+			return us;
+	}
+
+	return NULL;
+}
+
+/*
+ * userscan_find()
+ *
+ * Checks whether the source of a command has a scan of a name running.
+ */
+bool userscan_find(sourceinfo_t *si, const char *name)
+{
+	return_val_if_fail(si != NULL && name != NULL, false);
+
+	return userscan_find_real(si, name) != NULL;
+}
+
+/*
+ * userscan_cancel()
+ *
+ * Stops the scan of a name the source of a command has running.
+ *
+ * inputs:
+ *       the sourceinfo of the command and the name of the scan
+ *
+ * outputs:
+ *       whether there was such a scan
+ *
+ * side effects:
+ *       its done function is called with si and cancelled set
+ */
+bool userscan_cancel(sourceinfo_t *si, const char *name)
+{
+	userscan_t *us;
+
+	return_val_if_fail(si != NULL && name != NULL, false);
+
+	if ((us = userscan_find_real(si, name)) == NULL)
+		return false;
+
+	command_success_nodata(si, _("%s: cancelled after \2%u\2 of \2%u\2 users."), us->name, us->pos, us->count);
+	userscan_finish(us, si, true);
+
+	return true;
+}
+
+/*
+ * userscan_cancel_all()
+ *
+ * Stops every scan of a name, e.g. when the module doing them is unloaded.
+ */
+void userscan_cancel_all(const char *name)
+{
+	mowgli_node_t *n, *tn;
+	userscan_t *us;
+	sourceinfo_t *si;
+
+	return_if_fail(name != NULL);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, userscans.head)
+	{
+		us = n->data;
+
+		if (strcasecmp(us->name, name))
+			continue;
+
+		si = userscan_sourceinfo(us);
+		command_success_nodata(si, _("%s: cancelled after \2%u\2 of \2%u\2 users."), us->name, us->pos, us->count);
+		userscan_finish(us, si, true);
+		object_unref(si);
+	}
+}
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
@@ -65,6 +65,8 @@ struct alis_query
 {
 	char *mask;
 	char *topic;
+	match_pattern_t *maskpat;	/* mask and topic, compiled */
+	match_pattern_t *topicpat;
 	int min;
 	int max;
 	int show_mode;
@@ -342,10 +344,10 @@ static int show_channel(channel_t *chptr, struct alis_query *query)
 				return 0;
 	}
 
-        if(match(query->mask, chptr->name))
+        if(match_pattern(query->maskpat, chptr->name))
                 return 0;
 
-        if(query->topic != NULL && match(query->topic, chptr->topic))
+        if(query->topic != NULL && match_pattern(query->topicpat, chptr->topic))
                 return 0;
 
         if(query->skip)
@@ -393,6 +395,10 @@ static void alis_cmd_list(sourceinfo_t *si, int parc, char *parv[])
                 return;
         }
 
+	query.maskpat = match_pattern_create(query.mask);
+	if (query.topic != NULL)
+		query.topicpat = match_pattern_create(query.topic);
+
 	MOWGLI_PATRICIA_FOREACH(chptr, &state, chanlist)
 	{
 		/* matches, so show it */
@@ -408,6 +414,10 @@ static void alis_cmd_list(sourceinfo_t *si, int parc, char *parv[])
 		}
 	}
 
+	match_pattern_destroy(query.maskpat);
+	if (query.topicpat != NULL)
+		match_pattern_destroy(query.topicpat);
+
 	command_success_nodata(si, "End of output");
         return;
 }
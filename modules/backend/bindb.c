@@ -0,0 +1,1063 @@
+/*
+ * Copyright (c) 2026 Atheme Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Compact binary database format. It stores the same rows as opensex,
+ * which still provides the row handlers and the load/save logic; only
+ * the file format differs.
+ *
+ * Layout (integers are LEB128 varints unless noted):
+ *
+ *   header   "ATHEMEDB" version:byte
+ *   rows     rowlen:varint cell...	(the first cell is the row type)
+ *   strings  len:varint bytes...	(the interned string table)
+ *   index    strings-offset nstrings nsections
+ *            { kind offset length rows }...
+ *   trailer  index-offset:8 bytes little endian, "ATHEMEDB"
+ *
+ * A cell is a tag byte followed by its value: 'N' (null), 'S' (string
+ * table index), 's' (length and bytes), 'I' (zigzag-encoded int), 'U'
+ * (unsigned int) or 'T' (time). Words are interned, free-form strings
+ * are stored inline. Consecutive rows of the same kind form a section,
+ * and sections can be loaded on their own through the index.
+ */
+
+#include "atheme.h"
+
+#ifdef HAVE_MMAP
+# include <sys/mman.h>
+#endif
+
+DECLARE_MODULE_V1
+(
+	"backend/bindb", true, _modinit, _moddeinit,
+	PACKAGE_STRING,
+	"Atheme Development Group <http://www.atheme.org>"
+);
+
+#define BINDB_MAGIC	"ATHEMEDB"
+#define BINDB_MAGICLEN	8
+#define BINDB_VERSION	1
+#define BINDB_TRAILER	(8 + BINDB_MAGICLEN)
+
+typedef enum {
+	BINDB_SECTION_CORE = 0,
+	BINDB_SECTION_ACCOUNTS,
+	BINDB_SECTION_CHANNELS,
+	BINDB_SECTION_KLINES,
+	BINDB_SECTION_MODULES,
+	BINDB_SECTION_COUNT
+} bindb_section_kind_t;
+
+static const char *bindb_section_names[BINDB_SECTION_COUNT] = {
+	"core", "accounts", "channels", "klines", "modules"
+};
+
+static const struct {
+	const char *type;
+	bindb_section_kind_t kind;
+} bindb_row_kinds[] = {
+	{ "GRVER", BINDB_SECTION_CORE },
+	{ "DBV", BINDB_SECTION_CORE },
+	{ "MDEP", BINDB_SECTION_CORE },
+	{ "LUID", BINDB_SECTION_CORE },
+	{ "CF", BINDB_SECTION_CORE },
+	{ "MU", BINDB_SECTION_ACCOUNTS },
+	{ "ME", BINDB_SECTION_ACCOUNTS },
+	{ "MI", BINDB_SECTION_ACCOUNTS },
+	{ "AC", BINDB_SECTION_ACCOUNTS },
+	{ "MN", BINDB_SECTION_ACCOUNTS },
+	{ "MCFP", BINDB_SECTION_ACCOUNTS },
+	{ "SU", BINDB_SECTION_ACCOUNTS },
+	{ "NAM", BINDB_SECTION_ACCOUNTS },
+	{ "SO", BINDB_SECTION_ACCOUNTS },
+	{ "MDU", BINDB_SECTION_ACCOUNTS },
+	{ "MDN", BINDB_SECTION_ACCOUNTS },
+	{ "MC", BINDB_SECTION_CHANNELS },
+	{ "CA", BINDB_SECTION_CHANNELS },
+	{ "MDC", BINDB_SECTION_CHANNELS },
+	{ "MDA", BINDB_SECTION_CHANNELS },
+	{ "KID", BINDB_SECTION_KLINES },
+	{ "KL", BINDB_SECTION_KLINES },
+	{ "XID", BINDB_SECTION_KLINES },
+	{ "XL", BINDB_SECTION_KLINES },
+	{ "QID", BINDB_SECTION_KLINES },
+	{ "QL", BINDB_SECTION_KLINES },
+	{ NULL, BINDB_SECTION_MODULES }
+};
+
+typedef struct {
+	unsigned int kind;
+	size_t offset;
+	size_t length;
+	unsigned int rows;
+} bindb_section_t;
+
+typedef struct {
+	FILE *f;
+
+	/* Sections, in file order */
+	bindb_section_t *sections;
+	unsigned int nsections;
+	unsigned int sectsize;
+
+	/* Interned strings; writing looks them up by value, reading by index */
+	mowgli_patricia_t *strids;
+	char **strs;
+	unsigned int nstrs;
+	unsigned int strsize;
+
+	/* Writing state */
+	unsigned char *row;
+	size_t rowlen;
+	size_t rowsize;
+	size_t pos;
+	unsigned int rowkind;
+	bool failed;
+
+	/* Reading state */
+	unsigned char *map;
+	size_t maplen;
+	bool mapped;
+	char *arena;
+	unsigned int cursect;
+	const unsigned char *p;
+	const unsigned char *sectend;
+	const unsigned char *rowend;
+	char *buf;
+	size_t bufsize;
+	char *rest;
+	char numbuf[32];
+} bindb_t;
+
+/* sections loaded by db_load(); the core section is always loaded */
+static unsigned int bindb_load_mask = ~0U;
+
+static database_module_t *bindb_prev = NULL;
+extern database_vtable_t bindb_vt;
+
+static bindb_section_kind_t bindb_row_kind(const char *type)
+{
+	unsigned int i;
+
+	for (i = 0; bindb_row_kinds[i].type != NULL; i++)
+		if (!strcmp(bindb_row_kinds[i].type, type))
+			return bindb_row_kinds[i].kind;
+
+	return BINDB_SECTION_MODULES;
+}
+
+/*
+ * bindb_select_sections()
+ *
+ * Restricts the following loads to some sections of the database, for
+ * tools that only need part of it. Rows of one section may refer to
+ * objects of another (channel access to accounts), so a load without
+ * those has to tolerate that.
+ *
+ * inputs:
+ *       comma separated section names, or NULL for all of them
+ *
+ * outputs:
+ *       false if a name was not recognized
+ *
+ * side effects:
+ *       changes which sections db_load() reads from a binary database
+ */
+bool bindb_select_sections(const char *list)
+{
+	char *copy, *name, *saveptr = NULL;
+	unsigned int i, mask = 1U << BINDB_SECTION_CORE;
+	bool ok = true;
+
+	if (list == NULL)
+	{
+		bindb_load_mask = ~0U;
+		return true;
+	}
+
+	copy = sstrdup(list);
+	for (name = strtok_r(copy, ",", &saveptr); name != NULL; name = strtok_r(NULL, ",", &saveptr))
+	{
+		for (i = 0; i < BINDB_SECTION_COUNT; i++)
+			if (!strcasecmp(name, bindb_section_names[i]))
+				break;
+
+		if (i == BINDB_SECTION_COUNT)
+		{
+			slog(LG_ERROR, "bindb_select_sections(): unknown section '%s'", name);
+			ok = false;
+			continue;
+		}
+
+		mask |= 1U << i;
+	}
+	free(copy);
+
+	bindb_load_mask = mask;
+	return ok;
+}
+
+/***************************************************************************************************
+ * writing
+ */
+
+static void bindb_row_reserve(bindb_t *bs, size_t len)
+{
+	if (bs->rowlen + len <= bs->rowsize)
+		return;
+
+	while (bs->rowlen + len > bs->rowsize)
+		bs->rowsize *= 2;
+
+	bs->row = srealloc(bs->row, bs->rowsize);
+}
+
+static void bindb_row_putc(bindb_t *bs, unsigned char c)
+{
+	bindb_row_reserve(bs, 1);
+	bs->row[bs->rowlen++] = c;
+}
+
+static void bindb_row_varint(bindb_t *bs, unsigned long long v)
+{
+	bindb_row_reserve(bs, 10);
+
+	while (v >= 0x80)
+	{
+		bs->row[bs->rowlen++] = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	bs->row[bs->rowlen++] = v;
+}
+
+static void bindb_row_bytes(bindb_t *bs, const char *data, size_t len)
+{
+	bindb_row_reserve(bs, len);
+	memcpy(bs->row + bs->rowlen, data, len);
+	bs->rowlen += len;
+}
+
+static void bindb_fput_varint(bindb_t *bs, unsigned long long v)
+{
+	unsigned char buf[10];
+	size_t n = 0;
+
+	while (v >= 0x80)
+	{
+		buf[n++] = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	buf[n++] = v;
+
+	if (fwrite(buf, 1, n, bs->f) != n)
+		bs->failed = true;
+	bs->pos += n;
+}
+
+static void bindb_fput_bytes(bindb_t *bs, const void *data, size_t len)
+{
+	if (fwrite(data, 1, len, bs->f) != len)
+		bs->failed = true;
+	bs->pos += len;
+}
+
+static unsigned int bindb_intern(bindb_t *bs, const char *str)
+{
+	void *id;
+
+	if ((id = mowgli_patricia_retrieve(bs->strids, str)) != NULL)
+		return (uintptr_t)id - 1;
+
+	if (bs->nstrs == bs->strsize)
+	{
+		bs->strsize = bs->strsize ? bs->strsize * 2 : 256;
+		bs->strs = srealloc(bs->strs, bs->strsize * sizeof(char *));
+	}
+
+	bs->strs[bs->nstrs] = sstrdup(str);
+	mowgli_patricia_add(bs->strids, str, (void *)(uintptr_t)(bs->nstrs + 1));
+
+	return bs->nstrs++;
+}
+
+static bool bindb_start_row(database_handle_t *db, const char *type)
+{
+	bindb_t *bs;
+
+	return_val_if_fail(db != NULL, false);
+	return_val_if_fail(type != NULL, false);
+	bs = (bindb_t *)db->priv;
+
+	bs->rowlen = 0;
+	bs->rowkind = bindb_row_kind(type);
+
+	bindb_row_putc(bs, 'S');
+	bindb_row_varint(bs, bindb_intern(bs, type));
+
+	return true;
+}
+
+static bool bindb_write_word(database_handle_t *db, const char *word)
+{
+	bindb_t *bs;
+
+	return_val_if_fail(db != NULL, false);
+	bs = (bindb_t *)db->priv;
+
+	if (word == NULL)
+	{
+		bindb_row_putc(bs, 'N');
+		return true;
+	}
+
+	bindb_row_putc(bs, 'S');
+	bindb_row_varint(bs, bindb_intern(bs, word));
+
+	return true;
+}
+
+static bool bindb_write_str(database_handle_t *db, const char *str)
+{
+	bindb_t *bs;
+	size_t len;
+
+	return_val_if_fail(db != NULL, false);
+	bs = (bindb_t *)db->priv;
+
+	if (str == NULL)
+	{
+		bindb_row_putc(bs, 'N');
+		return true;
+	}
+
+	len = strlen(str);
+	bindb_row_putc(bs, 's');
+	bindb_row_varint(bs, len);
+	bindb_row_bytes(bs, str, len);
+
+	return true;
+}
+
+static bool bindb_write_int(database_handle_t *db, int num)
+{
+	bindb_t *bs;
+
+	return_val_if_fail(db != NULL, false);
+	bs = (bindb_t *)db->priv;
+
+	bindb_row_putc(bs, 'I');
+	bindb_row_varint(bs, ((unsigned int)num << 1) ^ (unsigned int)(num >> (sizeof(int) * 8 - 1)));
+
+	return true;
+}
+
+static bool bindb_write_uint(database_handle_t *db, unsigned int num)
+{
+	bindb_t *bs;
+
+	return_val_if_fail(db != NULL, false);
+	bs = (bindb_t *)db->priv;
+
+	bindb_row_putc(bs, 'U');
+	bindb_row_varint(bs, num);
+
+	return true;
+}
+
+static bool bindb_write_time(database_handle_t *db, time_t tm)
+{
+	bindb_t *bs;
+
+	return_val_if_fail(db != NULL, false);
+	bs = (bindb_t *)db->priv;
+
+	bindb_row_putc(bs, 'T');
+	bindb_row_varint(bs, (unsigned long)tm);
+
+	return true;
+}
+
+static bool bindb_commit_row(database_handle_t *db)
+{
+	bindb_t *bs;
+	bindb_section_t *sect;
+
+	return_val_if_fail(db != NULL, false);
+	bs = (bindb_t *)db->priv;
+
+	sect = bs->nsections ? &bs->sections[bs->nsections - 1] : NULL;
+	if (sect == NULL || sect->kind != bs->rowkind)
+	{
+		if (bs->nsections == bs->sectsize)
+		{
+			bs->sectsize = bs->sectsize ? bs->sectsize * 2 : 16;
+			bs->sections = srealloc(bs->sections, bs->sectsize * sizeof(bindb_section_t));
+		}
+
+		sect = &bs->sections[bs->nsections++];
+		sect->kind = bs->rowkind;
+		sect->offset = bs->pos;
+		sect->length = 0;
+		sect->rows = 0;
+	}
+
+	bindb_fput_varint(bs, bs->rowlen);
+	bindb_fput_bytes(bs, bs->row, bs->rowlen);
+
+	sect->length = bs->pos - sect->offset;
+	sect->rows++;
+
+	return true;
+}
+
+/***************************************************************************************************
+ * reading
+ */
+
+static void bindb_corrupt(database_handle_t *db, const char *what)
+{
+	slog(LG_ERROR, "bindb: %s is corrupt (%s) near row %u", db->file, what, db->line);
+	slog(LG_ERROR, "bindb: exiting to avoid data loss");
+	exit(EXIT_FAILURE);
+}
+
+static unsigned long long bindb_get_varint(database_handle_t *db, const unsigned char **pp, const unsigned char *end)
+{
+	const unsigned char *p = *pp;
+	unsigned long long v = 0;
+	unsigned int shift = 0;
+
+	do
+	{
+		if (p >= end || shift > 63)
+			bindb_corrupt(db, "truncated integer");
+
+		v |= (unsigned long long)(*p & 0x7f) << shift;
+		shift += 7;
+	} while (*p++ & 0x80);
+
+	*pp = p;
+	return v;
+}
+
+static const char *bindb_string(database_handle_t *db, unsigned long long id)
+{
+	bindb_t *bs = (bindb_t *)db->priv;
+
+	if (id >= bs->nstrs)
+		bindb_corrupt(db, "string index out of range");
+
+	return bs->strs[id];
+}
+
+/* the next cell of the row as text, or NULL at the end of the row */
+static const char *bindb_read_cell(database_handle_t *db)
+{
+	bindb_t *bs = (bindb_t *)db->priv;
+	unsigned long long v, len;
+	unsigned char tag;
+
+	if (bs->p >= bs->rowend)
+		return NULL;
+
+	db->token++;
+	tag = *bs->p++;
+
+	switch (tag)
+	{
+	case 'N':
+		return "*";
+	case 'S':
+		return bindb_string(db, bindb_get_varint(db, &bs->p, bs->rowend));
+	case 's':
+		len = bindb_get_varint(db, &bs->p, bs->rowend);
+		if (len > (unsigned long long)(bs->rowend - bs->p))
+			bindb_corrupt(db, "string past end of row");
+
+		if (len >= bs->bufsize)
+		{
+			bs->bufsize = len + 1;
+			bs->buf = srealloc(bs->buf, bs->bufsize);
+		}
+		memcpy(bs->buf, bs->p, len);
+		bs->buf[len] = '\0';
+		bs->p += len;
+		return bs->buf;
+	case 'I':
+		v = bindb_get_varint(db, &bs->p, bs->rowend);
+		snprintf(bs->numbuf, sizeof bs->numbuf, "%d", (int)((v >> 1) ^ -(v & 1)));
+		return bs->numbuf;
+	case 'U':
+	case 'T':
+		v = bindb_get_varint(db, &bs->p, bs->rowend);
+		snprintf(bs->numbuf, sizeof bs->numbuf, "%llu", v);
+		return bs->numbuf;
+	default:
+		bindb_corrupt(db, "unknown cell type");
+	}
+
+	return NULL;
+}
+
+static bool bindb_read_next_row(database_handle_t *db)
+{
+	bindb_t *bs = (bindb_t *)db->priv;
+	bindb_section_t *sect;
+	unsigned long long len;
+
+	bs->rest = NULL;
+	bs->p = bs->rowend;
+
+	while (bs->p >= bs->sectend)
+	{
+		if (bs->cursect >= bs->nsections)
+			return false;
+
+		sect = &bs->sections[bs->cursect++];
+		if (sect->kind != BINDB_SECTION_CORE && !(bindb_load_mask & (1U << sect->kind)))
+			continue;
+
+		bs->p = bs->map + sect->offset;
+		bs->sectend = bs->p + sect->length;
+	}
+
+	len = bindb_get_varint(db, &bs->p, bs->sectend);
+	if (len > (unsigned long long)(bs->sectend - bs->p))
+		bindb_corrupt(db, "row past end of section");
+
+	bs->rowend = bs->p + len;
+
+	db->line++;
+	db->token = 0;
+	return true;
+}
+
+/* like opensex, a string cell read word by word yields its space separated parts */
+static const char *bindb_read_word(database_handle_t *db)
+{
+	bindb_t *bs = (bindb_t *)db->priv;
+	const char *cell;
+	char *res, *sp;
+	size_t len;
+
+	if (bs->rest == NULL)
+	{
+		if ((cell = bindb_read_cell(db)) == NULL)
+			return NULL;
+
+		if (strchr(cell, ' ') == NULL)
+			return cell;
+
+		if (cell != bs->buf)
+		{
+			len = strlen(cell);
+			if (len >= bs->bufsize)
+			{
+				bs->bufsize = len + 1;
+				bs->buf = srealloc(bs->buf, bs->bufsize);
+			}
+			memcpy(bs->buf, cell, len + 1);
+		}
+		bs->rest = bs->buf;
+	}
+
+	res = bs->rest;
+	if ((sp = strchr(res, ' ')) != NULL)
+	{
+		*sp = '\0';
+		bs->rest = sp + 1;
+	}
+	else
+		bs->rest = NULL;
+
+	return res;
+}
+
+/* the rest of the row, as opensex would return it */
+static const char *bindb_read_str(database_handle_t *db)
+{
+	bindb_t *bs = (bindb_t *)db->priv;
+	const char *cell;
+	char *res;
+	size_t len, used;
+
+	if (bs->rest != NULL)
+	{
+		res = bs->rest;
+		bs->rest = NULL;
+
+		if (bs->p >= bs->rowend)
+			return res;
+
+		used = strlen(res);
+		memmove(bs->buf, res, used + 1);
+	}
+	else
+	{
+		if ((cell = bindb_read_cell(db)) == NULL)
+			return NULL;
+
+		if (bs->p >= bs->rowend)
+			return cell;
+
+		used = strlen(cell);
+		if (cell != bs->buf)
+		{
+			if (used >= bs->bufsize)
+			{
+				bs->bufsize = used + 1;
+				bs->buf = srealloc(bs->buf, bs->bufsize);
+			}
+			memcpy(bs->buf, cell, used + 1);
+		}
+	}
+
+	/* the first part now lives in buf, which reading the next 's' cell would reuse */
+	res = sstrdup(bs->buf);
+	while ((cell = bindb_read_cell(db)) != NULL)
+	{
+		len = strlen(cell);
+		res = srealloc(res, used + len + 2);
+		res[used++] = ' ';
+		memcpy(res + used, cell, len + 1);
+		used += len;
+	}
+
+	if (used >= bs->bufsize)
+	{
+		bs->bufsize = used + 1;
+		bs->buf = srealloc(bs->buf, bs->bufsize);
+	}
+	memcpy(bs->buf, res, used + 1);
+	free(res);
+
+	return bs->buf;
+}
+
+/* numeric cells are decoded directly, anything else goes through strtol like opensex */
+static bool bindb_read_number(database_handle_t *db, unsigned long long *res, unsigned char *tag)
+{
+	bindb_t *bs = (bindb_t *)db->priv;
+
+	if (bs->rest != NULL || bs->p >= bs->rowend)
+		return false;
+
+	*tag = *bs->p;
+	if (*tag != 'I' && *tag != 'U' && *tag != 'T')
+		return false;
+
+	bs->p++;
+	db->token++;
+	*res = bindb_get_varint(db, &bs->p, bs->rowend);
+
+	return true;
+}
+
+static bool bindb_read_int(database_handle_t *db, int *res)
+{
+	unsigned long long v;
+	unsigned char tag;
+	const char *s;
+	char *rp;
+
+	if (bindb_read_number(db, &v, &tag))
+	{
+		*res = tag == 'I' ? (int)((v >> 1) ^ -(v & 1)) : (int)v;
+		return true;
+	}
+
+	if ((s = bindb_read_word(db)) == NULL)
+		return false;
+
+	*res = strtol(s, &rp, 0);
+	return *s && !*rp;
+}
+
+static bool bindb_read_uint(database_handle_t *db, unsigned int *res)
+{
+	unsigned long long v;
+	unsigned char tag;
+	const char *s;
+	char *rp;
+
+	if (bindb_read_number(db, &v, &tag))
+	{
+		*res = tag == 'I' ? (unsigned int)(int)((v >> 1) ^ -(v & 1)) : (unsigned int)v;
+		return true;
+	}
+
+	if ((s = bindb_read_word(db)) == NULL)
+		return false;
+
+	*res = strtoul(s, &rp, 0);
+	return *s && !*rp;
+}
+
+static bool bindb_read_time(database_handle_t *db, time_t *res)
+{
+	unsigned long long v;
+	unsigned char tag;
+	const char *s;
+	char *rp;
+
+	if (bindb_read_number(db, &v, &tag))
+	{
+		*res = tag == 'I' ? (time_t)(int)((v >> 1) ^ -(v & 1)) : (time_t)v;
+		return true;
+	}
+
+	if ((s = bindb_read_word(db)) == NULL)
+		return false;
+
+	*res = strtoul(s, &rp, 0);
+	return *s && !*rp;
+}
+
+database_vtable_t bindb_vt = {
+	.name = "bindb",
+
+	.read_next_row = bindb_read_next_row,
+
+	.read_word = bindb_read_word,
+	.read_str = bindb_read_str,
+	.read_int = bindb_read_int,
+	.read_uint = bindb_read_uint,
+	.read_time = bindb_read_time,
+
+	.start_row = bindb_start_row,
+	.write_word = bindb_write_word,
+	.write_str = bindb_write_str,
+	.write_int = bindb_write_int,
+	.write_uint = bindb_write_uint,
+	.write_time = bindb_write_time,
+	.commit_row = bindb_commit_row
+};
+
+/* index and string table; everything is checked against the file size */
+static void bindb_read_index(database_handle_t *db)
+{
+	bindb_t *bs = (bindb_t *)db->priv;
+	const unsigned char *p, *end, *strp;
+	unsigned long long idx = 0, stroff, len;
+	unsigned int i;
+	char *a;
+
+	end = bs->map + bs->maplen - BINDB_TRAILER;
+	for (i = 0; i < 8; i++)
+		idx |= (unsigned long long)end[i] << (i * 8);
+
+	if (idx < BINDB_MAGICLEN + 1 || idx > (unsigned long long)(end - bs->map))
+		bindb_corrupt(db, "bad index offset");
+
+	p = bs->map + idx;
+	stroff = bindb_get_varint(db, &p, end);
+	bs->nstrs = bindb_get_varint(db, &p, end);
+	bs->nsections = bindb_get_varint(db, &p, end);
+
+	if (stroff < BINDB_MAGICLEN + 1 || stroff > idx)
+		bindb_corrupt(db, "bad string table offset");
+	if (bs->nstrs > idx - stroff || bs->nsections > (unsigned long long)(end - p))
+		bindb_corrupt(db, "bad index counts");
+
+	bs->sections = scalloc(bs->nsections + 1, sizeof(bindb_section_t));
+	for (i = 0; i < bs->nsections; i++)
+	{
+		bs->sections[i].kind = bindb_get_varint(db, &p, end);
+		bs->sections[i].offset = bindb_get_varint(db, &p, end);
+		bs->sections[i].length = bindb_get_varint(db, &p, end);
+		bs->sections[i].rows = bindb_get_varint(db, &p, end);
+
+		if (bs->sections[i].offset < BINDB_MAGICLEN + 1 || bs->sections[i].offset > stroff ||
+		    bs->sections[i].length > stroff - bs->sections[i].offset)
+			bindb_corrupt(db, "bad section");
+	}
+
+	/* the strings are copied out once, so that they can be NUL terminated */
+	bs->strs = scalloc(bs->nstrs + 1, sizeof(char *));
+	bs->arena = a = smalloc(idx - stroff + bs->nstrs + 1);
+
+	strp = bs->map + stroff;
+	for (i = 0; i < bs->nstrs; i++)
+	{
+		len = bindb_get_varint(db, &strp, bs->map + idx);
+		if (len > (unsigned long long)(bs->map + idx - strp))
+			bindb_corrupt(db, "string past end of string table");
+
+		memcpy(a, strp, len);
+		a[len] = '\0';
+		bs->strs[i] = a;
+
+		a += len + 1;
+		strp += len;
+	}
+}
+
+static database_handle_t *bindb_db_open_read(const char *filename)
+{
+	database_handle_t *db;
+	bindb_t *bs;
+	int fd;
+	struct stat sb;
+	unsigned char *map = NULL;
+	bool mapped = false;
+	ssize_t n;
+	size_t got;
+	char path[BUFSIZE];
+
+	snprintf(path, BUFSIZE, "%s/%s", datadir, filename != NULL ? filename : "services.db");
+
+	/* let opensex handle missing files and complain about them */
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return bindb_prev->db_open(filename, DB_READ);
+
+	if (fstat(fd, &sb) < 0 || sb.st_size < BINDB_MAGICLEN + 1 + BINDB_TRAILER)
+	{
+		close(fd);
+		return bindb_prev->db_open(filename, DB_READ);
+	}
+
+#ifdef HAVE_MMAP
+	map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		map = NULL;
+	else
+	{
+		mapped = true;
+# ifdef MADV_SEQUENTIAL
+		madvise(map, sb.st_size, MADV_SEQUENTIAL);
+# endif
+	}
+#endif
+
+	if (map == NULL)
+	{
+		map = smalloc(sb.st_size);
+		for (got = 0; got < (size_t)sb.st_size; got += n)
+			if ((n = read(fd, map + got, sb.st_size - got)) <= 0)
+				break;
+
+		if (got < (size_t)sb.st_size)
+		{
+			slog(LG_ERROR, "db-open-read: cannot read '%s': %s", path, n < 0 ? strerror(errno) : "short read");
+			wallops(_("\2DATABASE ERROR\2: db-open-read: cannot read '%s'"), path);
+			free(map);
+			close(fd);
+			return NULL;
+		}
+	}
+
+	close(fd);
+
+	/* still an opensex database, e.g. right after switching backends */
+	if (memcmp(map, BINDB_MAGIC, BINDB_MAGICLEN) ||
+	    memcmp(map + sb.st_size - BINDB_MAGICLEN, BINDB_MAGIC, BINDB_MAGICLEN))
+	{
+#ifdef HAVE_MMAP
+		if (mapped)
+			munmap(map, sb.st_size);
+		else
+#endif
+			free(map);
+
+		slog(LG_INFO, "bindb: %s is not a binary database, reading it as opensex", path);
+		return bindb_prev->db_open(filename, DB_READ);
+	}
+
+	if (map[BINDB_MAGICLEN] != BINDB_VERSION)
+	{
+		slog(LG_ERROR, "bindb: %s has unsupported format version %u", path, map[BINDB_MAGICLEN]);
+		slog(LG_ERROR, "bindb: exiting to avoid data loss");
+		exit(EXIT_FAILURE);
+	}
+
+	bs = scalloc(sizeof(bindb_t), 1);
+	bs->map = map;
+	bs->maplen = sb.st_size;
+	bs->mapped = mapped;
+	bs->buf = smalloc(512);
+	bs->bufsize = 512;
+
+	db = scalloc(sizeof(database_handle_t), 1);
+	db->priv = bs;
+	db->vt = &bindb_vt;
+	db->txn = DB_READ;
+	db->file = sstrdup(path);
+	db->line = 0;
+	db->token = 0;
+
+	bindb_read_index(db);
+
+	bs->p = bs->rowend = bs->sectend = bs->map;
+
+	return db;
+}
+
+static database_handle_t *bindb_db_open_write(const char *filename)
+{
+	database_handle_t *db;
+	bindb_t *bs;
+	FILE *f;
+	int errno1;
+	char bpath[BUFSIZE], path[BUFSIZE];
+	unsigned char version = BINDB_VERSION;
+
+	snprintf(bpath, BUFSIZE, "%s/%s", datadir, filename != NULL ? filename : "services.db");
+
+	mowgli_strlcpy(path, bpath, sizeof path);
+	mowgli_strlcat(path, ".new", sizeof path);
+
+	f = fopen(path, "w");
+	if (!f)
+	{
+		errno1 = errno;
+		slog(LG_ERROR, "db-open-write: cannot open '%s' for writing: %s", path, strerror(errno1));
+		wallops(_("\2DATABASE ERROR\2: db-open-write: cannot open '%s' for writing: %s"), path, strerror(errno1));
+		return NULL;
+	}
+
+	bs = scalloc(sizeof(bindb_t), 1);
+	bs->f = f;
+	bs->strids = mowgli_patricia_create(NULL);
+	bs->row = smalloc(512);
+	bs->rowsize = 512;
+
+	db = scalloc(sizeof(database_handle_t), 1);
+	db->priv = bs;
+	db->vt = &bindb_vt;
+	db->txn = DB_WRITE;
+	db->file = sstrdup(bpath);
+	db->line = 0;
+	db->token = 0;
+
+	bindb_fput_bytes(bs, BINDB_MAGIC, BINDB_MAGICLEN);
+	bindb_fput_bytes(bs, &version, 1);
+
+	return db;
+}
+
+static database_handle_t *bindb_db_open(const char *filename, database_transaction_t txn)
+{
+	if (txn == DB_WRITE)
+		return bindb_db_open_write(filename);
+	return bindb_db_open_read(filename);
+}
+
+/* string table, index and trailer follow the last row */
+static void bindb_write_index(bindb_t *bs)
+{
+	size_t stroff, idx, len;
+	unsigned char trailer[8];
+	unsigned int i;
+
+	stroff = bs->pos;
+	for (i = 0; i < bs->nstrs; i++)
+	{
+		len = strlen(bs->strs[i]);
+		bindb_fput_varint(bs, len);
+		bindb_fput_bytes(bs, bs->strs[i], len);
+	}
+
+	idx = bs->pos;
+	bindb_fput_varint(bs, stroff);
+	bindb_fput_varint(bs, bs->nstrs);
+	bindb_fput_varint(bs, bs->nsections);
+	for (i = 0; i < bs->nsections; i++)
+	{
+		bindb_fput_varint(bs, bs->sections[i].kind);
+		bindb_fput_varint(bs, bs->sections[i].offset);
+		bindb_fput_varint(bs, bs->sections[i].length);
+		bindb_fput_varint(bs, bs->sections[i].rows);
+	}
+
+	for (i = 0; i < 8; i++)
+		trailer[i] = ((unsigned long long)idx >> (i * 8)) & 0xff;
+
+	bindb_fput_bytes(bs, trailer, sizeof trailer);
+	bindb_fput_bytes(bs, BINDB_MAGIC, BINDB_MAGICLEN);
+}
+
+static void bindb_db_close(database_handle_t *db)
+{
+	bindb_t *bs;
+	unsigned int i;
+	int errno1;
+	char path[BUFSIZE];
+
+	return_if_fail(db != NULL);
+
+	if (db->vt != &bindb_vt)
+	{
+		bindb_prev->db_close(db);
+		return;
+	}
+
+	bs = db->priv;
+
+	if (db->txn == DB_WRITE)
+	{
+		bindb_write_index(bs);
+
+		/* as with opensex, the backend only renames complete files into place */
+		if (bs->failed || fflush(bs->f) != 0 || ferror(bs->f) || fsync(fileno(bs->f)) < 0)
+		{
+			errno1 = errno;
+			snprintf(path, BUFSIZE, "%s.new", db->file);
+			unlink(path);
+
+			slog(LG_ERROR, "db-close: cannot write '%s': %s", path, strerror(errno1));
+			wallops(_("\2DATABASE ERROR\2: db-close: cannot write '%s': %s"), path, strerror(errno1));
+		}
+
+		fclose(bs->f);
+
+		for (i = 0; i < bs->nstrs; i++)
+			free(bs->strs[i]);
+		mowgli_patricia_destroy(bs->strids, NULL, NULL);
+		free(bs->row);
+	}
+	else
+	{
+#ifdef HAVE_MMAP
+		if (bs->mapped)
+			munmap(bs->map, bs->maplen);
+		else
+#endif
+			free(bs->map);
+
+		free(bs->arena);
+		free(bs->buf);
+	}
+
+	free(bs->strs);
+	free(bs->sections);
+	free(bs);
+	free(db->file);
+	free(db);
+}
+
+database_module_t bindb_mod = {
+	bindb_db_open,
+	bindb_db_close
+};
+
+void _modinit(module_t *m)
+{
+	MODULE_TRY_REQUEST_DEPENDENCY(m, "backend/opensex");
+
+	m->mflags = MODTYPE_CORE;
+
+	bindb_prev = db_mod;
+	db_mod = &bindb_mod;
+}
+
+void _moddeinit(module_unload_intent_t intent)
+{
+	db_mod = bindb_prev;
+}
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
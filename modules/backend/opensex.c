@@ -9,6 +9,15 @@
  */
 
 #include "atheme.h"
+#include "conf.h"
+
+#ifdef HAVE_FORK
+# include <sys/wait.h>
+#endif
+
+#ifdef HAVE_MMAP
+# include <sys/mman.h>
+#endif
 
 DECLARE_MODULE_V1
 (
@@ -24,12 +33,61 @@ typedef struct opensex_ {
 	char *token;
 	FILE *f;
 
+	/* Private writable mapping of the file being read, if we have one */
+	char *map;
+	size_t maplen;
+	char *mappos;
+
 	/* Interpreting state */
 	unsigned int grver;
-	unsigned int dbv;
+
+	/* Rows written since the last fsync (change journal) */
+	bool dirty;
 } opensex_t;
 
 extern mowgli_list_t modules;
+extern database_vtable_t opensex_vt;
+
+/* data schema version of the database being loaded, whatever its format */
+static unsigned int opensex_dbv = 0;
+
+/* general::db_snapshot_save -- write the database from a forked child */
+static bool opensex_snapshot_save = false;
+
+/* in-flight snapshot writer, if any */
+static pid_t opensex_snapshot_pid = 0;
+static char *opensex_snapshot_path = NULL;	/* callback data of the running snapshot */
+static struct timeval opensex_snapshot_start;
+static bool opensex_snapshot_pending = false;
+static char *opensex_snapshot_pending_file = NULL;
+
+/* general::db_journal -- append changes to services.db.journal between saves */
+static bool opensex_journal_enabled = false;
+static char opensex_journal_base[BUFSIZE];
+static bool opensex_journal_failed = false;	/* reported, retried quietly */
+
+static database_handle_t *opensex_journal_open(const char *file);
+static void opensex_journal_close(void);
+static void opensex_db_close(database_handle_t *db);
+
+/* write the grammar version, must always be written as a grver:1 row */
+static void
+opensex_write_grver(database_handle_t *db)
+{
+	opensex_t *rs = db->priv;
+	unsigned int tmp_grver;
+
+	/* only our own grammar has versions */
+	if (db->vt != &opensex_vt)
+		return;
+
+	tmp_grver = rs->grver;
+	rs->grver = 1;
+	db_start_row(db, "GRVER");
+	db_write_int(db, tmp_grver);
+	db_commit_row(db);
+	rs->grver = tmp_grver;
+}
 
 /* write atheme.db (core fields) */
 static void
@@ -49,18 +107,10 @@ opensex_db_save(database_handle_t *db)
 	mowgli_node_t *n, *tn;
 	mowgli_patricia_iteration_state_t state;
 	myentity_iteration_state_t mestate;
-	opensex_t *rs = db->priv;
-	unsigned int tmp_grver;
 
 	errno = 0;
 
-	/* write the grammar version, must always be written as a grver:1 row */
-	tmp_grver = rs->grver;
-	rs->grver = 1;
-	db_start_row(db, "GRVER");
-	db_write_int(db, tmp_grver);
-	db_commit_row(db);
-	rs->grver = tmp_grver;
+	opensex_write_grver(db);
 
 	/* write the database version */
 	db_start_row(db, "DBV");
@@ -373,12 +423,24 @@ opensex_db_save(database_handle_t *db)
 static void opensex_db_parse(database_handle_t *db)
 {
 	const char *cmd;
+	unsigned int rows = 0;
+	struct timeval tv;
+	int ms;
+
+	s_time(&tv);
+
 	while (db_read_next_row(db))
 	{
 		cmd = db_read_word(db);
 		if (!cmd || !*cmd || strchr("#\n\t \r", *cmd)) continue;
 		db_process(db, cmd);
+		rows++;
 	}
+
+	e_time(tv, &tv);
+	ms = tv2ms(&tv);
+	slog(LG_INFO, "opensex: read %u rows from %s in %d ms (%u rows/s)", rows, db->file, ms,
+	     ms > 0 ? (unsigned int)((unsigned long long)rows * 1000 / ms) : rows);
 }
 
 static void opensex_h_unknown(database_handle_t *db, const char *type)
@@ -391,15 +453,20 @@ static void opensex_h_unknown(database_handle_t *db, const char *type)
 static void opensex_h_grver(database_handle_t *db, const char *type)
 {
 	opensex_t *rs = (opensex_t *)db->priv;
-	rs->grver = db_sread_int(db);
+	int grver = db_sread_int(db);
+
+	/* other formats (backend/bindb) carry our rows, but not our lexer */
+	if (db->vt != &opensex_vt)
+		return;
+
+	rs->grver = grver;
 	slog(LG_INFO, "opensex: grammar version is %d.", rs->grver);
 }
 
 static void opensex_h_dbv(database_handle_t *db, const char *type)
 {
-	opensex_t *rs = (opensex_t *)db->priv;
-	rs->dbv = db_sread_int(db);
-	slog(LG_INFO, "opensex: data schema version is %d.", rs->dbv);
+	opensex_dbv = db_sread_int(db);
+	slog(LG_INFO, "opensex: data schema version is %d.", opensex_dbv);
 }
 
 static void opensex_h_luid(database_handle_t *db, const char *type)
@@ -425,7 +492,6 @@ static void opensex_h_cf(database_handle_t *db, const char *type)
 
 static void opensex_h_mu(database_handle_t *db, const char *type)
 {
-	opensex_t *rs = (opensex_t *)db->priv;
 	const char *uid = NULL;
 	const char *name;
 	const char *pass, *email, *language;
@@ -434,7 +500,7 @@ static void opensex_h_mu(database_handle_t *db, const char *type)
 	unsigned int flags = 0;
 	myuser_t *mu;
 
-	if (rs->dbv >= 10)
+	if (opensex_dbv >= 10)
 		uid = db_sread_word(db);
 
 	name = db_sread_word(db);
@@ -455,7 +521,7 @@ static void opensex_h_mu(database_handle_t *db, const char *type)
 	email = db_sread_word(db);
 	reg = db_sread_time(db);
 	login = db_sread_time(db);
-	if (rs->dbv >= 8) {
+	if (opensex_dbv >= 8) {
 		sflags = db_sread_word(db);
 		if (!gflags_fromstr(mu_flags, sflags, &flags))
 			slog(LG_INFO, "db-h-mu: line %d: confused by flags: %s", db->line, sflags);
@@ -601,7 +667,6 @@ static void opensex_h_nam(database_handle_t *db, const char *type)
 
 static void opensex_h_so(database_handle_t *db, const char *type)
 {
-	opensex_t *rs = (opensex_t *)db->priv;
 	const char *user, *class, *pass;
 	unsigned int flags = 0;
 	myuser_t *mu;
@@ -609,7 +674,7 @@ static void opensex_h_so(database_handle_t *db, const char *type)
 
 	user = db_sread_word(db);
 	class = db_sread_word(db);
-	if (rs->dbv >= 8)
+	if (opensex_dbv >= 8)
 	{
 		sflags = db_sread_word(db);
 		if (!gflags_fromstr(soper_flags, sflags, &flags))
@@ -631,7 +696,6 @@ static void opensex_h_so(database_handle_t *db, const char *type)
 
 static void opensex_h_mc(database_handle_t *db, const char *type)
 {
-	opensex_t *rs = (opensex_t *)db->priv;
 	char buf[4096];
 	const char *name = db_sread_word(db);
 	const char *key;
@@ -643,7 +707,7 @@ static void opensex_h_mc(database_handle_t *db, const char *type)
 
 	mc->registered = db_sread_time(db);
 	mc->used = db_sread_time(db);
-	if (rs->dbv >= 8) {
+	if (opensex_dbv >= 8) {
 		sflags = db_sread_word(db);
 		if (!gflags_fromstr(mc_flags, sflags, &flags))
 			slog(LG_INFO, "db-h-mc: line %d: confused by flags %s",
@@ -666,40 +730,42 @@ static void opensex_h_mc(database_handle_t *db, const char *type)
 	}
 }
 
-static void opensex_h_md(database_handle_t *db, const char *type)
+/* find the object an MDU/MDC/MDA/MDN row refers to */
+static void *opensex_md_object(const char *type, const char *name)
 {
-	const char *name = db_sread_word(db);
-	const char *prop = db_sread_word(db);
-	const char *value = db_sread_str(db);
-	void *obj = NULL;
+	char buf[BUFSIZE];
+	char *mask;
 
 	if (!strcmp(type, "MDU"))
-	{
-		obj = myuser_find(name);
-	}
+		return myuser_find(name);
 	else if (!strcmp(type, "MDC"))
-	{
-		obj = mychan_find(name);
-	}
+		return mychan_find(name);
 	else if (!strcmp(type, "MDA"))
 	{
-		char *mask = strrchr(name, ':');
+		mowgli_strlcpy(buf, name, sizeof buf);
+		mask = strrchr(buf, ':');
 		if (mask != NULL)
 		{
 			*mask++ = '\0';
-			obj = chanacs_find_by_mask(mychan_find(name), mask, CA_NONE);
+			return chanacs_find_by_mask(mychan_find(buf), mask, CA_NONE);
 		}
+		return NULL;
 	}
 	else if (!strcmp(type, "MDN"))
-	{
-		obj = myuser_name_find(name);
-	}
-	else
-	{
-		slog(LG_INFO, "db-h-md: unknown metadata type '%s'; name %s, prop %s", type, name, prop);
-		return;
-	}
+		return myuser_name_find(name);
+
+	slog(LG_INFO, "db-h-md: unknown metadata type '%s'; name %s", type, name);
+	return NULL;
+}
 
+static void opensex_h_md(database_handle_t *db, const char *type)
+{
+	const char *name = db_sread_word(db);
+	const char *prop = db_sread_word(db);
+	const char *value = db_sread_str(db);
+	void *obj;
+
+	obj = opensex_md_object(type, name);
 	if (obj == NULL)
 	{
 		slog(LG_INFO, "db-h-md: attempting to add %s property to non-existant object %s",
@@ -712,7 +778,6 @@ static void opensex_h_md(database_handle_t *db, const char *type)
 
 static void opensex_h_ca(database_handle_t *db, const char *type)
 {
-	opensex_t *rs = (opensex_t *)db->priv;
 	const char *chan, *target;
 	time_t tmod;
 	unsigned int flags;
@@ -729,7 +794,7 @@ static void opensex_h_ca(database_handle_t *db, const char *type)
 	mt = myentity_find(target);
 
 	setter = NULL;
-	if (rs->dbv >= 9)
+	if (opensex_dbv >= 9)
 		setter = myentity_find(db_sread_word(db));
 
 	if (mc == NULL)
@@ -784,7 +849,6 @@ static void opensex_h_kid(database_handle_t *db, const char *type)
 
 static void opensex_h_kl(database_handle_t *db, const char *type)
 {
-	opensex_t *rs = (opensex_t *)db->priv;
 	char buf[4096];
 	const char *user, *host, *reason, *setby;
 	unsigned int id = 0;
@@ -792,7 +856,7 @@ static void opensex_h_kl(database_handle_t *db, const char *type)
 	long duration;
 	kline_t *k;
 
-	if (rs->dbv > 10)
+	if (opensex_dbv > 10)
 		id = db_sread_uint(db);
 
 	user = db_sread_word(db);
@@ -817,7 +881,6 @@ static void opensex_h_xid(database_handle_t *db, const char *type)
 
 static void opensex_h_xl(database_handle_t *db, const char *type)
 {
-	opensex_t *rs = (opensex_t *)db->priv;
 	char buf[4096];
 	const char *realname, *reason, *setby;
 	unsigned int id = 0;
@@ -825,7 +888,7 @@ static void opensex_h_xl(database_handle_t *db, const char *type)
 	long duration;
 	xline_t *x;
 
-	if (rs->dbv > 10)
+	if (opensex_dbv > 10)
 		id = db_sread_uint(db);
 
 	realname = db_sread_word(db);
@@ -852,7 +915,6 @@ static void opensex_h_qid(database_handle_t *db, const char *type)
 
 static void opensex_h_ql(database_handle_t *db, const char *type)
 {
-	opensex_t *rs = (opensex_t *)db->priv;
 	char buf[4096];
 	const char *mask, *reason, *setby;
 	unsigned int id = 0;
@@ -860,7 +922,7 @@ static void opensex_h_ql(database_handle_t *db, const char *type)
 	long duration;
 	qline_t *q;
 
-	if (rs->dbv > 10)
+	if (opensex_dbv > 10)
 		id = db_sread_uint(db);
 
 	mask = db_sread_word(db);
@@ -880,6 +942,296 @@ static void opensex_h_ql(database_handle_t *db, const char *type)
 		q->number = id;
 }
 
+/*
+ * Change journal rows, see metadata_journal() and friends in account.c.
+ * These are replayed after the full save and may describe changes the
+ * save already contains, so each one checks the current state first.
+ */
+static void opensex_h_jmu(database_handle_t *db, const char *type)
+{
+	const char *uid, *name, *pass, *email, *sflags;
+	unsigned int flags = 0;
+	time_t reg;
+	myuser_t *mu;
+
+	uid = db_sread_word(db);
+	name = db_sread_word(db);
+	pass = db_sread_word(db);
+	email = db_sread_word(db);
+	reg = db_sread_time(db);
+	sflags = db_sread_word(db);
+
+	if (myuser_find(name) || myuser_find_uid(uid))
+		return;
+
+	if (!gflags_fromstr(mu_flags, sflags, &flags))
+		slog(LG_INFO, "db-h-jmu: line %d: confused by flags: %s", db->line, sflags);
+
+	mu = myuser_add_id(uid, name, pass, email, flags);
+	mu->registered = reg;
+}
+
+static void opensex_h_jmud(database_handle_t *db, const char *type)
+{
+	myuser_t *mu;
+
+	if ((mu = myuser_find(db_sread_word(db))) != NULL)
+		object_dispose(mu);
+}
+
+static void opensex_h_jmur(database_handle_t *db, const char *type)
+{
+	const char *oldname = db_sread_word(db);
+	const char *newname = db_sread_word(db);
+	myuser_t *mu;
+
+	if ((mu = myuser_find(oldname)) != NULL && myuser_find(newname) == NULL)
+		myuser_rename(mu, newname);
+}
+
+static void opensex_h_jmue(database_handle_t *db, const char *type)
+{
+	const char *name = db_sread_word(db);
+	const char *email = db_sread_word(db);
+	myuser_t *mu;
+
+	if ((mu = myuser_find(name)) != NULL)
+		myuser_set_email(mu, email);
+}
+
+static void opensex_h_jmus(database_handle_t *db, const char *type)
+{
+	const char *name, *pass, *sflags;
+	unsigned int flags = 0;
+	myuser_t *mu;
+
+	name = db_sread_word(db);
+	pass = db_sread_word(db);
+	sflags = db_sread_word(db);
+
+	if ((mu = myuser_find(name)) == NULL)
+		return;
+
+	if (!gflags_fromstr(mu_flags, sflags, &flags))
+		slog(LG_INFO, "db-h-jmus: line %d: confused by flags: %s", db->line, sflags);
+
+	mowgli_strlcpy(mu->pass, pass, PASSLEN);
+	mu->flags = flags;
+}
+
+/* the memo of an account a JME or JMED row is about, if it has it */
+static mymemo_t *opensex_memo_find(myuser_t *mu, const char *sender, time_t sent, const char *text, mowgli_node_t **np)
+{
+	mowgli_node_t *n;
+	mymemo_t *mz;
+
+	MOWGLI_ITER_FOREACH(n, mu->memos.head)
+	{
+		mz = n->data;
+
+		if (mz->sent == sent && !strcmp(mz->sender, sender) && !strcmp(mz->text, text))
+		{
+			*np = n;
+			return mz;
+		}
+	}
+
+	return NULL;
+}
+
+static void opensex_h_jme(database_handle_t *db, const char *type)
+{
+	const char *name, *sender, *text;
+	char sbuf[NICKLEN], tbuf[MEMOLEN];
+	time_t sent;
+	unsigned int status;
+	myuser_t *mu;
+	mymemo_t *mz;
+	mowgli_node_t *n;
+
+	name = db_sread_word(db);
+	sender = db_sread_word(db);
+	sent = db_sread_time(db);
+	status = db_sread_uint(db);
+	text = db_sread_str(db);
+
+	if ((mu = myuser_find(name)) == NULL)
+		return;
+
+	/* compare as stored, i.e. cut to length */
+	mowgli_strlcpy(sbuf, sender, sizeof sbuf);
+	mowgli_strlcpy(tbuf, text, sizeof tbuf);
+
+	if ((mz = opensex_memo_find(mu, sbuf, sent, tbuf, &n)) == NULL)
+	{
+		mz = smalloc(sizeof *mz);
+		mowgli_strlcpy(mz->sender, sbuf, NICKLEN);
+		mowgli_strlcpy(mz->text, tbuf, MEMOLEN);
+		mz->sent = sent;
+		mz->status = MEMO_READ;	/* counted as new below if it is */
+		mowgli_node_add(mz, mowgli_node_create(), &mu->memos);
+	}
+
+	if ((mz->status & MEMO_READ) && !(status & MEMO_READ))
+		mu->memoct_new++;
+	else if (!(mz->status & MEMO_READ) && (status & MEMO_READ))
+		mu->memoct_new--;
+
+	mz->status = status;
+}
+
+static void opensex_h_jmed(database_handle_t *db, const char *type)
+{
+	const char *name, *sender, *text;
+	char sbuf[NICKLEN], tbuf[MEMOLEN];
+	time_t sent;
+	myuser_t *mu;
+	mymemo_t *mz;
+	mowgli_node_t *n;
+
+	name = db_sread_word(db);
+	sender = db_sread_word(db);
+	sent = db_sread_time(db);
+	text = db_sread_str(db);
+
+	if ((mu = myuser_find(name)) == NULL)
+		return;
+
+	mowgli_strlcpy(sbuf, sender, sizeof sbuf);
+	mowgli_strlcpy(tbuf, text, sizeof tbuf);
+
+	if ((mz = opensex_memo_find(mu, sbuf, sent, tbuf, &n)) == NULL)
+		return;
+
+	if (!(mz->status & MEMO_READ))
+		mu->memoct_new--;
+
+	mowgli_node_delete(n, &mu->memos);
+	mowgli_node_free(n);
+	free(mz);
+}
+
+static void opensex_h_jmn(database_handle_t *db, const char *type)
+{
+	const char *name = db_sread_word(db);
+	const char *nick = db_sread_word(db);
+	myuser_t *mu;
+
+	if ((mu = myuser_find(name)) == NULL || mynick_find(nick))
+		return;
+
+	mynick_add(mu, nick);
+}
+
+static void opensex_h_jmnd(database_handle_t *db, const char *type)
+{
+	mynick_t *mn;
+
+	if ((mn = mynick_find(db_sread_word(db))) != NULL)
+		object_unref(mn);
+}
+
+static void opensex_h_jmc(database_handle_t *db, const char *type)
+{
+	char buf[BUFSIZE];
+
+	mowgli_strlcpy(buf, db_sread_word(db), sizeof buf);
+	if (mychan_find(buf))
+		return;
+
+	mychan_add(buf);
+}
+
+static void opensex_h_jmcd(database_handle_t *db, const char *type)
+{
+	mychan_t *mc;
+
+	if ((mc = mychan_find(db_sread_word(db))) != NULL)
+		object_unref(mc);
+}
+
+static chanacs_t *opensex_chanacs_literal(mychan_t *mc, const char *target, myentity_t **mt)
+{
+	*mt = myentity_find(target);
+	if (*mt != NULL)
+		return chanacs_find_literal(mc, *mt, 0);
+
+	return chanacs_find_host_literal(mc, target, 0);
+}
+
+static void opensex_h_jca(database_handle_t *db, const char *type)
+{
+	const char *chan, *target, *setname;
+	unsigned int flags;
+	time_t tmod;
+	mychan_t *mc;
+	myentity_t *mt;
+	chanacs_t *ca;
+
+	chan = db_sread_word(db);
+	target = db_sread_word(db);
+	flags = flags_to_bitmask(db_sread_word(db), 0);
+	tmod = db_sread_time(db);
+	setname = db_sread_word(db);
+
+	if ((mc = mychan_find(chan)) == NULL)
+	{
+		slog(LG_DEBUG, "db-h-jca: line %d: chanacs for nonexistent channel %s", db->line, chan);
+		return;
+	}
+
+	ca = opensex_chanacs_literal(mc, target, &mt);
+	if (ca == NULL)
+	{
+		if (mt != NULL)
+			chanacs_add(mc, mt, flags, tmod, myentity_find(setname));
+		else if (validhostmask(target))
+			chanacs_add_host(mc, target, flags, tmod, myentity_find(setname));
+		return;
+	}
+
+	ca->level = flags & ca_all;
+	ca->tmodified = tmod;
+}
+
+static void opensex_h_jcad(database_handle_t *db, const char *type)
+{
+	const char *chan = db_sread_word(db);
+	const char *target = db_sread_word(db);
+	mychan_t *mc;
+	myentity_t *mt;
+	chanacs_t *ca;
+
+	if ((mc = mychan_find(chan)) == NULL)
+		return;
+
+	if ((ca = opensex_chanacs_literal(mc, target, &mt)) != NULL)
+		object_unref(ca);
+}
+
+static void opensex_h_jmd(database_handle_t *db, const char *type)
+{
+	const char *mdtype = db_sread_word(db);
+	const char *name = db_sread_word(db);
+	const char *prop = db_sread_word(db);
+	const char *value = NULL;
+	void *obj;
+
+	if (!strcmp(type, "JMD"))
+		value = db_sread_str(db);
+
+	if ((obj = opensex_md_object(mdtype, name)) == NULL)
+	{
+		slog(LG_DEBUG, "db-h-jmd: line %d: %s property for nonexistent object %s", db->line, prop, name);
+		return;
+	}
+
+	if (value != NULL)
+		metadata_add(obj, prop, value);
+	else
+		metadata_delete(obj, prop);
+}
+
 static void opensex_ignore_row(database_handle_t *db, const char *type)
 {
 	return;
@@ -887,12 +1239,57 @@ static void opensex_ignore_row(database_handle_t *db, const char *type)
 
 /***************************************************************************************************/
 
+#ifdef HAVE_MMAP
+/* split the mapped file in place: each row is terminated where its newline was */
+static bool opensex_read_next_mapped_row(database_handle_t *hdl)
+{
+	opensex_t *rs = (opensex_t *)hdl->priv;
+	char *end = rs->map + rs->maplen;
+	char *p = rs->mappos;
+	char *nl;
+	size_t n;
+
+	if (p >= end)
+		return false;
+
+	if ((nl = memchr(p, '\n', end - p)) != NULL)
+	{
+		*nl = '\0';
+		rs->token = p;
+		rs->mappos = nl + 1;
+	}
+	else
+	{
+		/* the last row has no newline to overwrite, so it gets copied */
+		n = end - p;
+		if (n >= rs->bufsize)
+		{
+			rs->bufsize = n + 1;
+			rs->buf = srealloc(rs->buf, rs->bufsize);
+		}
+		memcpy(rs->buf, p, n);
+		rs->buf[n] = '\0';
+		rs->token = rs->buf;
+		rs->mappos = end;
+	}
+
+	hdl->line++;
+	hdl->token = 0;
+	return true;
+}
+#endif
+
 static bool opensex_read_next_row(database_handle_t *hdl)
 {
 	int c = 0;
 	unsigned int n = 0;
 	opensex_t *rs = (opensex_t *)hdl->priv;
 
+#ifdef HAVE_MMAP
+	if (rs->map != NULL)
+		return opensex_read_next_mapped_row(hdl);
+#endif
+
 	while ((c = getc(rs->f)) != EOF && c != '\n')
 	{
 		rs->buf[n++] = c;
@@ -920,12 +1317,12 @@ static bool opensex_read_next_row(database_handle_t *hdl)
 	return true;
 }
 
+/* rows are private copies (or a private mapping), so cells are unescaped in place */
 static const char *opensex_read_word(database_handle_t *db)
 {
 	opensex_t *rs = (opensex_t *)db->priv;
 	char *ptr = rs->token;
 	char *res;
-	static char buf[BUFSIZE];
 
 	switch (rs->grver)
 	{
@@ -936,31 +1333,23 @@ static const char *opensex_read_word(database_handle_t *db)
 		if (ptr != NULL)
 		{
 			char *bi, *pi;
-			bool escaped = false;
 
 			ptr++;
-			for (bi = buf, pi = ptr; *pi != '\0' && (bi - buf) < sizeof buf; pi++)
+			for (bi = pi = ptr; *pi != '\0'; pi++)
 			{
-				switch (*pi)
+				if (*pi == '\\' && pi[1] != '\0')
+					pi++;
+				else if (*pi == ')')
 				{
-				case '\\':
-					escaped = true;
 					pi++;
 					break;
-				case ')':
-					if (!escaped)
-						goto demarshal_out;
-				default:
-					*bi++ = *pi;
-					escaped = false;
-					break;
 				}
+
+				*bi++ = *pi;
 			}
-demarshal_out:
-			*bi++ = '\0';
+			*bi = '\0';
 			rs->token = pi;
-			res = buf;
-			slog(LG_DEBUG, "opensex_read_word(): read [%s], pi [%s]", res, pi);
+			res = ptr;
 		}
 		else
 			rs->token = NULL;
@@ -1163,6 +1552,8 @@ static bool opensex_commit_row(database_handle_t *db)
 		break;
 	}
 
+	rs->dirty = true;
+
 	return true;
 }
 
@@ -1193,6 +1584,9 @@ static database_handle_t *opensex_db_open_read(const char *filename)
 	FILE *f;
 	int errno1;
 	char path[BUFSIZE];
+#ifdef HAVE_MMAP
+	struct stat sb;
+#endif
 
 	snprintf(path, BUFSIZE, "%s/%s", datadir, filename != NULL ? filename : "services.db");
 	f = fopen(path, "r");
@@ -1219,6 +1613,27 @@ static database_handle_t *opensex_db_open_read(const char *filename)
 	rs->token = NULL;
 	rs->f = f;
 
+#ifdef HAVE_MMAP
+	/* map the whole file; if that fails we simply read it through stdio */
+	if (fstat(fileno(f), &sb) == 0 && sb.st_size > 0)
+	{
+		rs->map = mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(f), 0);
+		if (rs->map == MAP_FAILED)
+		{
+			slog(LG_DEBUG, "db-open-read: cannot map '%s': %s", path, strerror(errno));
+			rs->map = NULL;
+		}
+		else
+		{
+			rs->maplen = sb.st_size;
+			rs->mappos = rs->map;
+# ifdef MADV_SEQUENTIAL
+			madvise(rs->map, rs->maplen, MADV_SEQUENTIAL);
+# endif
+		}
+	}
+#endif
+
 	db = scalloc(sizeof(database_handle_t), 1);
 	db->priv = rs;
 	db->vt = &opensex_vt;
@@ -1278,34 +1693,266 @@ static database_handle_t *opensex_db_open(const char *filename, database_transac
 	return opensex_db_open_read(filename);
 }
 
-static void opensex_db_close(database_handle_t *db)
+static database_handle_t *opensex_journal_open(const char *file)
 {
+	database_handle_t *db;
 	opensex_t *rs;
+	FILE *f;
 	int errno1;
-	char oldpath[BUFSIZE], newpath[BUFSIZE];
+	char path[BUFSIZE];
 
-	return_if_fail(db != NULL);
-	rs = db->priv;
+	snprintf(path, BUFSIZE, "%s.journal", file);
 
-	mowgli_strlcpy(oldpath, db->file, sizeof oldpath);
-	mowgli_strlcat(oldpath, ".new", sizeof oldpath);
+	f = fopen(path, "a");
+	if (!f)
+	{
+		/* opensex_journal_sync() retries every second; say so only once */
+		if (opensex_journal_failed)
+			return NULL;
+
+		errno1 = errno;
+		slog(LG_ERROR, "db-journal-open: cannot open '%s' for writing: %s", path, strerror(errno1));
+		wallops(_("\2DATABASE ERROR\2: db-journal-open: cannot open '%s' for writing: %s"), path, strerror(errno1));
+		opensex_journal_failed = true;
+		return NULL;
+	}
+
+	if (opensex_journal_failed)
+	{
+		slog(LG_INFO, "db-journal-open: '%s' is open for writing again", path);
+		wallops(_("db-journal-open: '%s' is open for writing again"), path);
+		opensex_journal_failed = false;
+	}
+
+	rs = scalloc(sizeof(opensex_t), 1);
+	rs->f = f;
+#ifndef EXPERIMENTAL
+	rs->grver = 1;
+#else
+	rs->grver = 2;
+#endif
+
+	db = scalloc(sizeof(database_handle_t), 1);
+	db->priv = rs;
+	db->vt = &opensex_vt;
+	db->txn = DB_WRITE;
+	db->file = sstrdup(path);
+	db->line = 0;
+	db->token = 0;
+
+	if (ftell(f) == 0)
+		opensex_write_grver(db);
+
+	return db;
+}
+
+static void opensex_journal_flush(database_handle_t *db)
+{
+	opensex_t *rs = db->priv;
 
-	mowgli_strlcpy(newpath, db->file, sizeof newpath);
+	rs->dirty = false;
+	if (fflush(rs->f) != 0 || fsync(fileno(rs->f)) < 0)
+		slog(LG_ERROR, "db-journal-sync: cannot write '%s': %s", db->file, strerror(errno));
+}
 
+/* group commit: make everything journaled so far durable */
+static void opensex_journal_sync(void *arg)
+{
+	opensex_t *rs;
+
+	/* general::db_journal may have been changed by a rehash */
+	if (!opensex_journal_enabled || readonly || offline_mode)
+	{
+		opensex_journal_close();
+		return;
+	}
+
+	if (db_journal == NULL)
+	{
+		if (runflags & RF_STARTING || opensex_journal_base[0] == '\0')
+			return;
+
+		/* the journal is only meaningful on top of a save made after it was opened */
+		db_journal = opensex_journal_open(opensex_journal_base);
+		if (db_journal != NULL && db_save != NULL)
+			db_save(NULL);
+		return;
+	}
+
+	rs = db_journal->priv;
+	if (!rs->dirty)
+		return;
+
+	opensex_journal_flush(db_journal);
+}
+
+static void opensex_journal_close(void)
+{
+	opensex_t *rs;
+
+	if (db_journal == NULL)
+		return;
+
+	rs = db_journal->priv;
+	opensex_journal_flush(db_journal);
 	fclose(rs->f);
 
-	if (db->txn == DB_WRITE)
+	free(rs);
+	free(db_journal->file);
+	free(db_journal);
+	db_journal = NULL;
+}
+
+/* move the current journal aside while a snapshot of the same state is written */
+static void opensex_journal_rotate(void)
+{
+	FILE *in, *out;
+	size_t n;
+	char buf[BUFSIZE], path[BUFSIZE], oldpath[BUFSIZE];
+
+	if (db_journal == NULL)
+		return;
+
+	opensex_journal_close();
+
+	snprintf(path, BUFSIZE, "%s.journal", opensex_journal_base);
+	snprintf(oldpath, BUFSIZE, "%s.journal.old", opensex_journal_base);
+
+	/* a previous snapshot failed; its rows are still needed, keep appending */
+	if ((out = fopen(oldpath, "r")) != NULL)
 	{
-		/* now, replace the old database with the new one, using an atomic rename */
-		if (srename(oldpath, newpath) < 0)
+		fclose(out);
+
+		if ((in = fopen(path, "r")) != NULL && (out = fopen(oldpath, "a")) != NULL)
 		{
-			errno1 = errno;
-			slog(LG_ERROR, "db_save(): cannot rename services.db.new to services.db: %s", strerror(errno1));
-			wallops(_("\2DATABASE ERROR\2: db_save(): cannot rename services.db.new to services.db: %s"), strerror(errno1));
+			while ((n = fread(buf, 1, sizeof buf, in)) > 0)
+				fwrite(buf, 1, n, out);
+
+			if (fflush(out) == 0 && !ferror(in) && fsync(fileno(out)) == 0)
+				unlink(path);
+			fclose(out);
 		}
 
-		hook_call_db_saved();
+		if (in != NULL)
+			fclose(in);
 	}
+	else if (srename(path, oldpath) < 0)
+		slog(LG_ERROR, "db-journal-rotate: cannot rename '%s': %s", path, strerror(errno));
+
+	db_journal = opensex_journal_open(opensex_journal_base);
+}
+
+/* a save was renamed into place; drop the journal rows it includes */
+static void opensex_journal_compact(const char *file, bool snapshot)
+{
+	opensex_t *rs;
+	char path[BUFSIZE];
+
+	if (strcmp(file, opensex_journal_base))
+		return;
+
+	snprintf(path, BUFSIZE, "%s.journal.old", file);
+	unlink(path);
+
+	/* changes made after the snapshot was taken are only in the current journal */
+	if (snapshot && db_journal != NULL)
+		return;
+
+	if (db_journal == NULL)
+	{
+		snprintf(path, BUFSIZE, "%s.journal", file);
+		unlink(path);
+		return;
+	}
+
+	rs = db_journal->priv;
+	fflush(rs->f);
+	if (ftruncate(fileno(rs->f), 0) < 0)
+	{
+		slog(LG_ERROR, "db-journal-compact: cannot truncate '%s': %s", db_journal->file, strerror(errno));
+		return;
+	}
+
+	opensex_write_grver(db_journal);
+}
+
+static void opensex_journal_replay(const char *filename)
+{
+	database_handle_t *db;
+	char file[BUFSIZE], path[BUFSIZE];
+	const char *suffix[] = { ".journal.old", ".journal", NULL };
+	int i;
+
+	for (i = 0; suffix[i] != NULL; i++)
+	{
+		snprintf(file, BUFSIZE, "%s%s", filename != NULL ? filename : "services.db", suffix[i]);
+		snprintf(path, BUFSIZE, "%s/%s", datadir, file);
+
+		if (access(path, F_OK) < 0)
+			continue;
+
+		slog(LG_INFO, "opensex: replaying change journal %s", path);
+
+		/* the journal is always text, whatever db_mod writes */
+		if ((db = opensex_db_open_read(file)) == NULL)
+			continue;
+
+		opensex_db_parse(db);
+		opensex_db_close(db);
+	}
+}
+
+/* replace the old database with the freshly written one, using an atomic rename */
+static bool opensex_db_commit(const char *file, bool snapshot)
+{
+	int errno1;
+	char oldpath[BUFSIZE], newpath[BUFSIZE];
+
+	mowgli_strlcpy(oldpath, file, sizeof oldpath);
+	mowgli_strlcat(oldpath, ".new", sizeof oldpath);
+
+	mowgli_strlcpy(newpath, file, sizeof newpath);
+
+	if (srename(oldpath, newpath) < 0)
+	{
+		errno1 = errno;
+		slog(LG_ERROR, "db_save(): cannot rename services.db.new to services.db: %s", strerror(errno1));
+		wallops(_("\2DATABASE ERROR\2: db_save(): cannot rename services.db.new to services.db: %s"), strerror(errno1));
+		return false;
+	}
+
+	opensex_journal_compact(file, snapshot);
+
+	hook_call_db_saved();
+	return true;
+}
+
+static void opensex_db_close(database_handle_t *db)
+{
+	opensex_t *rs;
+	int errno1;
+	char path[BUFSIZE];
+
+	return_if_fail(db != NULL);
+	rs = db->priv;
+
+#ifdef HAVE_MMAP
+	if (rs->map != NULL)
+		munmap(rs->map, rs->maplen);
+#endif
+
+	/* never let a short write be renamed over the previous database */
+	if (db->txn == DB_WRITE && (fflush(rs->f) != 0 || ferror(rs->f) || fsync(fileno(rs->f)) < 0))
+	{
+		errno1 = errno;
+		snprintf(path, BUFSIZE, "%s.new", db->file);
+		unlink(path);
+
+		slog(LG_ERROR, "db-close: cannot write '%s': %s", path, strerror(errno1));
+		wallops(_("\2DATABASE ERROR\2: db-close: cannot write '%s': %s"), path, strerror(errno1));
+	}
+
+	fclose(rs->f);
 
 	free(rs->buf);
 	free(rs);
@@ -1317,24 +1964,212 @@ static void opensex_db_load(const char *filename)
 {
 	database_handle_t *db;
 
+	opensex_dbv = 0;
+
 	db = db_open(filename, DB_READ);
+	if (db != NULL)
+	{
+		opensex_db_parse(db);
+		db_close(db);
+	}
+
+	opensex_journal_replay(filename);
+
+	snprintf(opensex_journal_base, BUFSIZE, "%s/%s", datadir, filename != NULL ? filename : "services.db");
+
+	if (opensex_journal_enabled && !readonly && !offline_mode)
+		db_journal = opensex_journal_open(opensex_journal_base);
+}
+
+static void opensex_db_write_sync(const char *filename)
+{
+	database_handle_t *db;
+	struct timeval tv;
+	char path[BUFSIZE];
+
+	snprintf(path, BUFSIZE, "%s/%s", datadir, filename != NULL ? filename : "services.db");
+
+	s_time(&tv);
+
+	db = db_open(filename, DB_WRITE);
 	if (db == NULL)
+	{
+		db_save_stats.failures++;
 		return;
+	}
+
+	opensex_db_save(db);
+	hook_call_db_write(db);
 
-	opensex_db_parse(db);
 	db_close(db);
+
+	if (!opensex_db_commit(path, false))
+	{
+		db_save_stats.failures++;
+		return;
+	}
+
+	e_time(tv, &tv);
+	db_save_stats.saves++;
+	db_save_stats.last_duration = db_save_stats.last_stall = tv2ms(&tv);
+	if (db_save_stats.last_stall > db_save_stats.max_stall)
+		db_save_stats.max_stall = db_save_stats.last_stall;
 }
 
-static void opensex_db_write(void *filename)
+#ifdef HAVE_FORK
+static void opensex_db_write(void *filename);
+
+/* the snapshot writer exited; the parent renames the file into place */
+static void opensex_snapshot_done(pid_t pid, int status, void *data)
+{
+	char *file = data;
+	char *next;
+	struct timeval tv;
+
+	opensex_snapshot_pid = 0;
+	opensex_snapshot_path = NULL;
+
+	e_time(opensex_snapshot_start, &tv);
+	db_save_stats.last_duration = tv2ms(&tv);
+
+	if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS)
+	{
+		if (opensex_db_commit(file, true))
+			db_save_stats.saves++;
+		else
+			db_save_stats.failures++;
+
+		slog(LG_DEBUG, "db_save(): snapshot %d finished in %u ms", (int)pid, db_save_stats.last_duration);
+	}
+	else
+	{
+		db_save_stats.failures++;
+
+		slog(LG_ERROR, "db_save(): snapshot writer %d failed (status %d); '%s' was not replaced", (int)pid, status, file);
+		wallops(_("\2DATABASE ERROR\2: db_save(): snapshot writer failed; '%s' was not replaced"), file);
+	}
+
+	free(file);
+
+	/* saves requested while we were busy were folded into one */
+	if (opensex_snapshot_pending)
+	{
+		next = opensex_snapshot_pending_file;
+
+		opensex_snapshot_pending = false;
+		opensex_snapshot_pending_file = NULL;
+
+		opensex_db_write(next);
+		free(next);
+	}
+}
+
+/* child side: serialize the copy-on-write image of our state and exit */
+static void opensex_snapshot_write(const char *filename)
 {
 	database_handle_t *db;
+	char path[BUFSIZE];
+
+	connection_close_all_fds();
+
+	snprintf(path, BUFSIZE, "%s/%s.new", datadir, filename != NULL ? filename : "services.db");
 
 	db = db_open(filename, DB_WRITE);
+	if (db == NULL)
+		_exit(EXIT_FAILURE);
 
 	opensex_db_save(db);
 	hook_call_db_write(db);
 
+	/* closing removes the file again if it could not be written completely */
 	db_close(db);
+	_exit(access(path, F_OK) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+static bool opensex_snapshot_start_write(const char *filename)
+{
+	pid_t pid;
+	struct timeval tv;
+	char path[BUFSIZE];
+
+	snprintf(path, BUFSIZE, "%s/%s", datadir, filename != NULL ? filename : "services.db");
+
+	/* don't let the child inherit (and later flush a second time) buffered log output */
+	fflush(NULL);
+
+	s_time(&tv);
+	opensex_snapshot_start = tv;
+
+	switch (pid = fork())
+	{
+		case -1:
+			slog(LG_ERROR, "db_save(): cannot fork snapshot writer: %s; saving synchronously", strerror(errno));
+			return false;
+		case 0:
+			opensex_snapshot_write(filename);
+			/* NOTREACHED */
+	}
+
+	e_time(tv, &tv);
+	db_save_stats.last_stall = tv2ms(&tv);
+	if (db_save_stats.last_stall > db_save_stats.max_stall)
+		db_save_stats.max_stall = db_save_stats.last_stall;
+
+	opensex_snapshot_pid = pid;
+	opensex_snapshot_path = sstrdup(path);
+	childproc_add(pid, "db_save", opensex_snapshot_done, opensex_snapshot_path);
+
+	opensex_journal_rotate();
+
+	return true;
+}
+
+/* a blocking write is about to reuse services.db.new; the snapshot is stale anyway */
+static void opensex_snapshot_abort(void)
+{
+	int status;
+
+	if (opensex_snapshot_pid == 0)
+		return;
+
+	kill(opensex_snapshot_pid, SIGKILL);
+	waitpid(opensex_snapshot_pid, &status, 0);
+	/* the callback will not run, so its data is ours to free */
+	childproc_delete_all(opensex_snapshot_done);
+	free(opensex_snapshot_path);
+	opensex_snapshot_path = NULL;
+
+	opensex_snapshot_pid = 0;
+	opensex_snapshot_pending = false;
+	free(opensex_snapshot_pending_file);
+	opensex_snapshot_pending_file = NULL;
+}
+#endif
+
+static void opensex_db_write(void *filename)
+{
+#ifdef HAVE_FORK
+	/* on shutdown, restart or offline use nobody would be around to finish the job */
+	if (opensex_snapshot_save && !offline_mode && !(runflags & (RF_SHUTDOWN | RF_RESTART)))
+	{
+		if (opensex_snapshot_pid != 0)
+		{
+			if (!opensex_snapshot_pending)
+				opensex_snapshot_pending_file = filename != NULL ? sstrdup(filename) : NULL;
+
+			opensex_snapshot_pending = true;
+			db_save_stats.coalesced++;
+			return;
+		}
+
+		if (opensex_snapshot_start_write(filename))
+			return;
+	}
+
+	opensex_snapshot_abort();
+#endif
+
+	opensex_db_write_sync(filename);
 }
 
 database_module_t opensex_mod = {
@@ -1350,6 +2185,11 @@ void _modinit(module_t *m)
 	db_load = &opensex_db_load;
 	db_save = &opensex_db_write;
 
+	add_bool_conf_item("DB_SNAPSHOT_SAVE", &conf_gi_table, 0, &opensex_snapshot_save, false);
+	add_bool_conf_item("DB_JOURNAL", &conf_gi_table, 0, &opensex_journal_enabled, false);
+
+	mowgli_timer_add(base_eventloop, "db_journal_sync", opensex_journal_sync, NULL, 1);
+
 	db_register_type_handler("GRVER", opensex_h_grver);
 	db_register_type_handler("DBV", opensex_h_dbv);
 	db_register_type_handler("MDEP", opensex_ignore_row);
@@ -1381,6 +2221,22 @@ void _modinit(module_t *m)
 
 	db_register_type_handler("DE", opensex_ignore_row);
 
+	db_register_type_handler("JMU", opensex_h_jmu);
+	db_register_type_handler("JMUD", opensex_h_jmud);
+	db_register_type_handler("JMUR", opensex_h_jmur);
+	db_register_type_handler("JMUE", opensex_h_jmue);
+	db_register_type_handler("JMUS", opensex_h_jmus);
+	db_register_type_handler("JME", opensex_h_jme);
+	db_register_type_handler("JMED", opensex_h_jmed);
+	db_register_type_handler("JMN", opensex_h_jmn);
+	db_register_type_handler("JMND", opensex_h_jmnd);
+	db_register_type_handler("JMC", opensex_h_jmc);
+	db_register_type_handler("JMCD", opensex_h_jmcd);
+	db_register_type_handler("JCA", opensex_h_jca);
+	db_register_type_handler("JCAD", opensex_h_jcad);
+	db_register_type_handler("JMD", opensex_h_jmd);
+	db_register_type_handler("JMDD", opensex_h_jmd);
+
 	db_register_type_handler("???", opensex_h_unknown);
 
 	backend_loaded = true;
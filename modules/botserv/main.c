@@ -446,6 +446,13 @@ static void botserv_config_ready(void *unused)
 	hook_del_config_ready(botserv_config_ready);
 }
 
+/* channels kept across an uplink reconnect get no joins to bring the bots
+ * back, and bots new after a handoff restart are in no channels yet */
+static void bs_burst_done(void *unused)
+{
+	bs_join_registered(false);
+}
+
 /* ******************************************************************** */
 
 void botserv_save_database(database_handle_t *db)
@@ -997,6 +1004,10 @@ void _modinit(module_t *m)
 	hook_add_event("channel_can_change_topic");
 	hook_add_event("operserv_info");
 	hook_add_operserv_info(osinfo_hook);
+	hook_add_event("burst_done");
+	hook_add_burst_done(bs_burst_done);
+	hook_add_event("handoff_restored");
+	hook_add_handoff_restored(bs_burst_done);
 	hook_add_first_channel_join(bs_join);
 	hook_add_channel_part(bs_part);
 
@@ -1036,6 +1047,8 @@ void _moddeinit(module_unload_intent_t intent)
 	del_conf_item("MIN_USERS", &botsvs->conf_table);
 	hook_del_channel_join(bs_join);
 	hook_del_channel_part(bs_part);
+	hook_del_burst_done(bs_burst_done);
+	hook_del_handoff_restored(bs_burst_done);
 	hook_del_channel_drop(bs_channel_drop);
 	hook_del_shutdown(on_shutdown);
 	hook_del_config_ready(botserv_config_ready);
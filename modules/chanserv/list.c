@@ -139,6 +139,7 @@ static void cs_cmd_list(sourceinfo_t *si, int parc, char *parv[])
 	mychan_t *mc;
 	metadata_t *md, *mdclosed;
 	char *chanpattern = NULL, *markpattern = NULL, *closedpattern = NULL;
+	match_pattern_t *chanpat = NULL;
 	char buf[BUFSIZE];
 	char criteriastr[BUFSIZE];
 	unsigned int matches = 0;
@@ -177,9 +178,12 @@ static void cs_cmd_list(sourceinfo_t *si, int parc, char *parv[])
 
 	command_success_nodata(si, _("Channels matching \2%s\2:"), criteriastr);
 
+	if (chanpattern != NULL)
+		chanpat = match_pattern_create(chanpattern);
+
 	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
 	{
-		if (chanpattern != NULL && match(chanpattern, mc->name))
+		if (chanpat != NULL && match_pattern(chanpat, mc->name))
 			continue;
 
 		if (markpattern)
@@ -245,6 +249,9 @@ static void cs_cmd_list(sourceinfo_t *si, int parc, char *parv[])
 		matches++;
 	}
 
+	if (chanpat != NULL)
+		match_pattern_destroy(chanpat);
+
 	logcommand(si, CMDLOG_ADMIN, "LIST: \2%s\2 (\2%d\2 matches)", criteriastr, matches);
 	if (matches == 0)
 		command_success_nodata(si, _("No channel matched criteria \2%s\2"), criteriastr);
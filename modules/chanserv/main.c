@@ -19,6 +19,9 @@ DECLARE_MODULE_V1
 );
 
 static void cs_join(hook_channel_joinpart_t *hdata);
+static void cs_burst_done(void *unused);
+static void cs_handoff_restored(void *unused);
+static void cs_free_deferred(const char *key, void *data, void *privdata);
 static void cs_part(hook_channel_joinpart_t *hdata);
 static void cs_register(hook_channel_req_t *mc);
 static void cs_succession(hook_channel_succession_req_t *data);
@@ -32,6 +35,14 @@ static void on_shutdown(void *unused);
 
 static mowgli_eventloop_timer_t *cs_leave_empty_timer = NULL;
 
+/* registered channels joined during the burst */
+static mowgli_patricia_t *cs_deferred_joins = NULL;
+
+typedef struct {
+	char *name;
+	char *creator;	/* CLIENT_NAME of who joined it new and empty, if anyone */
+} cs_deferred_t;
+
 static void join_registered(bool all)
 {
 	mychan_t *mc;
@@ -283,6 +294,7 @@ void _modinit(module_t *m)
 	hook_add_event("channel_tschange");
 	hook_add_event("user_identify");
 	hook_add_event("shutdown");
+	hook_add_event("burst_done");
 	hook_add_channel_join(cs_join);
 	hook_add_channel_part(cs_part);
 	hook_add_channel_register(cs_register);
@@ -292,6 +304,11 @@ void _modinit(module_t *m)
 	hook_add_channel_can_change_topic(cs_topiccheck);
 	hook_add_channel_tschange(cs_tschange);
 	hook_add_shutdown(on_shutdown);
+	hook_add_burst_done(cs_burst_done);
+	hook_add_event("handoff_restored");
+	hook_add_handoff_restored(cs_handoff_restored);
+
+	cs_deferred_joins = mowgli_patricia_create(irccasecanon);
 
 	cs_leave_empty_timer = mowgli_timer_add(base_eventloop, "cs_leave_empty", cs_leave_empty, NULL, 300);
 
@@ -335,41 +352,44 @@ void _moddeinit(module_unload_intent_t intent)
 	hook_del_channel_can_change_topic(cs_topiccheck);
 	hook_del_channel_tschange(cs_tschange);
 	hook_del_shutdown(on_shutdown);
+	hook_del_burst_done(cs_burst_done);
+	hook_del_handoff_restored(cs_handoff_restored);
 
 	mowgli_timer_destroy(base_eventloop, cs_leave_empty_timer);
+
+	mowgli_patricia_destroy(cs_deferred_joins, cs_free_deferred, NULL);
 }
 
-static void cs_join(hook_channel_joinpart_t *hdata)
+/* applies access and settings of a registered channel to a member of it;
+ * returns false if the member was kicked. bursting is set for members
+ * that joined during the burst, which are only looked at afterwards.
+ * created is set if the member joined the channel alone, less than five
+ * minutes after it was created. */
+static bool cs_join_user(mychan_t *mc, chanuser_t *cu, bool bursting, bool created)
 {
-	chanuser_t *cu = hdata->cu;
 	user_t *u;
 	channel_t *chan;
-	mychan_t *mc;
 	unsigned int flags;
 	bool noop;
 	bool secure;
 	bool guard;
+	bool eob;
 	metadata_t *md;
 	chanacs_t *ca2;
 	char akickreason[120] = "User is banned from this channel", *p;
 
-	if (cu == NULL || is_internal_client(cu->user))
-		return;
 	u = cu->user;
 	chan = cu->chan;
 
-	/* first check if this is a registered channel at all */
-	mc = mychan_find(chan->name);
-	if (mc == NULL)
-		return;
-
 	flags = chanacs_user_flags(mc, u);
+	/* treat members from the burst as if their server had not finished
+	 * sending it yet, as they would have been then */
+	eob = !bursting && u->server->flags & SF_EOB;
 	noop = mc->flags & MC_NOOP || (u->myuser != NULL &&
 			u->myuser->flags & MU_NOOP);
 	/* attempt to deop people recreating channels, if the more
 	 * sophisticated mechanism is disabled */
-	secure = mc->flags & MC_SECURE || (!chansvs.changets &&
-			chan->nummembers == 1 && chan->ts > CURRTIME - 300);
+	secure = mc->flags & MC_SECURE || (!chansvs.changets && created);
 	/* chanserv or a botserv bot should join */
 	guard = mc->flags & MC_GUARD ||
 		metadata_find(mc, "private:botserv:bot-assigned") != NULL;
@@ -404,8 +424,7 @@ static void cs_join(hook_channel_joinpart_t *hdata)
 			remove_ban_exceptions(chansvs.me->me, chan, u);
 		}
 		try_kick(chansvs.me->me, chan, u, "You are not authorized to be on this channel");
-		hdata->cu = NULL;
-		return;
+		return false;
 	}
 
 	if (flags & CA_AKICK && !(flags & CA_REMOVE))
@@ -456,8 +475,7 @@ static void cs_join(hook_channel_joinpart_t *hdata)
 			}
 		}
 		try_kick(chansvs.me->me, chan, u, akickreason);
-		hdata->cu = NULL;
-		return;
+		return false;
 	}
 
 	/* Kick out users who may be recreating channels mlocked +i.
@@ -472,8 +490,8 @@ static void cs_join(hook_channel_joinpart_t *hdata)
 	 * operator, after a split.
 	 */
 	if (mc->mlock_on & CMODE_INVITE && !(flags & CA_INVITE) &&
-			(!me.bursting || mc->flags & MC_RECREATED) &&
-			(!(u->server->flags & SF_EOB) || (chan->nummembers <= 2 && (chan->nummembers <= 1 || chanuser_find(chan, chansvs.me->me)))) &&
+			(!bursting || mc->flags & MC_RECREATED) &&
+			(!eob || (chan->nummembers <= 2 && (chan->nummembers <= 1 || chanuser_find(chan, chansvs.me->me)))) &&
 			(!ircd->invex_mchar || !next_matching_ban(chan, u, ircd->invex_mchar, chan->bans.head)))
 	{
 		if (chan->nummembers <= (guard ? 2 : 1))
@@ -486,8 +504,7 @@ static void cs_join(hook_channel_joinpart_t *hdata)
 			check_modes(mc, true);
 		modestack_flush_channel(chan);
 		try_kick(chansvs.me->me, chan, u, "Invite only channel");
-		hdata->cu = NULL;
-		return;
+		return false;
 	}
 
 	/* A second user joined and was not kicked; we do not need
@@ -577,16 +594,134 @@ static void cs_join(hook_channel_joinpart_t *hdata)
 		}
 	}
 
-	if (u->server->flags & SF_EOB && (md = metadata_find(mc, "private:entrymsg"))) {
+	if (eob && (md = metadata_find(mc, "private:entrymsg"))) {
 		if (!u->myuser || !(u->myuser->flags & MU_NOGREET))
 			notice(chansvs.nick, cu->user->nick, "[%s] %s", mc->name, md->value);
 	}
 
-	if (u->server->flags & SF_EOB && (md = metadata_find(mc, "url")))
+	if (eob && (md = metadata_find(mc, "url")))
 		numeric_sts(me.me, 328, cu->user, "%s :%s", mc->name, md->value);
 
 	if (flags & CA_USEDUPDATE)
 		mc->used = CURRTIME;
+
+	return true;
+}
+
+static void cs_join(hook_channel_joinpart_t *hdata)
+{
+	chanuser_t *cu = hdata->cu;
+	mychan_t *mc;
+	cs_deferred_t *d;
+	bool created;
+
+	if (cu == NULL || is_internal_client(cu->user))
+		return;
+
+	/* first check if this is a registered channel at all */
+	mc = mychan_find(cu->chan->name);
+	if (mc == NULL)
+		return;
+
+	created = cu->chan->nummembers == 1 && cu->chan->ts > CURRTIME - 300;
+
+	/* during the burst, wait until all of the channel is known; whether
+	 * it was new has to be noted now, as others join it meanwhile */
+	if (me.bursting)
+	{
+		if ((d = mowgli_patricia_retrieve(cs_deferred_joins, cu->chan->name)) == NULL)
+		{
+			d = smalloc(sizeof(cs_deferred_t));
+			d->name = sstrdup(cu->chan->name);
+			d->creator = NULL;
+			mowgli_patricia_add(cs_deferred_joins, d->name, d);
+		}
+		if (created)
+		{
+			free(d->creator);
+			d->creator = sstrdup(CLIENT_NAME(cu->user));
+		}
+		return;
+	}
+
+	if (!cs_join_user(mc, cu, false, created))
+		hdata->cu = NULL;
+}
+
+static void cs_free_deferred(const char *key, void *data, void *privdata)
+{
+	cs_deferred_t *d = data;
+
+	free(d->name);
+	free(d->creator);
+	free(d);
+}
+
+/* goes through the members of the registered channels that were joined
+ * during the burst, one channel at a time */
+static void cs_burst_done(void *unused)
+{
+	mowgli_patricia_iteration_state_t state;
+	mowgli_node_t *n;
+	channel_t *chan;
+	mychan_t *mc;
+	chanuser_t *cu;
+	user_t **members;
+	unsigned int i, count;
+	cs_deferred_t *d;
+	char *name;
+	bool created;
+
+	MOWGLI_PATRICIA_FOREACH(d, &state, cs_deferred_joins)
+	{
+		name = d->name;
+		mc = mychan_find(name);
+		chan = channel_find(name);
+		if (mc == NULL || chan == NULL)
+			continue;
+
+		if (mc->flags & MC_GUARD &&
+			metadata_find(mc, "private:botserv:bot-assigned") == NULL)
+			join(chan->name, chansvs.nick);
+
+		/* kicks change the member list, so work from a copy */
+		members = smalloc(chan->nummembers * sizeof(user_t *));
+		count = 0;
+		MOWGLI_ITER_FOREACH(n, chan->members.head)
+			members[count++] = ((chanuser_t *)n->data)->user;
+
+		for (i = 0; i < count; i++)
+		{
+			if (is_internal_client(members[i]))
+				continue;
+
+			/* the channel goes away if it is emptied */
+			if ((chan = channel_find(name)) == NULL || (mc = mychan_find(name)) == NULL)
+				break;
+
+			created = d->creator != NULL && !strcmp(CLIENT_NAME(members[i]), d->creator);
+
+			if ((cu = chanuser_find(chan, members[i])) != NULL)
+				cs_join_user(mc, cu, true, created);
+		}
+
+		free(members);
+
+		if ((chan = channel_find(name)) != NULL)
+			modestack_flush_channel(chan);
+	}
+
+	mowgli_patricia_destroy(cs_deferred_joins, cs_free_deferred, NULL);
+	cs_deferred_joins = mowgli_patricia_create(irccasecanon);
+
+	/* channels kept across an uplink reconnect had no joins above */
+	join_registered(false);
+}
+
+/* services clients new after a handoff restart are in no channels yet */
+static void cs_handoff_restored(void *unused)
+{
+	join_registered(false);
 }
 
 static void cs_part(hook_channel_joinpart_t *hdata)
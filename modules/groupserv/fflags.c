@@ -60,7 +60,10 @@ static void gs_cmd_fflags(sourceinfo_t *si, int parc, char *parv[])
 	flags = gs_flags_parser(parv[2], 1);
 
 	if (ga != NULL && flags != 0)
+	{
 		ga->flags = flags;
+		chanacs_cache_invalidate_all();
+	}
 	else if (ga != NULL)
 	{
 		groupacs_delete(mg, mu);
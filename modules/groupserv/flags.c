@@ -196,7 +196,10 @@ static void gs_cmd_flags(sourceinfo_t *si, int parc, char *parv[])
 	}
 
 	if (ga != NULL && flags != 0)
+	{
 		ga->flags = flags;
+		chanacs_cache_invalidate_all();
+	}
 	else if (ga != NULL)
 	{
 		groupacs_delete(mg, mu);
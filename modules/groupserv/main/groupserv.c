@@ -105,6 +105,9 @@ mygroup_t *mygroup_find(const char *name)
 
 static void groupacs_des(groupacs_t *ga)
 {
+	/* group membership can grant channel access */
+	chanacs_cache_invalidate_all();
+
 	metadata_delete_all(ga);
 	mowgli_heap_free(groupacs_heap, ga);
 }
@@ -126,6 +129,8 @@ groupacs_t *groupacs_add(mygroup_t *mg, myuser_t *mu, unsigned int flags)
 	mowgli_node_add(ga, &ga->gnode, &mg->acs);
 	mowgli_node_add(ga, &ga->unode, myuser_get_membership_list(mu));
 
+	chanacs_cache_invalidate_all();
+
 	return ga;
 }
 
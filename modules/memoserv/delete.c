@@ -109,6 +109,7 @@ static void ms_cmd_delete(sourceinfo_t *si, int parc, char *parv[])
 			/* Free to node pool, remove from chain */
 			mowgli_node_delete(n, &si->smu->memos);
 			mowgli_node_free(n);
+			mymemo_journal(si->smu, memo, true);
 
 			free(memo);
 		}
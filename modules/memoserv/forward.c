@@ -168,6 +168,7 @@ static void ms_cmd_forward(sourceinfo_t *si, int parc, char *parv[])
 			temp = mowgli_node_create();
 			mowgli_node_add(newmemo, temp, &tmu->memos);
 			tmu->memoct_new++;
+			mymemo_journal(tmu, newmemo, false);
 		
 			/* Should we email this? */
 			if (tmu->flags & MU_EMAILMEMOS)
@@ -91,6 +91,7 @@ static void ms_cmd_read(sourceinfo_t *si, int parc, char *parv[])
 			{
 				memo->status |= MEMO_READ;
 				si->smu->memoct_new--;
+				mymemo_journal(si->smu, memo, false);
 				tmu = myuser_find(memo->sender);
 				
 				/* If the sender is logged in, tell them the memo's been read */
@@ -115,6 +116,7 @@ static void ms_cmd_read(sourceinfo_t *si, int parc, char *parv[])
 						n = mowgli_node_create();
 						mowgli_node_add(receipt, n, &tmu->memos);
 						tmu->memoct_new++;
+						mymemo_journal(tmu, receipt, false);
 					}
 				}
 			}
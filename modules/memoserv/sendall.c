@@ -142,6 +142,7 @@ static void ms_cmd_sendall(sourceinfo_t *si, int parc, char *parv[])
 		n = mowgli_node_create();
 		mowgli_node_add(memo, n, &tmu->memos);
 		tmu->memoct_new++;
+		mymemo_journal(tmu, memo, false);
 
 		/* Should we email this? */
 		if (tmu->flags & MU_EMAILMEMOS)
@@ -82,6 +82,7 @@ static bool log_enforce_victim_out(user_t *u, myuser_t *mu)
 		}
 
 		u->myuser = NULL;
+		hook_call_user_loginchange(u);
 		return false;
 	}
 
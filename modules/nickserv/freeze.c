@@ -88,9 +88,11 @@ static void ns_cmd_freeze(sourceinfo_t *si, int parc, char *parv[])
 				u->myuser = NULL;
 				mowgli_node_delete(n, &mu->logins);
 				mowgli_node_free(n);
+				hook_call_user_loginchange(u);
 			}
 		}
 		mu->flags |= MU_NOBURSTLOGIN;
+		myuser_journal(mu);
 		authcookie_destroy_all(mu);
 
 		wallops("%s froze the account \2%s\2 (%s).", get_oper_name(si), target, reason);
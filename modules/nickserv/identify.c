@@ -143,6 +143,7 @@ static void ns_cmd_login(sourceinfo_t *si, int parc, char *parv[])
 		                }
 		        }
 		        u->myuser = NULL;
+		        hook_call_user_loginchange(u);
 		}
 
 		command_success_nodata(si, nicksvs.no_nick_ownership ? _("You are now logged in as \2%s\2.") : _("You are now identified for \2%s\2."), entity(mu)->name);
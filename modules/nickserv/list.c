@@ -202,6 +202,7 @@ static void list_one(sourceinfo_t *si, myuser_t *mu, mynick_t *mn)
 static void ns_cmd_list(sourceinfo_t *si, int parc, char *parv[])
 {
 	char criteriastr[BUFSIZE];
+	match_pattern_t *nickpat = NULL;
 	char pat[512], *pattern = NULL, *nickpattern = NULL, *hostpattern = NULL, *p, *email = NULL, *markpattern = NULL, *frozenpattern = NULL, *restrictedpattern = NULL;
 	bool hostmatch, markmatch, frozenmatch, restrictedmatch;
 	mowgli_patricia_iteration_state_t state;
@@ -269,12 +270,15 @@ static void ns_cmd_list(sourceinfo_t *si, int parc, char *parv[])
 			nickpattern = NULL;
 	}
 
+	if (nickpattern != NULL)
+		nickpat = match_pattern_create(nickpattern);
+
 	if (nicksvs.no_nick_ownership)
 	{
 		MYENTITY_FOREACH_T(mt, &mestate, ENT_USER)
 		{
 			mu = user(mt);
-			if (nickpattern && match(nickpattern, entity(mu)->name))
+			if (nickpat && match_pattern(nickpat, entity(mu)->name))
 				continue;
 			if (hostpattern)
 			{
@@ -351,7 +355,7 @@ static void ns_cmd_list(sourceinfo_t *si, int parc, char *parv[])
 	{
 		MOWGLI_PATRICIA_FOREACH(mn, &state, nicklist)
 		{
-			if (nickpattern && match(nickpattern, mn->nick))
+			if (nickpat && match_pattern(nickpat, mn->nick))
 				continue;
 			mu = mn->owner;
 			if (hostpattern)
@@ -426,6 +430,9 @@ static void ns_cmd_list(sourceinfo_t *si, int parc, char *parv[])
 		}
 	}
 
+	if (nickpat != NULL)
+		match_pattern_destroy(nickpat);
+
 	logcommand(si, CMDLOG_ADMIN, "LIST: \2%s\2 (\2%d\2 matches)", criteriastr, matches);
 	if (matches == 0)
 		command_success_nodata(si, _("No nicknames matched criteria \2%s\2"), criteriastr);
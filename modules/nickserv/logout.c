@@ -109,6 +109,7 @@ static void ns_cmd_logout(sourceinfo_t *si, int parc, char *parv[])
 				}
 			}
 			si->su->myuser = NULL;
+			hook_call_user_loginchange(si->su);
 		}
 	}
 }
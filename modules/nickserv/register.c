@@ -223,6 +223,7 @@ static void ns_cmd_register(sourceinfo_t *si, int parc, char *parv[])
 	{
 		char *key = random_string(12);
 		mu->flags |= MU_WAITAUTH;
+		myuser_journal(mu);
 
 		metadata_add(mu, "private:verify:register:key", key);
 		metadata_add(mu, "private:verify:register:timestamp", number_to_string(time(NULL)));
@@ -246,6 +247,7 @@ static void ns_cmd_register(sourceinfo_t *si, int parc, char *parv[])
 		si->su->myuser = mu;
 		n = mowgli_node_create();
 		mowgli_node_add(si->su, n, &mu->logins);
+		hook_call_user_loginchange(si->su);
 
 		if (!(mu->flags & MU_WAITAUTH))
 			/* only grant ircd registered status if it's verified */
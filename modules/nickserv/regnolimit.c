@@ -57,6 +57,7 @@ static void ns_cmd_regnolimit(sourceinfo_t *si, int parc, char *parv[])
 		}
 
 		mu->flags |= MU_REGNOLIMIT;
+		myuser_journal(mu);
 
 		wallops("%s set the REGNOLIMIT option for the account \2%s\2.", get_oper_name(si), entity(mu)->name);
 		logcommand(si, CMDLOG_ADMIN, "REGNOLIMIT:ON: \2%s\2", entity(mu)->name);
@@ -71,6 +72,7 @@ static void ns_cmd_regnolimit(sourceinfo_t *si, int parc, char *parv[])
 		}
 
 		mu->flags &= ~MU_REGNOLIMIT;
+		myuser_journal(mu);
 
 		wallops("%s removed the REGNOLIMIT option on the account \2%s\2.", get_oper_name(si), entity(mu)->name);
 		logcommand(si, CMDLOG_ADMIN, "REGNOLIMIT:OFF: \2%s\2", entity(mu)->name);
@@ -96,9 +96,11 @@ static void ns_cmd_return(sourceinfo_t *si, int parc, char *parv[])
 			u->myuser = NULL;
 			mowgli_node_delete(n, &mu->logins);
 			mowgli_node_free(n);
+			hook_call_user_loginchange(u);
 		}
 	}
 	mu->flags |= MU_NOBURSTLOGIN;
+	myuser_journal(mu);
 	authcookie_destroy_all(mu);
 
 	wallops("%s returned the account \2%s\2 to \2%s\2", get_oper_name(si), target, newmail);
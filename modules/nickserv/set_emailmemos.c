@@ -67,6 +67,7 @@ static void ns_cmd_set_emailmemos(sourceinfo_t *si, int parc, char *parv[])
 
 		logcommand(si, CMDLOG_SET, "SET:EMAILMEMOS:ON");
 		si->smu->flags |= MU_EMAILMEMOS;
+		myuser_journal(si->smu);
 		command_success_nodata(si, _("The \2%s\2 flag has been set for account \2%s\2."), "EMAILMEMOS", entity(si->smu)->name);
 		return;
 	}
@@ -81,6 +82,7 @@ static void ns_cmd_set_emailmemos(sourceinfo_t *si, int parc, char *parv[])
 
 		logcommand(si, CMDLOG_SET, "SET:EMAILMEMOS:OFF");
 		si->smu->flags &= ~MU_EMAILMEMOS;
+		myuser_journal(si->smu);
 		command_success_nodata(si, _("The \2%s\2 flag has been removed for account \2%s\2."), "EMAILMEMOS", entity(si->smu)->name);
 		return;
 	}
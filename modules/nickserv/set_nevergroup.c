@@ -57,6 +57,7 @@ static void ns_cmd_set_nevergroup(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:NEVERGROUP:ON");
 
 		si->smu->flags |= MU_NEVERGROUP;
+		myuser_journal(si->smu);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been set for account \2%s\2."), "NEVERGROUP", entity(si->smu)->name);
 
@@ -74,6 +75,7 @@ static void ns_cmd_set_nevergroup(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:NEVERGROUP:OFF");
 
 		si->smu->flags &= ~MU_NEVERGROUP;
+		myuser_journal(si->smu);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been removed for account \2%s\2."), "NEVERGROUP", entity(si->smu)->name);
 
@@ -38,6 +38,7 @@ static void ns_cmd_set_privmsg(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:PRIVMSG:ON");
 
 		si->smu->flags |= MU_USE_PRIVMSG;
+		myuser_journal(si->smu);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been set for \2%s\2."), "PRIVMSG" ,entity(si->smu)->name);
 
@@ -54,6 +55,7 @@ static void ns_cmd_set_privmsg(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:PRIVMSG:OFF");
 
 		si->smu->flags &= ~MU_USE_PRIVMSG;
+		myuser_journal(si->smu);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been removed for \2%s\2."), "PRIVMSG", entity(si->smu)->name);
 
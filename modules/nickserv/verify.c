@@ -76,6 +76,7 @@ static void ns_cmd_verify(sourceinfo_t *si, int parc, char *parv[])
 		if (!strcasecmp(key, md->value))
 		{
 			mu->flags &= ~MU_WAITAUTH;
+			myuser_journal(mu);
 
 			logcommand(si, CMDLOG_SET, "VERIFY:REGISTER: \2%s\2 (email: \2%s\2)", get_source_name(si), mu->email);
 
@@ -175,6 +176,7 @@ static void ns_cmd_fverify(sourceinfo_t *si, int parc, char *parv[])
 		}
 
 		mu->flags &= ~MU_WAITAUTH;
+		myuser_journal(mu);
 
 		logcommand(si, CMDLOG_REGISTER, "FVERIFY:REGISTER: \2%s\2 (email: \2%s\2)", entity(mu)->name, mu->email);
 
@@ -17,10 +17,14 @@ DECLARE_MODULE_V1
 
 #define CLONESDB_VERSION	3
 #define CLONES_GRACE_TIMEPERIOD	180
+#define CLONES_MAXPREFIXES	4
 
 static void clones_newuser(hook_user_nick_t *data);
 static void clones_userquit(user_t *u);
+static void clones_userquit_bulk(hook_user_delete_bulk_t *hdata);
+static void clones_loginchange(user_t *u);
 static void clones_configready(void *unused);
+static void clones_handoff_restored(void *unused);
 
 static void os_cmd_clones(sourceinfo_t *si, int parc, char *parv[]);
 static void os_cmd_clones_kline(sourceinfo_t *si, int parc, char *parv[]);
@@ -47,12 +51,13 @@ service_t *serviceinfo;
 static mowgli_list_t clone_exempts;
 bool kline_enabled;
 unsigned int grace_count;
-mowgli_patricia_t *hostlist;
 mowgli_heap_t *hostentry_heap;
 static long kline_duration;
 static int clones_allowed, clones_warn;
 static unsigned int clones_dbversion = 1;
 
+typedef struct clonenode_ clonenode_t;
+
 typedef struct cexcept_ cexcept_t;
 struct cexcept_
 {
@@ -61,17 +66,46 @@ struct cexcept_
 	int warn;
 	char *reason;
 	long expires;
+	clonenode_t *node;	/* NULL if ip is not an address or CIDR mask */
 };
 
+/* the clients within one aggregation prefix */
 typedef struct hostentry_ hostentry_t;
 struct hostentry_
 {
-	char ip[HOSTIPLEN];
-	mowgli_list_t clients;
+	char ip[HOSTIPLEN + 5];	/* the prefix, or the address if it is whole */
+	clonenode_t *node;
+	unsigned int clients;
+	unsigned int loggedin;
 	time_t firstkill;
 	unsigned int gracekills;
 };
 
+/*
+ * Clients and exemptions are kept in a binary radix tree over addresses.
+ * IPv4 addresses are stored IPv4-mapped, so that both families share one
+ * tree of 128 bits; a node is either an aggregation prefix with clients,
+ * an exemption, or a branch between them.
+ */
+struct clonenode_
+{
+	unsigned char addr[16];	/* bits past len are zero */
+	unsigned int len;
+	clonenode_t *parent;
+	clonenode_t *child[2];
+	hostentry_t *he;
+	cexcept_t *exempt;	/* the first exemption for exactly this prefix */
+};
+
+static const unsigned char v4mapped[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+
+static clonenode_t *clone_root;
+static mowgli_heap_t *clonenode_heap;
+
+/* aggregation prefix lengths in tree bits, longest first */
+static unsigned int prefixes4[CLONES_MAXPREFIXES], nprefixes4;
+static unsigned int prefixes6[CLONES_MAXPREFIXES], nprefixes6;
+
 static inline bool cexempt_expired(cexcept_t *c)
 {
 	if (c && c->expires && CURRTIME > c->expires)
@@ -80,6 +114,389 @@ static inline bool cexempt_expired(cexcept_t *c)
 	return false;
 }
 
+static inline unsigned int addr_bit(const unsigned char *addr, unsigned int i)
+{
+	return (addr[i / 8] >> (7 - i % 8)) & 1;
+}
+
+/* the number of leading bits, up to max, that two addresses share */
+static unsigned int addr_common(const unsigned char *a, const unsigned char *b, unsigned int max)
+{
+	unsigned int i, n;
+	unsigned char x;
+
+	for (i = 0; i * 8 < max; i++)
+	{
+		if ((x = a[i] ^ b[i]) == 0)
+			continue;
+
+		for (n = i * 8; !(x & 0x80); x <<= 1)
+			n++;
+
+		return n < max ? n : max;
+	}
+
+	return max;
+}
+
+/* parses an address or a CIDR mask into the form the tree uses */
+static bool clones_parse(const char *s, unsigned char *addr, unsigned int *len)
+{
+	unsigned char raw[16];
+	char ip[HOSTIPLEN + 1];
+	const char *slash;
+	int bits, l;
+
+	if ((slash = strrchr(s, '/')) != NULL)
+	{
+		if ((size_t)(slash - s) >= sizeof ip)
+			return false;
+
+		memcpy(ip, s, slash - s);
+		ip[slash - s] = '\0';
+		s = ip;
+	}
+
+	if ((bits = cidr_parse_ip(s, raw)) == 0)
+		return false;
+
+	l = slash != NULL ? atoi(slash + 1) : bits;
+	if (l <= 0 || l > bits)
+		return false;
+
+	if (bits == 32)
+	{
+		memcpy(addr, v4mapped, sizeof v4mapped);
+		memcpy(addr + 12, raw, 4);
+		l += 96;
+	}
+	else
+		memcpy(addr, raw, 16);
+
+	*len = l;
+	return true;
+}
+
+static clonenode_t *clonenode_create(const unsigned char *addr, unsigned int len)
+{
+	clonenode_t *n;
+	unsigned int i;
+
+	n = mowgli_heap_alloc(clonenode_heap);
+	memset(n, 0, sizeof *n);
+
+	memcpy(n->addr, addr, (len + 7) / 8);
+	if (len % 8 != 0)
+		n->addr[len / 8] &= 0xff << (8 - len % 8);
+	for (i = (len + 7) / 8; i < 16; i++)
+		n->addr[i] = 0;
+	n->len = len;
+
+	return n;
+}
+
+/* finds the node for a prefix, creating it and any branch above it if asked */
+static clonenode_t *clonenode_find(const unsigned char *addr, unsigned int len, bool create)
+{
+	clonenode_t **link = &clone_root, *parent = NULL, *n, *nn, *b;
+	unsigned int common = 0;
+
+	while ((n = *link) != NULL)
+	{
+		common = addr_common(n->addr, addr, n->len < len ? n->len : len);
+
+		if (common < n->len)
+			break;
+
+		if (n->len == len)
+			return n;
+
+		parent = n;
+		link = &n->child[addr_bit(addr, n->len)];
+	}
+
+	if (!create)
+		return NULL;
+
+	nn = clonenode_create(addr, len);
+	nn->parent = parent;
+	*link = nn;
+
+	if (n == NULL)
+		return nn;
+
+	if (common == len)
+	{
+		/* the new prefix contains the node that was here */
+		nn->child[addr_bit(n->addr, len)] = n;
+		n->parent = nn;
+		return nn;
+	}
+
+	/* they part somewhere in between */
+	b = clonenode_create(addr, common);
+	b->parent = parent;
+	*link = b;
+	b->child[addr_bit(n->addr, common)] = n;
+	b->child[addr_bit(addr, common)] = nn;
+	n->parent = nn->parent = b;
+
+	return nn;
+}
+
+/* drops a node, and branches above it, that no longer hold anything */
+static void clonenode_release(clonenode_t *n)
+{
+	clonenode_t *parent, *child, **link;
+
+	while (n != NULL && n->he == NULL && n->exempt == NULL && (n->child[0] == NULL || n->child[1] == NULL))
+	{
+		parent = n->parent;
+		child = n->child[0] != NULL ? n->child[0] : n->child[1];
+		link = parent == NULL ? &clone_root : &parent->child[parent->child[1] == n];
+
+		*link = child;
+		if (child != NULL)
+			child->parent = parent;
+
+		mowgli_heap_free(clonenode_heap, n);
+		n = parent;
+	}
+}
+
+/* the longest exemption that covers a prefix */
+static cexcept_t *find_exempt(const unsigned char *addr, unsigned int len)
+{
+	clonenode_t *n = clone_root;
+	cexcept_t *c = NULL;
+
+	while (n != NULL && n->len <= len && addr_common(n->addr, addr, n->len) == n->len)
+	{
+		if (n->exempt != NULL && !cexempt_expired(n->exempt))
+			c = n->exempt;
+
+		if (n->len == len)
+			break;
+
+		n = n->child[addr_bit(addr, n->len)];
+	}
+
+	return c;
+}
+
+static void cexempt_link(cexcept_t *c)
+{
+	unsigned char addr[16];
+	unsigned int len;
+
+	c->node = NULL;
+
+	if (!clones_parse(c->ip, addr, &len))
+		return;
+
+	c->node = clonenode_find(addr, len, true);
+	if (c->node->exempt == NULL)
+		c->node->exempt = c;
+}
+
+static void cexempt_destroy(mowgli_node_t *n)
+{
+	cexcept_t *c = n->data;
+	mowgli_node_t *tn;
+
+	mowgli_node_delete(n, &clone_exempts);
+	mowgli_node_free(n);
+
+	if (c->node != NULL && c->node->exempt == c)
+	{
+		c->node->exempt = NULL;
+
+		/* another exemption for the same prefix takes over */
+		MOWGLI_ITER_FOREACH(tn, clone_exempts.head)
+		{
+			if (((cexcept_t *)tn->data)->node == c->node)
+			{
+				c->node->exempt = tn->data;
+				break;
+			}
+		}
+
+		clonenode_release(c->node);
+	}
+
+	free(c->ip);
+	free(c->reason);
+	free(c);
+}
+
+/* the aggregation prefixes for an address */
+static unsigned int clones_prefixes(const unsigned char *addr, const unsigned int **prefixes)
+{
+	if (!memcmp(addr, v4mapped, sizeof v4mapped))
+	{
+		*prefixes = prefixes4;
+		return nprefixes4;
+	}
+
+	*prefixes = prefixes6;
+	return nprefixes6;
+}
+
+/* counts a client in every prefix of its address, longest first */
+static unsigned int clones_add(user_t *u, const unsigned char *addr, hostentry_t **hes)
+{
+	const unsigned int *prefixes;
+	unsigned int i, count;
+	char ip[INET6_ADDRSTRLEN];
+	clonenode_t *n;
+	hostentry_t *he;
+
+	count = clones_prefixes(addr, &prefixes);
+
+	for (i = 0; i < count; i++)
+	{
+		n = clonenode_find(addr, prefixes[i], true);
+
+		if ((he = n->he) == NULL)
+		{
+			he = mowgli_heap_alloc(hostentry_heap);
+			memset(he, 0, sizeof *he);
+
+			if (n->len == 128)
+				mowgli_strlcpy(he->ip, u->ip, sizeof he->ip);
+			else if (prefixes == prefixes4)
+				snprintf(he->ip, sizeof he->ip, "%s/%u", inet_ntop(AF_INET, n->addr + 12, ip, sizeof ip), n->len - 96);
+			else
+				snprintf(he->ip, sizeof he->ip, "%s/%u", inet_ntop(AF_INET6, n->addr, ip, sizeof ip), n->len);
+
+			he->node = n;
+			n->he = he;
+		}
+
+		he->clients++;
+		if (u->myuser != NULL)
+			he->loggedin++;
+
+		hes[i] = he;
+	}
+
+	return count;
+}
+
+static void clones_remove(user_t *u)
+{
+	const unsigned int *prefixes;
+	unsigned char addr[16];
+	unsigned int i, count, len;
+	clonenode_t *n;
+	hostentry_t *he;
+
+	if (!clones_parse(u->ip, addr, &len) || len != 128)
+		return;
+
+	count = clones_prefixes(addr, &prefixes);
+
+	for (i = 0; i < count; i++)
+	{
+		if ((n = clonenode_find(addr, prefixes[i], false)) == NULL || (he = n->he) == NULL)
+		{
+			slog(LG_DEBUG, "clones_remove(): hostentry for %s/%u not found??", u->ip, prefixes[i]);
+			continue;
+		}
+
+		if (u->myuser != NULL && he->loggedin > 0)
+			he->loggedin--;
+
+		if (--he->clients == 0)
+		{
+			/* TODO: free later if he->firstkill > time(NULL) - CLONES_GRACE_TIMEPERIOD. */
+			n->he = NULL;
+			mowgli_heap_free(hostentry_heap, he);
+			clonenode_release(n);
+		}
+	}
+}
+
+/* reads "32 24" style lists of prefix lengths, longest first */
+static unsigned int clones_parse_prefixes(const char *s, unsigned int bits, unsigned int *prefixes)
+{
+	unsigned int i, j, count = 0;
+	unsigned long l;
+	char *end;
+
+	while (s != NULL && *s != '\0')
+	{
+		l = strtoul(s, &end, 10);
+		if (end == s)
+		{
+			s++;
+			continue;
+		}
+		s = end;
+
+		if (l == 0 || l > bits)
+		{
+			slog(LG_INFO, "clones_parse_prefixes(): ignoring invalid prefix length /%lu for %u bit addresses", l, bits);
+			continue;
+		}
+
+		l += 128 - bits;
+
+		for (i = 0; i < count && prefixes[i] > l; i++)
+			;
+		if (i < count && prefixes[i] == l)
+			continue;
+
+		if (count == CLONES_MAXPREFIXES)
+		{
+			slog(LG_INFO, "clones_parse_prefixes(): only %u prefix lengths are used per address family", CLONES_MAXPREFIXES);
+			break;
+		}
+
+		for (j = count++; j > i; j--)
+			prefixes[j] = prefixes[j - 1];
+		prefixes[i] = l;
+	}
+
+	if (count == 0)
+		prefixes[count++] = 128;
+
+	return count;
+}
+
+/* counts everyone again, e.g. because the prefixes changed */
+static void clones_rebuild(void)
+{
+	mowgli_patricia_iteration_state_t state;
+	mowgli_node_t *n;
+	hostentry_t *hes[CLONES_MAXPREFIXES];
+	unsigned char addr[16];
+	unsigned int len;
+	user_t *u;
+
+	if (clonenode_heap != NULL)
+	{
+		mowgli_heap_destroy(clonenode_heap);
+		mowgli_heap_destroy(hostentry_heap);
+	}
+
+	clonenode_heap = mowgli_heap_create(sizeof(clonenode_t), HEAP_USER, BH_NOW);
+	hostentry_heap = mowgli_heap_create(sizeof(hostentry_t), HEAP_USER, BH_NOW);
+	clone_root = NULL;
+
+	MOWGLI_ITER_FOREACH(n, clone_exempts.head)
+		cexempt_link(n->data);
+
+	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
+	{
+		if (is_internal_client(u) || u->ip == NULL)
+			continue;
+
+		if (clones_parse(u->ip, addr, &len) && len == 128)
+			clones_add(u, addr, hes);
+	}
+}
+
 command_t os_clones = { "CLONES", N_("Manages network wide clones."), PRIV_AKILL, 5, os_cmd_clones, { .path = "oservice/clones" } };
 
 command_t os_clones_kline = { "KLINE", N_("Enables/disables klines for excessive clones."), AC_NONE, 1, os_cmd_clones_kline, { .path = "" } };
@@ -92,8 +509,35 @@ command_t os_clones_duration = { "DURATION", N_("Sets a custom duration to ban c
 
 static void clones_configready(void *unused)
 {
+	unsigned int p4[CLONES_MAXPREFIXES], p6[CLONES_MAXPREFIXES], n4, n6;
+
 	clones_allowed = config_options.default_clone_allowed;
 	clones_warn = config_options.default_clone_warn;
+
+	n4 = clones_parse_prefixes(config_options.clone_ipv4_prefixes, 32, p4);
+	n6 = clones_parse_prefixes(config_options.clone_ipv6_prefixes, 128, p6);
+
+	if (n4 == nprefixes4 && n6 == nprefixes6 && !memcmp(p4, prefixes4, n4 * sizeof *p4) && !memcmp(p6, prefixes6, n6 * sizeof *p6))
+		return;
+
+	memcpy(prefixes4, p4, sizeof p4);
+	memcpy(prefixes6, p6, sizeof p6);
+	nprefixes4 = n4;
+	nprefixes6 = n6;
+
+	clones_rebuild();
+}
+
+/* users taken over from before a handoff restart were not added one by one */
+static void clones_handoff_restored(void *unused)
+{
+	user_t *u;
+	mowgli_patricia_iteration_state_t state;
+
+	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
+	{
+		clones_newuser(&(hook_user_nick_t){ .u = u });
+	}
 }
 
 void _modinit(module_t *m)
@@ -127,6 +571,12 @@ void _modinit(module_t *m)
 	hook_add_user_add(clones_newuser);
 	hook_add_event("user_delete");
 	hook_add_user_delete(clones_userquit);
+	hook_add_event("user_delete_bulk");
+	hook_add_user_delete_bulk(clones_userquit_bulk);
+	hook_add_event("user_loginchange");
+	hook_add_user_loginchange(clones_loginchange);
+	hook_add_event("handoff_restored");
+	hook_add_handoff_restored(clones_handoff_restored);
 	hook_add_db_write(write_exemptdb);
 
 	db_register_type_handler("CLONES-DBV", db_h_clonesdbv);
@@ -135,7 +585,10 @@ void _modinit(module_t *m)
 	db_register_type_handler("CLONES-GR", db_h_gr);
 	db_register_type_handler("CLONES-EX", db_h_ex);
 
-	hostlist = mowgli_patricia_create(noopcanon);
+	nprefixes4 = clones_parse_prefixes(config_options.clone_ipv4_prefixes, 32, prefixes4);
+	nprefixes6 = clones_parse_prefixes(config_options.clone_ipv6_prefixes, 128, prefixes6);
+
+	clonenode_heap = mowgli_heap_create(sizeof(clonenode_t), HEAP_USER, BH_NOW);
 	hostentry_heap = mowgli_heap_create(sizeof(hostentry_t), HEAP_USER, BH_NOW);
 
 	kline_duration = 3600; /* set a default */
@@ -143,34 +596,17 @@ void _modinit(module_t *m)
 	serviceinfo = service_find("operserv");
 
 
-	/* add everyone to host hash */
+	/* add everyone to the tree */
 	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
 	{
 		clones_newuser(&(hook_user_nick_t){ .u = u });
 	}
 }
 
-static void free_hostentry(const char *key, void *data, void *privdata)
-{
-	mowgli_node_t *n, *tn;
-	hostentry_t *he = data;
-
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, he->clients.head)
-	{
-		mowgli_node_delete(n, &he->clients);
-		mowgli_node_free(n);
-	}
-
-	mowgli_heap_free(hostentry_heap, he);
-}
-
 void _moddeinit(module_unload_intent_t intent)
 {
 	mowgli_node_t *n, *tn;
 
-	mowgli_patricia_destroy(hostlist, free_hostentry, NULL);
-	mowgli_heap_destroy(hostentry_heap);
-
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, clone_exempts.head)
 	{
 		cexcept_t *c = n->data;
@@ -183,6 +619,11 @@ void _moddeinit(module_unload_intent_t intent)
 		mowgli_node_free(n);
 	}
 
+	mowgli_heap_destroy(clonenode_heap);
+	mowgli_heap_destroy(hostentry_heap);
+	clonenode_heap = hostentry_heap = NULL;
+	clone_root = NULL;
+
 	service_named_unbind_command("operserv", &os_clones);
 
 	command_delete(&os_clones_kline, os_clones_cmds);
@@ -196,6 +637,9 @@ void _moddeinit(module_unload_intent_t intent)
 
 	hook_del_user_add(clones_newuser);
 	hook_del_user_delete(clones_userquit);
+	hook_del_user_delete_bulk(clones_userquit_bulk);
+	hook_del_user_loginchange(clones_loginchange);
+	hook_del_handoff_restored(clones_handoff_restored);
 	hook_del_db_write(write_exemptdb);
 	hook_del_config_ready(clones_configready);
 
@@ -230,11 +674,7 @@ static void write_exemptdb(database_handle_t *db)
 		cexcept_t *c = n->data;
 		if (cexempt_expired(c))
 		{
-			free(c->ip);
-			free(c->reason);
-			free(c);
-			mowgli_node_delete(n, &clone_exempts);
-			mowgli_node_free(n);
+			cexempt_destroy(n);
 		}
 		else
 		{
@@ -299,31 +739,7 @@ static void db_h_ex(database_handle_t *db, const char *type)
 	c->expires = expires;
 	c->reason = sstrdup(reason);
 	mowgli_node_add(c, mowgli_node_create(), &clone_exempts);
-}
-
-static cexcept_t * find_exempt(const char *ip)
-{
-	mowgli_node_t *n;
-
-	/* first check for an exact match */
-	MOWGLI_ITER_FOREACH(n, clone_exempts.head)
-	{
-		cexcept_t *c = n->data;
-
-		if (!strcmp(ip, c->ip))
-			return c;
-	}
-
-	/* then look for cidr */
-	MOWGLI_ITER_FOREACH(n, clone_exempts.head)
-	{
-		cexcept_t *c = n->data;
-
-		if (!match_ips(c->ip, ip))
-			return c;
-	}
-
-	return 0;
+	cexempt_link(c);
 }
 
 static void os_cmd_clones(sourceinfo_t *si, int parc, char *parv[])
@@ -408,25 +824,30 @@ static void os_cmd_clones_kline(sourceinfo_t *si, int parc, char *parv[])
 	}
 }
 
-static void os_cmd_clones_list(sourceinfo_t *si, int parc, char *parv[])
+static void clones_list_node(sourceinfo_t *si, clonenode_t *n)
 {
-	hostentry_t *he;
-	int k = 0;
-	mowgli_patricia_iteration_state_t state;
+	cexcept_t *c;
 
-	MOWGLI_PATRICIA_FOREACH(he, &state, hostlist)
-	{
-		k = MOWGLI_LIST_LENGTH(&he->clients);
+	if (n == NULL)
+		return;
 
-		if (k > 3)
-		{
-			cexcept_t *c = find_exempt(he->ip);
-			if (c)
-				command_success_nodata(si, _("%d from %s (\2EXEMPT\2; allowed %d)"), k, he->ip, c->allowed);
-			else
-				command_success_nodata(si, _("%d from %s"), k, he->ip);
-		}
+	if (n->he != NULL && n->he->clients > 3)
+	{
+		c = find_exempt(n->addr, n->len);
+		if (c)
+			command_success_nodata(si, _("%d from %s (\2EXEMPT\2; allowed %d)"), n->he->clients, n->he->ip, c->allowed);
+		else
+			command_success_nodata(si, _("%d from %s"), n->he->clients, n->he->ip);
 	}
+
+	clones_list_node(si, n->child[0]);
+	clones_list_node(si, n->child[1]);
+}
+
+static void os_cmd_clones_list(sourceinfo_t *si, int parc, char *parv[])
+{
+	clones_list_node(si, clone_root);
+
 	command_success_nodata(si, _("End of CLONES LIST"));
 	logcommand(si, CMDLOG_ADMIN, "CLONES:LIST");
 }
@@ -442,6 +863,8 @@ static void os_cmd_clones_addexempt(sourceinfo_t *si, int parc, char *parv[])
 	char rreason[BUFSIZE];
 	cexcept_t *c = NULL;
 	long duration;
+	unsigned char addr[16];
+	unsigned int len;
 
 	if (!ip || !clonesstr || !expiry)
 	{
@@ -450,6 +873,12 @@ static void os_cmd_clones_addexempt(sourceinfo_t *si, int parc, char *parv[])
 		return;
 	}
 
+	if (!clones_parse(ip, addr, &len))
+	{
+		command_fail(si, fault_badparams, _("\2%s\2 is not an IP address or CIDR mask."), ip);
+		return;
+	}
+
 	clones = atoi(clonesstr);
 
 	if (expiry && !strcasecmp(expiry, "!P"))
@@ -556,6 +985,7 @@ static void os_cmd_clones_addexempt(sourceinfo_t *si, int parc, char *parv[])
 		c->ip = sstrdup(ip);
 		c->reason = sstrdup(rreason);
 		mowgli_node_add(c, mowgli_node_create(), &clone_exempts);
+		cexempt_link(c);
 		command_success_nodata(si, _("Added \2%s\2 to clone exempt list."), ip);
 	}
 	else
@@ -590,19 +1020,11 @@ static void os_cmd_clones_delexempt(sourceinfo_t *si, int parc, char *parv[])
 
 		if (cexempt_expired(c))
 		{
-			free(c->ip);
-			free(c->reason);
-			free(c);
-			mowgli_node_delete(n, &clone_exempts);
-			mowgli_node_free(n);
+			cexempt_destroy(n);
 		}
 		else if (!strcmp(c->ip, arg))
 		{
-			free(c->ip);
-			free(c->reason);
-			free(c);
-			mowgli_node_delete(n, &clone_exempts);
-			mowgli_node_free(n);
+			cexempt_destroy(n);
 			command_success_nodata(si, _("Removed \2%s\2 from clone exempt list."), arg);
 			logcommand(si, CMDLOG_ADMIN, "CLONES:DELEXEMPT: \2%s\2", arg);
 			return;
@@ -671,11 +1093,7 @@ static void os_cmd_clones_setexempt(sourceinfo_t *si, int parc, char *parv[])
 
 			if (cexempt_expired(c))
 			{
-				free(c->ip);
-				free(c->reason);
-				free(c);
-				mowgli_node_delete(n, &clone_exempts);
-				mowgli_node_free(n);
+				cexempt_destroy(n);
 			}
 			else if (!strcmp(c->ip, ip))
 			{
@@ -819,11 +1237,7 @@ static void os_cmd_clones_listexempt(sourceinfo_t *si, int parc, char *parv[])
 
 		if (cexempt_expired(c))
 		{
-			free(c->ip);
-			free(c->reason);
-			free(c);
-			mowgli_node_delete(n, &clone_exempts);
-			mowgli_node_free(n);
+			cexempt_destroy(n);
 		}
 		else if (c->expires)
 			command_success_nodata(si, _("%s - allowed limit %d, warn on %d - expires in %s - \2%s\2"), c->ip, c->allowed, c->warn, timediff(c->expires > CURRTIME ? c->expires - CURRTIME : 0), c->reason);
@@ -837,10 +1251,11 @@ static void os_cmd_clones_listexempt(sourceinfo_t *si, int parc, char *parv[])
 static void clones_newuser(hook_user_nick_t *data)
 {
 	user_t *u = data->u;
-	unsigned int i;
-	hostentry_t *he;
-	unsigned int allowed, warn;
-	mowgli_node_t *n;
+	unsigned int i, count, len;
+	unsigned char addr[16];
+	hostentry_t *he, *hes[CLONES_MAXPREFIXES];
+	unsigned int allowed[CLONES_MAXPREFIXES], warn[CLONES_MAXPREFIXES];
+	cexcept_t *c;
 
 	/* If the user has been killed, don't do anything. */
 	if (!u)
@@ -850,57 +1265,40 @@ static void clones_newuser(hook_user_nick_t *data)
 	if (is_internal_client(u) || u->ip == NULL)
 		return;
 
-	he = mowgli_patricia_retrieve(hostlist, u->ip);
-	if (he == NULL)
+	if (!clones_parse(u->ip, addr, &len) || len != 128)
 	{
-		he = mowgli_heap_alloc(hostentry_heap);
-		mowgli_strlcpy(he->ip, u->ip, sizeof he->ip);
-		mowgli_patricia_add(hostlist, he->ip, he);
+		slog(LG_DEBUG, "clones_newuser(): cannot parse IP address %s of %s", u->ip, u->nick);
+		return;
 	}
-	mowgli_node_add(u, mowgli_node_create(), &he->clients);
-	i = MOWGLI_LIST_LENGTH(&he->clients);
 
-	cexcept_t *c = find_exempt(u->ip);
-	if (c == 0)
-	{
-		allowed = clones_allowed;
-		warn = clones_warn;
-	}
-	else
-	{
-		allowed = c->allowed;
-		warn = c->warn;
-	}
+	count = clones_add(u, addr, hes);
+
+	/* the longest exemption covering the address applies to every prefix */
+	c = find_exempt(addr, len);
 
-	if (config_options.clone_increase)
+	for (i = 0; i < count; i++)
 	{
-		unsigned int real_allowed = allowed;
-		unsigned int real_warn = warn;
+		allowed[i] = c != NULL ? c->allowed : clones_allowed;
+		warn[i] = c != NULL ? c->warn : clones_warn;
 
-		MOWGLI_ITER_FOREACH(n, he->clients.head)
+		/* A hard limit of 2x the "real" limit sounds good IMO --jdhore */
+		if (config_options.clone_increase)
 		{
-			user_t *tu = n->data;
-
-			if (tu->myuser == NULL)
-				continue;
-			if (allowed != 0)
-				allowed++;
-			if (warn != 0)
-				warn++;
+			allowed[i] += hes[i]->loggedin < allowed[i] ? hes[i]->loggedin : allowed[i];
+			warn[i] += hes[i]->loggedin < warn[i] ? hes[i]->loggedin : warn[i];
 		}
-			
-		/* A hard limit of 2x the "real" limit sounds good IMO --jdhore */
-		if (allowed > (real_allowed * 2))
-			allowed = real_allowed * 2;
-		if (warn > (real_warn * 2))
-			warn = real_warn * 2;
 	}
 
-	if (i > allowed && allowed != 0)
+	for (i = 0; i < count; i++)
 	{
+		he = hes[i];
+
+		if (he->clients <= allowed[i] || allowed[i] == 0)
+			continue;
+
 		/* User has exceeded the maximum number of allowed clones. */
 		if (is_autokline_exempt(u))
-			slog(LG_INFO, "CLONES: \2%d\2 clones on \2%s\2 (%s!%s@%s) (user is autokline exempt)", i, u->ip, u->nick, u->user, u->host);
+			slog(LG_INFO, "CLONES: \2%d\2 clones on \2%s\2 (%s!%s@%s) (user is autokline exempt)", he->clients, he->ip, u->nick, u->user, u->host);
 		else if (!kline_enabled || he->gracekills < grace_count || (grace_count > 0 && he->firstkill < time(NULL) - CLONES_GRACE_TIMEPERIOD))
 		{
 			if (he->firstkill < time(NULL) - CLONES_GRACE_TIMEPERIOD)
@@ -914,9 +1312,9 @@ static void clones_newuser(hook_user_nick_t *data)
 			}
 
 			if (!kline_enabled)
-				slog(LG_INFO, "CLONES: \2%d\2 clones on \2%s\2 (%s!%s@%s) (TKLINE disabled, killing user)", i, u->ip, u->nick, u->user, u->host);
+				slog(LG_INFO, "CLONES: \2%d\2 clones on \2%s\2 (%s!%s@%s) (TKLINE disabled, killing user)", he->clients, he->ip, u->nick, u->user, u->host);
 			else
-				slog(LG_INFO, "CLONES: \2%d\2 clones on \2%s\2 (%s!%s@%s) (grace period, killing user, %d grace kills remaining)", i, u->ip, u->nick,
+				slog(LG_INFO, "CLONES: \2%d\2 clones on \2%s\2 (%s!%s@%s) (grace period, killing user, %d grace kills remaining)", he->clients, he->ip, u->nick,
 					u->user, u->host, grace_count - he->gracekills);
 
 			kill_user(serviceinfo->me, u, "Too many connections from this host.");
@@ -924,44 +1322,81 @@ static void clones_newuser(hook_user_nick_t *data)
 		}
 		else
 		{
-			slog(LG_INFO, "CLONES: \2%d\2 clones on \2%s\2 (%s!%s@%s) (TKLINE due to excess clones)", i, u->ip, u->nick, u->user, u->host);
-			kline_sts("*", "*", u->ip, kline_duration, "Excessive clones");
+			slog(LG_INFO, "CLONES: \2%d\2 clones on \2%s\2 (%s!%s@%s) (TKLINE due to excess clones)", he->clients, he->ip, u->nick, u->user, u->host);
+			kline_sts("*", "*", he->ip, kline_duration, "Excessive clones");
 		}
 
+		return;
 	}
-	else if (i >= warn && warn != 0)
+
+	for (i = 0; i < count; i++)
 	{
-		slog(LG_INFO, "CLONES: \2%d\2 clones on \2%s\2 (%s!%s@%s) (\2%d\2 allowed)", i, u->ip, u->nick, u->user, u->host, allowed);
-		msg(serviceinfo->nick, u->nick, _("\2WARNING\2: You may not have more than \2%d\2 clients connected to the network at once. Any further connections risks being removed."), allowed);
+		he = hes[i];
+
+		if (he->clients < warn[i] || warn[i] == 0)
+			continue;
+
+		slog(LG_INFO, "CLONES: \2%d\2 clones on \2%s\2 (%s!%s@%s) (\2%d\2 allowed)", he->clients, he->ip, u->nick, u->user, u->host, allowed[i]);
+		msg(serviceinfo->nick, u->nick, _("\2WARNING\2: You may not have more than \2%d\2 clients connected to the network at once. Any further connections risks being removed."), allowed[i]);
+		return;
 	}
 }
 
 static void clones_userquit(user_t *u)
 {
-	mowgli_node_t *n;
-	hostentry_t *he;
-
 	/* User has no IP, ignore him */
 	if (is_internal_client(u) || u->ip == NULL)
 		return;
 
-	he = mowgli_patricia_retrieve(hostlist, u->ip);
-	if (he == NULL)
-	{
-		slog(LG_DEBUG, "clones_userquit(): hostentry for %s not found??", u->ip);
+	/* already done by clones_userquit_bulk() */
+	if (u->flags & UF_NETSPLIT)
 		return;
+
+	clones_remove(u);
+}
+
+/* drops all split users before user_delete is called for each of them */
+static void clones_userquit_bulk(hook_user_delete_bulk_t *hdata)
+{
+	user_t *u;
+	size_t i;
+
+	for (i = 0; i < hdata->count; i++)
+	{
+		u = hdata->users[i];
+
+		if (is_internal_client(u) || u->ip == NULL)
+			continue;
+
+		clones_remove(u);
 	}
-	n = mowgli_node_find(u, &he->clients);
-	if (n)
+}
+
+/* keeps the logged in counts for CLONE_IDENTIFIED_INCREASE_LIMIT */
+static void clones_loginchange(user_t *u)
+{
+	const unsigned int *prefixes;
+	unsigned char addr[16];
+	unsigned int i, count, len;
+	clonenode_t *n;
+
+	if (is_internal_client(u) || u->ip == NULL || u->flags & UF_NETSPLIT)
+		return;
+
+	if (!clones_parse(u->ip, addr, &len) || len != 128)
+		return;
+
+	count = clones_prefixes(addr, &prefixes);
+
+	for (i = 0; i < count; i++)
 	{
-		mowgli_node_delete(n, &he->clients);
-		mowgli_node_free(n);
-		if (MOWGLI_LIST_LENGTH(&he->clients) == 0)
-		{
-			/* TODO: free later if he->firstkill > time(NULL) - CLONES_GRACE_TIMEPERIOD. */
-			mowgli_patricia_delete(hostlist, he->ip);
-			mowgli_heap_free(hostentry_heap, he);
-		}
+		if ((n = clonenode_find(addr, prefixes[i], false)) == NULL || n->he == NULL)
+			continue;
+
+		if (u->myuser != NULL)
+			n->he->loggedin++;
+		else if (n->he->loggedin > 0)
+			n->he->loggedin--;
 	}
 }
 
@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2026 Atheme Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * This file contains functionality implementing OperServ CMDSTATS and
+ * HOOKSTATS.
+ */
+
+#include "atheme.h"
+
+DECLARE_MODULE_V1
+(
+	"operserv/cmdstats", false, _modinit, _moddeinit,
+	PACKAGE_STRING,
+	"Atheme Development Group <http://www.atheme.org>"
+);
+
+static void os_cmd_cmdstats(sourceinfo_t *si, int parc, char *parv[]);
+static void os_cmd_hookstats(sourceinfo_t *si, int parc, char *parv[]);
+
+command_t os_cmdstats = { "CMDSTATS", N_("Shows how long services commands take to run."), PRIV_SERVER_AUSPEX, 1, os_cmd_cmdstats, { .path = "oservice/cmdstats" } };
+command_t os_hookstats = { "HOOKSTATS", N_("Shows how long hook handlers take to run."), PRIV_SERVER_AUSPEX, 1, os_cmd_hookstats, { .path = "oservice/hookstats" } };
+
+#define CMDSTATS_SHOWN	20
+
+typedef struct {
+	const char *pattern;
+	command_stats_t **list;
+	unsigned int count, max;
+} cmdstats_req_t;
+
+typedef struct {
+	const char *pattern;
+	hook_t **list;
+	unsigned int count, max;
+} hookstats_req_t;
+
+void _modinit(module_t *m)
+{
+	service_named_bind_command("operserv", &os_cmdstats);
+	service_named_bind_command("operserv", &os_hookstats);
+}
+
+void _moddeinit(module_unload_intent_t intent)
+{
+	service_named_unbind_command("operserv", &os_cmdstats);
+	service_named_unbind_command("operserv", &os_hookstats);
+}
+
+static void cmdstats_collect(command_stats_t *st, void *privdata)
+{
+	cmdstats_req_t *req = privdata;
+
+	if (req->pattern != NULL && match(req->pattern, st->name))
+		return;
+
+	if (req->count == req->max)
+	{
+		req->max = req->max ? req->max * 2 : 64;
+		req->list = srealloc(req->list, req->max * sizeof(command_stats_t *));
+	}
+
+	req->list[req->count++] = st;
+}
+
+/* most total time first */
+static int cmdstats_compare(const void *a, const void *b)
+{
+	const command_stats_t *sa = *(command_stats_t * const *)a;
+	const command_stats_t *sb = *(command_stats_t * const *)b;
+
+	if (sa->total_us != sb->total_us)
+		return sa->total_us < sb->total_us ? 1 : -1;
+
+	return strcasecmp(sa->name, sb->name);
+}
+
+static void os_cmd_cmdstats(sourceinfo_t *si, int parc, char *parv[])
+{
+	cmdstats_req_t req = { parv[0], NULL, 0, 0 };
+	command_stats_t *st;
+	unsigned int i;
+
+	if (parv[0] != NULL && !strcasecmp(parv[0], "RESET"))
+	{
+		if (!has_priv(si, PRIV_ADMIN))
+		{
+			command_fail(si, fault_noprivs, STR_NO_PRIVILEGE, PRIV_ADMIN);
+			return;
+		}
+
+		command_stats_reset();
+		logcommand(si, CMDLOG_ADMIN, "CMDSTATS: \2RESET\2");
+		command_success_nodata(si, _("Command statistics have been reset."));
+		return;
+	}
+
+	command_stats_foreach(cmdstats_collect, &req);
+
+	if (req.count == 0)
+	{
+		command_success_nodata(si, _("No commands have been run that match your request."));
+		return;
+	}
+
+	qsort(req.list, req.count, sizeof(command_stats_t *), cmdstats_compare);
+
+	command_success_nodata(si, _("%-28s %7s %10s %9s %9s  %s"), _("Command"), _("Count"), _("Total ms"), _("Avg ms"), _("Max ms"),
+			_("<10us <100us <1ms <10ms <100ms <1s >=1s"));
+
+	for (i = 0; i < req.count && i < CMDSTATS_SHOWN; i++)
+	{
+		st = req.list[i];
+		command_success_nodata(si, "%-28s %7u %10.1f %9.2f %9.2f  %u %u %u %u %u %u %u",
+				st->name, st->count, st->total_us / 1000.0,
+				st->total_us / 1000.0 / st->count, st->max_us / 1000.0,
+				st->histogram[0], st->histogram[1], st->histogram[2], st->histogram[3],
+				st->histogram[4], st->histogram[5], st->histogram[6]);
+	}
+
+	if (req.count > CMDSTATS_SHOWN)
+		command_success_nodata(si, _("End of list, %u more not shown."), req.count - CMDSTATS_SHOWN);
+	else
+		command_success_nodata(si, _("End of list."));
+
+	free(req.list);
+
+	logcommand(si, CMDLOG_GET, "CMDSTATS: \2%s\2", parv[0] != NULL ? parv[0] : "*");
+}
+
+static void hookstats_collect(hook_t *h, void *privdata)
+{
+	hookstats_req_t *req = privdata;
+
+	if (h->calls == 0 || (req->pattern != NULL && match(req->pattern, h->name)))
+		return;
+
+	if (req->count == req->max)
+	{
+		req->max = req->max ? req->max * 2 : 64;
+		req->list = srealloc(req->list, req->max * sizeof(hook_t *));
+	}
+
+	req->list[req->count++] = h;
+}
+
+static int hookstats_compare(const void *a, const void *b)
+{
+	const hook_t *ha = *(hook_t * const *)a;
+	const hook_t *hb = *(hook_t * const *)b;
+
+	if (ha->total_us != hb->total_us)
+		return ha->total_us < hb->total_us ? 1 : -1;
+
+	return strcasecmp(ha->name, hb->name);
+}
+
+static int hookstats_compare_handler(const void *a, const void *b)
+{
+	const hook_handler_t *ha = *(hook_handler_t * const *)a;
+	const hook_handler_t *hb = *(hook_handler_t * const *)b;
+
+	if (ha->total_us != hb->total_us)
+		return ha->total_us < hb->total_us ? 1 : -1;
+
+	return 0;
+}
+
+/* the handlers of a hook, slowest first */
+static void hookstats_show(sourceinfo_t *si, hook_t *h)
+{
+	hook_handler_t **list, *hh;
+	mowgli_node_t *n;
+	unsigned int count = 0, i;
+
+	command_success_nodata(si, "\2%-28s\2 %7u %10.1f %9.2f %9.2f", h->name, h->calls,
+			h->total_us / 1000.0, h->total_us / 1000.0 / h->calls,
+			h->max_us / 1000.0);
+
+	list = smalloc((MOWGLI_LIST_LENGTH(&h->hooks) + 1) * sizeof(hook_handler_t *));
+
+	MOWGLI_ITER_FOREACH(n, h->hooks.head)
+	{
+		hh = n->data;
+
+		if (hh->func != NULL && hh->calls != 0)
+			list[count++] = hh;
+	}
+
+	qsort(list, count, sizeof(hook_handler_t *), hookstats_compare_handler);
+
+	for (i = 0; i < count; i++)
+	{
+		hh = list[i];
+		command_success_nodata(si, "  %-26s %7u %10.1f %9.2f %9.2f  %p",
+				hh->module != NULL ? hh->module : "core", hh->calls,
+				hh->total_us / 1000.0, hh->total_us / 1000.0 / hh->calls,
+				hh->max_us / 1000.0, (void *)hh->func);
+	}
+
+	free(list);
+}
+
+static void os_cmd_hookstats(sourceinfo_t *si, int parc, char *parv[])
+{
+	hookstats_req_t req = { parv[0], NULL, 0, 0 };
+	unsigned int i;
+
+	hook_stats_foreach(hookstats_collect, &req);
+
+	if (req.count == 0)
+	{
+		command_success_nodata(si, _("No hooks have been run that match your request."));
+		return;
+	}
+
+	qsort(req.list, req.count, sizeof(hook_t *), hookstats_compare);
+
+	command_success_nodata(si, _("%-28s %7s %10s %9s %9s"), _("Hook / module"), _("Count"), _("Total ms"), _("Avg ms"), _("Max ms"));
+
+	for (i = 0; i < req.count && i < CMDSTATS_SHOWN; i++)
+		hookstats_show(si, req.list[i]);
+
+	if (req.count > CMDSTATS_SHOWN)
+		command_success_nodata(si, _("End of list, %u more not shown."), req.count - CMDSTATS_SHOWN);
+	else
+		command_success_nodata(si, _("End of list."));
+
+	free(req.list);
+
+	logcommand(si, CMDLOG_GET, "HOOKSTATS: \2%s\2", parv[0] != NULL ? parv[0] : "*");
+}
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
@@ -182,6 +182,7 @@ static void os_cmd_ignore_clear(sourceinfo_t *si, int parc, char *parv[])
 		mowgli_node_delete(n,&svs_ignore_list);
 		mowgli_node_free(n);
 		free(svsignore->mask);
+		match_pattern_destroy(svsignore->pattern);
 		free(svsignore->setby);
 		free(svsignore->reason);
 
@@ -31,16 +31,45 @@ void _modinit(module_t *m)
 
 void _moddeinit(module_unload_intent_t intent)
 {
+	userscan_cancel_all("RAKILL");
 	service_named_unbind_command("operserv", &os_rakill);
 }
 
+typedef struct {
+	char *pattern;
+	char *reason;
+} rakill_t;
+
+static void rakill_match(sourceinfo_t *si, const char *nick, const char *user, const char *host, const char *gecos, void *privdata)
+{
+	rakill_t *rk = privdata;
+
+	command_success_nodata(si, _("\2Match:\2  %s!%s@%s %s - akilling"), nick, user, host, gecos);
+	kline_sts("*", "*", host, 604800, rk->reason);
+}
+
+static void rakill_done(sourceinfo_t *si, unsigned int matches, bool cancelled, void *privdata)
+{
+	rakill_t *rk = privdata;
+
+	if (si != NULL)
+	{
+		command_success_nodata(si, cancelled ? _("\2%u\2 matches for %s akilled before the scan was cancelled.") : _("\2%u\2 matches for %s akilled."),
+				matches, rk->pattern);
+		logcommand(si, CMDLOG_ADMIN, "RAKILL: finished (\2%u\2 matches%s)", matches,
+				cancelled ? ", cancelled" : "");
+	}
+
+	free(rk->pattern);
+	free(rk->reason);
+	free(rk);
+}
+
 static void os_cmd_rakill(sourceinfo_t *si, int parc, char *parv[])
 {
 	atheme_regex_t *regex;
 	char usermask[512];
-	unsigned int matches = 0;
-	mowgli_patricia_iteration_state_t state;
-	user_t *u;
+	rakill_t *rk;
 	char *args = parv[0];
 	char *pattern;
 	char *reason;
@@ -61,6 +90,13 @@ static void os_cmd_rakill(sourceinfo_t *si, int parc, char *parv[])
 		return;
 	}
 
+	if (!strcasecmp(args, "CANCEL"))
+	{
+		if (!userscan_cancel(si, "RAKILL"))
+			command_fail(si, fault_nochange, _("You have no RAKILL scan running."));
+		return;
+	}
+
 	pattern = regex_extract(args, &args, &flags);
 	if (pattern == NULL)
 	{
@@ -79,6 +115,12 @@ static void os_cmd_rakill(sourceinfo_t *si, int parc, char *parv[])
 		return;
 	}
 
+	if (userscan_find(si, "RAKILL"))
+	{
+		command_fail(si, fault_toomany, _("You already have an RAKILL scan running; use \2RAKILL CANCEL\2 to stop it."));
+		return;
+	}
+
 	regex = regex_create(pattern, flags);
 	if (regex == NULL)
 	{
@@ -102,22 +144,15 @@ static void os_cmd_rakill(sourceinfo_t *si, int parc, char *parv[])
 		return;
 	}
 
-	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
-	{
-		sprintf(usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
-
-		if (regex_match(regex, usermask))
-		{
-			/* match */
-			command_success_nodata(si, _("\2Match:\2  %s!%s@%s %s - akilling"), u->nick, u->user, u->host, u->gecos);
-			kline_sts("*", "*", u->host, 604800, reason);
-			matches++;
-		}
-	}
-	
-	regex_destroy(regex);
-	command_success_nodata(si, _("\2%d\2 matches for %s akilled."), matches, pattern);
-	logcommand(si, CMDLOG_ADMIN, "RAKILL: \2%s\2 (reason: \2%s\2) (\2%d\2 matches)", pattern, reason, matches);
+	/* logged now, as the scan may end with nobody to log it for */
+	logcommand(si, CMDLOG_ADMIN, "RAKILL: \2%s\2 (reason: \2%s\2)", pattern, reason);
+
+	rk = smalloc(sizeof(rakill_t));
+	rk->pattern = sstrdup(pattern);
+	rk->reason = sstrdup(reason);
+
+	/* the results may come after this returns, see userscan.c */
+	userscan_start(si, "RAKILL", regex, rakill_match, rakill_done, rk);
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
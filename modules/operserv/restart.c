@@ -17,7 +17,7 @@ DECLARE_MODULE_V1
 
 static void os_cmd_restart(sourceinfo_t *si, int parc, char *parv[]);
 
-command_t os_restart = { "RESTART", N_("Restart services."), PRIV_ADMIN, 0, os_cmd_restart, { .path = "oservice/restart" } };
+command_t os_restart = { "RESTART", N_("Restart services."), PRIV_ADMIN, 1, os_cmd_restart, { .path = "oservice/restart" } };
 
 void _modinit(module_t *m)
 {
@@ -31,8 +31,24 @@ void _moddeinit(module_unload_intent_t intent)
 
 static void os_cmd_restart(sourceinfo_t *si, int parc, char *parv[])
 {
-	logcommand(si, CMDLOG_ADMIN, "RESTART");
-	wallops("Restarting by request of \2%s\2.", get_oper_name(si));
+	if (parc > 0 && strcasecmp(parv[0], "HANDOFF"))
+	{
+		command_fail(si, fault_badparams, STR_INVALID_PARAMS, "RESTART");
+		command_fail(si, fault_badparams, _("Syntax: RESTART [HANDOFF]"));
+		return;
+	}
+
+	if (parc > 0)
+	{
+		logcommand(si, CMDLOG_ADMIN, "RESTART: HANDOFF");
+		wallops("Restarting (handoff) by request of \2%s\2.", get_oper_name(si));
+		runflags |= RF_HANDOFF;
+	}
+	else
+	{
+		logcommand(si, CMDLOG_ADMIN, "RESTART");
+		wallops("Restarting by request of \2%s\2.", get_oper_name(si));
+	}
 
 	runflags |= RF_RESTART;
 }
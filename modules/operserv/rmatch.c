@@ -31,18 +31,52 @@ void _modinit(module_t *m)
 
 void _moddeinit(module_unload_intent_t intent)
 {
+	userscan_cancel_all("RMATCH");
 	service_named_unbind_command("operserv", &os_rmatch);
 }
 
 #define MAXMATCHES_DEF 1000
 
+typedef struct {
+	char *pattern;
+	unsigned int matches, maxmatches;
+} rmatch_t;
+
+static void rmatch_match(sourceinfo_t *si, const char *nick, const char *user, const char *host, const char *gecos, void *privdata)
+{
+	rmatch_t *rm = privdata;
+
+	rm->matches++;
+	if (rm->matches <= rm->maxmatches)
+		command_success_nodata(si, _("\2Match:\2  %s!%s@%s %s"), nick, user, host, gecos);
+	else if (rm->matches == rm->maxmatches + 1)
+	{
+		command_success_nodata(si, _("Too many matches, not displaying any more"));
+		command_success_nodata(si, _("Add the FORCE keyword to see them all"));
+	}
+}
+
+static void rmatch_done(sourceinfo_t *si, unsigned int matches, bool cancelled, void *privdata)
+{
+	rmatch_t *rm = privdata;
+
+	if (si != NULL)
+	{
+		command_success_nodata(si, cancelled ? _("\2%u\2 matches for %s before the scan was cancelled") : _("\2%u\2 matches for %s"),
+				matches, rm->pattern);
+		logcommand(si, CMDLOG_ADMIN, "RMATCH: \2%s\2 (\2%u\2 matches%s)", rm->pattern, matches,
+				cancelled ? ", cancelled" : "");
+	}
+
+	free(rm->pattern);
+	free(rm);
+}
+
 static void os_cmd_rmatch(sourceinfo_t *si, int parc, char *parv[])
 {
 	atheme_regex_t *regex;
-	char usermask[512];
-	unsigned int matches = 0, maxmatches;
-	mowgli_patricia_iteration_state_t state;
-	user_t *u;
+	unsigned int maxmatches;
+	rmatch_t *rm;
 	char *args = parv[0];
 	char *pattern;
 	int flags = 0;
@@ -54,6 +88,13 @@ static void os_cmd_rmatch(sourceinfo_t *si, int parc, char *parv[])
 		return;
 	}
 
+	if (!strcasecmp(args, "CANCEL"))
+	{
+		if (!userscan_cancel(si, "RMATCH"))
+			command_fail(si, fault_nochange, _("You have no RMATCH scan running."));
+		return;
+	}
+
 	pattern = regex_extract(args, &args, &flags);
 	if (pattern == NULL)
 	{
@@ -76,6 +117,12 @@ static void os_cmd_rmatch(sourceinfo_t *si, int parc, char *parv[])
 		return;
 	}
 
+	if (userscan_find(si, "RMATCH"))
+	{
+		command_fail(si, fault_toomany, _("You already have an RMATCH scan running; use \2RMATCH CANCEL\2 to stop it."));
+		return;
+	}
+
 	regex = regex_create(pattern, flags);
 	
 	if (regex == NULL)
@@ -83,27 +130,14 @@ static void os_cmd_rmatch(sourceinfo_t *si, int parc, char *parv[])
 		command_fail(si, fault_badparams, _("The provided regex \2%s\2 is invalid."), pattern);
 		return;
 	}
-		
-	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
-	{
-		sprintf(usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
-
-		if (regex_match(regex, usermask))
-		{
-			matches++;
-			if (matches <= maxmatches)
-				command_success_nodata(si, _("\2Match:\2  %s!%s@%s %s"), u->nick, u->user, u->host, u->gecos);
-			else if (matches == maxmatches + 1)
-			{
-				command_success_nodata(si, _("Too many matches, not displaying any more"));
-				command_success_nodata(si, _("Add the FORCE keyword to see them all"));
-			}
-		}
-	}
-	
-	regex_destroy(regex);
-	command_success_nodata(si, _("\2%d\2 matches for %s"), matches, pattern);
-	logcommand(si, CMDLOG_ADMIN, "RMATCH: \2%s\2 (\2%d\2 matches)", pattern, matches);
+
+	rm = smalloc(sizeof(rmatch_t));
+	rm->pattern = sstrdup(pattern);
+	rm->matches = 0;
+	rm->maxmatches = maxmatches;
+
+	/* the results may come after this returns, see userscan.c */
+	userscan_start(si, "RMATCH", regex, rmatch_match, rmatch_done, rm);
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
@@ -36,14 +36,26 @@ void _moddeinit(module_unload_intent_t intent)
 	service_named_unbind_command("operserv", &os_rnc);
 }
 
+/* most frequent first; ties in the order of the realnames */
+static int rnc_cmp(const void *a, const void *b)
+{
+	const rnc_t *ra = *(rnc_t * const *)a;
+	const rnc_t *rb = *(rnc_t * const *)b;
+
+	if (ra->count != rb->count)
+		return rb->count - ra->count;
+
+	return strcmp(ra->gecos, rb->gecos);
+}
+
 static void os_cmd_rnc(sourceinfo_t *si, int parc, char *parv[])
 {
 	char *param = parv[0];
 	int count = param ? atoi(param) : 20;
 	user_t *u;
-	rnc_t *rnc, *biggest;
+	rnc_t *rnc, **sorted;
 	mowgli_patricia_t *realnames;
-	int i, found = 0;
+	unsigned int i, n = 0;
 	mowgli_patricia_iteration_state_t state;
 
 	realnames = mowgli_patricia_create(noopcanon);
@@ -62,34 +74,20 @@ static void os_cmd_rnc(sourceinfo_t *si, int parc, char *parv[])
 		}
 	}
 
-	/* this is ugly to the max :P */
-	for (i = 1; i <= count; i++)
-	{
-		found = 0;
-		biggest = NULL;
-		MOWGLI_PATRICIA_FOREACH(rnc, &state, realnames)
-		{
-			if (rnc->count > found)
-			{
-				found = rnc->count;
-				biggest = rnc;
-			}
-		}
+	/* one sort, rather than a pass over all realnames for each line */
+	sorted = smalloc(sizeof(rnc_t *) * (mowgli_patricia_size(realnames) + 1));
+	MOWGLI_PATRICIA_FOREACH(rnc, &state, realnames)
+		sorted[n++] = rnc;
 
-		if (biggest == NULL)
-			break;
+	qsort(sorted, n, sizeof(rnc_t *), rnc_cmp);
 
-		command_success_nodata(si, _("\2%d\2: \2%d\2 matches for realname \2%s\2"), i, biggest->count, biggest->gecos);
-		mowgli_patricia_delete(realnames, biggest->gecos);
-		free(biggest);
-	}
+	for (i = 0; count > 0 && i < n && i < (unsigned int)count; i++)
+		command_success_nodata(si, _("\2%d\2: \2%d\2 matches for realname \2%s\2"), i + 1, sorted[i]->count, sorted[i]->gecos);
 
 	/* cleanup */
-	MOWGLI_PATRICIA_FOREACH(rnc, &state, realnames)
-	{
-		mowgli_patricia_delete(realnames, rnc->gecos);
-		free(rnc);
-	}
+	for (i = 0; i < n; i++)
+		free(sorted[i]);
+	free(sorted);
 	mowgli_patricia_destroy(realnames, NULL, NULL);
 
 	logcommand(si, CMDLOG_ADMIN, "RNC: \2%d\2", count);
@@ -33,6 +33,9 @@ mowgli_patricia_t *os_rwatch_cmds;
 
 mowgli_list_t rwatch_list;
 
+/* every compiled regex in rwatch_list, so that a client is scanned once */
+static pattern_set_t *rwatch_set;
+
 #define RWACT_SNOOP 		1
 #define RWACT_KLINE 		2
 #define RWACT_QUARANTINE	4
@@ -45,8 +48,18 @@ struct rwatch_
 	char *reason;
 	int actions; /* RWACT_* */
 	atheme_regex_t *re;
+	pattern_set_entry_t *entry;
+	unsigned int hits;
 };
 
+/* what the matches of one client are checked against */
+typedef struct {
+	user_t *u;
+	const char *usermask;
+	const char *oldusermask;
+	const char *oldnick;
+} rwatch_match_t;
+
 command_t os_rwatch = { "RWATCH", N_("Performs actions on connecting clients matching regexes."), PRIV_USER_AUSPEX, 2, os_cmd_rwatch, { .path = "oservice/rwatch" } };
 
 command_t os_rwatch_add = { "ADD", N_("Adds an entry to the regex watch list."), AC_NONE, 1, os_cmd_rwatch_add, { .path = "" } };
@@ -57,6 +70,30 @@ command_t os_rwatch_set = { "SET", N_("Changes actions on an entry in the regex
 rwatch_t *rwread = NULL;
 FILE *f;
 
+/* puts a new entry on the list, and in the set if its regex compiled */
+static void rwatch_link(rwatch_t *rw)
+{
+	rw->hits = 0;
+	rw->entry = NULL;
+
+	if (rw->re != NULL)
+		rw->entry = pattern_set_add_regex(rwatch_set, rw->regex, rw->reflags, rw->re, rw);
+
+	mowgli_node_add(rw, mowgli_node_create(), &rwatch_list);
+}
+
+static void rwatch_destroy(rwatch_t *rw)
+{
+	if (rw->entry != NULL)
+		pattern_set_delete(rwatch_set, rw->entry);
+
+	free(rw->regex);
+	free(rw->reason);
+	if (rw->re != NULL)
+		regex_destroy(rw->re);
+	free(rw);
+}
+
 void _modinit(module_t *m)
 {
 	service_named_bind_command("operserv", &os_rwatch);
@@ -68,6 +105,8 @@ void _modinit(module_t *m)
 	command_add(&os_rwatch_list, os_rwatch_cmds);
 	command_add(&os_rwatch_set, os_rwatch_cmds);
 
+	rwatch_set = pattern_set_create();
+
 	hook_add_event("user_add");
 	hook_add_user_add(rwatch_newuser);
 	hook_add_event("user_nickchange");
@@ -93,18 +132,14 @@ void _moddeinit(module_unload_intent_t intent)
 
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, rwatch_list.head)
 	{
-		rwatch_t *rw = n->data;
-
-		free(rw->regex);
-		free(rw->reason);
-		if (rw->re != NULL)
-			regex_destroy(rw->re);
-		free(rw);
+		rwatch_destroy(n->data);
 
 		mowgli_node_delete(n, &rwatch_list);
 		mowgli_node_free(n);
 	}
 
+	pattern_set_destroy(rwatch_set);
+
 	service_named_unbind_command("operserv", &os_rwatch);
 
 	command_delete(&os_rwatch_add, os_rwatch_cmds);
@@ -182,7 +217,7 @@ static void load_rwatchdb(char *path)
 			{
 				rw->actions = atoi(actionstr);
 				rw->reason = sstrdup(reason);
-				mowgli_node_add(rw, mowgli_node_create(), &rwatch_list);
+				rwatch_link(rw);
 				rw = NULL;
 			}
 		}
@@ -218,7 +253,7 @@ static void db_h_rr(database_handle_t *db, const char *type)
 
 	rwread->actions = actions;
 	rwread->reason = sstrdup(reason);
-	mowgli_node_add(rwread, mowgli_node_create(), &rwatch_list);
+	rwatch_link(rwread);
 	rwread = NULL;
 }
 
@@ -306,7 +341,7 @@ static void os_cmd_rwatch_add(sourceinfo_t *si, int parc, char *parv[])
 	rw->actions = RWACT_SNOOP;
 	rw->re = regex;
 
-	mowgli_node_add(rw, mowgli_node_create(), &rwatch_list);
+	rwatch_link(rw);
 	command_success_nodata(si, _("Added \2%s\2 to regex watch list."), pattern);
 	logcommand(si, CMDLOG_ADMIN, "RWATCH:ADD: \2%s\2 (reason: \2%s\2)", pattern, reason);
 }
@@ -357,11 +392,7 @@ static void os_cmd_rwatch_del(sourceinfo_t *si, int parc, char *parv[])
 				}
 				wallops("\2%s\2 disabled quarantine on regex watch pattern \2%s\2", get_oper_name(si), pattern);
 			}
-			free(rw->regex);
-			free(rw->reason);
-			if (rw->re != NULL)
-				regex_destroy(rw->re);
-			free(rw);
+			rwatch_destroy(rw);
 			mowgli_node_delete(n, &rwatch_list);
 			mowgli_node_free(n);
 			command_success_nodata(si, _("Removed \2%s\2 from regex watch list."), pattern);
@@ -381,13 +412,13 @@ static void os_cmd_rwatch_list(sourceinfo_t *si, int parc, char *parv[])
 	{
 		rwatch_t *rw = n->data;
 
-		command_success_nodata(si, "%s (%s%s%s%s) - %s",
+		command_success_nodata(si, "%s (%s%s%s%s) - %s (%u hits)",
 				rw->regex,
 				rw->reflags & AREGEX_ICASE ? "i" : "",
 				rw->reflags & AREGEX_PCRE ? "p" : "",
 				rw->actions & RWACT_SNOOP ? "S" : "",
 				rw->actions & RWACT_KLINE ? "\2K\2" : "",
-				rw->reason);
+				rw->reason, rw->hits);
 	}
 	command_success_nodata(si, _("End of RWATCH LIST"));
 	logcommand(si, CMDLOG_GET, "RWATCH:LIST");
@@ -497,12 +528,55 @@ static void os_cmd_rwatch_set(sourceinfo_t *si, int parc, char *parv[])
 	command_fail(si, fault_nosuch_target, _("\2%s\2 not found in regex watch list."), pattern);
 }
 
+static void rwatch_newuser_match(void *data, void *privdata)
+{
+	rwatch_t *rw = data;
+	rwatch_match_t *m = privdata;
+	user_t *u = m->u;
+
+	rw->hits++;
+
+	if (rw->actions & RWACT_SNOOP)
+	{
+		slog(LG_INFO, "RWATCH:%s \2%s\2 matches \2%s\2 (reason: \2%s\2)",
+				rw->actions & RWACT_KLINE ? "KLINE:" : "",
+				m->usermask, rw->regex, rw->reason);
+	}
+	if (rw->actions & RWACT_KLINE)
+	{
+		if (is_autokline_exempt(u))
+			slog(LG_INFO, "rwatch_newuser(): not klining *@%s (user %s!%s@%s is autokline exempt but matches %s %s)",
+					u->host, u->nick, u->user, u->host,
+					rw->regex, rw->reason);
+		else
+		{
+			slog(LG_VERBOSE, "rwatch_newuser(): klining *@%s (user %s!%s@%s matches %s %s)",
+					u->host, u->nick, u->user, u->host,
+					rw->regex, rw->reason);
+			kline_sts("*", "*", u->host, 86400, rw->reason);
+		}
+	}
+	else if (rw->actions & RWACT_QUARANTINE)
+	{
+		if (is_autokline_exempt(u))
+			slog(LG_INFO, "rwatch_newuser(): not qurantining *@%s (user %s!%s@%s is autokline exempt but matches %s %s)",
+					u->host, u->nick, u->user, u->host,
+					rw->regex, rw->reason);
+		else
+		{
+			slog(LG_VERBOSE, "rwatch_newuser(): quaranting *@%s (user %s!%s@%s matches %s %s)",
+					u->host, u->nick, u->user, u->host,
+					rw->regex, rw->reason);
+			quarantine_sts(service_find("operserv")->me, u, 86400, rw->reason);
+		}
+	}
+}
+
 static void rwatch_newuser(hook_user_nick_t *data)
 {
 	user_t *u = data->u;
 	char usermask[NICKLEN+USERLEN+HOSTLEN+GECOSLEN];
-	mowgli_node_t *n;
-	rwatch_t *rw;
+	rwatch_match_t m;
 
 	/* If the user has been killed, don't do anything. */
 	if (!u)
@@ -513,47 +587,57 @@ static void rwatch_newuser(hook_user_nick_t *data)
 
 	snprintf(usermask, sizeof usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
 
-	MOWGLI_ITER_FOREACH(n, rwatch_list.head)
+	m.u = u;
+	m.usermask = usermask;
+	m.oldusermask = m.oldnick = NULL;
+
+	pattern_set_match_all(rwatch_set, usermask, rwatch_newuser_match, &m);
+}
+
+static void rwatch_nickchange_match(void *data, void *privdata)
+{
+	rwatch_t *rw = data;
+	rwatch_match_t *m = privdata;
+	user_t *u = m->u;
+
+	/* Only process if they did not match before. */
+	if (regex_match(rw->re, (char *)m->oldusermask))
+		return;
+
+	rw->hits++;
+
+	if (rw->actions & RWACT_SNOOP)
+	{
+		slog(LG_INFO, "RWATCH:NICKCHANGE:%s \2%s\2 -> \2%s\2 matches \2%s\2 (reason: \2%s\2)",
+				rw->actions & RWACT_KLINE ? "KLINE:" : "",
+				m->oldnick, m->usermask, rw->regex, rw->reason);
+	}
+	if (rw->actions & RWACT_KLINE)
 	{
-		rw = n->data;
-		if (!rw->re)
-			continue;
-		if (regex_match(rw->re, usermask))
+		if (is_autokline_exempt(u))
+			slog(LG_INFO, "rwatch_nickchange(): not klining *@%s (user %s -> %s!%s@%s is autokline exempt but matches %s %s)",
+					u->host, m->oldnick, u->nick, u->user, u->host,
+					rw->regex, rw->reason);
+		else
 		{
-			if (rw->actions & RWACT_SNOOP)
-			{
-				slog(LG_INFO, "RWATCH:%s \2%s\2 matches \2%s\2 (reason: \2%s\2)",
-						rw->actions & RWACT_KLINE ? "KLINE:" : "",
-						usermask, rw->regex, rw->reason);
-			}
-			if (rw->actions & RWACT_KLINE)
-			{
-				if (is_autokline_exempt(u))
-					slog(LG_INFO, "rwatch_newuser(): not klining *@%s (user %s!%s@%s is autokline exempt but matches %s %s)",
-							u->host, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-				else
-				{
-					slog(LG_VERBOSE, "rwatch_newuser(): klining *@%s (user %s!%s@%s matches %s %s)",
-							u->host, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-					kline_sts("*", "*", u->host, 86400, rw->reason);
-				}
-			}
-			else if (rw->actions & RWACT_QUARANTINE)
-			{
-				if (is_autokline_exempt(u))
-					slog(LG_INFO, "rwatch_newuser(): not qurantining *@%s (user %s!%s@%s is autokline exempt but matches %s %s)",
-							u->host, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-				else
-				{
-					slog(LG_VERBOSE, "rwatch_newuser(): quaranting *@%s (user %s!%s@%s matches %s %s)",
-							u->host, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-					quarantine_sts(service_find("operserv")->me, u, 86400, rw->reason);
-				}
-			}
+			slog(LG_VERBOSE, "rwatch_nickchange(): klining *@%s (user %s -> %s!%s@%s matches %s %s)",
+					u->host, m->oldnick, u->nick, u->user, u->host,
+					rw->regex, rw->reason);
+			kline_sts("*", "*", u->host, 86400, rw->reason);
+		}
+	}
+	else if (rw->actions & RWACT_QUARANTINE)
+	{
+		if (is_autokline_exempt(u))
+			slog(LG_INFO, "rwatch_newuser(): not qurantining *@%s (user %s!%s@%s is autokline exempt but matches %s %s)",
+					u->host, u->nick, u->user, u->host,
+					rw->regex, rw->reason);
+		else
+		{
+			slog(LG_VERBOSE, "rwatch_newuser(): quaranting *@%s (user %s!%s@%s matches %s %s)",
+					u->host, u->nick, u->user, u->host,
+					rw->regex, rw->reason);
+			quarantine_sts(service_find("operserv")->me, u, 86400, rw->reason);
 		}
 	}
 }
@@ -563,8 +647,7 @@ static void rwatch_nickchange(hook_user_nick_t *data)
 	user_t *u = data->u;
 	char usermask[NICKLEN+USERLEN+HOSTLEN+GECOSLEN];
 	char oldusermask[NICKLEN+USERLEN+HOSTLEN+GECOSLEN];
-	mowgli_node_t *n;
-	rwatch_t *rw;
+	rwatch_match_t m;
 
 	/* If the user has been killed, don't do anything. */
 	if (!u)
@@ -576,52 +659,12 @@ static void rwatch_nickchange(hook_user_nick_t *data)
 	snprintf(usermask, sizeof usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
 	snprintf(oldusermask, sizeof oldusermask, "%s!%s@%s %s", data->oldnick, u->user, u->host, u->gecos);
 
-	MOWGLI_ITER_FOREACH(n, rwatch_list.head)
-	{
-		rw = n->data;
-		if (!rw->re)
-			continue;
-		if (regex_match(rw->re, usermask))
-		{
-			/* Only process if they did not match before. */
-			if (regex_match(rw->re, oldusermask))
-				continue;
-			if (rw->actions & RWACT_SNOOP)
-			{
-				slog(LG_INFO, "RWATCH:NICKCHANGE:%s \2%s\2 -> \2%s\2 matches \2%s\2 (reason: \2%s\2)",
-						rw->actions & RWACT_KLINE ? "KLINE:" : "",
-						data->oldnick, usermask, rw->regex, rw->reason);
-			}
-			if (rw->actions & RWACT_KLINE)
-			{
-				if (is_autokline_exempt(u))
-					slog(LG_INFO, "rwatch_nickchange(): not klining *@%s (user %s -> %s!%s@%s is autokline exempt but matches %s %s)",
-							u->host, data->oldnick, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-				else
-				{
-					slog(LG_VERBOSE, "rwatch_nickchange(): klining *@%s (user %s -> %s!%s@%s matches %s %s)",
-							u->host, data->oldnick, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-					kline_sts("*", "*", u->host, 86400, rw->reason);
-				}
-			}
-			else if (rw->actions & RWACT_QUARANTINE)
-			{
-				if (is_autokline_exempt(u))
-					slog(LG_INFO, "rwatch_newuser(): not qurantining *@%s (user %s!%s@%s is autokline exempt but matches %s %s)",
-							u->host, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-				else
-				{
-					slog(LG_VERBOSE, "rwatch_newuser(): quaranting *@%s (user %s!%s@%s matches %s %s)",
-							u->host, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-					quarantine_sts(service_find("operserv")->me, u, 86400, rw->reason);
-				}
-			}
-		}
-	}
+	m.u = u;
+	m.usermask = usermask;
+	m.oldusermask = oldusermask;
+	m.oldnick = data->oldnick;
+
+	pattern_set_match_all(rwatch_set, usermask, rwatch_nickchange_match, &m);
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
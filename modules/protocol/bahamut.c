@@ -463,6 +463,7 @@ static void m_burst(sourceinfo_t *si, int parc, char *parv[])
 #endif
 
 		me.bursting = false;
+		hook_call_burst_done();
 	}
 }
 
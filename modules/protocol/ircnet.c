@@ -431,6 +431,7 @@ static void m_eob(sourceinfo_t *si, int parc, char *parv[])
 #endif
 
 		me.bursting = false;
+		hook_call_burst_done();
 	}
 }
 
@@ -346,6 +346,7 @@ static void m_pong(sourceinfo_t *si, int parc, char *parv[])
 #endif
 
 		me.bursting = false;
+		hook_call_burst_done();
 	}
 }
 
@@ -433,8 +433,11 @@ int login_user(sasl_session_t *p)
 	/* We just did SASL authentication for a user.  With IRCds which do not have unique UIDs for users,
 	 * we will likely be expecting the login data to be bursted.
 	 */
-	if (ircd->flags & IRCD_SASL_USE_PUID)
+	if (ircd->flags & IRCD_SASL_USE_PUID && mu->flags & MU_NOBURSTLOGIN)
+	{
 		mu->flags &= ~MU_NOBURSTLOGIN;
+		myuser_journal(mu);
+	}
 
 	return 1;
 }
@@ -41,7 +41,6 @@ static void p10_parse(char *line)
 	char *command = NULL;
 	char *message = NULL;
 	char *parv[MAXPARC + 1];
-	static char coreLine[BUFSIZE];
 	int parc = 0;
 	unsigned int i;
 	pcommand_t *pcmd;
@@ -50,7 +49,7 @@ static void p10_parse(char *line)
 	for (i = 0; i <= MAXPARC; i++)
 		parv[i] = NULL;
 
-	si = sourceinfo_create();
+	si = sourceinfo_acquire();
 	si->connection = curr_uplink->conn;
 	si->output_limit = MAX_IRC_OUTPUT_LINES;
 
@@ -64,9 +63,8 @@ static void p10_parse(char *line)
 		if (*line == '\000')
 			goto cleanup;
 
-		/* copy the original line so we know what we crashed on */
-		memset((char *)&coreLine, '\0', BUFSIZE);
-		mowgli_strlcpy(coreLine, line, BUFSIZE);
+		/* remember the original line so we know what we crashed on */
+		core_line_set(line);
 
 		slog(LG_RAWDATA, "-> %s", line);
 
@@ -85,14 +83,22 @@ static void p10_parse(char *line)
 				if (*origin == ':')
 				{
 					origin++;
-                                	si->s = server_find(origin);
-                                	si->su = user_find_named(origin);
+					if (strchr(origin, '.') != NULL)
+					{
+						if ((si->s = server_find(origin)) == NULL)
+							si->su = user_find_named(origin);
+					}
+					else if ((si->su = user_find_named(origin)) == NULL)
+						si->s = server_find(origin);
 				}
-				else
+				else if (origin[0] != '\0' && (origin[1] == '\0' || origin[2] == '\0'))
 				{
-                                	si->s = server_find(origin);
-                                	si->su = user_find(origin);
+					/* server numerics are one or two characters */
+					if ((si->s = server_find(origin)) == NULL)
+						si->su = user_find(origin);
 				}
+				else if ((si->su = user_find(origin)) == NULL)
+					si->s = server_find(origin);
 
 				if ((message = strchr(pos, ' ')))
 				{
@@ -120,12 +126,12 @@ static void p10_parse(char *line)
                 }
 		if (si->s == me.me)
 		{
-                        slog(LG_INFO, "p10_parse(): got message supposedly from myself %s: %s", si->s->name, coreLine);
+                        slog(LG_INFO, "p10_parse(): got message supposedly from myself %s: %s", si->s->name, core_line());
                         goto cleanup;
 		}
 		if (si->su != NULL && si->su->server == me.me)
 		{
-                        slog(LG_INFO, "p10_parse(): got message supposedly from my own client %s: %s", si->su->nick, coreLine);
+                        slog(LG_INFO, "p10_parse(): got message supposedly from my own client %s: %s", si->su->nick, core_line());
                         goto cleanup;
 		}
 		si->smu = si->su != NULL ? si->su->myuser : NULL;
@@ -153,7 +159,7 @@ static void p10_parse(char *line)
 		 */
 		if (!command)
 		{
-			slog(LG_DEBUG, "p10_parse(): command not found: %s", coreLine);
+			slog(LG_DEBUG, "p10_parse(): command not found: %s", core_line());
 			goto cleanup;
 		}
 
@@ -188,7 +194,8 @@ static void p10_parse(char *line)
 	}
 
 cleanup:
-	object_unref(si);
+	sourceinfo_release(si);
+	core_line_set(NULL);
 }
 
 void (*default_parse)(char *line) = NULL;
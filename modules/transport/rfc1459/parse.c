@@ -26,6 +26,17 @@
 #include "pmodule.h"
 #include "rfc1459.h"
 
+/* tells from its form whether a prefix names a server (a name with a dot
+ * in it or a TS6 SID) or a user (a nick or a UID), so that only one of the
+ * two is usually looked up */
+static inline bool origin_is_server(const char *origin)
+{
+	if (ircd->uses_uid && IsDigit(*origin))
+		return origin[1] != '\0' && origin[2] != '\0' && origin[3] == '\0';
+
+	return strchr(origin, '.') != NULL;
+}
+
 /* parses a standard 2.8.21 style IRC stream */
 void irc_parse(char *line)
 {
@@ -35,7 +46,6 @@ void irc_parse(char *line)
 	char *command = NULL;
 	char *message = NULL;
 	char *parv[MAXPARC + 1];
-	static char coreLine[BUFSIZE];
 	int parc = 0;
 	unsigned int i;
 	pcommand_t *pcmd;
@@ -44,7 +54,7 @@ void irc_parse(char *line)
 	for (i = 0; i <= MAXPARC; i++)
 		parv[i] = NULL;
 
-	si = sourceinfo_create();
+	si = sourceinfo_acquire();
 	si->connection = curr_uplink->conn;
 	si->output_limit = MAX_IRC_OUTPUT_LINES;
 
@@ -58,9 +68,8 @@ void irc_parse(char *line)
 		if (*line == '\000')
 			goto cleanup;
 
-		/* copy the original line so we know what we crashed on */
-		memset((char *)&coreLine, '\0', BUFSIZE);
-		mowgli_strlcpy(coreLine, line, BUFSIZE);
+		/* remember the original line so we know what we crashed on */
+		core_line_set(line);
 
 		slog(LG_RAWDATA, "-> %s", line);
 
@@ -77,8 +86,13 @@ void irc_parse(char *line)
 			{
                         	origin = line + 1;
 
-				si->s = server_find(origin);
-				si->su = user_find(origin);
+				if (origin_is_server(origin))
+				{
+					if ((si->s = server_find(origin)) == NULL)
+						si->su = user_find(origin);
+				}
+				else if ((si->su = user_find(origin)) == NULL)
+					si->s = server_find(origin);
 
 				if ((message = strchr(pos, ' ')))
 				{
@@ -120,12 +134,12 @@ void irc_parse(char *line)
                 }
 		if (si->s == me.me)
 		{
-                        slog(LG_INFO, "irc_parse(): got message supposedly from myself %s: %s", si->s->name, coreLine);
+                        slog(LG_INFO, "irc_parse(): got message supposedly from myself %s: %s", si->s->name, core_line());
                         goto cleanup;
 		}
 		if (si->su != NULL && si->su->server == me.me)
 		{
-                        slog(LG_INFO, "irc_parse(): got message supposedly from my own client %s: %s", si->su->nick, coreLine);
+                        slog(LG_INFO, "irc_parse(): got message supposedly from my own client %s: %s", si->su->nick, core_line());
                         goto cleanup;
 		}
 		si->smu = si->su != NULL ? si->su->myuser : NULL;
@@ -153,7 +167,7 @@ void irc_parse(char *line)
 		 */
 		if (!command)
 		{
-			slog(LG_DEBUG, "irc_parse(): command not found: %s", coreLine);
+			slog(LG_DEBUG, "irc_parse(): command not found: %s", core_line());
 			goto cleanup;
 		}
 
@@ -188,7 +202,8 @@ void irc_parse(char *line)
 	}
 
 cleanup:
-	object_unref(si);
+	sourceinfo_release(si);
+	core_line_set(NULL);
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2026 Atheme Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Converts a database between the opensex and bindb formats.
+ *
+ * The rows are read and written by the real backends, with every module
+ * named in the database loaded, so the output holds exactly what
+ * services would have saved. Converting a database to bindb and back
+ * should give the same rows as the original opensex file.
+ */
+
+#include "atheme.h"
+#include "libathemecore.h"
+
+static void handle_mdep(database_handle_t *db, const char *type)
+{
+	const char *modname = db_sread_word(db);
+
+	module_load(modname);
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [-t] [-s sections] input output\n", argv0);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "  Reads input (opensex or bindb) and writes output as bindb,\n");
+	fprintf(stderr, "  or as opensex with -t. Both are relative to %s.\n", DATADIR);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "  -s  only read these sections of a bindb input, comma separated:\n");
+	fprintf(stderr, "      accounts, channels, klines, modules\n");
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	database_module_t *opensex_mod, *bindb_mod;
+	bool (*select_sections)(const char *list);
+	bool text = false;
+	const char *sections = NULL;
+	int c;
+
+	while ((c = getopt(argc, argv, "ts:h")) != -1)
+	{
+		switch (c)
+		{
+		case 't':
+			text = true;
+			break;
+		case 's':
+			sections = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (argc - optind != 2)
+		usage(argv[0]);
+
+	atheme_bootstrap();
+	atheme_init(argv[0], LOGDIR "/dbconvert.log");
+	atheme_setup();
+
+	runflags = RF_LIVE;
+	datadir = DATADIR;
+	strict_mode = false;
+	offline_mode = true;
+
+	if (module_load("backend/opensex") == NULL)
+		return EXIT_FAILURE;
+	opensex_mod = db_mod;
+
+	/* bindb reads either format, so it stays selected while loading */
+	if (module_load("backend/bindb") == NULL)
+		return EXIT_FAILURE;
+	bindb_mod = db_mod;
+
+	if (sections != NULL)
+	{
+		select_sections = module_locate_symbol("backend/bindb", "bindb_select_sections");
+		if (select_sections == NULL || !select_sections(sections))
+			usage(argv[0]);
+	}
+
+	db_unregister_type_handler("MDEP");
+	db_register_type_handler("MDEP", handle_mdep);
+
+	slog(LG_INFO, "dbconvert: reading %s", argv[optind]);
+
+	runflags &= ~RF_LIVE;
+	db_load(argv[optind]);
+	runflags |= RF_LIVE;
+
+	slog(LG_INFO, "dbconvert: writing %s as %s", argv[optind + 1], text ? "opensex" : "bindb");
+
+	db_mod = text ? opensex_mod : bindb_mod;
+	db_save(argv[optind + 1]);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2026 Atheme Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Checks irccasecmp(), ircncasecmp() and irccasecanon() against the plain
+ * byte at a time versions built on ToUpper(), for every mapping
+ * set_match_mapping() knows, then times both:
+ *
+ *   ./casebench [iterations]
+ *
+ * Every byte is tried at every position of strings up to CASE_MAXLEN
+ * long, against every other byte, so that the word at a time paths are
+ * covered at each offset and for bytes outside ASCII. Mismatches are
+ * printed and make the exit status nonzero. Timings are reported as one
+ * JSON object per line on stdout.
+ */
+
+#include "atheme.h"
+#include "libathemecore.h"
+
+#define CASE_MAXLEN	24
+
+static const struct {
+	int mapping;
+	const char *name;
+} mappings[] = {
+	{ MATCH_RFC1459, "rfc1459" },
+	{ MATCH_ASCII, "ascii" },
+};
+
+static unsigned long failures;
+
+/* the implementations being replaced */
+static int ref_irccasecmp(const char *s1, const char *s2)
+{
+	const unsigned char *str1 = (const unsigned char *)s1;
+	const unsigned char *str2 = (const unsigned char *)s2;
+	int res;
+
+	if (match_mapping == MATCH_ASCII)
+		return strcasecmp(s1, s2);
+
+	while ((res = ToUpper(*str1) - ToUpper(*str2)) == 0)
+	{
+		if (*str1 == '\0')
+			return 0;
+		str1++;
+		str2++;
+	}
+	return res;
+}
+
+static int ref_ircncasecmp(const char *str1, const char *str2, size_t n)
+{
+	const unsigned char *s1 = (const unsigned char *)str1;
+	const unsigned char *s2 = (const unsigned char *)str2;
+	int res;
+
+	if (match_mapping == MATCH_ASCII)
+		return strncasecmp(str1, str2, n);
+
+	while ((res = ToUpper(*s1) - ToUpper(*s2)) == 0)
+	{
+		s1++;
+		s2++;
+		n--;
+		if (n == 0 || (*s1 == '\0' && *s2 == '\0'))
+			return 0;
+	}
+	return res;
+}
+
+static void ref_irccasecanon(char *str)
+{
+	while (*str)
+	{
+		*str = ToUpper(*str);
+		str++;
+	}
+}
+
+static void case_fail(const char *what, const char *s1, const char *s2, int want, int got)
+{
+	if (failures++ < 20)
+		fprintf(stderr, "%s(\"%s\", \"%s\"): %d, expected %d\n", what, s1, s2, got, want);
+}
+
+static void case_check_pair(const char *s1, const char *s2)
+{
+	size_t n;
+	int want, got;
+
+	want = ref_irccasecmp(s1, s2);
+	if ((got = irccasecmp(s1, s2)) != want)
+		case_fail("irccasecmp", s1, s2, want, got);
+
+	for (n = 1; n <= CASE_MAXLEN + 1; n += 7)
+	{
+		want = ref_ircncasecmp(s1, s2, n);
+		if ((got = ircncasecmp(s1, s2, n)) != want)
+			case_fail("ircncasecmp", s1, s2, want, got);
+	}
+}
+
+static void case_check_canon(const char *s)
+{
+	char want[CASE_MAXLEN + 1], got[CASE_MAXLEN + 1];
+
+	mowgli_strlcpy(want, s, sizeof want);
+	mowgli_strlcpy(got, s, sizeof got);
+
+	ref_irccasecanon(want);
+	irccasecanon(got);
+
+	if (strcmp(want, got))
+		case_fail("irccasecanon", s, "", 0, 1);
+}
+
+/* a mixed case nick-like string of a given length */
+static void case_fill(char *buf, size_t len, unsigned int seed)
+{
+	static const char chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ[]\\^{}|~`_-0123456789";
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = chars[(seed + i * 7) % (sizeof chars - 1)];
+	buf[len] = '\0';
+}
+
+static void case_check(void)
+{
+	char s1[CASE_MAXLEN + 1], s2[CASE_MAXLEN + 1];
+	size_t len, pos;
+	int c, d;
+
+	for (len = 1; len <= CASE_MAXLEN; len++)
+	{
+		for (pos = 0; pos < len; pos++)
+		{
+			for (c = 1; c < 256; c++)
+			{
+				case_fill(s1, len, len);
+				s1[pos] = c;
+				case_check_canon(s1);
+
+				for (d = 1; d < 256; d++)
+				{
+					memcpy(s2, s1, len + 1);
+					s2[pos] = d;
+					case_check_pair(s1, s2);
+				}
+
+				/* the other string ending here */
+				memcpy(s2, s1, len + 1);
+				s2[pos] = '\0';
+				case_check_pair(s1, s2);
+				case_check_pair(s2, s1);
+			}
+		}
+	}
+}
+
+static double case_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000.0 + ts.tv_nsec;
+}
+
+static void case_bench(const char *mapname, unsigned long iterations)
+{
+	static const size_t lens[] = { 9, 30, 64 };
+	char a[128], b[128], buf[128];
+	volatile int sink = 0;
+	unsigned long i;
+	unsigned int l;
+	double t, ref_cmp, new_cmp, ref_canon, new_canon;
+
+	for (l = 0; l < ARRAY_SIZE(lens); l++)
+	{
+		case_fill(a, lens[l], 3);
+		mowgli_strlcpy(b, a, sizeof b);
+		irccasecanon(b);
+
+		t = case_now();
+		for (i = 0; i < iterations; i++)
+			sink += ref_irccasecmp(a, b);
+		ref_cmp = case_now() - t;
+
+		t = case_now();
+		for (i = 0; i < iterations; i++)
+			sink += irccasecmp(a, b);
+		new_cmp = case_now() - t;
+
+		t = case_now();
+		for (i = 0; i < iterations; i++)
+		{
+			memcpy(buf, a, lens[l] + 1);
+			ref_irccasecanon(buf);
+		}
+		ref_canon = case_now() - t;
+
+		t = case_now();
+		for (i = 0; i < iterations; i++)
+		{
+			memcpy(buf, a, lens[l] + 1);
+			irccasecanon(buf);
+		}
+		new_canon = case_now() - t;
+
+		printf("{\"mapping\":\"%s\",\"length\":%zu,\"iterations\":%lu,"
+		       "\"ref_cmp_ns\":%.2f,\"cmp_ns\":%.2f,\"ref_canon_ns\":%.2f,\"canon_ns\":%.2f}\n",
+		       mapname, lens[l], iterations,
+		       ref_cmp / iterations, new_cmp / iterations,
+		       ref_canon / iterations, new_canon / iterations);
+	}
+
+	(void)sink;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(mappings); i++)
+	{
+		set_match_mapping(mappings[i].mapping);
+		case_check();
+		case_bench(mappings[i].name, iterations);
+	}
+
+	/* and back, in case switching leaves something behind */
+	set_match_mapping(mappings[0].mapping);
+	case_check();
+
+	if (failures != 0)
+	{
+		fprintf(stderr, "%s: %lu mismatches\n", argv[0], failures);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
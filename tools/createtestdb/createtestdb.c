@@ -25,45 +25,184 @@
  */
 /*
  * make createtestdb
- * ./createtestdb 500000 >atheme.db
+ * ./createtestdb 500000 >services.db
+ * ./createtestdb -n 2 -c 100000 -a 10 -m 3 -M 2 500000 >services.db
  * 
- * then start atheme-services with this atheme.db
+ * then start atheme-services with this services.db, or feed it to
+ * tools/dbbench.
+ *
+ * The database is deterministic for a given seed (-s). Last login and
+ * last use times are spread over the last -d days, so that some part of
+ * it expires with the usual expiry settings.
  */
 
 #include	<stdio.h>
 #include	<time.h>
 #include	<stdlib.h>
+#include	<unistd.h>
+
+#define DAY	86400
+
+static const char *md_user_keys[] = {
+	"private:host:actual", "private:host:vhost", "private:usercloak",
+	"private:loginfail:failnum", "private:setpass:key", "private:freeze:reason",
+	NULL
+};
+
+static const char *md_chan_keys[] = {
+	"url", "email", "private:entrymsg", "private:topic:setter",
+	"private:topic:text", "private:topic:ts",
+	NULL
+};
+
+static const char *ca_flags[] = {
+	"+AV", "+AOiotv", "+AVv", "+AOfiortv", "+V",
+	NULL
+};
+
+static unsigned int
+nkeys(const char **keys)
+{
+	unsigned int n;
+
+	for (n = 0; keys[n] != NULL; n++)
+		;
+
+	return n;
+}
 
-#define MUFLAGS 0x100 /* MU_CRYPTPASS */
+/* entity IDs as myentity_alloc_uid() hands them out: AAA then six digits */
+static const char *
+uid(unsigned int i)
+{
+	static char buf[10];
+	static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+	int j;
+
+	buf[0] = buf[1] = buf[2] = 'A';
+	for (j = 8; j > 2; j--)
+	{
+		buf[j] = digits[i % 36];
+		i /= 36;
+	}
+	buf[9] = '\0';
+
+	return buf;
+}
+
+static unsigned long
+ago(time_t now, unsigned int days)
+{
+	if (days == 0)
+		return (unsigned long)now;
+
+	return (unsigned long)now - (unsigned long)(rand() % (days * DAY));
+}
+
+static void
+usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [-n nicks] [-c channels] [-a chanacs] [-m metadata] [-M memos] [-d days] [-s seed] accounts\n", argv0);
+	fprintf(stderr, "  -n  grouped nicks per account, besides the account name (0)\n");
+	fprintf(stderr, "  -c  registered channels (0)\n");
+	fprintf(stderr, "  -a  access entries per channel, including the founder (1)\n");
+	fprintf(stderr, "  -m  metadata entries per account and channel (0)\n");
+	fprintf(stderr, "  -M  memos per account (0)\n");
+	fprintf(stderr, "  -d  spread last use times over this many days (0: all are now)\n");
+	fprintf(stderr, "  -s  random seed (1)\n");
+	exit(1);
+}
 
 int
 main(int argc, char *argv[])
 {
-	int count, i;
+	unsigned int count, i, j, k;
+	unsigned int nicks = 0, channels = 0, chanacs = 1, metadata = 0, memos = 0, days = 0, seed = 1;
 	char nick[20];
 	time_t now;
+	int c;
 
-	if (argc != 2)
+	while ((c = getopt(argc, argv, "n:c:a:m:M:d:s:")) != -1)
 	{
-		fprintf(stderr, "Usage: %s count\n", argv[0]);
-		return 1;
+		switch (c)
+		{
+		case 'n': nicks = atoi(optarg); break;
+		case 'c': channels = atoi(optarg); break;
+		case 'a': chanacs = atoi(optarg); break;
+		case 'm': metadata = atoi(optarg); break;
+		case 'M': memos = atoi(optarg); break;
+		case 'd': days = atoi(optarg); break;
+		case 's': seed = atoi(optarg); break;
+		default: usage(argv[0]);
+		}
 	}
 
-	count = atoi(argv[1]);
+	if (argc - optind != 1)
+		usage(argv[0]);
+
+	count = atoi(argv[optind]);
+	if (count == 0 && (channels > 0 || memos > 0))
+	{
+		fprintf(stderr, "%s: channels and memos need at least one account\n", argv[0]);
+		return 1;
+	}
 
+	srand(seed);
 	now = time(NULL);
 
-	printf("# Test database with %d accounts\n", count);
-	printf("DBV 4\n");
-	printf("CF +vVhHoOtsriRfAb\n");
+	printf("# Test database with %u accounts, %u channels\n", count, channels);
+	printf("GRVER 1\n");
+	printf("DBV 11\n");
+	printf("LUID %s\n", uid(count > 0 ? count - 1 : 0));
+	printf("CF +AFORVbefiorstv\n");
 	for (i = 0; i < count; i++)
 	{
-		snprintf(nick, sizeof nick, "a%010d", i);
-		printf("MU %s * noemail %lu %lu 0 0 0 %d\n", nick,
-				(unsigned long)now,
-				(unsigned long)now, MUFLAGS);
-		printf("MN %s %s %lu %lu\n", nick, nick, (unsigned long)now,
-				(unsigned long)now);
+		unsigned long registered, lastlogin;
+
+		snprintf(nick, sizeof nick, "a%010u", i);
+		lastlogin = ago(now, days);
+		registered = lastlogin - (unsigned long)(rand() % (365 * DAY));
+
+		printf("MU %s %s $rawsha1$%08x%08x%08x%08x%08x user%u@example.net %lu %lu +C default\n",
+				uid(i), nick, rand(), rand(), rand(), rand(), rand(), i,
+				registered, lastlogin);
+
+		for (j = 0; j < metadata; j++)
+			printf("MDU %s %s value %u of %s\n", nick,
+					md_user_keys[j % nkeys(md_user_keys)], j, nick);
+
+		for (j = 0; j < memos; j++)
+			printf("ME %s a%010u %lu %u memo %u for %s, just some text to fill a line\n",
+					nick, (unsigned int)rand() % count, ago(now, days), j % 2, j, nick);
+
+		printf("MN %s %s %lu %lu\n", nick, nick, registered, lastlogin);
+		for (j = 0; j < nicks; j++)
+			printf("MN %s %s_%u %lu %lu\n", nick, nick, j, registered, ago(now, days));
+	}
+
+	for (i = 0; i < channels; i++)
+	{
+		unsigned long used = ago(now, days);
+		unsigned int founder = (unsigned int)rand() % count;
+
+		printf("MC #c%u %lu %lu +v 0 0 0\n", i, used - (unsigned long)(rand() % (365 * DAY)), used);
+
+		/* the founder, then other accounts, with a host mask or two mixed in */
+		printf("CA #c%u a%010u +AFORVefiorstv %lu *\n", i, founder, used);
+		for (j = 1; j < chanacs; j++)
+		{
+			k = (unsigned int)rand();
+			if (k % 10 == 0)
+				printf("CA #c%u *!*@host%u.example.net +V %lu *\n", i, k % 100000, used);
+			else if (k % 10 == 1)
+				printf("CA #c%u *!*@%u.%u.%u.* +b %lu *\n", i, k % 223 + 1, k % 251, k % 241, used);
+			else
+				printf("CA #c%u a%010u %s %lu a%010u\n", i, (founder + j) % count,
+						ca_flags[k % nkeys(ca_flags)], used, founder);
+		}
+
+		for (j = 0; j < metadata; j++)
+			printf("MDC #c%u %s value %u of #c%u\n", i, md_chan_keys[j % nkeys(md_chan_keys)], j, i);
 	}
 
 	return 0;
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2026 Atheme Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Headless database benchmark: loads the core and a backend without an
+ * uplink and times db_load(), db_check(), db_save() and expire_check()
+ * on a database, e.g. one made by tools/createtestdb:
+ *
+ *   ./createtestdb -n 2 -c 100000 -a 10 -m 3 -M 2 -d 60 500000 >/tmp/bench.db
+ *   ./dbbench -D /tmp bench.db
+ *
+ * Each phase is reported as one JSON object per line on stdout, so that
+ * runs can be collected and compared.
+ */
+
+#include "atheme.h"
+#include "libathemecore.h"
+
+#include <sys/resource.h>
+
+/*
+ * Count allocations by interposing the allocator; glibc lets a program
+ * replace malloc() and friends for itself and every library it loads.
+ * Elsewhere allocations are reported as -1.
+ */
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static unsigned long long alloc_count = 0;
+
+void *malloc(size_t size)
+{
+	alloc_count++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	alloc_count++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	alloc_count++;
+	return __libc_realloc(ptr, size);
+}
+
+# define ALLOC_COUNT()	((long long)alloc_count)
+#else
+# define ALLOC_COUNT()	(-1LL)
+#endif
+
+typedef struct {
+	struct timeval start;
+	long long allocs;
+} bench_phase_t;
+
+static const char *bench_backend = "opensex";
+
+static void bench_start(bench_phase_t *ph)
+{
+	ph->allocs = ALLOC_COUNT();
+	gettimeofday(&ph->start, NULL);
+}
+
+static void bench_end(bench_phase_t *ph, const char *name)
+{
+	struct timeval end;
+	struct rusage ru;
+	long long allocs = ALLOC_COUNT();
+
+	gettimeofday(&end, NULL);
+	getrusage(RUSAGE_SELF, &ru);
+
+	printf("{\"phase\":\"%s\",\"backend\":\"%s\",\"wall_ms\":%.3f,\"maxrss_kb\":%ld,\"allocs\":%lld,"
+	       "\"accounts\":%u,\"nicks\":%u,\"channels\":%u,\"chanacs\":%u}\n",
+	       name, bench_backend,
+	       (end.tv_sec - ph->start.tv_sec) * 1000.0 + (end.tv_usec - ph->start.tv_usec) / 1000.0,
+#ifdef __APPLE__
+	       ru.ru_maxrss / 1024,
+#else
+	       ru.ru_maxrss,
+#endif
+	       allocs < 0 ? -1 : allocs - ph->allocs,
+	       cnt.myuser, cnt.mynick, cnt.mychan, cnt.chanacs);
+	fflush(stdout);
+}
+
+static void handle_mdep(database_handle_t *db, const char *type)
+{
+	const char *modname = db_sread_word(db);
+
+	module_load(modname);
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [-b backend] [-D datadir] [-e days] [-o output] database\n", argv0);
+	fprintf(stderr, "  -b  backend module to load: opensex (default) or bindb\n");
+	fprintf(stderr, "  -D  directory the database is in (default: current directory)\n");
+	fprintf(stderr, "  -e  nick and channel expiry in days for expire_check (default 30)\n");
+	fprintf(stderr, "  -o  file to save to, in the same directory (default dbbench.db)\n");
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	bench_phase_t ph;
+	const char *output = "dbbench.db";
+	char *dir = ".";
+	char modname[BUFSIZE];
+	unsigned int days = 30;
+	int c;
+
+	while ((c = getopt(argc, argv, "b:D:e:o:h")) != -1)
+	{
+		switch (c)
+		{
+		case 'b':
+			bench_backend = optarg;
+			break;
+		case 'D':
+			dir = optarg;
+			break;
+		case 'e':
+			days = atoi(optarg);
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (argc - optind != 1)
+		usage(argv[0]);
+
+	atheme_bootstrap();
+	atheme_init(argv[0], LOGDIR "/dbbench.log");
+	atheme_setup();
+
+	runflags = RF_LIVE;
+	datadir = dir;
+	strict_mode = false;
+	offline_mode = true;
+
+	nicksvs.expiry = chansvs.expiry = days * 86400;
+
+	snprintf(modname, sizeof modname, "backend/%s", bench_backend);
+	if (module_load("backend/opensex") == NULL || module_load(modname) == NULL)
+	{
+		fprintf(stderr, "%s: cannot load %s\n", argv[0], modname);
+		return EXIT_FAILURE;
+	}
+
+	db_unregister_type_handler("MDEP");
+	db_register_type_handler("MDEP", handle_mdep);
+
+	bench_start(&ph);
+	runflags &= ~RF_LIVE;
+	db_load(argv[optind]);
+	runflags |= RF_LIVE;
+	bench_end(&ph, "load");
+
+	bench_start(&ph);
+	db_check();
+	bench_end(&ph, "db_check");
+
+	bench_start(&ph);
+	db_save((void *)output);
+	bench_end(&ph, "save");
+
+	bench_start(&ph);
+	expire_check(NULL);
+	bench_end(&ph, "expire_check");
+
+	return EXIT_SUCCESS;
+}
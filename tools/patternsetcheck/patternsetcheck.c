@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2026 Atheme Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Checks that pattern_set_match_all() finds the same regexes as trying
+ * each of them with regex_match() does:
+ *
+ *   ./patternsetcheck [rounds]
+ *
+ * The literal a regex set is prefiltered on must occur in everything the
+ * regex matches, or RWATCH silently misses clients. A list of regexes
+ * that once broke that is tried against masks made to match them, then
+ * regexes and masks put together from pieces at random are. Mismatches
+ * are printed and make the exit status nonzero.
+ */
+
+#include "atheme.h"
+#include "libathemecore.h"
+
+#define CHECK_REGEXES	200
+#define CHECK_MASKS	500
+
+static const struct {
+	const char *regex;
+	const char *mask;	/* something it matches */
+} cases[] = {
+	/* a ) in a bracket expression within a group */
+	{ "^([^)]+)$", "nick!user@host gecos" },
+	{ "([])]x)", "nick!user@host a]x" },
+	{ "([^])]+)@", "nick!user@host gecos" },
+	{ "([[:alpha:])]+)!", "nick!user@host gecos" },
+	{ "(a[)]b|c)d", "nick!user@host cd" },
+	/* stacked quantifiers, which POSIX reads as (b+)? and so on */
+	{ "ab+?c", "nick!user@host ac" },
+	{ "ab+*c", "nick!user@host ac" },
+	{ "ab+{0,1}c", "nick!user@host ac" },
+	{ "^nick!x+?user", "nick!user@host gecos" },
+	/* and ones that must still be found */
+	{ "ab+c", "nick!user@host abbc" },
+	{ "user@h[aeiou]st", "nick!user@host gecos" },
+	{ "\\.example\\.net", "nick!user@a.example.net gecos" },
+};
+
+static const char *atoms[] = {
+	"a", "b", "c", "ab", "user", "host", "\\.", "\\*", ".", "!", "@",
+	"[ab]", "[^a]", "[]a]", "[^)]", "[])]", "[[:alpha:]]", "[[:digit:])]",
+	"(ab|c)", "(a(b)c)", "([^)]+)", "([])]a)", "(u[)]s|h)",
+	"x*", "y?", "z+", "a{2}", "b{1,3}", "b+?", "b+*", "c+{0,2}",
+	"^", "$", "|",
+};
+
+static const char mask_chars[] = "abcuserhostABx.*!@)]( ";
+
+static unsigned long failures, checked;
+static unsigned int found[CHECK_REGEXES], nfound;
+
+static void check_cb(void *data, void *privdata)
+{
+	if (nfound < CHECK_REGEXES)
+		found[nfound++] = (unsigned int)(uintptr_t)data;
+}
+
+/* tries a mask against a set and against each regex in it */
+static void check_mask(pattern_set_t *ps, atheme_regex_t **res, const char **regexes, unsigned int count, const char *mask)
+{
+	char buf[BUFSIZE];
+	unsigned int i, j, n;
+	bool want;
+
+	nfound = 0;
+	n = pattern_set_match_all(ps, mask, check_cb, NULL);
+
+	for (i = 0, j = 0; i < count; i++)
+	{
+		if (res[i] == NULL)
+			continue;
+
+		mowgli_strlcpy(buf, mask, sizeof buf);
+		want = regex_match(res[i], buf);
+		checked++;
+
+		if (want == (j < nfound && found[j] == i))
+		{
+			if (want)
+				j++;
+			continue;
+		}
+
+		if (failures++ < 20)
+			fprintf(stderr, "/%s/ against \"%s\": regex_match() says %s, the set %s\n",
+					regexes[i], mask, want ? "yes" : "no", want ? "missed it" : "found it");
+
+		if (!want)
+			j++;
+	}
+
+	if (n != nfound && failures++ < 20)
+		fprintf(stderr, "\"%s\": %u matches counted, %u passed on\n", mask, n, nfound);
+}
+
+static void check_cases(int flags)
+{
+	pattern_set_t *ps;
+	atheme_regex_t *res[ARRAY_SIZE(cases)];
+	const char *regexes[ARRAY_SIZE(cases)];
+	char buf[BUFSIZE];
+	unsigned int i;
+
+	ps = pattern_set_create();
+
+	for (i = 0; i < ARRAY_SIZE(cases); i++)
+	{
+		mowgli_strlcpy(buf, cases[i].regex, sizeof buf);
+		regexes[i] = cases[i].regex;
+
+		if ((res[i] = regex_create(buf, flags)) != NULL)
+			pattern_set_add_regex(ps, cases[i].regex, flags, res[i], (void *)(uintptr_t)i);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(cases); i++)
+		check_mask(ps, res, regexes, ARRAY_SIZE(cases), cases[i].mask);
+
+	pattern_set_destroy(ps);
+
+	for (i = 0; i < ARRAY_SIZE(cases); i++)
+		if (res[i] != NULL)
+			regex_destroy(res[i]);
+}
+
+static void check_random(int flags)
+{
+	pattern_set_t *ps;
+	atheme_regex_t *res[CHECK_REGEXES];
+	char *regexes[CHECK_REGEXES];
+	char buf[BUFSIZE], mask[64];
+	unsigned int i, k, atoms_n, len;
+
+	ps = pattern_set_create();
+
+	for (i = 0; i < CHECK_REGEXES; i++)
+	{
+		buf[0] = '\0';
+		atoms_n = 1 + rand() % 5;
+		for (k = 0; k < atoms_n; k++)
+			mowgli_strlcat(buf, atoms[rand() % ARRAY_SIZE(atoms)], sizeof buf);
+
+		regexes[i] = sstrdup(buf);
+
+		if ((res[i] = regex_create(buf, flags)) != NULL)
+			pattern_set_add_regex(ps, regexes[i], flags, res[i], (void *)(uintptr_t)i);
+	}
+
+	for (i = 0; i < CHECK_MASKS; i++)
+	{
+		len = rand() % (sizeof mask - 1);
+		for (k = 0; k < len; k++)
+			mask[k] = mask_chars[rand() % (sizeof mask_chars - 1)];
+		mask[len] = '\0';
+
+		check_mask(ps, res, (const char **)regexes, CHECK_REGEXES, mask);
+	}
+
+	pattern_set_destroy(ps);
+
+	for (i = 0; i < CHECK_REGEXES; i++)
+	{
+		if (res[i] != NULL)
+			regex_destroy(res[i]);
+		free(regexes[i]);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	static const int flags[] = { 0, AREGEX_ICASE, AREGEX_PCRE, AREGEX_PCRE | AREGEX_ICASE };
+	unsigned long rounds = argc > 1 ? strtoul(argv[1], NULL, 10) : 20;
+	unsigned long r;
+	unsigned int i;
+
+	srand(1);
+
+	for (i = 0; i < ARRAY_SIZE(flags); i++)
+	{
+		check_cases(flags[i]);
+
+		for (r = 0; r < rounds; r++)
+			check_random(flags[i]);
+	}
+
+	printf("%lu regex_match() calls compared\n", checked);
+
+	if (failures != 0)
+	{
+		fprintf(stderr, "%s: %lu mismatches\n", argv[0], failures);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
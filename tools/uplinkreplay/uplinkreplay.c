@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2026 Atheme Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Offline uplink replay: loads the core and whatever a configuration file
+ * loads (the protocol module, services, a backend), links to a fake uplink
+ * and feeds it a recorded stream through parse(). The stream is either raw
+ * protocol lines, e.g. from tools/createburst, or a log with LG_RAWDATA
+ * enabled, of which only the "->" lines are used:
+ *
+ *   ./createburst 200000 >/tmp/burst.txt
+ *   ./uplinkreplay -c /tmp/ts6.conf -P linkit /tmp/burst.txt
+ *
+ * What services send back is checksummed and discarded. The totals, and
+ * the time spent per command and per hook, are reported as one JSON object
+ * per line on stdout, so that runs can be collected and compared.
+ */
+
+#include "atheme.h"
+#include "conf.h"
+#include "uplink.h"
+#include "datastream.h"
+#include "libathemecore.h"
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+typedef struct {
+	char *name;
+	unsigned long count;
+	double total_us;
+	double max_us;
+} replay_stat_t;
+
+static mowgli_patricia_t *command_stats;
+
+static connection_t *uplink_conn;
+static int peer_fd = -1;
+static unsigned long long output_bytes;
+static unsigned long long output_hash = 14695981039346656037ULL;
+
+static double replay_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+static void replay_account(mowgli_patricia_t *stats, const char *name, double us)
+{
+	replay_stat_t *st;
+
+	if ((st = mowgli_patricia_retrieve(stats, name)) == NULL)
+	{
+		st = smalloc(sizeof(replay_stat_t));
+		st->name = sstrdup(name);
+		mowgli_patricia_add(stats, name, st);
+	}
+
+	st->count++;
+	st->total_us += us;
+	if (us > st->max_us)
+		st->max_us = us;
+}
+
+/* pushes out what services sent so far and folds it into the checksum */
+static void replay_drain(void)
+{
+	char buf[16384];
+	ssize_t l, i;
+
+	do
+	{
+		sendq_flush(uplink_conn);
+
+		while ((l = read(peer_fd, buf, sizeof buf)) > 0)
+		{
+			output_bytes += l;
+			for (i = 0; i < l; i++)
+			{
+				output_hash ^= (unsigned char)buf[i];
+				output_hash *= 1099511628211ULL;
+			}
+		}
+	} while (sendq_nonempty(uplink_conn) && !(uplink_conn->flags & CF_DEAD));
+}
+
+/* returns the protocol line in a line of input, or NULL to skip it */
+static char *replay_line(char *line)
+{
+	char *p;
+
+	line[strcspn(line, "\r\n")] = '\0';
+
+	/* a log line: "[timestamp] -> line" */
+	if (*line == '[')
+	{
+		if ((p = strstr(line, "] -> ")) == NULL)
+			return NULL;
+		line = p + 5;
+	}
+
+	return *line != '\0' ? line : NULL;
+}
+
+/* the command of a protocol line, for the per-command statistics */
+static void replay_command(const char *line, char *buf, size_t buflen)
+{
+	size_t len;
+
+	if (*line == ':' && (line = strchr(line, ' ')) != NULL)
+		line++;
+	if (line == NULL)
+		line = "";
+
+	len = strcspn(line, " ");
+	if (len >= buflen)
+		len = buflen - 1;
+
+	memcpy(buf, line, len);
+	buf[len] = '\0';
+}
+
+static void replay_report(mowgli_patricia_t *stats, const char *kind)
+{
+	mowgli_patricia_iteration_state_t state;
+	replay_stat_t *st;
+
+	MOWGLI_PATRICIA_FOREACH(st, &state, stats)
+	{
+		printf("{\"%s\":\"%s\",\"count\":%lu,\"total_ms\":%.3f,\"avg_us\":%.3f,\"max_us\":%.3f}\n",
+		       kind, st->name, st->count, st->total_us / 1000.0,
+		       st->total_us / st->count, st->max_us);
+	}
+}
+
+/* hooks and their handlers, as timed by hook_call_handle() */
+static void replay_report_hook(hook_t *h, void *privdata)
+{
+	mowgli_node_t *n;
+	hook_handler_t *hh;
+
+	if (h->calls == 0)
+		return;
+
+	printf("{\"hook\":\"%s\",\"count\":%u,\"total_ms\":%.3f,\"avg_us\":%.3f,\"max_us\":%u}\n",
+	       h->name, h->calls, h->total_us / 1000.0, (double)h->total_us / h->calls, h->max_us);
+
+	MOWGLI_ITER_FOREACH(n, h->hooks.head)
+	{
+		hh = n->data;
+
+		if (hh->func == NULL || hh->calls == 0)
+			continue;
+
+		printf("{\"hook\":\"%s\",\"handler\":\"%p\",\"module\":\"%s\",\"count\":%u,\"total_ms\":%.3f,\"avg_us\":%.3f,\"max_us\":%u}\n",
+		       h->name, (void *)hh->func, hh->module != NULL ? hh->module : "core",
+		       hh->calls, hh->total_us / 1000.0, (double)hh->total_us / hh->calls, hh->max_us);
+	}
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s -c config [-D datadir] [-P password] [input]\n", argv0);
+	fprintf(stderr, "  -c  configuration file; its loadmodule lines choose the protocol module\n");
+	fprintf(stderr, "  -D  directory a backend loads the database from (default: no database)\n");
+	fprintf(stderr, "  -P  password the uplink sends, instead of the first uplink block's\n");
+	fprintf(stderr, "  input is raw protocol lines or an LG_RAWDATA log (default: stdin)\n");
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	FILE *in = stdin;
+	char *password = NULL;
+	char *dir = NULL;
+	char line[BUFSIZE * 2], buf[BUFSIZE], command[BUFSIZE];
+	char *p;
+	int fds[2];
+	int c;
+	unsigned long lines = 0;
+	double start, wall_us, parse_us = 0, t, us;
+	struct rusage ru;
+
+	while ((c = getopt(argc, argv, "c:D:P:h")) != -1)
+	{
+		switch (c)
+		{
+		case 'c':
+			config_file = sstrdup(optarg);
+			break;
+		case 'D':
+			dir = optarg;
+			break;
+		case 'P':
+			password = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (config_file == NULL || argc - optind > 1)
+		usage(argv[0]);
+
+	if (argc - optind == 1 && strcmp(argv[optind], "-") && (in = fopen(argv[optind], "r")) == NULL)
+	{
+		fprintf(stderr, "%s: %s: %s\n", argv[0], argv[optind], strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	runflags = RF_STARTING;
+	cold_start = true;
+	datadir = dir != NULL ? dir : ".";
+	readonly = true;
+
+	atheme_bootstrap();
+	atheme_init(argv[0], LOGDIR "/uplinkreplay.log");
+	atheme_setup();
+
+	conf_init();
+	if (!conf_parse(config_file))
+	{
+		fprintf(stderr, "%s: cannot load %s\n", argv[0], config_file);
+		return EXIT_FAILURE;
+	}
+
+	cold_start = false;
+
+	if (dir != NULL && db_load != NULL)
+		db_load(NULL);
+	db_check();
+
+	runflags &= ~RF_STARTING;
+
+	if (MOWGLI_LIST_LENGTH(&uplinks) == 0)
+	{
+		fprintf(stderr, "%s: %s has no uplink block\n", argv[0], config_file);
+		return EXIT_FAILURE;
+	}
+
+	curr_uplink = uplinks.head->data;
+	if (password != NULL)
+	{
+		free(curr_uplink->receive_pass);
+		curr_uplink->receive_pass = sstrdup(password);
+	}
+
+	/* the uplink is the other end of a socket pair */
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+	{
+		fprintf(stderr, "%s: socketpair: %s\n", argv[0], strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	peer_fd = fds[1];
+	fcntl(peer_fd, F_SETFL, fcntl(peer_fd, F_GETFL) | O_NONBLOCK);
+
+	uplink_conn = connection_add(curr_uplink->name, fds[0], 0, NULL, NULL);
+	curr_uplink->conn = uplink_conn;
+
+	command_stats = mowgli_patricia_create(strcasecanon);
+
+	irc_handle_connect(uplink_conn);
+	replay_drain();
+
+	start = replay_now();
+
+	while (fgets(line, sizeof line, in) != NULL)
+	{
+		if ((p = replay_line(line)) == NULL)
+			continue;
+
+		replay_command(p, command, sizeof command);
+		mowgli_strlcpy(buf, p, sizeof buf);
+
+		t = replay_now();
+		parse(buf);
+		us = replay_now() - t;
+
+		parse_us += us;
+		replay_account(command_stats, command, us);
+		lines++;
+
+		if (uplink_conn->sendq_len >= 65536)
+			replay_drain();
+
+		if (runflags & RF_SHUTDOWN)
+		{
+			fprintf(stderr, "%s: services shut down after %lu lines; see the log\n", argv[0], lines);
+			break;
+		}
+	}
+
+	replay_drain();
+
+	wall_us = replay_now() - start;
+	getrusage(RUSAGE_SELF, &ru);
+
+	replay_report(command_stats, "command");
+	hook_stats_foreach(replay_report_hook, NULL);
+
+	printf("{\"lines\":%lu,\"wall_ms\":%.3f,\"parse_ms\":%.3f,\"lines_per_s\":%.0f,\"hook_ms\":%.3f,"
+	       "\"maxrss_kb\":%ld,\"users\":%u,\"channels\":%u,\"servers\":%u,"
+	       "\"output_bytes\":%llu,\"output_fnv1a\":\"%016llx\"}\n",
+	       lines, wall_us / 1000.0, parse_us / 1000.0,
+	       parse_us > 0 ? lines / (parse_us / 1000000.0) : 0.0,
+	       hook_time_us / 1000.0,
+#ifdef __APPLE__
+	       ru.ru_maxrss / 1024,
+#else
+	       ru.ru_maxrss,
+#endif
+	       cnt.user, cnt.chan, cnt.server,
+	       output_bytes, output_hash);
+
+	return EXIT_SUCCESS;
+}